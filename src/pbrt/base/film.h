@@ -49,6 +49,9 @@ class Film : public TaggedPointer<RGBFilm, GBufferFilm> {
                                         const SampledWavelengths &lambda) const;
 
     Image GetImage(ImageMetadata *metadata, Float splatScale = 1);
+    // Returns an image with the film's unnormalized pixel sums; see
+    // _MergeRawFilmImages()_.
+    Image GetRawImage(ImageMetadata *metadata);
     PBRT_CPU_GPU
     RGB GetPixelRGB(Point2i p, Float splatScale = 1) const;
 
@@ -56,6 +59,13 @@ class Film : public TaggedPointer<RGBFilm, GBufferFilm> {
     PBRT_CPU_GPU inline const PixelSensor *GetPixelSensor() const;
     std::string GetFilename() const;
 
+    // Returns the film's accumulated pixel values, for checkpointing.
+    std::string SerializePixels() const;
+    // Restores pixel values returned by _SerializePixels()_ or, if
+    // _accumulate_ is true, adds them to the film's, returning false if
+    // they don't match the film's pixels.
+    bool DeserializePixels(const std::string &data, bool accumulate = false);
+
     using TaggedPointer::TaggedPointer;
 
     static Film Create(const std::string &name, const ParameterDictionary &parameters,
@@ -4,9 +4,12 @@
 
 #include <pbrt/pbrt.h>
 
+#include <pbrt/cpu/denoiser.h>
+#include <pbrt/film.h>
 #include <pbrt/filters.h>
 #include <pbrt/options.h>
 #include <pbrt/util/args.h>
+#include <pbrt/util/bcn.h>
 #include <pbrt/util/check.h>
 #include <pbrt/util/color.h>
 #include <pbrt/util/colorspace.h>
@@ -14,6 +17,7 @@
 #include <pbrt/util/image.h>
 #include <pbrt/util/log.h>
 #include <pbrt/util/math.h>
+#include <pbrt/util/mipmap.h>
 #include <pbrt/util/parallel.h>
 #include <pbrt/util/print.h>
 #include <pbrt/util/progressreporter.h>
@@ -29,6 +33,7 @@ extern "C" {
 
 #include <algorithm>
 #include <array>
+#include <atomic>
 #include <cctype>
 #include <cstdarg>
 #include <cstdio>
@@ -109,6 +114,20 @@ static std::map<std::string, CommandUsage> commandUsage = {
                        added to the original image. Default: 0.3
     --width <w>        Width of Gaussian used to generate bloom images.
                        Default: 15
+)")}},
+    {"compress",
+     {"compress [options] <filename>",
+      "Encode an image with a block-compression format and write the decoded\n"
+      "    result, which can be compared to the original with \"imgtool diff\".\n"
+      "    Channels after the ones that the format stores are copied unchanged.",
+      std::string(R"(
+    --encoding <name>  Color encoding of 8-bit images, which is also used to
+                       quantize other images for the 8-bit formats: "sRGB",
+                       "linear", or "gamma <value>". Default: sRGB
+    --format <name>    Block-compression format: "bc1", "bc4", "bc5", or "bc6h".
+                       Default: the format that pbrt's --compress-textures
+                       option uses for the image.
+    --outfile <name>   Output image filename.
 )")}},
     {"convert",
      {"convert [options] <filename>",
@@ -160,9 +179,9 @@ static std::map<std::string, CommandUsage> commandUsage = {
 )")}},
     {"denoise",
      {"denoise [options] <filename>",
-      "Applies a simple denoising algorithm to the provided image.\n"
-      "    The image should be a multi-channel EXR as generated by pbrt's\n"
-      "    \"gbuffer\" film.",
+      "Applies the edge-avoiding wavelet denoiser that pbrt --denoise\n"
+      "    uses to the provided image. The image should be a multi-channel\n"
+      "    EXR as generated by pbrt's \"gbuffer\" film.",
       std::string(R"( options:
     --outfile <name>   Filename to use for the denoised image.
 )")}},
@@ -230,6 +249,31 @@ static std::map<std::string, CommandUsage> commandUsage = {
     --outfile <name>   Filename to store environment map in.
     --turbidity <t>    Atmospheric turbidity (range 1.7-10). Default: 3
     --resolution <r>   Resolution of generated environment map. Default: 2048
+)")}},
+    {"maketiled",
+     {"maketiled [options] <filenames...>",
+      "Convert images to pbrt's tiled MIP map format, which stores the\n"
+      "    pre-filtered MIP levels that image textures use so that pbrt can\n"
+      "    read them on demand rather than generating them when the scene is\n"
+      "    loaded. Each image is written to a file with the same name and a\n"
+      "    \".tmip\" extension. Tiled MIP files can only be used by the CPU\n"
+      "    renderers.",
+      std::string(R"(
+    --encoding <name>  Color encoding of 8-bit images: "sRGB", "linear", or
+                       "gamma <value>". Default: sRGB
+    --outdir <dir>     Directory to write the converted files to. Default: the
+                       directory of each image.
+    --wrapmode <mode>  Wrap mode used when filtering the MIP levels; it should
+                       match the textures' "wrap" parameter. (Options: "repeat",
+                       "black", "clamp", "octahedralsphere") Default: repeat
+)")}},
+    {"merge",
+     {"merge [options] <filenames...>",
+      "Add up the images that pbrt wrote with --raw-film when rendering\n"
+      "    different ranges of an image's pixel samples and write the final\n"
+      "    image.",
+      std::string(R"(
+    --outfile          Output image filename.
 )")}},
     {"splitn",
      {"splitn [options] <filenames>",
@@ -539,6 +583,105 @@ int assemble(std::vector<std::string> args) {
     return 0;
 }
 
+int maketiled(std::vector<std::string> args) {
+    std::string encodingName = "sRGB", outdir, wrapModeName = "repeat";
+    std::vector<std::string> infiles;
+    for (auto iter = args.begin(); iter != args.end(); ++iter) {
+        auto onError = [](const std::string &err) {
+            usage("maketiled", "%s", err.c_str());
+        };
+        if (ParseArg(&iter, args.end(), "encoding", &encodingName, onError) ||
+            ParseArg(&iter, args.end(), "outdir", &outdir, onError) ||
+            ParseArg(&iter, args.end(), "wrapmode", &wrapModeName, onError))
+            ;  // success
+        else if ((*iter)[0] == '-')
+            usage("maketiled", "%s: unknown command flag", iter->c_str());
+        else
+            infiles.push_back(*iter);
+    }
+
+    if (infiles.empty())
+        usage("maketiled", "no filenames provided to \"maketiled\"?");
+    pstd::optional<WrapMode> wrapMode = ParseWrapMode(wrapModeName.c_str());
+    if (!wrapMode)
+        usage("maketiled", "%s: unknown wrap mode", wrapModeName.c_str());
+    ColorEncoding encoding = ColorEncoding::Get(encodingName, {});
+
+    // Convert the images in parallel
+    std::atomic<bool> success{true};
+    ParallelFor(0, infiles.size(), [&](int64_t i) {
+        std::string tiledFilename = RemoveExtension(infiles[i]) + ".tmip";
+        if (!outdir.empty()) {
+            size_t slash = tiledFilename.find_last_of("/\\");
+            if (slash != std::string::npos)
+                tiledFilename = tiledFilename.substr(slash + 1);
+            tiledFilename = outdir + "/" + tiledFilename;
+        }
+        if (!MIPMap::WriteTiledFile(infiles[i], tiledFilename, *wrapMode, encoding))
+            success = false;
+    });
+    return success ? 0 : 1;
+}
+
+int merge(std::vector<std::string> args) {
+    std::string outfile;
+    std::vector<std::string> infiles;
+    for (auto iter = args.begin(); iter != args.end(); ++iter) {
+        auto onError = [](const std::string &err) {
+            usage("merge", "%s", err.c_str());
+        };
+        if (ParseArg(&iter, args.end(), "outfile", &outfile, onError))
+            ;  // success
+        else if ((*iter)[0] == '-')
+            usage("merge", "%s: unknown command flag", iter->c_str());
+        else
+            infiles.push_back(*iter);
+    }
+
+    if (infiles.empty())
+        usage("merge", "no filenames provided to \"merge\"?");
+    if (outfile.empty())
+        usage("merge", "--outfile not provided for \"merge\"");
+
+    std::vector<ImageAndMetadata> images;
+    for (const std::string &file : infiles) {
+        ImageAndMetadata im = Image::Read(file);
+        if (!IsRawFilmImage(im.metadata)) {
+            fprintf(stderr, "%s: not a raw film image written using --raw-film.\n",
+                    file.c_str());
+            return 1;
+        }
+        if (!im.metadata.samplesPerPixel) {
+            fprintf(stderr, "%s: doesn't have samples per pixel in image metadata.\n",
+                    file.c_str());
+            return 1;
+        }
+        if (!images.empty()) {
+            // Make sure that the images can be added up
+            const ImageAndMetadata &first = images[0];
+            if (im.metadata.stringVectors != first.metadata.stringVectors ||
+                im.metadata.pixelBounds.has_value() !=
+                    first.metadata.pixelBounds.has_value() ||
+                (im.metadata.pixelBounds &&
+                 *im.metadata.pixelBounds != *first.metadata.pixelBounds) ||
+                im.image.ChannelNames() != first.image.ChannelNames() ||
+                im.image.Resolution() != first.image.Resolution()) {
+                fprintf(stderr,
+                        "%s: image wasn't written by the same film as \"%s\".\n",
+                        file.c_str(), infiles[0].c_str());
+                return 1;
+            }
+        }
+        images.push_back(std::move(im));
+    }
+
+    ImageMetadata metadata;
+    Image image = MergeRawFilmImages(images, &metadata);
+    if (!image.Write(outfile, metadata))
+        return 1;
+    return 0;
+}
+
 int splitn(std::vector<std::string> args) {
     if (args.empty())
         usage("splitn", "no filenames provided to \"splitn\"?");
@@ -1669,6 +1812,68 @@ int bloom(std::vector<std::string> args) {
     return 0;
 }
 
+int compress(std::vector<std::string> args) {
+    std::string encodingName = "sRGB", formatName, inFile, outFile;
+    for (auto iter = args.begin(); iter != args.end(); ++iter) {
+        auto onError = [](const std::string &err) {
+            usage("compress", "%s", err.c_str());
+        };
+        if (ParseArg(&iter, args.end(), "encoding", &encodingName, onError) ||
+            ParseArg(&iter, args.end(), "format", &formatName, onError) ||
+            ParseArg(&iter, args.end(), "outfile", &outFile, onError))
+            ;  // success
+        else if ((*iter)[0] == '-')
+            usage("compress", "%s: unknown command flag", iter->c_str());
+        else if (inFile.empty())
+            inFile = *iter;
+        else
+            usage("compress", "multiple input filenames provided.");
+    }
+    if (inFile.empty())
+        usage("compress", "input image filename must be provided.");
+    if (outFile.empty())
+        usage("compress", "--outfile must be specified.");
+
+    ColorEncoding encoding = ColorEncoding::Get(encodingName, {});
+    ImageAndMetadata imageAndMetadata = Image::Read(inFile, {}, encoding);
+    Image &image = imageAndMetadata.image;
+    pstd::optional<BCFormat> format =
+        formatName.empty() ? BCImage::TextureFormat(image.Format(), image.NChannels())
+                           : ParseBCFormat(formatName);
+    if (!format) {
+        if (formatName.empty())
+            ErrorExit("%s: no default block-compression format for %s images with %d "
+                      "channels; use --format.",
+                      inFile, image.Format(), image.NChannels());
+        usage("compress", "%s: unknown block-compression format", formatName.c_str());
+    }
+    int nc = BCChannels(*format);
+    if (image.NChannels() < nc)
+        ErrorExit("%s: %s requires at least %d channels.", inFile, *format, nc);
+
+    // Compress the image, quantizing it first for the 8-bit formats
+    Image source = image;
+    if (*format != BCFormat::BC6H && image.Format() != PixelFormat::U256)
+        source = image.ConvertToFormat(PixelFormat::U256, encoding);
+    BCImage compressed = BCImage::Compress(source, *format);
+    Image decoded = compressed.Decompress();
+
+    Point2i res = image.Resolution();
+    size_t bytes = size_t(res.x) * res.y * nc * TexelBytes(image.Format());
+    Printf("%s: %s, %d bytes -> %d bytes (%.2fx smaller)\n", inFile, *format, bytes,
+           compressed.BytesUsed(), Float(bytes) / compressed.BytesUsed());
+
+    // Replace the compressed channels of the image with the decoded ones
+    ParallelFor(0, res.y, [&](int64_t y) {
+        for (int x = 0; x < res.x; ++x)
+            for (int c = 0; c < nc; ++c)
+                image.SetChannel({x, int(y)}, c, decoded.GetChannel({x, int(y)}, c));
+    });
+    if (!image.Write(outFile, imageAndMetadata.metadata))
+        return 1;
+    return 0;
+}
+
 int convert(std::vector<std::string> args) {
     bool acesFilmic = false;
     float scale = 1.f, gamma = 1.f;
@@ -2200,167 +2405,6 @@ int makeequiarea(std::vector<std::string> args) {
     return 0;
 }
 
-Image denoiseImage(const Image &in, const ImageChannelDesc &Ldesc,
-                   const Image &varianceImage, const ImageChannelDesc &albedoDesc,
-                   const ImageChannelDesc &zDesc, const ImageChannelDesc &deltaZDesc,
-                   const ImageChannelDesc &nDesc, int halfWidth, int nLevels) {
-    Image illum(PixelFormat::Float, in.Resolution(), {"R", "G", "B"});
-    for (int y = 0; y < in.Resolution().y; ++y)
-        for (int x = 0; x < in.Resolution().x; ++x) {
-            ImageChannelValues albedo = in.GetChannels({x, y}, albedoDesc);
-            ImageChannelValues L = in.GetChannels({x, y}, Ldesc);
-            for (int c = 0; c < 3; ++c)
-                if (albedo[c] > 0)
-                    illum.SetChannel({x, y}, c, L[c] / albedo[c]);
-                else
-                    illum.SetChannel({x, y}, c, L[c]);
-        }
-
-    std::vector<Float> f(halfWidth + 1, 0.);
-    for (int i = 0; i <= halfWidth; ++i)
-        f[i] = FastExp(-Float(i) / halfWidth * 3.f);
-
-    static int call = -1;
-    ++call;
-
-    Image currentImage = std::move(illum);
-    for (int i = 0; i < nLevels; ++i) {
-        int delta = 1 << i;  // A-Trous step between samples.
-
-        Image filtered(PixelFormat::Float, in.Resolution(), {"R", "G", "B"});
-        // Image wImage(PixelFormat::Float, in.Resolution(), 3, "Wp,Wn,Wc");
-        // Image dzImage(PixelFormat::Float, in.Resolution(), 1, "Y");
-
-        ParallelFor(0, currentImage.Resolution().y, [&](int64_t start, int64_t end) {
-            for (int y = start; y < end; ++y) {
-                for (int x = 0; x < currentImage.Resolution().x; ++x) {
-                    float wsum = 0;
-                    ImageChannelValues c = currentImage.GetChannels({x, y});
-
-                    Float z = in.GetChannels({x, y}, zDesc);
-                    // FIXME: hack multiply to cancel out scaled ray
-                    // differentials...
-                    Float dzdx = 8 * in.GetChannels({x, y}, deltaZDesc)[0];
-                    Float dzdy = 8 * in.GetChannels({x, y}, deltaZDesc)[1];
-
-                    ImageChannelValues nChan = in.GetChannels({x, y}, nDesc);
-                    Normal3f n = Normal3f(nChan[0], nChan[1], nChan[2]);
-                    if (n == Normal3f(0, 0, 0))
-                        // background pixel
-                        continue;
-
-                    Float pixelVariance = varianceImage.GetChannel({x, y}, 0);
-                    float result[3] = {0.f};
-                    float wpSum = 0, wnSum = 0, wcSum = 0;
-                    // if (pixelVariance > .001) {
-                    // pixelVariance = std::max<Float>(pixelVariance,
-                    // .000001); {
-                    {
-                        // Higher sigma -> more blur
-                        // Float sigma_y = .05;
-                        Float sigma_z = .005;
-
-                        // sigma_y = pixelVariance * 50;
-                        // sigma_y = std::sqrt(std::sqrt(pixelVariance)) *
-                        // 10 * sigmaYScale;
-
-                        for (int dy = -halfWidth * delta; dy <= halfWidth * delta;
-                             dy += delta) {
-                            if (y + dy < 0 || y + dy >= currentImage.Resolution().y)
-                                continue;
-                            for (int dx = -halfWidth * delta; dx <= halfWidth * delta;
-                                 dx += delta) {
-                                if (x + dx < 0 || x + dx >= currentImage.Resolution().x)
-                                    continue;
-                                ImageChannelValues co =
-                                    currentImage.GetChannels({x + dx, y + dy});
-                                Float dc2 = (Sqr(c[0] - co[0]) + Sqr(c[1] - co[1]) +
-                                             Sqr(c[2] - co[2]));  // squared color
-                                                                  // difference
-                                Float otherVariance =
-                                    varianceImage.GetChannel({x + dx, y + dy}, 0);
-                                Float d2 =
-                                    std::max<Float>(0, dc2 - (pixelVariance +
-                                                              std::min(pixelVariance,
-                                                                       otherVariance))) /
-                                    (1e-4 + 0.36f * (pixelVariance + otherVariance));
-
-                                Float zo = in.GetChannels({x + dx, y + dy}, zDesc);
-                                ImageChannelValues noChan =
-                                    in.GetChannels({x + dx, y + dy}, nDesc);
-                                Normal3f no = Normal3f(noChan[0], noChan[1], noChan[2]);
-                                if (no == Normal3f(0, 0, 0))
-                                    // background pixel;
-                                    continue;
-
-                                Float zp = z + dx * dzdx + dy * dzdy;
-                                Float dz = (z - zp) / ((z + zp) * 0.5f);
-
-                                // Assume camera space position...
-                                Float wp = Gaussian(dz, 0, sigma_z) *
-                                           f[std::abs(dy / delta)] *
-                                           f[std::abs(dx / delta)];
-                                Float wn = Pow<32>(std::max<float>(0, Dot(n, no)));
-                                Float wc =
-                                    FastExp(-d2 / 90);  // Gaussian(dc, 0, sigma_y);
-                                CHECK(!std::isnan(wc));
-                                wpSum += wp;
-                                wnSum += wn;
-                                wcSum += wc;
-                                Float w = wp * wn * wc;
-
-                                // CO fprintf(stderr, "(%d, %d) dc2 %f var
-                                // %f other var %f -> d2 %f\n", CO x, y,
-                                // dc2, pixelVariance, otherVariance, d2);
-
-                                CHECK(!std::isnan(w));
-                                if (w == 0)
-                                    continue;
-
-                                for (int c = 0; c < 3; ++c) {
-                                    result[c] +=
-                                        w * currentImage.GetChannel({x + dx, y + dy}, c);
-                                    CHECK(!std::isnan(result[c]));
-                                }
-                                wsum += w;
-                            }
-                        }
-                    }
-                    for (int c = 0; c < 3; ++c)
-                        if (wsum > 0) {
-                            filtered.SetChannel({x, y}, c, result[c] / wsum);
-                            // wImage.SetChannels({x, y}, {wpSum, wnSum,
-                            // wcSum});
-                        } else
-                            filtered.SetChannel({x, y}, c,
-                                                currentImage.GetChannel({x, y}, c));
-                }
-            }
-        });
-
-        // filtered.Write(StringPrintf("filtered-%d-%d.exr", call, i));
-        // wImage.Write(StringPrintf("weights%d.exr", i));
-        //        if (i == 0)
-        //  dzImage.Write("dz.exr");
-
-        pstd::swap(filtered, currentImage);
-    }
-
-    // static int i = 0;
-    // currentImage.Write(StringPrintf("filteredillum-%d.exr", i++));
-
-    // reincorporate albedo
-    for (int y = 0; y < currentImage.Resolution().y; ++y)
-        for (int x = 0; x < currentImage.Resolution().x; ++x) {
-            ImageChannelValues albedo = in.GetChannels({x, y}, albedoDesc);
-            for (int c = 0; c < 3; ++c)
-                currentImage.SetChannel({x, y}, c,
-                                        currentImage.GetChannel({x, y}, c) * albedo[c]);
-        }
-
-    return currentImage;
-}
-
 int denoise(std::vector<std::string> args) {
     std::string inFilename, outFilename;
 
@@ -2384,48 +2428,12 @@ int denoise(std::vector<std::string> args) {
         usage("denoise", "output image filename must be provided.");
 
     ImageAndMetadata im = Image::Read(inFilename);
-    Image &in = im.image;
-
-    auto checkForChannels = [&inFilename](ImageChannelDesc &desc, const char *names) {
-        if (!desc) {
-            fprintf(stderr, "%s: didn't find \"%s\" channels.\n", inFilename.c_str(),
-                    names);
-            exit(1);
-        }
-    };
-    ImageChannelDesc rgbDesc = in.GetChannelDesc({"R", "G", "B"});
-    checkForChannels(rgbDesc, "R,G,B");
-    ImageChannelDesc zDesc = in.GetChannelDesc({"Pz"});
-    checkForChannels(zDesc, "Pz");
-    ImageChannelDesc deltaZDesc = in.GetChannelDesc({"dzdx", "dzdy"});
-    checkForChannels(deltaZDesc, "dzdx,dzdy");
-    ImageChannelDesc nDesc = in.GetChannelDesc({"Nx", "Ny", "Nz"});
-    checkForChannels(nDesc, "Nx,Ny,Nz");
-    ImageChannelDesc nsDesc = in.GetChannelDesc({"Nsx", "Nsy", "Nsz"});
-    checkForChannels(nsDesc, "Nsx,Nsy,Nsz");
-    ImageChannelDesc albedoDesc = in.GetChannelDesc({"Albedo.R", "Albedo.G", "Albedo.B"});
-    checkForChannels(albedoDesc, "Albedo.R,Albedo.G,Albedo.B");
-    ImageChannelDesc varianceDesc = in.GetChannelDesc({"rgbVariance"});
-    checkForChannels(varianceDesc, "rgbVariance");
-
-    ImageChannelDesc jointDesc = in.GetChannelDesc({"Pz", "Nx", "Ny", "Nz"});
-    ImageChannelValues jointSigmaIndir(4, 1);
-    Float xySigmaIndir[2] = {2.f, 2.f};
-    Image filteredVariance = in.JointBilateralFilter(varianceDesc, 7, xySigmaIndir,
-                                                     jointDesc, jointSigmaIndir);
-
-    int halfWidth = 3;
-    int nLevels = 3;
-    Image denoisedImage = denoiseImage(in, rgbDesc, filteredVariance, albedoDesc, zDesc,
-                                       deltaZDesc, nsDesc, halfWidth, nLevels);
-
-    Image result(PixelFormat::Float, in.Resolution(), {"R", "G", "B"});
-    for (int y = 0; y < in.Resolution().y; ++y)
-        for (int x = 0; x < in.Resolution().x; ++x) {
-            ImageChannelValues Ldenoised = denoisedImage.GetChannels({x, y});
-            for (int c = 0; c < 3; ++c)
-                result.SetChannel({x, y}, c, Ldenoised[c]);
-        }
+    if (!im.metadata.samplesPerPixel) {
+        fprintf(stderr, "%s: doesn't have samples per pixel in image metadata.\n",
+                inFilename.c_str());
+        return 1;
+    }
+    Image result = DenoiseImage(im.image, *im.metadata.samplesPerPixel);
 
     if (!result.Write(outFilename)) {
         fprintf(stderr, "%s: couldn't write image.\n", outFilename.c_str());
@@ -2631,6 +2639,8 @@ int main(int argc, char *argv[]) {
         return bloom(args);
     else if (cmd == "cat")
         return cat(args);
+    else if (cmd == "compress")
+        return compress(args);
     else if (cmd == "convert")
         return convert(args);
     else if (cmd == "diff")
@@ -2655,6 +2665,10 @@ int main(int argc, char *argv[]) {
         return makeemitters(args);
     else if (cmd == "makesky")
         return makesky(args);
+    else if (cmd == "maketiled")
+        return maketiled(args);
+    else if (cmd == "merge")
+        return merge(args);
     else if (cmd == "whitebalance")
         return whitebalance(args);
     else if (cmd == "scalenormalmap")
@@ -4,6 +4,7 @@
 
 #include <pbrt/pbrt.h>
 
+#include <pbrt/cpu/distributed.h>
 #include <pbrt/cpu/render.h>
 #ifdef PBRT_BUILD_GPU_RENDERER
 #include <pbrt/gpu/memory.h>
@@ -35,10 +36,19 @@ static void usage(const std::string &msg = {}) {
             R"(usage: pbrt [<options>] <filename.pbrt...>
 
 Rendering options:
+  --cache-dir <dir>             Cache BVHs and PLY meshes in the given directory and
+                                reuse them in later runs if their inputs are unchanged.
+  --compress-textures           Store image textures in block-compressed formats: BC1
+                                for 8-bit RGB, BC4 for 8-bit single-channel, and BC6H
+                                for floating-point RGB textures.
+  --coordinator <addr:port>     Render as a worker for the coordinator at the given
+                                address, which was started with --listen or --workers.
   --cropwindow <x0,x1,y0,y1>    Specify an image crop window w.r.t. [0,1]^2
   --debugstart <values>         Inform the Integrator where to start rendering for
                                 faster debugging. (<values> are Integrator-specific
                                 and come from error message text.)
+  --denoise                     Denoise the images written by the "gbuffer" film using
+                                its albedo, normal, depth, and variance channels.
   --disable-pixel-jitter        Always sample pixels at their centers.
   --disable-wavelength-jitter   Always sample the same %d wavelengths of light.
   --displacement-edge-scale <s> Scale target triangle edge length by given value.
@@ -53,9 +63,14 @@ Rendering options:
 #endif
             R"(
   --help                        Print this help text.
+  --listen <addr:port>          Coordinate a distributed render, handing out work to
+                                workers that connect to the given address using
+                                --coordinator.
   --mse-reference-image         Filename for reference image to use for MSE computation.
   --mse-reference-out           File to write MSE error vs spp results.
   --nthreads <num>              Use specified number of threads for rendering.
+  --numa                        Pin rendering threads to cores, interleave scene data
+                                across NUMA nodes, and keep film writes node-local.
   --outfile <filename>          Write the final image to the given filename.
   --pixel <x,y>                 Render just the specified pixel.
   --pixelbounds <x0,x1,y0,y1>   Specify an image crop window w.r.t. pixel coordinates.
@@ -66,13 +81,28 @@ Rendering options:
   --quick                       Automatically reduce a number of quality settings
                                 to render more quickly.
   --quiet                       Suppress all text output other than error messages.
+  --raw-film                    Write the film's unnormalized pixel sums to an EXR
+                                file that "imgtool merge" can add to others.
   --render-coord-sys <name>     Coordinate system to use for the scene when rendering,
                                 where name is "camera", "cameraworld", or "world".
+  --resume                      Continue rendering from the checkpoint written when a
+                                previous run reached its --time-limit, if present.
+  --sample-range <start,end>    Only take the pixel samples with indices in the range
+                                [start,end). Use with --raw-film to render an image's
+                                samples in multiple runs.
   --seed <n>                    Set random number generator seed. Default: 0.
   --stats                       Print various statistics after rendering completes.
   --spp <n>                     Override number of pixel samples specified in scene
                                 description file.
+  --texture-cache <MB>          Split image textures into tiles that are read on demand
+                                from temporary files, keeping at most the given amount
+                                of tile data in memory. (Default: disabled)
+  --time-limit <secs>           Stop rendering before starting a wave of samples that
+                                isn't expected to finish within the given time, and
+                                write the image and a checkpoint for --resume.
   --wavefront                   Use wavefront volumetric path integrator.
+  --workers <n>                 Render using the given number of worker processes on
+                                this machine, coordinated by this one.
   --write-partial-images        Periodically write the current image to disk, rather
                                 than waiting for the end of rendering. Default: disabled.
 
@@ -121,7 +151,7 @@ int main(int argc, char *argv[]) {
             exit(1);
         };
 
-        std::string cropWindow, pixelBounds, pixel, pixelMaterial;
+        std::string cropWindow, pixelBounds, pixel, pixelMaterial, sampleRange;
         if (ParseArg(&iter, args.end(), "cropwindow", &cropWindow, onError)) {
             std::vector<Float> c = SplitStringToFloats(cropWindow, ',');
             if (c.size() != 4) {
@@ -144,6 +174,15 @@ int main(int argc, char *argv[]) {
                 return 1;
             }
             options.pixelBounds = Bounds2i(Point2i(p[0], p[2]), Point2i(p[1], p[3]));
+        } else if (ParseArg(&iter, args.end(), "sample-range", &sampleRange, onError)) {
+            std::vector<int> r = SplitStringToInts(sampleRange, ',');
+            if (r.size() != 2 || r[0] < 0 || r[1] <= r[0]) {
+                usage("Expected two increasing non-negative integers after "
+                      "--sample-range");
+                return 1;
+            }
+            options.sampleStart = r[0];
+            options.sampleEnd = r[1];
         } else if (ParseArg(&iter, args.end(), "pixelmaterial", &pixelMaterial,
                             onError)) {
             std::vector<int> p = SplitStringToInts(pixelMaterial, ',');
@@ -157,7 +196,13 @@ int main(int argc, char *argv[]) {
             ParseArg(&iter, args.end(), "gpu", &options.useGPU, onError) ||
             ParseArg(&iter, args.end(), "gpu-device", &options.gpuDevice, onError) ||
 #endif
+            ParseArg(&iter, args.end(), "cache-dir", &options.cacheDirectory, onError) ||
+            ParseArg(&iter, args.end(), "compress-textures", &options.compressTextures,
+                     onError) ||
+            ParseArg(&iter, args.end(), "coordinator", &options.coordinatorAddress,
+                     onError) ||
             ParseArg(&iter, args.end(), "debugstart", &options.debugStart, onError) ||
+            ParseArg(&iter, args.end(), "denoise", &options.denoise, onError) ||
             ParseArg(&iter, args.end(), "disable-pixel-jitter",
                      &options.disablePixelJitter, onError) ||
             ParseArg(&iter, args.end(), "disable-wavelength-jitter",
@@ -172,23 +217,31 @@ int main(int argc, char *argv[]) {
             ParseArg(&iter, args.end(), "log-level", &logLevel, onError) ||
             ParseArg(&iter, args.end(), "log-utilization", &options.logUtilization,
                      onError) ||
+            ParseArg(&iter, args.end(), "listen", &options.listenAddress, onError) ||
             ParseArg(&iter, args.end(), "log-file", &options.logFile, onError) ||
             ParseArg(&iter, args.end(), "mse-reference-image", &options.mseReferenceImage,
                      onError) ||
             ParseArg(&iter, args.end(), "mse-reference-out", &options.mseReferenceOutput,
                      onError) ||
             ParseArg(&iter, args.end(), "nthreads", &options.nThreads, onError) ||
+            ParseArg(&iter, args.end(), "numa", &options.numa, onError) ||
             ParseArg(&iter, args.end(), "outfile", &options.imageFile, onError) ||
             ParseArg(&iter, args.end(), "pixelstats", &options.recordPixelStatistics,
                      onError) ||
             ParseArg(&iter, args.end(), "quick", &options.quickRender, onError) ||
             ParseArg(&iter, args.end(), "quiet", &options.quiet, onError) ||
+            ParseArg(&iter, args.end(), "raw-film", &options.writeRawFilm, onError) ||
             ParseArg(&iter, args.end(), "render-coord-sys", &renderCoordSys, onError) ||
+            ParseArg(&iter, args.end(), "resume", &options.resume, onError) ||
             ParseArg(&iter, args.end(), "seed", &options.seed, onError) ||
             ParseArg(&iter, args.end(), "spp", &options.pixelSamples, onError) ||
             ParseArg(&iter, args.end(), "stats", &options.printStatistics, onError) ||
+            ParseArg(&iter, args.end(), "texture-cache", &options.textureCacheMB,
+                     onError) ||
+            ParseArg(&iter, args.end(), "time-limit", &options.timeLimit, onError) ||
             ParseArg(&iter, args.end(), "toply", &toPly, onError) ||
             ParseArg(&iter, args.end(), "wavefront", &options.wavefront, onError) ||
+            ParseArg(&iter, args.end(), "workers", &options.workers, onError) ||
             ParseArg(&iter, args.end(), "write-partial-images",
                      &options.writePartialImages, onError) ||
             ParseArg(&iter, args.end(), "upgrade", &options.upgrade, onError)) {
@@ -245,11 +298,52 @@ int main(int argc, char *argv[]) {
         options.wavefront = false;
     }
 
+    // Workers ignore the coordinator options they were launched with
+    if (!options.coordinatorAddress.empty()) {
+        options.workers = 0;
+        options.listenAddress.clear();
+    }
+    bool distributed = options.workers > 0 || !options.listenAddress.empty() ||
+                       !options.coordinatorAddress.empty();
+    if (distributed && (options.useGPU || options.wavefront))
+        ErrorExit("Distributed rendering is only supported by the CPU renderer.");
+    if (distributed && (options.timeLimit > 0 || options.resume))
+        ErrorExit("--time-limit and --resume can't be used with distributed rendering.");
+    if (options.sampleEnd != -1 && (distributed || options.useGPU || options.wavefront))
+        ErrorExit("--sample-range is only supported by the CPU renderer without "
+                  "distributed rendering.");
+    if (options.textureCacheMB < 0)
+        ErrorExit("--texture-cache must be given a non-negative size.");
+    if (options.textureCacheMB > 0 && options.useGPU)
+        ErrorExit("--texture-cache is only supported by the CPU renderers.");
+    if (options.compressTextures && options.useGPU)
+        ErrorExit("--compress-textures is only supported by the CPU renderers.");
+    if (options.compressTextures && options.textureCacheMB > 0)
+        ErrorExit("--compress-textures can't be used with --texture-cache.");
+    if (options.denoise && options.writeRawFilm)
+        ErrorExit("--denoise can't be used with --raw-film; denoise the image "
+                  "written by \"imgtool merge\" instead.");
+
     options.logLevel = LogLevelFromString(logLevel);
 
     // Initialize pbrt
     InitPBRT(options);
 
+    // Start listening for workers and launch local ones if coordinating a
+    // distributed render
+    bool coordinator = options.workers > 0 || !options.listenAddress.empty();
+    if (coordinator && !format && !toPly && !options.upgrade) {
+        // Split the cores between local workers unless told otherwise
+        std::vector<std::string> workerArgs = args;
+        if (options.workers > 0 && options.nThreads == 0)
+            workerArgs.insert(workerArgs.end(),
+                              {"--nthreads", std::to_string(std::max(
+                                                 1, AvailableCores() / options.workers))});
+        StartRenderCoordinator(
+            options.listenAddress.empty() ? "localhost:0" : options.listenAddress,
+            options.workers, argv[0], workerArgs);
+    }
+
     if (format || toPly || options.upgrade) {
         FormattingParserTarget formattingTarget(toPly, options.upgrade);
         ParseFiles(&formattingTarget, filenames);
@@ -257,6 +351,10 @@ int main(int argc, char *argv[]) {
         // Parse provided scene description files
         ParsedScene scene;
         SceneStateManager manager(&scene);
+        // In NUMA mode, spread the scene's meshes, textures, and BVH over
+        // all of the nodes' memory; _RenderCPU()_ resets this before
+        // rendering starts.
+        SetNumaInterleavedAllocation(true);
         ParseFiles(&manager, filenames);
 
         // Render the scene
@@ -267,6 +365,7 @@ int main(int argc, char *argv[]) {
 
         LOG_VERBOSE("Memory used after post-render cleanup: %s", GetCurrentRSS());
         // Clean up after rendering the scene
+        StopRenderCoordinator();
         CleanupPBRT();
     }
     return 0;
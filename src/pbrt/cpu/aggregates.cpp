@@ -5,18 +5,25 @@
 #include <pbrt/cpu/aggregates.h>
 
 #include <pbrt/interaction.h>
+#include <pbrt/options.h>
 #include <pbrt/paramdict.h>
 #include <pbrt/shapes.h>
 #include <pbrt/util/error.h>
+#include <pbrt/util/file.h>
+#include <pbrt/util/hash.h>
 #include <pbrt/util/log.h>
 #include <pbrt/util/math.h>
 #include <pbrt/util/memory.h>
 #include <pbrt/util/parallel.h>
 #include <pbrt/util/print.h>
+#include <pbrt/util/progressreporter.h>
+#include <pbrt/util/simd.h>
 #include <pbrt/util/stats.h>
 
 #include <algorithm>
 #include <tuple>
+#include <type_traits>
+#include <unordered_map>
 
 namespace pbrt {
 
@@ -25,6 +32,22 @@ STAT_RATIO("BVH/Primitives per leaf node", totalPrimitives, totalLeafNodes);
 STAT_COUNTER("BVH/Interior nodes", interiorNodes);
 STAT_COUNTER("BVH/Leaf nodes", leafNodes);
 STAT_PIXEL_COUNTER("BVH/Nodes visited", bvhNodesVisited);
+STAT_COUNTER("BVH/Wide nodes", wideBVHNodes);
+STAT_MEMORY_COUNTER("Memory/BVH nodes", bvhNodeBytes);
+STAT_COUNTER("BVH/Quantized nodes", quantizedBVHNodes);
+STAT_PERCENT("BVH/Coherent ray packets", coherentRayPackets, totalRayPackets);
+STAT_COUNTER("BVH/Deferred triangle intersections", deferredTriangleHits);
+STAT_MEMORY_COUNTER("Memory/BVH packed triangles", packedTriangleBytes);
+STAT_COUNTER("BVH/Deferred instance intersections", deferredInstanceHits);
+STAT_MEMORY_COUNTER("Memory/BVH packed instances", packedInstanceBytes);
+STAT_FLOAT_DISTRIBUTION("BVH/Build time (ms)", bvhBuildMilliseconds);
+STAT_FLOAT_DISTRIBUTION("BVH/SAH cost", bvhSAHCost);
+STAT_COUNTER("BVH/Spatial splits", sbvhSpatialSplits);
+STAT_COUNTER("BVH/Duplicated primitive references", sbvhDuplicatedReferences);
+STAT_COUNTER("BVH/Refits", bvhRefits);
+STAT_COUNTER("BVH/Rebuilds", bvhRebuilds);
+STAT_FLOAT_DISTRIBUTION("BVH/Refit time (ms)", bvhRefitMilliseconds);
+STAT_COUNTER("BVH/BVHs read from cache", bvhCacheHits);
 
 // MortonPrimitive Definition
 struct MortonPrimitive {
@@ -87,6 +110,51 @@ struct BVHSplitBucket {
     Bounds3f bounds;
 };
 
+// Returns the index of the bucket after which splitting minimizes the SAH
+// metric, or -1 if no split separates the primitives; the split's
+// surface-area-weighted cost is returned in _minCost_.
+template <int nBuckets>
+static int MinCostSAHSplit(const BVHSplitBucket buckets[nBuckets], Float *minCost) {
+    // Compute costs for splitting after each bucket
+    constexpr int nSplits = nBuckets - 1;
+    int countBelow[nSplits], countAbove[nSplits];
+    Bounds3f boundsBelow[nSplits], boundsAbove[nSplits];
+    // Initialize _countBelow_ and _boundsBelow_ using a forward scan over
+    // splits
+    countBelow[0] = buckets[0].count;
+    boundsBelow[0] = buckets[0].bounds;
+    for (int i = 1; i < nSplits; ++i) {
+        countBelow[i] = countBelow[i - 1] + buckets[i].count;
+        boundsBelow[i] = Union(boundsBelow[i - 1], buckets[i].bounds);
+    }
+
+    // Initialize _countAbove_ and _boundsAbove_ using a backwards scan
+    // over splits
+    countAbove[nSplits - 1] = buckets[nBuckets - 1].count;
+    boundsAbove[nSplits - 1] = buckets[nBuckets - 1].bounds;
+    for (int i = nSplits - 2; i >= 0; --i) {
+        countAbove[i] = countAbove[i + 1] + buckets[i + 1].count;
+        boundsAbove[i] = Union(boundsAbove[i + 1], buckets[i + 1].bounds);
+    }
+
+    // Find bucket to split at that minimizes SAH metric
+    int minCostSplitBucket = -1;
+    *minCost = Infinity;
+    for (int i = 0; i < nSplits; ++i) {
+        // Compute cost for candidate split and update minimum if
+        // necessary
+        if (countBelow[i] == 0 || countAbove[i] == 0)
+            continue;
+        Float cost = (countBelow[i] * boundsBelow[i].SurfaceArea() +
+                      countAbove[i] * boundsAbove[i].SurfaceArea());
+        if (cost < *minCost) {
+            *minCost = cost;
+            minCostSplitBucket = i;
+        }
+    }
+    return minCostSplitBucket;
+}
+
 // BVHPrimitive Definition
 struct BVHPrimitive {
     BVHPrimitive() {}
@@ -125,6 +193,62 @@ struct BVHBuildNode {
     int splitAxis, firstPrimOffset, nPrimitives;
 };
 
+// Returns the SAH cost of the BVH rooted at _node_, weighted by _node_'s
+// surface area, using the same relative traversal cost as the builders.
+static Float SAHCost(const BVHBuildNode *node) {
+    if (node->nPrimitives > 0)
+        return node->nPrimitives * node->bounds.SurfaceArea();
+    return node->bounds.SurfaceArea() / 2 + SAHCost(node->children[0]) +
+           SAHCost(node->children[1]);
+}
+
+// Returns the primitive's triangle if it is a triangle whose intersections
+// can be deferred, or nullptr otherwise.
+static const Triangle *DeferrableTriangle(Primitive prim) {
+    if (const SimplePrimitive *sp = prim.CastOrNullptr<SimplePrimitive>())
+        return sp->DeferrableTriangle();
+    else if (const GeometricPrimitive *gp = prim.CastOrNullptr<GeometricPrimitive>())
+        return gp->DeferrableTriangle();
+    return nullptr;
+}
+
+// Returns the bounds of the part of _prim_ that lies between _lo_ and _hi_
+// along _axis_, given the bounds _b_ of the reference being clipped. The
+// result is degenerate if nothing remains.
+static Bounds3f ClipPrimitiveBounds(Primitive prim, const Bounds3f &b, int axis,
+                                    Float lo, Float hi) {
+    Bounds3f clipped;
+    if (const Triangle *tri = DeferrableTriangle(prim)) {
+        // Bound the vertices of the triangle clipped to the slab
+        pstd::array<Point3f, 3> p = tri->Vertices();
+        for (int i = 0; i < 3; ++i) {
+            Point3f p0 = p[i], p1 = p[(i + 1) % 3];
+            if (p0[axis] >= lo && p0[axis] <= hi)
+                clipped = Union(clipped, p0);
+            for (Float plane : {lo, hi})
+                if ((p0[axis] < plane && p1[axis] > plane) ||
+                    (p0[axis] > plane && p1[axis] < plane)) {
+                    Point3f pc = Lerp((plane - p0[axis]) / (p1[axis] - p0[axis]), p0, p1);
+                    pc[axis] = plane;
+                    clipped = Union(clipped, pc);
+                }
+        }
+        if (clipped.IsDegenerate())
+            return clipped;
+        // Conservatively pad the clipped bounds for rounding error in the
+        // computed intersection points
+        Vector3f pad = gamma(4) * Vector3f(Max(Abs(clipped.pMin), Abs(clipped.pMax)));
+        pad[axis] = 0;
+        clipped.pMin -= pad;
+        clipped.pMax += pad;
+    } else {
+        clipped = b;
+        clipped.pMin[axis] = lo;
+        clipped.pMax[axis] = hi;
+    }
+    return Intersect(clipped, b);
+}
+
 // LinearBVHNode Definition
 struct alignas(32) LinearBVHNode {
     Bounds3f bounds;
@@ -136,18 +260,444 @@ struct alignas(32) LinearBVHNode {
     uint8_t axis;          // interior node: xyz
 };
 
+// PackedTriangle Definition
+// Copy of a triangle's vertices stored alongside the BVH's primitives so
+// that leaf intersection tests don't need to go through the mesh's
+// vertex index and position arrays.
+struct PackedTriangle {
+    Point3f p[3];
+    // Only set for primitives that are triangles whose intersections can be
+    // deferred (see _BVHClosestHit_).
+    bool valid;
+};
+
+// PackedInstance Definition
+// Instance-from-render transformation of a _TransformedPrimitive_ with an
+// affine transformation, stored as the columns of a 3x4 matrix so that
+// rays can be transformed into the instance's space using SIMD arithmetic.
+// The instance's primitive and visibility mask are copied as well, so that
+// the _TransformedPrimitive_ is only accessed for the closest intersection.
+struct alignas(16) PackedInstance {
+    // PackedInstance Public Methods
+    PackedInstance() = default;
+    PackedInstance(const TransformedPrimitive *instance, const SquareMatrix<4> &mInv)
+        : primitive(instance->GetPrimitive()),
+          instance(instance),
+          visibility(instance->Visibility()) {
+        for (int j = 0; j < 4; ++j) {
+            for (int i = 0; i < 3; ++i)
+                m[j][i] = mInv[i][j];
+            m[j][3] = 0;
+        }
+    }
+
+    // Equivalent to _Transform::ApplyInverse()_, including offsetting the
+    // ray origin past the bounds of its rounding error.
+    Ray ApplyInverse(const Ray &r, Float *tMax) const {
+        using F4 = SIMDFloat<4>;
+        F4 c0 = F4::Load(m[0]), c1 = F4::Load(m[1]), c2 = F4::Load(m[2]);
+        F4 c3 = F4::Load(m[3]);
+        F4 ox = F4(r.o.x) * c0, oy = F4(r.o.y) * c1, oz = F4(r.o.z) * c2;
+        F4 o = (ox + oy) + (oz + c3);
+        F4 d = (F4(r.d.x) * c0 + F4(r.d.y) * c1) + F4(r.d.z) * c2;
+        F4 oError = F4(gamma(3)) * (Abs(ox) + Abs(oy) + Abs(oz) + Abs(c3));
+        alignas(16) float of[4], df[4], ef[4];
+        o.Store(of);
+        d.Store(df);
+        oError.Store(ef);
+
+        Point3f origin(of[0], of[1], of[2]);
+        Vector3f dir(df[0], df[1], df[2]);
+        Float lengthSquared = LengthSquared(dir);
+        if (lengthSquared > 0) {
+            Float dt = Dot(Abs(dir), Vector3f(ef[0], ef[1], ef[2])) / lengthSquared;
+            origin += dir * dt;
+            *tMax -= dt;
+        }
+        return Ray(origin, dir, r.time, r.medium);
+    }
+
+    // PackedInstance Public Members
+    float m[4][4];
+    Primitive primitive;
+    const TransformedPrimitive *instance;
+    uint8_t visibility;
+};
+
+// WideBVHNode Definition
+template <int N>
+struct alignas(64) WideBVHNode {
+    // WideBVHNode Public Methods
+    static constexpr int Width = N;
+
+    WideBVHNode() {
+        // Initialize all children as empty; their inverted bounds are never hit
+        for (int i = 0; i < N; ++i) {
+            for (int axis = 0; axis < 3; ++axis) {
+                bMin[axis][i] = Infinity;
+                bMax[axis][i] = -Infinity;
+            }
+            offset[i] = -1;
+            nPrimitives[i] = 0;
+        }
+    }
+
+    void SetBounds(const Bounds3f childBounds[N], int nChildren) {
+        for (int i = 0; i < N; ++i)
+            for (int axis = 0; axis < 3; ++axis) {
+                bMin[axis][i] = (i < nChildren) ? float(childBounds[i].pMin[axis])
+                                                : Infinity;
+                bMax[axis][i] = (i < nChildren) ? float(childBounds[i].pMax[axis])
+                                                : -Infinity;
+            }
+    }
+    Bounds3f ChildBounds(int child) const {
+        Bounds3f b;
+        for (int axis = 0; axis < 3; ++axis) {
+            b.pMin[axis] = bMin[axis][child];
+            b.pMax[axis] = bMax[axis][child];
+        }
+        return b;
+    }
+
+    // Returns a bitmask of the children whose bounds the ray intersects and
+    // their parametric entry points in _tEntry_.
+    uint32_t Intersect(const SIMDFloat<N> o[3], const SIMDFloat<N> invDir[3],
+                       const int dirIsNeg[3], Float raytMax, float tEntry[N]) const {
+        SIMDFloat<N> tMin(0.f), tMax = SIMDFloat<N>(float(raytMax));
+        // Scale _tFar_ values to ensure robust bounds intersection
+        const SIMDFloat<N> tFarScale(1 + 2 * gamma(3));
+        for (int axis = 0; axis < 3; ++axis) {
+            const float *near = dirIsNeg[axis] ? bMax[axis] : bMin[axis];
+            const float *far = dirIsNeg[axis] ? bMin[axis] : bMax[axis];
+            // Slab values are the first argument so that NaNs are ignored
+            SIMDFloat<N> tNear = (SIMDFloat<N>::Load(near) - o[axis]) * invDir[axis];
+            SIMDFloat<N> tFar =
+                (SIMDFloat<N>::Load(far) - o[axis]) * invDir[axis] * tFarScale;
+            tMin = Max(tNear, tMin);
+            tMax = Min(tFar, tMax);
+        }
+        tMin.Store(tEntry);
+        return CompareLEMask(tMin, tMax);
+    }
+
+    // Child bounds are stored per axis so that all _N_ slabs can be tested
+    // together.
+    float bMin[3][N], bMax[3][N];
+    int offset[N];            // leaf: first primitive; interior: wide node index
+    uint16_t nPrimitives[N];  // 0 -> interior child
+};
+
+// QuantizedBVHNode Definition
+// Compressed alternative to _WideBVHNode_ that stores each child's bounds
+// with 8 bits per coordinate relative to the node's own bounds. Each axis
+// is quantized using a power-of-two step so that dequantization is exact
+// up to a single rounded addition, which is accounted for when the child
+// bounds are encoded so that the decoded bounds always contain them.
+template <int N>
+struct alignas(N >= 4 ? 64 : 16) QuantizedBVHNode {
+    // QuantizedBVHNode Public Methods
+    static constexpr int Width = N;
+
+    QuantizedBVHNode() {
+        for (int i = 0; i < N; ++i) {
+            for (int axis = 0; axis < 3; ++axis)
+                qMin[axis][i] = qMax[axis][i] = 0;
+            offset[i] = -1;
+            nPrimitives[i] = 0;
+        }
+    }
+
+    void SetBounds(const Bounds3f childBounds[N], int nChildren) {
+        Bounds3f b;
+        for (int i = 0; i < nChildren; ++i)
+            b = Union(b, childBounds[i]);
+        for (int axis = 0; axis < 3; ++axis) {
+            // Find smallest power-of-two step that covers the node's extent
+            origin[axis] = b.pMin[axis];
+            float extent = float(b.pMax[axis]) - origin[axis];
+            int e = (extent > 0) ? std::max(-126, Exponent(extent / 255) + 1) : -126;
+            while (e < 127 && Dequantize(axis, 255, e) < float(b.pMax[axis]))
+                ++e;
+            CHECK_GE(Dequantize(axis, 255, e), float(b.pMax[axis]));
+            exponent[axis] = e;
+
+            // Conservatively quantize child bounds along _axis_
+            for (int i = 0; i < nChildren; ++i) {
+                float lo = childBounds[i].pMin[axis], hi = childBounds[i].pMax[axis];
+                float scale = Scale(e);
+                int q0 = Clamp(int(std::floor((lo - origin[axis]) / scale)), 0, 255);
+                while (q0 > 0 && Dequantize(axis, q0, e) > lo)
+                    --q0;
+                int q1 = Clamp(int(std::ceil((hi - origin[axis]) / scale)), 0, 255);
+                while (q1 < 255 && Dequantize(axis, q1, e) < hi)
+                    ++q1;
+                qMin[axis][i] = q0;
+                qMax[axis][i] = q1;
+            }
+        }
+        childMask = (1u << nChildren) - 1;
+    }
+    Bounds3f ChildBounds(int child) const {
+        Bounds3f b;
+        for (int axis = 0; axis < 3; ++axis) {
+            b.pMin[axis] = Dequantize(axis, qMin[axis][child], exponent[axis]);
+            b.pMax[axis] = Dequantize(axis, qMax[axis][child], exponent[axis]);
+        }
+        return b;
+    }
+
+    uint32_t Intersect(const SIMDFloat<N> o[3], const SIMDFloat<N> invDir[3],
+                       const int dirIsNeg[3], Float raytMax, float tEntry[N]) const {
+        SIMDFloat<N> tMin(0.f), tMax = SIMDFloat<N>(float(raytMax));
+        // Scale _tFar_ values to ensure robust bounds intersection
+        const SIMDFloat<N> tFarScale(1 + 2 * gamma(3));
+        for (int axis = 0; axis < 3; ++axis) {
+            // Decode child slabs along _axis_
+            const uint8_t *qNear = dirIsNeg[axis] ? qMax[axis] : qMin[axis];
+            const uint8_t *qFar = dirIsNeg[axis] ? qMin[axis] : qMax[axis];
+            SIMDFloat<N> org(origin[axis]), scale(Scale(exponent[axis]));
+            SIMDFloat<N> near = org + SIMDFloat<N>::LoadBytes(qNear) * scale;
+            SIMDFloat<N> far = org + SIMDFloat<N>::LoadBytes(qFar) * scale;
+            SIMDFloat<N> tNear = (near - o[axis]) * invDir[axis];
+            SIMDFloat<N> tFar = (far - o[axis]) * invDir[axis] * tFarScale;
+            tMin = Max(tNear, tMin);
+            tMax = Min(tFar, tMax);
+        }
+        tMin.Store(tEntry);
+        return CompareLEMask(tMin, tMax) & childMask;
+    }
+
+    // QuantizedBVHNode Private Methods
+  private:
+    static float Scale(int e) { return BitsToFloat(uint32_t(e + 127) << 23); }
+    float Dequantize(int axis, int q, int e) const {
+        // Note: the product is exact, so this matches the result computed
+        // in _Intersect()_ whether or not it is evaluated with an FMA.
+        return origin[axis] + float(q) * Scale(e);
+    }
+
+  public:
+    // QuantizedBVHNode Public Members
+    float origin[3];
+    int8_t exponent[3];
+    uint8_t childMask = 0;
+    uint8_t qMin[3][N], qMax[3][N];
+    int offset[N];            // leaf: first primitive; interior: node index
+    uint16_t nPrimitives[N];  // 0 -> interior child
+};
+
+// WideBVHNodeToVisit Definition
+struct WideBVHNodeToVisit {
+    int offset;
+    int nPrimitives;
+    float tEntry;
+};
+
+// BVHRayPacket Definition
+static constexpr int BVHRayPacketSize = 16;
+
+struct BVHRayPacket {
+    // BVHRayPacket Public Methods
+    BVHRayPacket(pstd::span<const Ray> r, pstd::span<const Float> t)
+        : nRays(r.size()), rays(r.data()) {
+        CHECK_LE(nRays, BVHRayPacketSize);
+        for (int i = 0; i < nRays; ++i) {
+            tMax[i] = t[i];
+            invDir[i] = Vector3f(1 / rays[i].d.x, 1 / rays[i].d.y, 1 / rays[i].d.z);
+        }
+        // The packet is coherent if all rays share the same direction signs
+        coherent = true;
+        for (int a = 0; a < 3; ++a) {
+            dirIsNeg[a] = int(invDir[0][a] < 0);
+            for (int i = 1; i < nRays; ++i)
+                coherent &= (int(invDir[i][a] < 0) == dirIsNeg[a]);
+        }
+
+        // Compute packet-wide intervals of ray origins and reciprocal directions
+        for (int a = 0; a < 3; ++a) {
+            oMin[a] = oMax[a] = rays[0].o[a];
+            invDirMin[a] = invDirMax[a] = invDir[0][a];
+            // Slabs along axes where some ray has a non-finite reciprocal
+            // direction are not used for culling the packet
+            invDirFinite[a] = true;
+            for (int i = 0; i < nRays; ++i) {
+                oMin[a] = std::min(oMin[a], rays[i].o[a]);
+                oMax[a] = std::max(oMax[a], rays[i].o[a]);
+                invDirMin[a] = std::min(invDirMin[a], invDir[i][a]);
+                invDirMax[a] = std::max(invDirMax[a], invDir[i][a]);
+                invDirFinite[a] &= IsFinite(invDir[i][a]);
+            }
+        }
+        UpdateMaxT();
+    }
+
+    void UpdateMaxT() {
+        maxT = -Infinity;
+        for (int i = 0; i < nRays; ++i)
+            maxT = std::max(maxT, tMax[i]);
+    }
+
+    bool MayIntersect(const Bounds3f &b) const {
+        // Bound the slab entry and exit distances over all of the packet's rays;
+        // rounding is monotonic, so the bounds are also conservative with
+        // respect to the per-ray tests in _Bounds3::IntersectP()_.
+        Float t0 = -Infinity, t1 = Infinity;
+        for (int a = 0; a < 3; ++a) {
+            if (!invDirFinite[a])
+                continue;
+            Float pNear = b[dirIsNeg[a]][a], pFar = b[1 - dirIsNeg[a]][a];
+            Float tNear = std::min({(pNear - oMax[a]) * invDirMin[a],
+                                    (pNear - oMax[a]) * invDirMax[a],
+                                    (pNear - oMin[a]) * invDirMin[a],
+                                    (pNear - oMin[a]) * invDirMax[a]});
+            Float tFar = std::max({(pFar - oMax[a]) * invDirMin[a],
+                                   (pFar - oMax[a]) * invDirMax[a],
+                                   (pFar - oMin[a]) * invDirMin[a],
+                                   (pFar - oMin[a]) * invDirMax[a]});
+            tFar *= 1 + 2 * gamma(3);
+            t0 = std::max(t0, tNear);
+            t1 = std::min(t1, tFar);
+        }
+        return !(t0 > t1 || t0 >= maxT || t1 <= 0);
+    }
+
+    bool RayIntersects(const Bounds3f &b, int i) const {
+        return b.IntersectP(rays[i].o, rays[i].d, tMax[i], invDir[i], dirIsNeg);
+    }
+
+    // Returns the index of the first ray starting at _start_ that intersects
+    // _b_, or _nRays_ if there is none.
+    int FirstHit(const Bounds3f &b, int start) const {
+        if (!MayIntersect(b))
+            return nRays;
+        for (int i = start; i < nRays; ++i)
+            if (RayIntersects(b, i))
+                return i;
+        return nRays;
+    }
+
+    // BVHRayPacket Public Members
+    int nRays;
+    const Ray *rays;
+    Float tMax[BVHRayPacketSize];
+    Vector3f invDir[BVHRayPacketSize];
+    int dirIsNeg[3];
+    bool coherent;
+    Point3f oMin, oMax;
+    Vector3f invDirMin, invDirMax;
+    bool invDirFinite[3];
+    Float maxT;
+};
+
+// BVHClosestHit Definition
+// Closest intersection found so far during BVH traversal. Hits with
+// triangles only record the barycentrics and the primitive, so that the
+// _SurfaceInteraction_ is computed once, for the final closest hit.
+// Similarly, hits with packed instances are only transformed to rendering
+// space for the final closest hit.
+struct BVHClosestHit {
+    // BVHClosestHit Public Methods
+    void Intersect(Primitive prim, const Ray &ray, Float *tMax) {
+        if (const Triangle *tri = DeferrableTriangle(prim)) {
+            if (pstd::optional<TriangleIntersection> ti = tri->IntersectHit(ray, *tMax))
+                RecordTriangleHit(prim, *ti, tMax);
+        } else if (pstd::optional<ShapeIntersection> primSi = prim.Intersect(ray, *tMax)) {
+            si = primSi;
+            deferredPrim = nullptr;
+            instance = nullptr;
+            *tMax = si->tHit;
+        }
+    }
+
+    void RecordTriangleHit(Primitive prim, const TriangleIntersection &ti, Float *tMax) {
+        triHit = ti;
+        deferredPrim = prim;
+        instance = nullptr;
+        *tMax = ti.t;
+    }
+
+    // _instanceSi_ is in the instance's coordinate system.
+    void RecordInstanceHit(const TransformedPrimitive *inst,
+                           const ShapeIntersection &instanceSi, Float *tMax) {
+        si = instanceSi;
+        deferredPrim = nullptr;
+        instance = inst;
+        *tMax = si->tHit;
+    }
+
+    pstd::optional<ShapeIntersection> Interaction(const Ray &ray) const {
+        if (instance) {
+            ++deferredInstanceHits;
+            ShapeIntersection isect = *si;
+            isect.intr = instance->RenderFromPrimitive()(isect.intr);
+            return isect;
+        }
+        if (!deferredPrim)
+            return si;
+        ++deferredTriangleHits;
+        if (const SimplePrimitive *sp = deferredPrim.CastOrNullptr<SimplePrimitive>())
+            return sp->InteractionFromTriangleHit(ray, triHit);
+        return deferredPrim.Cast<GeometricPrimitive>()->InteractionFromTriangleHit(
+            ray, triHit);
+    }
+
+    // BVHClosestHit Public Members
+    pstd::optional<ShapeIntersection> si;
+    Primitive deferredPrim = nullptr;
+    TriangleIntersection triHit;
+    const TransformedPrimitive *instance = nullptr;
+};
+
 // BVHAggregate Method Definitions
 BVHAggregate::BVHAggregate(std::vector<Primitive> prims, int maxPrimsInNode,
-                           SplitMethod splitMethod)
+                           SplitMethod splitMethod, int width, bool packTriangles,
+                           Float maxDuplication, bool quantizeNodes, bool packInstances)
     : maxPrimsInNode(std::min(255, maxPrimsInNode)),
       primitives(std::move(prims)),
-      splitMethod(splitMethod) {
+      splitMethod(splitMethod),
+      width(width),
+      packTriangles(packTriangles),
+      maxDuplication(maxDuplication),
+      quantizeNodes(quantizeNodes),
+      packInstances(packInstances) {
+    CHECK(width == 2 || width == 4 || width == 8);
+#ifdef PBRT_FLOAT_AS_DOUBLE
+    // Packed instances store single-precision transformations.
+    this->packInstances = false;
+#endif
     CHECK(!primitives.empty());
+    build();
+}
+
+void BVHAggregate::build() {
     // Build BVH from _primitives_
+    Timer timer;
     // Initialize _bvhPrimitives_ array for primitives
     std::vector<BVHPrimitive> bvhPrimitives(primitives.size());
-    for (size_t i = 0; i < primitives.size(); ++i)
+    ParallelFor(0, primitives.size(), [&](int64_t i) {
         bvhPrimitives[i] = BVHPrimitive(i, primitives[i].Bounds());
+    });
+
+    // Use previously-built BVH from the cache directory, if available
+    std::string cacheFilename;
+    uint64_t cacheKey = 0;
+    std::vector<Primitive> inputPrimitives;
+    if (Options && !Options->cacheDirectory.empty()) {
+        cacheKey = computeCacheKey(bvhPrimitives);
+        cacheFilename = StringPrintf("%s/bvh-%016llx.bin", Options->cacheDirectory,
+                                     (unsigned long long)cacheKey);
+        if (readCache(cacheFilename, cacheKey)) {
+            ++bvhCacheHits;
+            bvhBuildMilliseconds << 1000 * timer.ElapsedSeconds();
+            if (packTriangles)
+                packTriangleVertices();
+            if (packInstances)
+                packInstanceTransforms();
+            return;
+        }
+        inputPrimitives = primitives;
+    }
 
     // Build BVH for primitives using _bvhPrimitives_
     // Declare _Allocator_s used for BVH construction
@@ -168,6 +718,28 @@ BVHAggregate::BVHAggregate(std::vector<Primitive> prims, int maxPrimsInNode,
     std::atomic<int> totalNodes{0};
     if (splitMethod == SplitMethod::HLBVH) {
         root = buildHLBVH(alloc, bvhPrimitives, &totalNodes, orderedPrims);
+    } else if (splitMethod == SplitMethod::SBVH) {
+        // Spatial splits may add references up to the duplication budget
+        int64_t maxDuplicates = int64_t(maxDuplication * primitives.size());
+        std::atomic<int64_t> duplicationBudget{maxDuplicates};
+        orderedPrims.resize(primitives.size() + maxDuplicates);
+        std::atomic<int> orderedPrimsOffset{0};
+        Bounds3f rootBounds;
+        for (const BVHPrimitive &bp : bvhPrimitives)
+            rootBounds = Union(rootBounds, bp.bounds);
+        root = buildSBVH(threadAllocators, std::move(bvhPrimitives),
+                         rootBounds.SurfaceArea(), &duplicationBudget, &totalNodes,
+                         &orderedPrimsOffset, orderedPrims);
+        // Every reference taken from the budget has been duplicated
+        CHECK_EQ(orderedPrimsOffset.load(),
+                 primitives.size() + maxDuplicates - duplicationBudget.load());
+        orderedPrims.resize(orderedPrimsOffset);
+    } else if (splitMethod == SplitMethod::ParallelSAH) {
+        std::atomic<int> orderedPrimsOffset{0};
+        root = buildParallelSAH(threadAllocators,
+                                pstd::span<BVHPrimitive>(bvhPrimitives), &totalNodes,
+                                &orderedPrimsOffset, orderedPrims);
+        CHECK_EQ(orderedPrimsOffset.load(), orderedPrims.size());
     } else {
         std::atomic<int> orderedPrimsOffset{0};
         root = buildRecursive(threadAllocators, pstd::span<BVHPrimitive>(bvhPrimitives),
@@ -176,17 +748,397 @@ BVHAggregate::BVHAggregate(std::vector<Primitive> prims, int maxPrimsInNode,
     }
     primitives.swap(orderedPrims);
 
-    // Convert BVH into compact representation in _nodes_ array
     bvhPrimitives.resize(0);
-    LOG_VERBOSE("BVH created with %d nodes for %d primitives (%.2f MB)",
-                totalNodes.load(), (int)primitives.size(),
-                float(totalNodes.load() * sizeof(LinearBVHNode)) / (1024.f * 1024.f));
-    treeBytes += totalNodes * sizeof(LinearBVHNode) + sizeof(*this) +
-                 primitives.size() * sizeof(primitives[0]);
-    nodes = new LinearBVHNode[totalNodes];
-    int offset = 0;
-    flattenBVH(root, &offset);
-    CHECK_EQ(totalNodes.load(), offset);
+    bounds = root->bounds;
+    bvhBuildMilliseconds << 1000 * timer.ElapsedSeconds();
+    if (bounds.SurfaceArea() > 0)
+        bvhSAHCost << SAHCost(root) / bounds.SurfaceArea();
+    treeBytes += sizeof(*this) + primitives.size() * sizeof(primitives[0]);
+    if (packTriangles)
+        packTriangleVertices();
+    if (packInstances)
+        packInstanceTransforms();
+
+    if (quantizeNodes) {
+        // Store BVH using quantized child bounds
+        if (width == 2)
+            quantizedNodes2 = createWideBVH<QuantizedBVHNode<2>>(root);
+        else if (width == 4)
+            quantizedNodes4 = createWideBVH<QuantizedBVHNode<4>>(root);
+        else
+            quantizedNodes8 = createWideBVH<QuantizedBVHNode<8>>(root);
+    } else if (width == 4)
+        // Collapse BVH into _width_-wide nodes for SIMD traversal
+        nodes4 = createWideBVH<WideBVHNode<4>>(root);
+    else if (width == 8)
+        nodes8 = createWideBVH<WideBVHNode<8>>(root);
+    else {
+        // Convert BVH into compact representation in _nodes_ array
+        LOG_VERBOSE("BVH created with %d nodes for %d primitives (%.2f MB)",
+                    totalNodes.load(), (int)primitives.size(),
+                    float(totalNodes.load() * sizeof(LinearBVHNode)) /
+                        (1024.f * 1024.f));
+        treeBytes += totalNodes * sizeof(LinearBVHNode);
+        bvhNodeBytes += totalNodes * sizeof(LinearBVHNode);
+        nNodes = totalNodes;
+        nodes = new LinearBVHNode[nNodes];
+        int offset = 0;
+        flattenBVH(root, &offset);
+        CHECK_EQ(totalNodes.load(), offset);
+    }
+    builtSAHCost = layoutSAHCost();
+
+    if (!cacheFilename.empty())
+        writeCache(cacheFilename, cacheKey, inputPrimitives);
+}
+
+void BVHAggregate::packTriangleVertices() {
+    // Copy triangle vertices into _packedTriangles_ in BVH leaf order
+    if (!packedTriangles) {
+        packedTriangles = new PackedTriangle[primitives.size()];
+        packedTriangleBytes += primitives.size() * sizeof(PackedTriangle);
+    }
+    ParallelFor(0, primitives.size(), [&](int64_t i) {
+        const Triangle *tri = DeferrableTriangle(primitives[i]);
+        packedTriangles[i].valid = tri != nullptr;
+        if (tri) {
+            pstd::array<Point3f, 3> p = tri->Vertices();
+            for (int j = 0; j < 3; ++j)
+                packedTriangles[i].p[j] = p[j];
+        }
+    });
+}
+
+void BVHAggregate::packInstanceTransforms() {
+    // Find primitives that are instances with affine transformations
+    std::vector<int32_t> slots(primitives.size(), -1);
+    std::vector<PackedInstance> instances;
+    for (size_t i = 0; i < primitives.size(); ++i) {
+        const TransformedPrimitive *inst =
+            primitives[i].CastOrNullptr<TransformedPrimitive>();
+        if (!inst)
+            continue;
+        const SquareMatrix<4> &mInv = inst->RenderFromPrimitive().GetInverseMatrix();
+        if (mInv[3][0] != 0 || mInv[3][1] != 0 || mInv[3][2] != 0 || mInv[3][3] != 1)
+            continue;
+        slots[i] = instances.size();
+        instances.push_back(PackedInstance(inst, mInv));
+    }
+
+    // Copy instance transformations into _packedInstances_ in BVH leaf order
+    if (!instanceSlots) {
+        if (instances.empty())
+            return;
+        instanceSlots = new int32_t[primitives.size()];
+        packedInstanceBytes += primitives.size() * sizeof(int32_t) +
+                               instances.size() * sizeof(PackedInstance);
+    } else
+        delete[] packedInstances;
+    std::copy(slots.begin(), slots.end(), instanceSlots);
+    nPackedInstances = instances.size();
+    packedInstances = new PackedInstance[instances.size()];
+    std::copy(instances.begin(), instances.end(), packedInstances);
+}
+
+// BVH Cache Definitions
+// Cached BVHs store a header, the index of each of the BVH's ordered
+// primitive references in the primitive array it was built from, and then
+// the BVH's nodes, stored starting at a 64-byte aligned offset so that they
+// can be used directly from the memory-mapped cache file. The header is
+// written as is, so it must not have any (uninitialized) padding; the SAH
+// cost is stored as a _double_ so that this holds for both float and
+// double _Float_s.
+struct BVHCacheHeader {
+    static constexpr uint64_t Magic = 0x3268766274726270;  // "pbrtbvh2"
+    uint64_t magic = Magic;
+    uint64_t key;
+    int32_t layout, nodeSize;
+    int32_t nNodes, nPrimitives;
+    uint64_t nodesOffset;
+    Bounds3f bounds;
+    double builtSAHCost;
+};
+static_assert(sizeof(BVHCacheHeader) ==
+                  5 * sizeof(uint64_t) + sizeof(Bounds3f) + sizeof(double),
+              "BVHCacheHeader has padding");
+
+uint64_t BVHAggregate::computeCacheKey(
+    const std::vector<BVHPrimitive> &bvhPrimitives) const {
+    // Hash build parameters and primitive bounds, which determine the BVH
+    uint64_t key = Hash(BVHCacheHeader::Magic, sizeof(Float), splitMethod,
+                        maxPrimsInNode, cacheLayout(), maxDuplication);
+    key = HashBuffer(bvhPrimitives.data(), bvhPrimitives.size() * sizeof(BVHPrimitive),
+                     key);
+    if (splitMethod == SplitMethod::SBVH)
+        // Spatial splits also depend on triangles' vertices
+        for (Primitive prim : primitives)
+            if (const Triangle *tri = DeferrableTriangle(prim)) {
+                pstd::array<Point3f, 3> p = tri->Vertices();
+                key = HashBuffer(p.data(), sizeof(p[0]) * 3, key);
+            }
+    return key;
+}
+
+int BVHAggregate::cacheLayout() const {
+    // Each width and node type gets a distinct layout index
+    int widthIndex = (width == 2) ? 0 : (width == 4 ? 1 : 2);
+    return quantizeNodes ? 3 + widthIndex : widthIndex;
+}
+
+static int CacheLayoutNodeSize(int layout) {
+    constexpr int nodeSizes[6] = {
+        sizeof(LinearBVHNode),       sizeof(WideBVHNode<4>),
+        sizeof(WideBVHNode<8>),      sizeof(QuantizedBVHNode<2>),
+        sizeof(QuantizedBVHNode<4>), sizeof(QuantizedBVHNode<8>)};
+    return nodeSizes[layout];
+}
+
+bool BVHAggregate::readCache(const std::string &filename, uint64_t key) {
+    std::unique_ptr<MappedFile> file = MappedFile::Open(filename);
+    if (!file || file->size() < sizeof(BVHCacheHeader))
+        return false;
+    // Validate cache file header
+    BVHCacheHeader header;
+    std::memcpy(&header, file->data(), sizeof(header));
+    int layout = cacheLayout();
+    if (header.magic != BVHCacheHeader::Magic || header.key != key ||
+        header.layout != layout || header.nodeSize != CacheLayoutNodeSize(layout) ||
+        header.nodesOffset % 64 != 0 ||
+        header.nodesOffset < sizeof(header) + header.nPrimitives * sizeof(int32_t) ||
+        file->size() != header.nodesOffset + size_t(header.nNodes) * header.nodeSize) {
+        Warning("%s: ignoring invalid BVH cache file", filename);
+        return false;
+    }
+
+    // Reorder primitives using the cached primitive indices
+    std::vector<Primitive> orderedPrims(header.nPrimitives);
+    const uint8_t *indices = file->data() + sizeof(header);
+    for (int i = 0; i < header.nPrimitives; ++i) {
+        int32_t index;
+        std::memcpy(&index, indices + i * sizeof(int32_t), sizeof(index));
+        if (index < 0 || index >= primitives.size()) {
+            Warning("%s: ignoring invalid BVH cache file", filename);
+            return false;
+        }
+        orderedPrims[i] = primitives[index];
+    }
+    primitives.swap(orderedPrims);
+
+    // Use BVH nodes directly from the mapped file
+    void *nodeData = file->data() + header.nodesOffset;
+    switch (layout) {
+    case 0:
+        nodes = (LinearBVHNode *)nodeData;
+        break;
+    case 1:
+        nodes4 = (WideBVHNode<4> *)nodeData;
+        break;
+    case 2:
+        nodes8 = (WideBVHNode<8> *)nodeData;
+        break;
+    case 3:
+        quantizedNodes2 = (QuantizedBVHNode<2> *)nodeData;
+        break;
+    case 4:
+        quantizedNodes4 = (QuantizedBVHNode<4> *)nodeData;
+        break;
+    case 5:
+        quantizedNodes8 = (QuantizedBVHNode<8> *)nodeData;
+        break;
+    }
+    nNodes = header.nNodes;
+    bounds = header.bounds;
+    builtSAHCost = Float(header.builtSAHCost);
+    treeBytes += sizeof(*this) + primitives.size() * sizeof(primitives[0]) +
+                 size_t(nNodes) * header.nodeSize;
+    bvhNodeBytes += size_t(nNodes) * header.nodeSize;
+    cacheFile = file.release();
+    return true;
+}
+
+void BVHAggregate::writeCache(const std::string &filename, uint64_t key,
+                              const std::vector<Primitive> &inputPrimitives) const {
+    // Find the index of each ordered primitive reference in _inputPrimitives_
+    std::unordered_map<const void *, int32_t> primitiveIndex;
+    for (size_t i = 0; i < inputPrimitives.size(); ++i)
+        primitiveIndex[inputPrimitives[i].ptr()] = i;
+
+    BVHCacheHeader header;
+    header.key = key;
+    header.layout = cacheLayout();
+    header.nodeSize = CacheLayoutNodeSize(header.layout);
+    header.nNodes = nNodes;
+    header.nPrimitives = primitives.size();
+    size_t indicesEnd = sizeof(header) + primitives.size() * sizeof(int32_t);
+    header.nodesOffset = (indicesEnd + 63) & ~size_t(63);
+    header.bounds = bounds;
+    header.builtSAHCost = builtSAHCost;
+
+    std::string buf((const char *)&header, sizeof(header));
+    for (Primitive prim : primitives) {
+        int32_t index = primitiveIndex[prim.ptr()];
+        buf.append((const char *)&index, sizeof(index));
+    }
+    buf.resize(header.nodesOffset, '\0');
+    const void *nodeData[6] = {nodes,           nodes4,          nodes8,
+                               quantizedNodes2, quantizedNodes4, quantizedNodes8};
+    buf.append((const char *)nodeData[header.layout], size_t(nNodes) * header.nodeSize);
+
+    if (!WriteFileContentsAtomic(filename, buf))
+        Warning("%s: unable to write BVH cache file", filename);
+}
+
+void BVHAggregate::Refit() {
+    Timer timer;
+    ++bvhRefits;
+    // Compute updated bounds of all primitives
+    std::vector<Bounds3f> primBounds(primitives.size());
+    ParallelFor(0, primitives.size(),
+                [&](int64_t i) { primBounds[i] = primitives[i].Bounds(); });
+    auto leafBounds = [&](int offset, int nPrimitives) {
+        Bounds3f b;
+        for (int i = 0; i < nPrimitives; ++i)
+            b = Union(b, primBounds[offset + i]);
+        return b;
+    };
+
+    // Update node bounds bottom-up; children are always stored after their parent
+    if (nodes) {
+        for (int i = nNodes - 1; i >= 0; --i) {
+            LinearBVHNode &node = nodes[i];
+            if (node.nPrimitives > 0)
+                node.bounds = leafBounds(node.primitivesOffset, node.nPrimitives);
+            else
+                node.bounds = Union(nodes[i + 1].bounds, nodes[node.secondChildOffset].bounds);
+        }
+        bounds = nodes[0].bounds;
+    } else if (nodes4)
+        bounds = refitWide(nodes4, leafBounds);
+    else if (nodes8)
+        bounds = refitWide(nodes8, leafBounds);
+    else if (quantizedNodes2)
+        bounds = refitWide(quantizedNodes2, leafBounds);
+    else if (quantizedNodes4)
+        bounds = refitWide(quantizedNodes4, leafBounds);
+    else if (quantizedNodes8)
+        bounds = refitWide(quantizedNodes8, leafBounds);
+
+    // Update packed triangle vertices and instance transformations, which
+    // may have changed
+    if (packedTriangles)
+        packTriangleVertices();
+    if (instanceSlots)
+        packInstanceTransforms();
+    bvhRefitMilliseconds << 1000 * timer.ElapsedSeconds();
+}
+
+template <typename Node, typename F>
+Bounds3f BVHAggregate::refitWide(Node *wideNodes, F leafBounds) {
+    std::vector<Bounds3f> nodeBounds(nNodes);
+    for (int i = nNodes - 1; i >= 0; --i) {
+        Node &node = wideNodes[i];
+        Bounds3f childBounds[Node::Width];
+        int nChildren = 0;
+        for (; nChildren < Node::Width && node.offset[nChildren] >= 0; ++nChildren) {
+            int c = nChildren;
+            childBounds[c] = (node.nPrimitives[c] > 0)
+                                 ? leafBounds(node.offset[c], node.nPrimitives[c])
+                                 : nodeBounds[node.offset[c]];
+            nodeBounds[i] = Union(nodeBounds[i], childBounds[c]);
+        }
+        node.SetBounds(childBounds, nChildren);
+    }
+    return nodeBounds[0];
+}
+
+void BVHAggregate::Rebuild() {
+    ++bvhRebuilds;
+    // Remove the current BVH's memory from the statistics; _build()_ adds
+    // the new BVH's
+    size_t nodeBytes = size_t(nNodes) * CacheLayoutNodeSize(cacheLayout());
+    treeBytes -= sizeof(*this) + primitives.size() * sizeof(primitives[0]) + nodeBytes;
+    bvhNodeBytes -= nodeBytes;
+    if (packedTriangles)
+        packedTriangleBytes -= primitives.size() * sizeof(PackedTriangle);
+    if (instanceSlots)
+        packedInstanceBytes -= primitives.size() * sizeof(int32_t) +
+                               nPackedInstances * sizeof(PackedInstance);
+
+    // Free the current BVH's nodes
+    if (cacheFile) {
+        // The nodes are stored in the mapped cache file
+        delete cacheFile;
+        cacheFile = nullptr;
+    } else {
+        delete[] nodes;
+        delete[] nodes4;
+        delete[] nodes8;
+        delete[] quantizedNodes2;
+        delete[] quantizedNodes4;
+        delete[] quantizedNodes8;
+    }
+    delete[] packedTriangles;
+    delete[] instanceSlots;
+    delete[] packedInstances;
+    nodes = nullptr;
+    nodes4 = nullptr;
+    nodes8 = nullptr;
+    quantizedNodes2 = nullptr;
+    quantizedNodes4 = nullptr;
+    quantizedNodes8 = nullptr;
+    packedTriangles = nullptr;
+    instanceSlots = nullptr;
+    packedInstances = nullptr;
+    nPackedInstances = 0;
+
+    if (splitMethod == SplitMethod::SBVH) {
+        // Remove references duplicated by spatial splits
+        std::sort(primitives.begin(), primitives.end());
+        primitives.erase(std::unique(primitives.begin(), primitives.end()),
+                         primitives.end());
+    }
+    build();
+}
+
+bool BVHAggregate::Update(Float maxCostIncrease) {
+    Refit();
+    // Rebuild if refitting degraded the BVH too much
+    if (layoutSAHCost() > maxCostIncrease * builtSAHCost) {
+        Rebuild();
+        return true;
+    }
+    return false;
+}
+
+Float BVHAggregate::layoutSAHCost() const {
+    // Sum surface areas of nodes, weighting leaves by their primitive counts
+    Float cost = 0;
+    if (nodes) {
+        for (int i = 0; i < nNodes; ++i)
+            cost += nodes[i].bounds.SurfaceArea() *
+                    (nodes[i].nPrimitives > 0 ? nodes[i].nPrimitives : Float(0.5));
+    } else if (nodes4)
+        cost = wideSAHCost(nodes4);
+    else if (nodes8)
+        cost = wideSAHCost(nodes8);
+    else if (quantizedNodes2)
+        cost = wideSAHCost(quantizedNodes2);
+    else if (quantizedNodes4)
+        cost = wideSAHCost(quantizedNodes4);
+    else if (quantizedNodes8)
+        cost = wideSAHCost(quantizedNodes8);
+    return bounds.SurfaceArea() > 0 ? cost / bounds.SurfaceArea() : 0;
+}
+
+template <typename Node>
+Float BVHAggregate::wideSAHCost(const Node *wideNodes) const {
+    Float cost = 0;
+    for (int i = 0; i < nNodes; ++i)
+        for (int c = 0; c < Node::Width && wideNodes[i].offset[c] >= 0; ++c)
+            cost += wideNodes[i].ChildBounds(c).SurfaceArea() *
+                    (wideNodes[i].nPrimitives[c] > 0 ? wideNodes[i].nPrimitives[c]
+                                                     : Float(0.5));
+    return cost;
 }
 
 BVHBuildNode *BVHAggregate::buildRecursive(ThreadLocal<Allocator> &threadAllocators,
@@ -289,43 +1241,9 @@ BVHBuildNode *BVHAggregate::buildRecursive(ThreadLocal<Allocator> &threadAllocat
                         buckets[b].bounds = Union(buckets[b].bounds, prim.bounds);
                     }
 
-                    // Compute costs for splitting after each bucket
-                    constexpr int nSplits = nBuckets - 1;
-                    int countBelow[nSplits], countAbove[nSplits];
-                    Bounds3f boundsBelow[nSplits], boundsAbove[nSplits];
-                    // Initialize _countBelow_ and _boundsBelow_ using a forward scan over
-                    // splits
-                    countBelow[0] = buckets[0].count;
-                    boundsBelow[0] = buckets[0].bounds;
-                    for (int i = 1; i < nSplits; ++i) {
-                        countBelow[i] = countBelow[i - 1] + buckets[i].count;
-                        boundsBelow[i] = Union(boundsBelow[i - 1], buckets[i].bounds);
-                    }
-
-                    // Initialize _countAbove_ and _boundsAbove_ using a backwards scan
-                    // over splits
-                    countAbove[nSplits - 1] = buckets[nBuckets - 1].count;
-                    boundsAbove[nSplits - 1] = buckets[nBuckets - 1].bounds;
-                    for (int i = nSplits - 2; i >= 0; --i) {
-                        countAbove[i] = countAbove[i + 1] + buckets[i + 1].count;
-                        boundsAbove[i] = Union(boundsAbove[i + 1], buckets[i + 1].bounds);
-                    }
-
                     // Find bucket to split at that minimizes SAH metric
-                    int minCostSplitBucket = -1;
-                    Float minCost = Infinity;
-                    for (int i = 0; i < nSplits; ++i) {
-                        // Compute cost for candidate split and update minimum if
-                        // necessary
-                        if (countBelow[i] == 0 || countAbove[i] == 0)
-                            continue;
-                        Float cost = (countBelow[i] * boundsBelow[i].SurfaceArea() +
-                                      countAbove[i] * boundsAbove[i].SurfaceArea());
-                        if (cost < minCost) {
-                            minCost = cost;
-                            minCostSplitBucket = i;
-                        }
-                    }
+                    Float minCost;
+                    int minCostSplitBucket = MinCostSAHSplit<nBuckets>(buckets, &minCost);
                     // Compute leaf cost and SAH split cost for chosen split
                     Float leafCost = bvhPrimitives.size();
                     minCost = 1.f / 2.f + minCost / bounds.SurfaceArea();
@@ -507,6 +1425,342 @@ BVHBuildNode *BVHAggregate::emitLBVH(BVHBuildNode *&buildNodes,
     }
 }
 
+BVHBuildNode *BVHAggregate::buildSBVH(ThreadLocal<Allocator> &threadAllocators,
+                                      std::vector<BVHPrimitive> bvhPrimitives,
+                                      Float rootSurfaceArea,
+                                      std::atomic<int64_t> *duplicationBudget,
+                                      std::atomic<int> *totalNodes,
+                                      std::atomic<int> *orderedPrimsOffset,
+                                      std::vector<Primitive> &orderedPrims) {
+    DCHECK_NE(bvhPrimitives.size(), 0);
+    Allocator alloc = threadAllocators.Get();
+    BVHBuildNode *node = alloc.new_object<BVHBuildNode>();
+    ++*totalNodes;
+    // Compute bounds of primitive references and their centroids
+    Bounds3f bounds, centroidBounds;
+    for (const BVHPrimitive &bp : bvhPrimitives) {
+        bounds = Union(bounds, bp.bounds);
+        centroidBounds = Union(centroidBounds, bp.Centroid());
+    }
+    size_t nPrimitives = bvhPrimitives.size();
+
+    // Find the best object split using binned SAH
+    int objectDim = centroidBounds.MaxDimension();
+    constexpr int nBuckets = 12;
+    int objectSplitBucket = -1;
+    Float objectCost = Infinity, overlapArea = 0;
+    auto objectBucket = [&](const BVHPrimitive &bp) {
+        int b = nBuckets * centroidBounds.Offset(bp.Centroid())[objectDim];
+        return std::min(b, nBuckets - 1);
+    };
+    if (centroidBounds.pMax[objectDim] > centroidBounds.pMin[objectDim]) {
+        BVHSplitBucket buckets[nBuckets];
+        for (const BVHPrimitive &bp : bvhPrimitives) {
+            int b = objectBucket(bp);
+            buckets[b].count++;
+            buckets[b].bounds = Union(buckets[b].bounds, bp.bounds);
+        }
+        objectSplitBucket = MinCostSAHSplit<nBuckets>(buckets, &objectCost);
+        if (objectSplitBucket != -1) {
+            // Compute overlap of the object split's children
+            Bounds3f b0, b1;
+            for (int i = 0; i < nBuckets; ++i)
+                if (i <= objectSplitBucket)
+                    b0 = Union(b0, buckets[i].bounds);
+                else
+                    b1 = Union(b1, buckets[i].bounds);
+            Bounds3f overlap = pbrt::Intersect(b0, b1);
+            if (!overlap.IsDegenerate())
+                overlapArea = overlap.SurfaceArea();
+        }
+    }
+
+    // Find the best spatial split if the object split's children overlap
+    constexpr int nSpatialBins = 32;
+    int spatialDim = -1, spatialSplitBin = -1;
+    Float spatialCost = Infinity;
+    auto spatialBin = [&](Float v, int dim) {
+        int b = nSpatialBins * (v - bounds.pMin[dim]) /
+                (bounds.pMax[dim] - bounds.pMin[dim]);
+        return Clamp(b, 0, nSpatialBins - 1);
+    };
+    auto spatialPlane = [&](int b, int dim) {
+        return Lerp(Float(b) / nSpatialBins, bounds.pMin[dim], bounds.pMax[dim]);
+    };
+    if (overlapArea > 1e-5f * rootSurfaceArea && *duplicationBudget > 0 &&
+        nPrimitives > 1) {
+        for (int dim = 0; dim < 3; ++dim) {
+            if (bounds.pMax[dim] == bounds.pMin[dim])
+                continue;
+            // Clip primitive references into spatial bins along _dim_
+            struct SpatialBin {
+                Bounds3f bounds;
+                int entries = 0, exits = 0;
+            };
+            SpatialBin bins[nSpatialBins];
+            for (const BVHPrimitive &bp : bvhPrimitives) {
+                int first = spatialBin(bp.bounds.pMin[dim], dim);
+                int last = spatialBin(bp.bounds.pMax[dim], dim);
+                ++bins[first].entries;
+                ++bins[last].exits;
+                for (int b = first; b <= last; ++b) {
+                    Float lo = (b == first) ? bp.bounds.pMin[dim] : spatialPlane(b, dim);
+                    Float hi =
+                        (b == last) ? bp.bounds.pMax[dim] : spatialPlane(b + 1, dim);
+                    Bounds3f clipped = ClipPrimitiveBounds(
+                        primitives[bp.primitiveIndex], bp.bounds, dim, lo, hi);
+                    if (!clipped.IsDegenerate())
+                        bins[b].bounds = Union(bins[b].bounds, clipped);
+                }
+            }
+
+            // Sweep over spatial bins to find the lowest-cost split plane
+            Bounds3f boundsAbove[nSpatialBins];
+            int countAbove[nSpatialBins];
+            boundsAbove[nSpatialBins - 1] = bins[nSpatialBins - 1].bounds;
+            countAbove[nSpatialBins - 1] = bins[nSpatialBins - 1].exits;
+            for (int b = nSpatialBins - 2; b >= 0; --b) {
+                boundsAbove[b] = Union(boundsAbove[b + 1], bins[b].bounds);
+                countAbove[b] = countAbove[b + 1] + bins[b].exits;
+            }
+            Bounds3f boundsBelow;
+            int countBelow = 0;
+            for (int b = 0; b < nSpatialBins - 1; ++b) {
+                boundsBelow = Union(boundsBelow, bins[b].bounds);
+                countBelow += bins[b].entries;
+                if (countBelow == 0 || countAbove[b + 1] == 0)
+                    continue;
+                Float cost = countBelow * boundsBelow.SurfaceArea() +
+                             countAbove[b + 1] * boundsAbove[b + 1].SurfaceArea();
+                if (cost < spatialCost) {
+                    spatialCost = cost;
+                    spatialDim = dim;
+                    spatialSplitBin = b;
+                }
+            }
+        }
+    }
+
+    // Create leaf if neither split is worthwhile
+    Float leafCost = nPrimitives;
+    Float splitCost = 1.f / 2.f + std::min(objectCost, spatialCost) / bounds.SurfaceArea();
+    if (bounds.SurfaceArea() == 0 || nPrimitives == 1 ||
+        (objectSplitBucket == -1 && spatialSplitBin == -1) ||
+        (nPrimitives <= maxPrimsInNode && leafCost <= splitCost)) {
+        int firstPrimOffset = orderedPrimsOffset->fetch_add(nPrimitives);
+        for (size_t i = 0; i < nPrimitives; ++i) {
+            int index = bvhPrimitives[i].primitiveIndex;
+            orderedPrims[firstPrimOffset + i] = primitives[index];
+        }
+        node->InitLeaf(firstPrimOffset, nPrimitives, bounds);
+        return node;
+    }
+
+    std::vector<BVHPrimitive> childPrimitives[2];
+    int splitDim = objectDim;
+    if (spatialCost < objectCost) {
+        // Partition references at spatial split plane, duplicating straddlers
+        Float plane = spatialPlane(spatialSplitBin + 1, spatialDim);
+        int64_t nStraddling = 0;
+        for (const BVHPrimitive &bp : bvhPrimitives)
+            nStraddling += (spatialBin(bp.bounds.pMin[spatialDim], spatialDim) <=
+                                spatialSplitBin &&
+                            spatialBin(bp.bounds.pMax[spatialDim], spatialDim) >
+                                spatialSplitBin);
+        // Reserve duplicated references from the budget
+        int64_t budget = duplicationBudget->load();
+        while (budget >= nStraddling &&
+               !duplicationBudget->compare_exchange_weak(budget, budget - nStraddling))
+            ;
+        if (budget >= nStraddling) {
+            splitDim = spatialDim;
+            int64_t nDuplicated = 0;
+            for (const BVHPrimitive &bp : bvhPrimitives) {
+                int first = spatialBin(bp.bounds.pMin[spatialDim], spatialDim);
+                int last = spatialBin(bp.bounds.pMax[spatialDim], spatialDim);
+                if (last <= spatialSplitBin)
+                    childPrimitives[0].push_back(bp);
+                else if (first > spatialSplitBin)
+                    childPrimitives[1].push_back(bp);
+                else {
+                    // Clip straddling reference to both sides of the plane
+                    Primitive prim = primitives[bp.primitiveIndex];
+                    Bounds3f b0 = ClipPrimitiveBounds(prim, bp.bounds, spatialDim,
+                                                      bp.bounds.pMin[spatialDim], plane);
+                    Bounds3f b1 = ClipPrimitiveBounds(prim, bp.bounds, spatialDim, plane,
+                                                      bp.bounds.pMax[spatialDim]);
+                    if (!b0.IsDegenerate())
+                        childPrimitives[0].push_back(BVHPrimitive(bp.primitiveIndex, b0));
+                    if (!b1.IsDegenerate())
+                        childPrimitives[1].push_back(BVHPrimitive(bp.primitiveIndex, b1));
+                    nDuplicated += !b0.IsDegenerate() && !b1.IsDegenerate();
+                }
+            }
+            // Fall back to the object split if clipping emptied a side
+            if (childPrimitives[0].empty() || childPrimitives[1].empty()) {
+                splitDim = objectDim;
+                childPrimitives[0].clear();
+                childPrimitives[1].clear();
+                nDuplicated = 0;
+            } else {
+                ++sbvhSpatialSplits;
+                sbvhDuplicatedReferences += nDuplicated;
+            }
+            // Return the reserved references that weren't duplicated
+            if (nDuplicated < nStraddling)
+                *duplicationBudget += nStraddling - nDuplicated;
+        }
+    }
+    if (childPrimitives[0].empty() && childPrimitives[1].empty()) {
+        if (objectSplitBucket == -1) {
+            // Create leaf if the object split isn't possible either
+            int firstPrimOffset = orderedPrimsOffset->fetch_add(nPrimitives);
+            for (size_t i = 0; i < nPrimitives; ++i) {
+                int index = bvhPrimitives[i].primitiveIndex;
+                orderedPrims[firstPrimOffset + i] = primitives[index];
+            }
+            node->InitLeaf(firstPrimOffset, nPrimitives, bounds);
+            return node;
+        }
+        // Partition references at the selected object split bucket
+        for (const BVHPrimitive &bp : bvhPrimitives)
+            childPrimitives[objectBucket(bp) <= objectSplitBucket ? 0 : 1].push_back(bp);
+    }
+    bvhPrimitives = std::vector<BVHPrimitive>();
+
+    // Recursively build child BVHs, in parallel for large nodes
+    BVHBuildNode *children[2];
+    auto buildChild = [&](int i) {
+        children[i] = buildSBVH(threadAllocators, std::move(childPrimitives[i]),
+                                rootSurfaceArea, duplicationBudget, totalNodes,
+                                orderedPrimsOffset, orderedPrims);
+    };
+    if (nPrimitives > 128 * 1024)
+        ParallelFor(0, 2, [&](int64_t i) { buildChild(i); });
+    else {
+        buildChild(0);
+        buildChild(1);
+    }
+    node->InitInterior(splitDim, children[0], children[1]);
+    return node;
+}
+
+BVHBuildNode *BVHAggregate::buildParallelSAH(ThreadLocal<Allocator> &threadAllocators,
+                                             pstd::span<BVHPrimitive> bvhPrimitives,
+                                             std::atomic<int> *totalNodes,
+                                             std::atomic<int> *orderedPrimsOffset,
+                                             std::vector<Primitive> &orderedPrims) {
+    // Use the serial builder for subtrees that are too small to parallelize
+    if (bvhPrimitives.size() < 64 * 1024)
+        return buildRecursive(threadAllocators, bvhPrimitives, totalNodes,
+                              orderedPrimsOffset, orderedPrims);
+
+    // Compute bounds of primitives and their centroids in parallel
+    constexpr int64_t chunkSize = 16 * 1024;
+    int64_t nChunks = (bvhPrimitives.size() + chunkSize - 1) / chunkSize;
+    auto chunkStart = [&](int64_t c) { return c * chunkSize; };
+    auto chunkEnd = [&](int64_t c) {
+        return std::min<int64_t>((c + 1) * chunkSize, bvhPrimitives.size());
+    };
+    std::vector<Bounds3f> chunkBounds(nChunks), chunkCentroidBounds(nChunks);
+    ParallelFor(0, nChunks, [&](int64_t c) {
+        for (int64_t i = chunkStart(c); i < chunkEnd(c); ++i) {
+            chunkBounds[c] = Union(chunkBounds[c], bvhPrimitives[i].bounds);
+            chunkCentroidBounds[c] =
+                Union(chunkCentroidBounds[c], bvhPrimitives[i].Centroid());
+        }
+    });
+    Bounds3f bounds, centroidBounds;
+    for (int64_t c = 0; c < nChunks; ++c) {
+        bounds = Union(bounds, chunkBounds[c]);
+        centroidBounds = Union(centroidBounds, chunkCentroidBounds[c]);
+    }
+    int dim = centroidBounds.MaxDimension();
+    // Let the serial builder handle nodes that must become leaves
+    if (bounds.SurfaceArea() == 0 ||
+        centroidBounds.pMax[dim] == centroidBounds.pMin[dim])
+        return buildRecursive(threadAllocators, bvhPrimitives, totalNodes,
+                              orderedPrimsOffset, orderedPrims);
+
+    // Bin primitive centroids into SAH buckets in parallel
+    constexpr int nBuckets = 32;
+    auto bucketIndex = [&](const BVHPrimitive &bp) {
+        int b = nBuckets * centroidBounds.Offset(bp.Centroid())[dim];
+        return std::min(b, nBuckets - 1);
+    };
+    std::vector<pstd::array<BVHSplitBucket, nBuckets>> chunkBuckets(nChunks);
+    ParallelFor(0, nChunks, [&](int64_t c) {
+        for (int64_t i = chunkStart(c); i < chunkEnd(c); ++i) {
+            BVHSplitBucket &bucket = chunkBuckets[c][bucketIndex(bvhPrimitives[i])];
+            bucket.count++;
+            bucket.bounds = Union(bucket.bounds, bvhPrimitives[i].bounds);
+        }
+    });
+    BVHSplitBucket buckets[nBuckets];
+    for (int64_t c = 0; c < nChunks; ++c)
+        for (int b = 0; b < nBuckets; ++b) {
+            buckets[b].count += chunkBuckets[c][b].count;
+            buckets[b].bounds = Union(buckets[b].bounds, chunkBuckets[c][b].bounds);
+        }
+
+    Float minCost;
+    int minCostSplitBucket = MinCostSAHSplit<nBuckets>(buckets, &minCost);
+    if (minCostSplitBucket == -1)
+        return buildRecursive(threadAllocators, bvhPrimitives, totalNodes,
+                              orderedPrimsOffset, orderedPrims);
+
+    // Partition primitives at the selected bucket in parallel
+    std::vector<int64_t> chunkBelowStart(nChunks), chunkAboveStart(nChunks);
+    ParallelFor(0, nChunks, [&](int64_t c) {
+        int64_t nBelow = 0;
+        for (int64_t i = chunkStart(c); i < chunkEnd(c); ++i)
+            nBelow += (bucketIndex(bvhPrimitives[i]) <= minCostSplitBucket);
+        chunkBelowStart[c] = nBelow;
+        chunkAboveStart[c] = chunkEnd(c) - chunkStart(c) - nBelow;
+    });
+    // Compute each chunk's starting offsets with an exclusive prefix sum
+    int64_t mid = 0;
+    for (int64_t c = 0; c < nChunks; ++c) {
+        int64_t nBelow = chunkBelowStart[c];
+        chunkBelowStart[c] = mid;
+        mid += nBelow;
+    }
+    int64_t aboveOffset = mid;
+    for (int64_t c = 0; c < nChunks; ++c) {
+        int64_t nAbove = chunkAboveStart[c];
+        chunkAboveStart[c] = aboveOffset;
+        aboveOffset += nAbove;
+    }
+    std::vector<BVHPrimitive> partitioned(bvhPrimitives.size());
+    ParallelFor(0, nChunks, [&](int64_t c) {
+        int64_t below = chunkBelowStart[c], above = chunkAboveStart[c];
+        for (int64_t i = chunkStart(c); i < chunkEnd(c); ++i) {
+            if (bucketIndex(bvhPrimitives[i]) <= minCostSplitBucket)
+                partitioned[below++] = bvhPrimitives[i];
+            else
+                partitioned[above++] = bvhPrimitives[i];
+        }
+    });
+    ParallelFor(0, nChunks, [&](int64_t c) {
+        std::copy(partitioned.begin() + chunkStart(c), partitioned.begin() + chunkEnd(c),
+                  bvhPrimitives.begin() + chunkStart(c));
+    });
+    partitioned = std::vector<BVHPrimitive>();
+
+    // Build children as parallel tasks
+    BVHBuildNode *node = threadAllocators.Get().new_object<BVHBuildNode>();
+    ++*totalNodes;
+    Future<BVHBuildNode *> child1 = RunAsync([&]() {
+        return buildParallelSAH(threadAllocators, bvhPrimitives.subspan(mid), totalNodes,
+                                orderedPrimsOffset, orderedPrims);
+    });
+    BVHBuildNode *child0 =
+        buildParallelSAH(threadAllocators, bvhPrimitives.subspan(0, mid), totalNodes,
+                         orderedPrimsOffset, orderedPrims);
+    node->InitInterior(dim, child0, child1.Get());
+    return node;
+}
+
 int BVHAggregate::flattenBVH(BVHBuildNode *node, int *offset) {
     LinearBVHNode *linearNode = &nodes[*offset];
     linearNode->bounds = node->bounds;
@@ -526,16 +1780,235 @@ int BVHAggregate::flattenBVH(BVHBuildNode *node, int *offset) {
     return nodeOffset;
 }
 
+template <typename Node>
+Node *BVHAggregate::createWideBVH(BVHBuildNode *root) {
+    std::vector<Node> wideNodes;
+    collapseBVH(root, wideNodes);
+    LOG_VERBOSE("%d-wide BVH created with %d nodes for %d primitives (%.2f MB)",
+                Node::Width, (int)wideNodes.size(), (int)primitives.size(),
+                float(wideNodes.size() * sizeof(Node)) / (1024.f * 1024.f));
+    treeBytes += wideNodes.size() * sizeof(Node);
+    bvhNodeBytes += wideNodes.size() * sizeof(Node);
+    if (std::is_same_v<Node, WideBVHNode<Node::Width>>)
+        wideBVHNodes += wideNodes.size();
+    else
+        quantizedBVHNodes += wideNodes.size();
+
+    nNodes = wideNodes.size();
+    Node *n = new Node[wideNodes.size()];
+    std::copy(wideNodes.begin(), wideNodes.end(), n);
+    return n;
+}
+
+template <typename Node>
+int BVHAggregate::collapseBVH(BVHBuildNode *node, std::vector<Node> &wideNodes) {
+    constexpr int N = Node::Width;
+    // Gather up to _N_ children by repeatedly opening the largest interior child
+    BVHBuildNode *children[N];
+    int nChildren = 0;
+    if (node->nPrimitives > 0)
+        // Only happens if the entire BVH is a single leaf
+        children[nChildren++] = node;
+    else {
+        children[nChildren++] = node->children[0];
+        children[nChildren++] = node->children[1];
+    }
+    while (nChildren < N) {
+        int largest = -1;
+        Float largestArea = -1;
+        for (int i = 0; i < nChildren; ++i)
+            if (children[i]->nPrimitives == 0 &&
+                children[i]->bounds.SurfaceArea() > largestArea) {
+                largest = i;
+                largestArea = children[i]->bounds.SurfaceArea();
+            }
+        if (largest == -1)
+            break;
+        BVHBuildNode *opened = children[largest];
+        children[largest] = opened->children[0];
+        children[nChildren++] = opened->children[1];
+    }
+
+    // Create wide BVH node and recursively collapse interior children
+    int nodeIndex = wideNodes.size();
+    wideNodes.push_back(Node());
+    Bounds3f childBounds[N];
+    for (int i = 0; i < nChildren; ++i)
+        childBounds[i] = children[i]->bounds;
+    wideNodes[nodeIndex].SetBounds(childBounds, nChildren);
+    for (int i = 0; i < nChildren; ++i) {
+        if (children[i]->nPrimitives > 0) {
+            CHECK_LT(children[i]->nPrimitives, 65536);
+            wideNodes[nodeIndex].offset[i] = children[i]->firstPrimOffset;
+            wideNodes[nodeIndex].nPrimitives[i] = children[i]->nPrimitives;
+        } else {
+            // Note: _wideNodes_ may be reallocated by the recursive call
+            int childIndex = collapseBVH(children[i], wideNodes);
+            wideNodes[nodeIndex].offset[i] = childIndex;
+        }
+    }
+    return nodeIndex;
+}
+
 Bounds3f BVHAggregate::Bounds() const {
-    CHECK(nodes);
-    return nodes[0].bounds;
+    return bounds;
+}
+
+inline void BVHAggregate::intersectPrimitive(int index, const Ray &ray, Float *tMax,
+                                             BVHClosestHit *hit) const {
+    if (packedTriangles && packedTriangles[index].valid) {
+        // Intersect ray with packed triangle vertices
+        const PackedTriangle &tri = packedTriangles[index];
+        if (pstd::optional<TriangleIntersection> ti =
+                IntersectTriangle(ray, *tMax, tri.p[0], tri.p[1], tri.p[2]))
+            hit->RecordTriangleHit(primitives[index], *ti, tMax);
+    } else if (instanceSlots && instanceSlots[index] >= 0) {
+        // Intersect ray with packed instance, deferring transforming the hit
+        const PackedInstance &inst = packedInstances[instanceSlots[index]];
+        if (!(inst.visibility & VisibleToRays))
+            return;
+        Float instanceTMax = *tMax;
+        Ray instanceRay = inst.ApplyInverse(ray, &instanceTMax);
+        if (pstd::optional<ShapeIntersection> si =
+                inst.primitive.Intersect(instanceRay, instanceTMax))
+            hit->RecordInstanceHit(inst.instance, *si, tMax);
+    } else
+        hit->Intersect(primitives[index], ray, tMax);
+}
+
+inline bool BVHAggregate::intersectPPrimitive(int index, const Ray &ray,
+                                              Float tMax) const {
+    if (packedTriangles && packedTriangles[index].valid) {
+        const PackedTriangle &tri = packedTriangles[index];
+        return IntersectTriangle(ray, tMax, tri.p[0], tri.p[1], tri.p[2]).has_value();
+    }
+    if (instanceSlots && instanceSlots[index] >= 0) {
+        const PackedInstance &inst = packedInstances[instanceSlots[index]];
+        if (!(inst.visibility & CastsShadows))
+            return false;
+        Ray instanceRay = inst.ApplyInverse(ray, &tMax);
+        return inst.primitive.IntersectP(instanceRay, tMax);
+    }
+    return primitives[index].IntersectP(ray, tMax);
+}
+
+template <typename Node>
+pstd::optional<ShapeIntersection> BVHAggregate::intersectWide(const Node *wideNodes,
+                                                              const Ray &ray,
+                                                              Float tMax) const {
+    constexpr int N = Node::Width;
+    BVHClosestHit hit;
+    // Set up ray for _N_-wide slab tests
+    Vector3f invDir(1 / ray.d.x, 1 / ray.d.y, 1 / ray.d.z);
+    int dirIsNeg[3] = {int(invDir.x < 0), int(invDir.y < 0), int(invDir.z < 0)};
+    SIMDFloat<N> o[3] = {SIMDFloat<N>(ray.o.x), SIMDFloat<N>(ray.o.y),
+                         SIMDFloat<N>(ray.o.z)};
+    SIMDFloat<N> invD[3] = {SIMDFloat<N>(invDir.x), SIMDFloat<N>(invDir.y),
+                            SIMDFloat<N>(invDir.z)};
+
+    // Follow ray through wide BVH nodes to find primitive intersections
+    WideBVHNodeToVisit nodesToVisit[64 * (N - 1) + 1];
+    int toVisitOffset = 0;
+    nodesToVisit[toVisitOffset++] = {0, 0, 0.f};
+    int nodesVisited = 0;
+    while (toVisitOffset > 0) {
+        WideBVHNodeToVisit toVisit = nodesToVisit[--toVisitOffset];
+        // Skip nodes that are beyond the closest intersection found so far
+        if (toVisit.tEntry > tMax)
+            continue;
+
+        if (toVisit.nPrimitives > 0) {
+            // Intersect ray with primitives in leaf
+            for (int i = 0; i < toVisit.nPrimitives; ++i)
+                intersectPrimitive(toVisit.offset + i, ray, &tMax, &hit);
+            continue;
+        }
+
+        // Check ray against all children of wide BVH node
+        ++nodesVisited;
+        const Node &node = wideNodes[toVisit.offset];
+        float tEntry[N];
+        uint32_t hitMask = node.Intersect(o, invD, dirIsNeg, tMax, tEntry);
+        if (!hitMask)
+            continue;
+
+        // Push intersected children so that the closest is visited next
+        int firstPushed = toVisitOffset;
+        for (int i = 0; i < N; ++i) {
+            if (!(hitMask & (1u << i)))
+                continue;
+            WideBVHNodeToVisit child{node.offset[i], node.nPrimitives[i], tEntry[i]};
+            // Insertion sort so entries are in decreasing order of _tEntry_
+            int j = toVisitOffset++;
+            while (j > firstPushed && nodesToVisit[j - 1].tEntry < child.tEntry) {
+                nodesToVisit[j] = nodesToVisit[j - 1];
+                --j;
+            }
+            nodesToVisit[j] = child;
+        }
+    }
+
+    bvhNodesVisited += nodesVisited;
+    return hit.Interaction(ray);
+}
+
+template <typename Node>
+bool BVHAggregate::intersectPWide(const Node *wideNodes, const Ray &ray,
+                                  Float tMax) const {
+    constexpr int N = Node::Width;
+    // Set up ray for _N_-wide slab tests
+    Vector3f invDir(1 / ray.d.x, 1 / ray.d.y, 1 / ray.d.z);
+    int dirIsNeg[3] = {int(invDir.x < 0), int(invDir.y < 0), int(invDir.z < 0)};
+    SIMDFloat<N> o[3] = {SIMDFloat<N>(ray.o.x), SIMDFloat<N>(ray.o.y),
+                         SIMDFloat<N>(ray.o.z)};
+    SIMDFloat<N> invD[3] = {SIMDFloat<N>(invDir.x), SIMDFloat<N>(invDir.y),
+                            SIMDFloat<N>(invDir.z)};
+
+    int nodesToVisit[64 * (N - 1) + 1];
+    int toVisitOffset = 0, currentNodeIndex = 0;
+    int nodesVisited = 0;
+    while (true) {
+        ++nodesVisited;
+        const Node &node = wideNodes[currentNodeIndex];
+        float tEntry[N];
+        uint32_t hitMask = node.Intersect(o, invD, dirIsNeg, tMax, tEntry);
+
+        // Test leaf children immediately and queue interior ones
+        for (int i = 0; i < N; ++i) {
+            if (!(hitMask & (1u << i)))
+                continue;
+            if (node.nPrimitives[i] > 0) {
+                for (int j = 0; j < node.nPrimitives[i]; ++j)
+                    if (intersectPPrimitive(node.offset[i] + j, ray, tMax)) {
+                        bvhNodesVisited += nodesVisited;
+                        return true;
+                    }
+            } else
+                nodesToVisit[toVisitOffset++] = node.offset[i];
+        }
+        if (toVisitOffset == 0)
+            break;
+        currentNodeIndex = nodesToVisit[--toVisitOffset];
+    }
+    bvhNodesVisited += nodesVisited;
+    return false;
 }
 
 pstd::optional<ShapeIntersection> BVHAggregate::Intersect(const Ray &ray,
                                                           Float tMax) const {
+    if (nodes4)
+        return intersectWide(nodes4, ray, tMax);
+    if (nodes8)
+        return intersectWide(nodes8, ray, tMax);
+    if (quantizedNodes2)
+        return intersectWide(quantizedNodes2, ray, tMax);
+    if (quantizedNodes4)
+        return intersectWide(quantizedNodes4, ray, tMax);
+    if (quantizedNodes8)
+        return intersectWide(quantizedNodes8, ray, tMax);
     if (!nodes)
         return {};
-    pstd::optional<ShapeIntersection> si;
+    BVHClosestHit hit;
     Vector3f invDir(1 / ray.d.x, 1 / ray.d.y, 1 / ray.d.z);
     int dirIsNeg[3] = {int(invDir.x < 0), int(invDir.y < 0), int(invDir.z < 0)};
     // Follow ray through BVH nodes to find primitive intersections
@@ -549,15 +2022,8 @@ pstd::optional<ShapeIntersection> BVHAggregate::Intersect(const Ray &ray,
         if (node->bounds.IntersectP(ray.o, ray.d, tMax, invDir, dirIsNeg)) {
             if (node->nPrimitives > 0) {
                 // Intersect ray with primitives in leaf BVH node
-                for (int i = 0; i < node->nPrimitives; ++i) {
-                    // Check for intersection with primitive in BVH node
-                    pstd::optional<ShapeIntersection> primSi =
-                        primitives[node->primitivesOffset + i].Intersect(ray, tMax);
-                    if (primSi) {
-                        si = primSi;
-                        tMax = si->tHit;
-                    }
-                }
+                for (int i = 0; i < node->nPrimitives; ++i)
+                    intersectPrimitive(node->primitivesOffset + i, ray, &tMax, &hit);
                 if (toVisitOffset == 0)
                     break;
                 currentNodeIndex = nodesToVisit[--toVisitOffset];
@@ -580,10 +2046,20 @@ pstd::optional<ShapeIntersection> BVHAggregate::Intersect(const Ray &ray,
     }
 
     bvhNodesVisited += nodesVisited;
-    return si;
+    return hit.Interaction(ray);
 }
 
 bool BVHAggregate::IntersectP(const Ray &ray, Float tMax) const {
+    if (nodes4)
+        return intersectPWide(nodes4, ray, tMax);
+    if (nodes8)
+        return intersectPWide(nodes8, ray, tMax);
+    if (quantizedNodes2)
+        return intersectPWide(quantizedNodes2, ray, tMax);
+    if (quantizedNodes4)
+        return intersectPWide(quantizedNodes4, ray, tMax);
+    if (quantizedNodes8)
+        return intersectPWide(quantizedNodes8, ray, tMax);
     if (!nodes)
         return false;
     Vector3f invDir(1.f / ray.d.x, 1.f / ray.d.y, 1.f / ray.d.z);
@@ -600,7 +2076,7 @@ bool BVHAggregate::IntersectP(const Ray &ray, Float tMax) const {
             // Process BVH node _node_ for traversal
             if (node->nPrimitives > 0) {
                 for (int i = 0; i < node->nPrimitives; ++i) {
-                    if (primitives[node->primitivesOffset + i].IntersectP(ray, tMax)) {
+                    if (intersectPPrimitive(node->primitivesOffset + i, ray, tMax)) {
                         bvhNodesVisited += nodesVisited;
                         return true;
                     }
@@ -628,6 +2104,130 @@ bool BVHAggregate::IntersectP(const Ray &ray, Float tMax) const {
     return false;
 }
 
+template <typename F>
+void BVHAggregate::traversePacket(BVHRayPacket &packet, F processLeaf) const {
+    // Follow the packet through BVH nodes, tracking the first active ray
+    struct PacketNodeToVisit {
+        int nodeIndex, firstRay;
+    };
+    PacketNodeToVisit nodesToVisit[64];
+    int toVisitOffset = 0, currentNodeIndex = 0, firstRay = 0;
+    int nodesVisited = 0;
+    while (true) {
+        ++nodesVisited;
+        const LinearBVHNode *node = &nodes[currentNodeIndex];
+        // Find the first ray in the packet that intersects _node_'s bounds;
+        // rays before it can also skip all of the node's children
+        int first = packet.FirstHit(node->bounds, firstRay);
+        if (first < packet.nRays) {
+            if (node->nPrimitives > 0) {
+                // Process leaf for the packet and stop if all rays are done
+                if (processLeaf(node, first))
+                    break;
+            } else {
+                // Visit near child next using the packet's common direction signs
+                if (packet.dirIsNeg[node->axis]) {
+                    nodesToVisit[toVisitOffset++] = {currentNodeIndex + 1, first};
+                    currentNodeIndex = node->secondChildOffset;
+                } else {
+                    nodesToVisit[toVisitOffset++] = {node->secondChildOffset, first};
+                    currentNodeIndex = currentNodeIndex + 1;
+                }
+                firstRay = first;
+                continue;
+            }
+        }
+        if (toVisitOffset == 0)
+            break;
+        --toVisitOffset;
+        currentNodeIndex = nodesToVisit[toVisitOffset].nodeIndex;
+        firstRay = nodesToVisit[toVisitOffset].firstRay;
+    }
+    bvhNodesVisited += nodesVisited;
+}
+
+void BVHAggregate::IntersectN(pstd::span<const Ray> rays, pstd::span<const Float> tMax,
+                              pstd::span<pstd::optional<ShapeIntersection>> si) const {
+    CHECK_EQ(rays.size(), tMax.size());
+    CHECK_EQ(rays.size(), si.size());
+    for (size_t start = 0; start < rays.size(); start += BVHRayPacketSize) {
+        size_t n = std::min<size_t>(BVHRayPacketSize, rays.size() - start);
+        BVHRayPacket packet(rays.subspan(start, n), tMax.subspan(start, n));
+        // Trace rays individually for wide BVHs and incoherent packets
+        if (nodes)
+            ++totalRayPackets;
+        if (!nodes || !packet.coherent) {
+            for (size_t i = start; i < start + n; ++i)
+                si[i] = Intersect(rays[i], tMax[i]);
+            continue;
+        }
+        ++coherentRayPackets;
+
+        BVHClosestHit hits[BVHRayPacketSize];
+        traversePacket(packet, [&](const LinearBVHNode *node, int first) {
+            bool foundHit = false;
+            for (int r = first; r < packet.nRays; ++r) {
+                // Skip rays that miss the leaf's bounds
+                if (r > first && !packet.RayIntersects(node->bounds, r))
+                    continue;
+                Float rayTMax = packet.tMax[r];
+                for (int i = 0; i < node->nPrimitives; ++i)
+                    intersectPrimitive(node->primitivesOffset + i, packet.rays[r],
+                                       &packet.tMax[r], &hits[r]);
+                foundHit |= (packet.tMax[r] != rayTMax);
+            }
+            if (foundHit)
+                packet.UpdateMaxT();
+            return false;
+        });
+        for (size_t i = 0; i < n; ++i)
+            si[start + i] = hits[i].Interaction(rays[start + i]);
+    }
+}
+
+void BVHAggregate::IntersectPN(pstd::span<const Ray> rays, pstd::span<const Float> tMax,
+                               pstd::span<bool> hit) const {
+    CHECK_EQ(rays.size(), tMax.size());
+    CHECK_EQ(rays.size(), hit.size());
+    for (size_t start = 0; start < rays.size(); start += BVHRayPacketSize) {
+        size_t n = std::min<size_t>(BVHRayPacketSize, rays.size() - start);
+        BVHRayPacket packet(rays.subspan(start, n), tMax.subspan(start, n));
+        // Trace rays individually for wide BVHs and incoherent packets
+        if (nodes)
+            ++totalRayPackets;
+        if (!nodes || !packet.coherent) {
+            for (size_t i = start; i < start + n; ++i)
+                hit[i] = IntersectP(rays[i], tMax[i]);
+            continue;
+        }
+        ++coherentRayPackets;
+
+        bool *packetHit = &hit[start];
+        for (size_t i = 0; i < n; ++i)
+            packetHit[i] = false;
+        traversePacket(packet, [&](const LinearBVHNode *node, int first) {
+            bool foundHit = false;
+            for (int r = first; r < packet.nRays; ++r) {
+                if (r > first && !packet.RayIntersects(node->bounds, r))
+                    continue;
+                for (int i = 0; i < node->nPrimitives; ++i)
+                    if (intersectPPrimitive(node->primitivesOffset + i, packet.rays[r],
+                                            packet.tMax[r])) {
+                        // Deactivate occluded ray so that it misses all bounds
+                        packetHit[r] = true;
+                        packet.tMax[r] = -Infinity;
+                        foundHit = true;
+                        break;
+                    }
+            }
+            if (!foundHit)
+                return false;
+            packet.UpdateMaxT();
+            return packet.maxT == -Infinity;
+        });
+    }
+}
+
 BVHBuildNode *BVHAggregate::buildUpperSAH(Allocator alloc,
                                           std::vector<BVHBuildNode *> &treeletRoots,
                                           int start, int end,
@@ -739,13 +2339,51 @@ BVHAggregate *BVHAggregate::Create(std::vector<Primitive> prims,
         splitMethod = BVHAggregate::SplitMethod::Middle;
     else if (splitMethodName == "equal")
         splitMethod = BVHAggregate::SplitMethod::EqualCounts;
+    else if (splitMethodName == "parallelsah")
+        splitMethod = BVHAggregate::SplitMethod::ParallelSAH;
+    else if (splitMethodName == "sbvh")
+        splitMethod = BVHAggregate::SplitMethod::SBVH;
     else {
         Warning(R"(BVH split method "%s" unknown.  Using "sah".)", splitMethodName);
         splitMethod = BVHAggregate::SplitMethod::SAH;
     }
 
     int maxPrimsInNode = parameters.GetOneInt("maxnodeprims", 4);
-    return new BVHAggregate(std::move(prims), maxPrimsInNode, splitMethod);
+    int width = parameters.GetOneInt("width", 2);
+    if (width != 2 && width != 4 && width != 8) {
+        Warning("BVH width %d not supported; must be 2, 4, or 8. Using 2.", width);
+        width = 2;
+    }
+#ifdef PBRT_FLOAT_AS_DOUBLE
+    if (width != 2) {
+        // Wide nodes store single-precision bounds for SIMD traversal.
+        Warning("Wide BVHs not supported with double-precision Float. Using width 2.");
+        width = 2;
+    }
+#endif
+    bool packTriangles = parameters.GetOneBool("packtriangles", false);
+    // Maximum number of additional primitive references that spatial splits
+    // may create, as a fraction of the number of primitives
+    Float maxDuplication = parameters.GetOneFloat("maxduplication", 0.3f);
+    if (maxDuplication < 0) {
+        Warning("BVH \"maxduplication\" must be non-negative. Using 0.");
+        maxDuplication = 0;
+    }
+    // Quantized nodes store child bounds with 8 bits per coordinate,
+    // trading some traversal precision for a smaller BVH
+    bool quantizeNodes = parameters.GetOneBool("quantizenodes", false);
+#ifdef PBRT_FLOAT_AS_DOUBLE
+    if (quantizeNodes) {
+        Warning("Quantized BVH nodes not supported with double-precision Float.");
+        quantizeNodes = false;
+    }
+#endif
+    // Store affine instance transformations compactly in the BVH so that
+    // rays are transformed to instances' spaces using SIMD arithmetic
+    bool packInstances = parameters.GetOneBool("packinstances", true);
+    return new BVHAggregate(std::move(prims), maxPrimsInNode, splitMethod, width,
+                            packTriangles, maxDuplication, quantizeNodes,
+                            packInstances);
 }
 
 // KdNodeToVisit Definition
@@ -23,16 +23,27 @@ struct BVHBuildNode;
 struct BVHPrimitive;
 struct LinearBVHNode;
 struct MortonPrimitive;
+struct BVHRayPacket;
+struct BVHClosestHit;
+struct PackedTriangle;
+struct PackedInstance;
+class MappedFile;
+template <int N>
+struct WideBVHNode;
+template <int N>
+struct QuantizedBVHNode;
 
 // BVHAggregate Definition
 class BVHAggregate {
   public:
     // BVHAggregate Public Types
-    enum class SplitMethod { SAH, HLBVH, Middle, EqualCounts };
+    enum class SplitMethod { SAH, HLBVH, Middle, EqualCounts, ParallelSAH, SBVH };
 
     // BVHAggregate Public Methods
     BVHAggregate(std::vector<Primitive> p, int maxPrimsInNode = 1,
-                 SplitMethod splitMethod = SplitMethod::SAH);
+                 SplitMethod splitMethod = SplitMethod::SAH, int width = 2,
+                 bool packTriangles = false, Float maxDuplication = 0.3f,
+                 bool quantizeNodes = false, bool packInstances = true);
 
     static BVHAggregate *Create(std::vector<Primitive> prims,
                                 const ParameterDictionary &parameters);
@@ -41,13 +52,56 @@ class BVHAggregate {
     pstd::optional<ShapeIntersection> Intersect(const Ray &ray, Float tMax) const;
     bool IntersectP(const Ray &ray, Float tMax) const;
 
+    // Batched intersection: rays are traced in small packets that share a
+    // traversal of the BVH. Results match calling _Intersect()_ and
+    // _IntersectP()_ for each ray individually.
+    void IntersectN(pstd::span<const Ray> rays, pstd::span<const Float> tMax,
+                    pstd::span<pstd::optional<ShapeIntersection>> si) const;
+    void IntersectPN(pstd::span<const Ray> rays, pstd::span<const Float> tMax,
+                     pstd::span<bool> hit) const;
+
+    // Updating the BVH after primitives move: _Refit()_ recomputes node
+    // bounds from the primitives' current bounds, keeping the tree's
+    // topology, and _Rebuild()_ builds a new BVH using the original
+    // construction parameters. _Update()_ refits and then rebuilds if the
+    // refit BVH's SAH cost grew by more than a factor of _maxCostIncrease_
+    // relative to when it was built; it returns true if it rebuilt.
+    void Refit();
+    void Rebuild();
+    bool Update(Float maxCostIncrease = 1.5f);
+
   private:
     // BVHAggregate Private Methods
+    void build();
+    void packTriangleVertices();
+    void packInstanceTransforms();
+    uint64_t computeCacheKey(const std::vector<BVHPrimitive> &bvhPrimitives) const;
+    int cacheLayout() const;
+    bool readCache(const std::string &filename, uint64_t key);
+    void writeCache(const std::string &filename, uint64_t key,
+                    const std::vector<Primitive> &inputPrimitives) const;
+    template <typename Node, typename F>
+    Bounds3f refitWide(Node *wideNodes, F leafBounds);
+    Float layoutSAHCost() const;
+    template <typename Node>
+    Float wideSAHCost(const Node *wideNodes) const;
     BVHBuildNode *buildRecursive(ThreadLocal<Allocator> &threadAllocators,
                                  pstd::span<BVHPrimitive> bvhPrimitives,
                                  std::atomic<int> *totalNodes,
                                  std::atomic<int> *orderedPrimsOffset,
                                  std::vector<Primitive> &orderedPrims);
+    BVHBuildNode *buildSBVH(ThreadLocal<Allocator> &threadAllocators,
+                            std::vector<BVHPrimitive> bvhPrimitives,
+                            Float rootSurfaceArea,
+                            std::atomic<int64_t> *duplicationBudget,
+                            std::atomic<int> *totalNodes,
+                            std::atomic<int> *orderedPrimsOffset,
+                            std::vector<Primitive> &orderedPrims);
+    BVHBuildNode *buildParallelSAH(ThreadLocal<Allocator> &threadAllocators,
+                                   pstd::span<BVHPrimitive> bvhPrimitives,
+                                   std::atomic<int> *totalNodes,
+                                   std::atomic<int> *orderedPrimsOffset,
+                                   std::vector<Primitive> &orderedPrims);
     BVHBuildNode *buildHLBVH(Allocator alloc,
                              const std::vector<BVHPrimitive> &primitiveInfo,
                              std::atomic<int> *totalNodes,
@@ -61,12 +115,47 @@ class BVHAggregate {
                                 std::vector<BVHBuildNode *> &treeletRoots, int start,
                                 int end, std::atomic<int> *totalNodes) const;
     int flattenBVH(BVHBuildNode *node, int *offset);
+    template <typename Node>
+    Node *createWideBVH(BVHBuildNode *root);
+    template <typename Node>
+    int collapseBVH(BVHBuildNode *node, std::vector<Node> &wideNodes);
+    template <typename Node>
+    pstd::optional<ShapeIntersection> intersectWide(const Node *wideNodes,
+                                                    const Ray &ray, Float tMax) const;
+    template <typename Node>
+    bool intersectPWide(const Node *wideNodes, const Ray &ray, Float tMax) const;
+    template <typename F>
+    void traversePacket(BVHRayPacket &packet, F processLeaf) const;
+    void intersectPrimitive(int index, const Ray &ray, Float *tMax,
+                            BVHClosestHit *hit) const;
+    bool intersectPPrimitive(int index, const Ray &ray, Float tMax) const;
 
     // BVHAggregate Private Members
     int maxPrimsInNode;
     std::vector<Primitive> primitives;
     SplitMethod splitMethod;
+    int width;
+    bool packTriangles;
+    Float maxDuplication;
+    bool quantizeNodes;
+    bool packInstances;
+    Bounds3f bounds;
+    Float builtSAHCost = 0;
+    int nNodes = 0;
     LinearBVHNode *nodes = nullptr;
+    WideBVHNode<4> *nodes4 = nullptr;
+    WideBVHNode<8> *nodes8 = nullptr;
+    QuantizedBVHNode<2> *quantizedNodes2 = nullptr;
+    QuantizedBVHNode<4> *quantizedNodes4 = nullptr;
+    QuantizedBVHNode<8> *quantizedNodes8 = nullptr;
+    PackedTriangle *packedTriangles = nullptr;
+    // Index of each primitive's _PackedInstance_, or -1 if it isn't an
+    // instance with an affine transformation
+    int32_t *instanceSlots = nullptr;
+    PackedInstance *packedInstances = nullptr;
+    int nPackedInstances = 0;
+    // Non-null if the nodes are stored in a memory-mapped cache file
+    MappedFile *cacheFile = nullptr;
 };
 
 struct KdTreeNode;
@@ -0,0 +1,562 @@
+// pbrt is Copyright(c) 1998-2020 Matt Pharr, Wenzel Jakob, and Greg Humphreys.
+// The pbrt source code is licensed under the Apache License, Version 2.0.
+// SPDX: Apache-2.0
+
+#include <gtest/gtest.h>
+
+#include <pbrt/pbrt.h>
+
+#include <pbrt/cpu/aggregates.h>
+#include <pbrt/cpu/primitive.h>
+#include <pbrt/interaction.h>
+#include <pbrt/options.h>
+#include <pbrt/shapes.h>
+#include <pbrt/util/file.h>
+#include <pbrt/util/rng.h>
+#include <pbrt/util/sampling.h>
+#include <pbrt/util/transform.h>
+
+#include <algorithm>
+#include <memory>
+#include <vector>
+
+using namespace pbrt;
+
+// Returns primitives for a soup of _nTris_ randomly placed small triangles.
+static std::vector<Primitive> RandomTrianglePrimitives(int nTris, RNG &rng) {
+    std::vector<int> indices;
+    std::vector<Point3f> p;
+    for (int i = 0; i < nTris; ++i) {
+        Point3f base(rng.Uniform<Float>(), rng.Uniform<Float>(), rng.Uniform<Float>());
+        for (int j = 0; j < 3; ++j) {
+            Vector3f offset(rng.Uniform<Float>(), rng.Uniform<Float>(),
+                            rng.Uniform<Float>());
+            indices.push_back(p.size());
+            p.push_back(base + .1f * (offset - Vector3f(.5f, .5f, .5f)));
+        }
+    }
+
+    static Transform identity;
+    // Leaks...
+    TriangleMesh *mesh =
+        new TriangleMesh(identity, false, indices, p, {}, {}, {}, {}, Allocator());
+    std::vector<Primitive> prims;
+    for (Shape tri : Triangle::CreateTriangles(mesh, Allocator()))
+        prims.push_back(new SimplePrimitive(tri, nullptr));
+    return prims;
+}
+
+static Ray RandomRay(RNG &rng) {
+    Point3f o(3 * rng.Uniform<Float>() - 1, 3 * rng.Uniform<Float>() - 1,
+              3 * rng.Uniform<Float>() - 1);
+    Point3f target(rng.Uniform<Float>(), rng.Uniform<Float>(), rng.Uniform<Float>());
+    return Ray(o, target - o);
+}
+
+static void CheckMatchesBinaryBVH(BVHAggregate::SplitMethod splitMethod) {
+    RNG rng;
+    std::vector<Primitive> prims = RandomTrianglePrimitives(2000, rng);
+    BVHAggregate binary(prims, 4, splitMethod, 2);
+    BVHAggregate wide4(prims, 4, splitMethod, 4);
+    BVHAggregate wide8(prims, 4, splitMethod, 8);
+
+    EXPECT_EQ(binary.Bounds(), wide4.Bounds());
+    EXPECT_EQ(binary.Bounds(), wide8.Bounds());
+
+    int nHits = 0;
+    for (int i = 0; i < 10000; ++i) {
+        Ray ray = RandomRay(rng);
+        Float tMax = (i & 1) ? Infinity : rng.Uniform<Float>();
+        pstd::optional<ShapeIntersection> si = binary.Intersect(ray, tMax);
+        bool hitP = binary.IntersectP(ray, tMax);
+        EXPECT_EQ(si.has_value(), hitP);
+        nHits += si.has_value();
+
+        for (const BVHAggregate *wide : {&wide4, &wide8}) {
+            pstd::optional<ShapeIntersection> wideSi = wide->Intersect(ray, tMax);
+            ASSERT_EQ(si.has_value(), wideSi.has_value());
+            if (si) {
+                EXPECT_EQ(si->tHit, wideSi->tHit);
+            }
+            EXPECT_EQ(hitP, wide->IntersectP(ray, tMax));
+        }
+    }
+    // Make sure the test is exercising both hits and misses.
+    EXPECT_GT(nHits, 1000);
+    EXPECT_LT(nHits, 9000);
+}
+
+TEST(BVHAggregate, WideMatchesBinarySAH) {
+    CheckMatchesBinaryBVH(BVHAggregate::SplitMethod::SAH);
+}
+
+TEST(BVHAggregate, WideMatchesBinaryHLBVH) {
+    CheckMatchesBinaryBVH(BVHAggregate::SplitMethod::HLBVH);
+}
+
+TEST(BVHAggregate, WideSinglePrimitive) {
+    RNG rng;
+    std::vector<Primitive> prims = RandomTrianglePrimitives(1, rng);
+    for (int width : {2, 4, 8}) {
+        BVHAggregate bvh(prims, 4, BVHAggregate::SplitMethod::SAH, width);
+        EXPECT_EQ(prims[0].Bounds(), bvh.Bounds());
+        for (int i = 0; i < 100; ++i) {
+            Ray ray = RandomRay(rng);
+            pstd::optional<ShapeIntersection> si = prims[0].Intersect(ray, Infinity);
+            pstd::optional<ShapeIntersection> bvhSi = bvh.Intersect(ray, Infinity);
+            ASSERT_EQ(si.has_value(), bvhSi.has_value());
+            if (si) {
+                EXPECT_EQ(si->tHit, bvhSi->tHit);
+            }
+            EXPECT_EQ(si.has_value(), bvh.IntersectP(ray, Infinity));
+        }
+    }
+}
+
+// Checks that the batched intersection routines give the same results as
+// tracing the rays one at a time.
+static void CheckIntersectN(const BVHAggregate &bvh, const std::vector<Ray> &rays,
+                            const std::vector<Float> &tMax) {
+    std::vector<pstd::optional<ShapeIntersection>> si(rays.size());
+    bool *hit = new bool[rays.size()];
+    bvh.IntersectN(rays, tMax, pstd::MakeSpan(si));
+    bvh.IntersectPN(rays, tMax, pstd::MakeSpan(hit, rays.size()));
+
+    for (size_t i = 0; i < rays.size(); ++i) {
+        pstd::optional<ShapeIntersection> raySi = bvh.Intersect(rays[i], tMax[i]);
+        ASSERT_EQ(raySi.has_value(), si[i].has_value());
+        if (raySi) {
+            EXPECT_EQ(raySi->tHit, si[i]->tHit);
+        }
+        EXPECT_EQ(bvh.IntersectP(rays[i], tMax[i]), hit[i]);
+    }
+    delete[] hit;
+}
+
+TEST(BVHAggregate, IntersectNCoherent) {
+    RNG rng;
+    std::vector<Primitive> prims = RandomTrianglePrimitives(2000, rng);
+    for (int width : {2, 4}) {
+        BVHAggregate bvh(prims, 4, BVHAggregate::SplitMethod::SAH, width);
+        // Rays from a common origin through a grid of points, as with
+        // camera rays
+        std::vector<Ray> rays;
+        std::vector<Float> tMax;
+        Point3f o(.5f, .5f, -1.5f);
+        for (int y = 0; y < 64; ++y)
+            for (int x = 0; x < 64; ++x) {
+                Point3f target((x + .5f) / 64, (y + .5f) / 64, .5f);
+                rays.push_back(Ray(o, target - o));
+                tMax.push_back(((x + y) % 5 == 0) ? Float(2) : Infinity);
+            }
+        CheckIntersectN(bvh, rays, tMax);
+    }
+}
+
+TEST(BVHAggregate, IntersectNIncoherent) {
+    RNG rng;
+    std::vector<Primitive> prims = RandomTrianglePrimitives(2000, rng);
+    BVHAggregate bvh(prims, 4, BVHAggregate::SplitMethod::HLBVH);
+    std::vector<Ray> rays;
+    std::vector<Float> tMax;
+    // Note: use a ray count that isn't a multiple of the packet size.
+    for (int i = 0; i < 1001; ++i) {
+        rays.push_back(RandomRay(rng));
+        tMax.push_back((i & 1) ? Infinity : rng.Uniform<Float>());
+    }
+    CheckIntersectN(bvh, rays, tMax);
+
+    // Axis-aligned rays have infinite reciprocal directions.
+    rays.clear();
+    tMax.clear();
+    for (int i = 0; i < 100; ++i) {
+        Point3f o(rng.Uniform<Float>(), rng.Uniform<Float>(), -1);
+        rays.push_back(Ray(o, Vector3f(0, 0, 1)));
+        tMax.push_back(Infinity);
+    }
+    CheckIntersectN(bvh, rays, tMax);
+}
+
+TEST(BVHAggregate, DeferredInteraction) {
+    // The BVH only computes the SurfaceInteraction for the closest triangle
+    // hit; make sure it matches what the primitives themselves return.
+    RNG rng;
+    std::vector<Primitive> prims = RandomTrianglePrimitives(500, rng);
+    BVHAggregate bvh(prims, 4, BVHAggregate::SplitMethod::SAH);
+    for (int i = 0; i < 1000; ++i) {
+        Ray ray = RandomRay(rng);
+        pstd::optional<ShapeIntersection> si;
+        Float tMax = Infinity;
+        for (const Primitive &prim : prims)
+            if (pstd::optional<ShapeIntersection> primSi = prim.Intersect(ray, tMax)) {
+                si = primSi;
+                tMax = si->tHit;
+            }
+
+        pstd::optional<ShapeIntersection> bvhSi = bvh.Intersect(ray, Infinity);
+        ASSERT_EQ(si.has_value(), bvhSi.has_value());
+        if (si) {
+            EXPECT_EQ(si->tHit, bvhSi->tHit);
+            EXPECT_EQ(si->intr.p(), bvhSi->intr.p());
+            EXPECT_EQ(si->intr.n, bvhSi->intr.n);
+            EXPECT_EQ(si->intr.uv, bvhSi->intr.uv);
+            EXPECT_EQ(si->intr.wo, bvhSi->intr.wo);
+        }
+    }
+}
+
+TEST(BVHAggregate, PackedTriangles) {
+    RNG rng;
+    std::vector<Primitive> prims = RandomTrianglePrimitives(2000, rng);
+    for (int width : {2, 8}) {
+        BVHAggregate bvh(prims, 4, BVHAggregate::SplitMethod::SAH, width);
+        BVHAggregate packed(prims, 4, BVHAggregate::SplitMethod::SAH, width, true);
+        for (int i = 0; i < 10000; ++i) {
+            Ray ray = RandomRay(rng);
+            Float tMax = (i & 1) ? Infinity : rng.Uniform<Float>();
+            pstd::optional<ShapeIntersection> si = bvh.Intersect(ray, tMax);
+            pstd::optional<ShapeIntersection> packedSi = packed.Intersect(ray, tMax);
+            ASSERT_EQ(si.has_value(), packedSi.has_value());
+            if (si) {
+                EXPECT_EQ(si->tHit, packedSi->tHit);
+                EXPECT_EQ(si->intr.p(), packedSi->intr.p());
+            }
+            EXPECT_EQ(bvh.IntersectP(ray, tMax), packed.IntersectP(ray, tMax));
+        }
+    }
+}
+
+TEST(BVHAggregate, ParallelSAH) {
+    // Use enough primitives that the top of the tree is built with the
+    // parallel binning and partitioning code.
+    RNG rng;
+    std::vector<Primitive> prims = RandomTrianglePrimitives(200000, rng);
+    BVHAggregate sah(prims, 4, BVHAggregate::SplitMethod::SAH);
+    BVHAggregate parallelSAH(prims, 4, BVHAggregate::SplitMethod::ParallelSAH);
+    EXPECT_EQ(sah.Bounds(), parallelSAH.Bounds());
+
+    for (int i = 0; i < 10000; ++i) {
+        Ray ray = RandomRay(rng);
+        Float tMax = (i & 1) ? Infinity : rng.Uniform<Float>();
+        pstd::optional<ShapeIntersection> si = sah.Intersect(ray, tMax);
+        pstd::optional<ShapeIntersection> parallelSi = parallelSAH.Intersect(ray, tMax);
+        ASSERT_EQ(si.has_value(), parallelSi.has_value());
+        if (si) {
+            EXPECT_EQ(si->tHit, parallelSi->tHit);
+        }
+        EXPECT_EQ(sah.IntersectP(ray, tMax), parallelSAH.IntersectP(ray, tMax));
+    }
+}
+
+TEST(BVHAggregate, SBVH) {
+    // Mix small triangles with long, thin diagonal ones so that the object
+    // split children overlap and spatial splits are worthwhile.
+    RNG rng;
+    std::vector<Primitive> prims = RandomTrianglePrimitives(5000, rng);
+    std::vector<int> indices;
+    std::vector<Point3f> p;
+    for (int i = 0; i < 500; ++i) {
+        Point3f p0(rng.Uniform<Float>(), rng.Uniform<Float>(), rng.Uniform<Float>());
+        Point3f p1 = Point3f(1, 1, 1) - Vector3f(p0);
+        indices.insert(indices.end(), {int(p.size()), int(p.size()) + 1,
+                                       int(p.size()) + 2});
+        p.insert(p.end(), {p0, p1, p1 + Vector3f(.01f, 0, 0)});
+    }
+    static Transform identity;
+    TriangleMesh *mesh =
+        new TriangleMesh(identity, false, indices, p, {}, {}, {}, {}, Allocator());
+    for (Shape tri : Triangle::CreateTriangles(mesh, Allocator()))
+        prims.push_back(new SimplePrimitive(tri, nullptr));
+
+    BVHAggregate sah(prims, 4, BVHAggregate::SplitMethod::SAH);
+    BVHAggregate sbvh(prims, 4, BVHAggregate::SplitMethod::SBVH);
+    BVHAggregate wideSBVH(prims, 4, BVHAggregate::SplitMethod::SBVH, 4, true);
+    BVHAggregate noDuplication(prims, 4, BVHAggregate::SplitMethod::SBVH, 2, false, 0);
+    EXPECT_EQ(sah.Bounds(), sbvh.Bounds());
+
+    for (int i = 0; i < 10000; ++i) {
+        Ray ray = RandomRay(rng);
+        Float tMax = (i & 1) ? Infinity : rng.Uniform<Float>();
+        pstd::optional<ShapeIntersection> si = sah.Intersect(ray, tMax);
+        for (const BVHAggregate *bvh : {&sbvh, &wideSBVH, &noDuplication}) {
+            pstd::optional<ShapeIntersection> sbvhSi = bvh->Intersect(ray, tMax);
+            ASSERT_EQ(si.has_value(), sbvhSi.has_value());
+            if (si) {
+                EXPECT_EQ(si->tHit, sbvhSi->tHit);
+            }
+            EXPECT_EQ(sah.IntersectP(ray, tMax), bvh->IntersectP(ray, tMax));
+        }
+    }
+}
+
+TEST(BVHAggregate, QuantizedNodes) {
+    RNG rng;
+    std::vector<Primitive> prims = RandomTrianglePrimitives(2000, rng);
+    BVHAggregate binary(prims, 4, BVHAggregate::SplitMethod::SAH, 2);
+    std::vector<std::unique_ptr<BVHAggregate>> quantized;
+    for (int width : {2, 4, 8})
+        quantized.push_back(std::make_unique<BVHAggregate>(
+            prims, 4, BVHAggregate::SplitMethod::SAH, width, false, 0.f, true));
+
+    for (int i = 0; i < 10000; ++i) {
+        Ray ray = RandomRay(rng);
+        Float tMax = (i & 1) ? Infinity : rng.Uniform<Float>();
+        pstd::optional<ShapeIntersection> si = binary.Intersect(ray, tMax);
+        bool hitP = binary.IntersectP(ray, tMax);
+        for (const auto &bvh : quantized) {
+            // Quantized bounds are conservative, so the same hits must be found
+            pstd::optional<ShapeIntersection> qSi = bvh->Intersect(ray, tMax);
+            ASSERT_EQ(si.has_value(), qSi.has_value());
+            if (si) {
+                EXPECT_EQ(si->tHit, qSi->tHit);
+            }
+            EXPECT_EQ(hitP, bvh->IntersectP(ray, tMax));
+        }
+    }
+
+    // Also handle a BVH that is a single leaf.
+    BVHAggregate single({prims[0]}, 4, BVHAggregate::SplitMethod::SAH, 2, false, 0.f,
+                        true);
+    EXPECT_EQ(prims[0].Bounds(), single.Bounds());
+    for (int i = 0; i < 1000; ++i) {
+        Ray ray = RandomRay(rng);
+        EXPECT_EQ(prims[0].IntersectP(ray, Infinity), single.IntersectP(ray, Infinity));
+    }
+}
+
+TEST(BVHAggregate, RefitAndRebuild) {
+    // Instance a small BVH many times and then move some of the instances.
+    RNG rng;
+    Primitive instance = new BVHAggregate(RandomTrianglePrimitives(100, rng), 4);
+    std::vector<Transform> transforms(200);
+    for (Transform &t : transforms)
+        t = Translate(Vector3f(rng.Uniform<Float>(), rng.Uniform<Float>(),
+                               rng.Uniform<Float>()));
+    std::vector<TransformedPrimitive *> instances;
+    std::vector<Primitive> prims;
+    for (const Transform &t : transforms) {
+        instances.push_back(new TransformedPrimitive(instance, &t));
+        prims.push_back(instances.back());
+    }
+
+    struct Config {
+        BVHAggregate::SplitMethod splitMethod;
+        int width;
+        bool quantize;
+    };
+    for (Config config : {Config{BVHAggregate::SplitMethod::SAH, 2, false},
+                          Config{BVHAggregate::SplitMethod::SAH, 4, false},
+                          Config{BVHAggregate::SplitMethod::SAH, 8, true},
+                          Config{BVHAggregate::SplitMethod::SBVH, 2, false}}) {
+        BVHAggregate bvh(prims, 2, config.splitMethod, config.width, false, 0.3f,
+                         config.quantize);
+        auto checkMatchesNewBVH = [&]() {
+            BVHAggregate reference(prims, 2);
+            EXPECT_EQ(reference.Bounds(), bvh.Bounds());
+            for (int i = 0; i < 2000; ++i) {
+                Ray ray = RandomRay(rng);
+                pstd::optional<ShapeIntersection> si = reference.Intersect(ray, Infinity);
+                pstd::optional<ShapeIntersection> bvhSi = bvh.Intersect(ray, Infinity);
+                ASSERT_EQ(si.has_value(), bvhSi.has_value());
+                if (si) {
+                    EXPECT_EQ(si->tHit, bvhSi->tHit);
+                }
+                EXPECT_EQ(reference.IntersectP(ray, Infinity),
+                          bvh.IntersectP(ray, Infinity));
+            }
+        };
+
+        // Move a few instances and refit
+        std::vector<Transform> moved(20);
+        for (int i = 0; i < moved.size(); ++i) {
+            moved[i] = Translate(Vector3f(0, .5f, 0)) * transforms[i];
+            instances[i]->SetRenderFromPrimitive(&moved[i]);
+        }
+        bvh.Refit();
+        checkMatchesNewBVH();
+
+        // Scatter all of the instances so that the refit BVH is poor
+        std::vector<Transform> scattered(instances.size());
+        for (int i = 0; i < instances.size(); ++i) {
+            scattered[i] = Translate(Vector3f(rng.Uniform<Float>(), rng.Uniform<Float>(),
+                                              rng.Uniform<Float>()));
+            instances[i]->SetRenderFromPrimitive(&scattered[i]);
+        }
+        EXPECT_TRUE(bvh.Update(1.01f));
+        checkMatchesNewBVH();
+        // Nothing has moved since the rebuild
+        EXPECT_FALSE(bvh.Update(1.01f));
+
+        for (int i = 0; i < instances.size(); ++i)
+            instances[i]->SetRenderFromPrimitive(&transforms[i]);
+    }
+}
+
+// Returns instances of a small BVH with random affine transformations.
+static std::vector<Primitive> RandomInstancePrimitives(int nInstances, RNG &rng) {
+    Primitive instance = new BVHAggregate(RandomTrianglePrimitives(50, rng), 4);
+    std::vector<Primitive> prims;
+    for (int i = 0; i < nInstances; ++i) {
+        Vector3f axis = SampleUniformSphere({rng.Uniform<Float>(), rng.Uniform<Float>()});
+        // Leaks...
+        Transform *t = new Transform(
+            Translate(Vector3f(rng.Uniform<Float>(), rng.Uniform<Float>(),
+                               rng.Uniform<Float>())) *
+            Rotate(360 * rng.Uniform<Float>(), axis) *
+            Scale(.2f + rng.Uniform<Float>(), .2f + rng.Uniform<Float>(),
+                  .2f + rng.Uniform<Float>()));
+        prims.push_back(new TransformedPrimitive(instance, t));
+    }
+    return prims;
+}
+
+TEST(BVHAggregate, PackedInstances) {
+    RNG rng;
+    std::vector<Primitive> prims = RandomInstancePrimitives(300, rng);
+    for (int width : {2, 4}) {
+        BVHAggregate bvh(prims, 4, BVHAggregate::SplitMethod::SAH, width, false, 0.3f,
+                         false, false);
+        BVHAggregate packed(prims, 4, BVHAggregate::SplitMethod::SAH, width);
+        int nHits = 0;
+        for (int i = 0; i < 10000; ++i) {
+            Ray ray = RandomRay(rng);
+            Float tMax = (i & 1) ? Infinity : rng.Uniform<Float>();
+            pstd::optional<ShapeIntersection> si = bvh.Intersect(ray, tMax);
+            pstd::optional<ShapeIntersection> packedSi = packed.Intersect(ray, tMax);
+            ASSERT_EQ(si.has_value(), packedSi.has_value());
+            if (si) {
+                // Rays are transformed with the same arithmetic as
+                // _Transform_, though the results may differ in the last
+                // bits due to differing rounding of the offset origins.
+                ++nHits;
+                EXPECT_LT(std::abs(si->tHit - packedSi->tHit),
+                          1e-5f * std::max<Float>(1, si->tHit));
+                EXPECT_LT(Distance(si->intr.p(), packedSi->intr.p()), 1e-5f);
+                EXPECT_GT(Dot(si->intr.n, packedSi->intr.n), .9999f);
+            }
+            EXPECT_EQ(bvh.IntersectP(ray, tMax), packed.IntersectP(ray, tMax));
+        }
+        EXPECT_GT(nHits, 1000);
+    }
+}
+
+TEST(BVHAggregate, PackedInstanceFarFromOrigin) {
+    // The rounding error of ray origins transformed into an instance far
+    // from the origin is dominated by its translation; packed instances
+    // must offset origins and _tMax_ as _Transform::ApplyInverse()_ does.
+    RNG rng;
+    Primitive instance = new BVHAggregate(RandomTrianglePrimitives(50, rng), 4);
+    Vector3f translation(1e5f, -2e5f, 3e5f);
+    // Leaks...
+    Transform *t = new Transform(Translate(translation));
+    std::vector<Primitive> prims = {new TransformedPrimitive(instance, t)};
+    BVHAggregate bvh(prims, 4, BVHAggregate::SplitMethod::SAH, 2, false, 0.3f, false,
+                     false);
+    BVHAggregate packed(prims, 4, BVHAggregate::SplitMethod::SAH, 2);
+    int nHits = 0;
+    for (int i = 0; i < 4000; ++i) {
+        Ray ray = RandomRay(rng);
+        ray.o += translation;
+        pstd::optional<ShapeIntersection> si = bvh.Intersect(ray, Infinity);
+        pstd::optional<ShapeIntersection> packedSi = packed.Intersect(ray, Infinity);
+        ASSERT_EQ(si.has_value(), packedSi.has_value());
+        if (si) {
+            // _tHit_ is relative to the offset origin.
+            ++nHits;
+            EXPECT_LT(std::abs(si->tHit - packedSi->tHit),
+                      1e-5f * std::max<Float>(1, si->tHit));
+        }
+    }
+    EXPECT_GT(nHits, 100);
+}
+
+TEST(BVHAggregate, InstanceVisibility) {
+    RNG rng;
+    Primitive instance = new BVHAggregate(RandomTrianglePrimitives(50, rng), 4);
+    std::vector<Transform> transforms(100);
+    // Instances with all four visibility masks, along with fully visible
+    // copies of them to compute the expected results
+    std::vector<Primitive> prims, visiblePrims;
+    for (int i = 0; i < transforms.size(); ++i) {
+        transforms[i] = Translate(Vector3f(rng.Uniform<Float>(), rng.Uniform<Float>(),
+                                           rng.Uniform<Float>()));
+        prims.push_back(new TransformedPrimitive(instance, &transforms[i], i % 4));
+        visiblePrims.push_back(new TransformedPrimitive(instance, &transforms[i]));
+    }
+
+    for (bool packInstances : {false, true}) {
+        BVHAggregate bvh(prims, 4, BVHAggregate::SplitMethod::SAH, 2, false, 0.3f,
+                         false, packInstances);
+        for (int i = 0; i < 2000; ++i) {
+            Ray ray = RandomRay(rng);
+            // Find the closest visible instance and any shadowing instance
+            Float tHit = Infinity;
+            bool hitP = false;
+            for (int j = 0; j < visiblePrims.size(); ++j) {
+                if (pstd::optional<ShapeIntersection> si =
+                        visiblePrims[j].Intersect(ray, Infinity)) {
+                    if (j & VisibleToRays)
+                        tHit = std::min(tHit, si->tHit);
+                    if (j & CastsShadows)
+                        hitP = true;
+                }
+            }
+
+            pstd::optional<ShapeIntersection> si = bvh.Intersect(ray, Infinity);
+            EXPECT_EQ(tHit < Infinity, si.has_value());
+            if (si) {
+                EXPECT_LT(std::abs(tHit - si->tHit), 1e-5f * std::max<Float>(1, tHit));
+            }
+            EXPECT_EQ(hitP, bvh.IntersectP(ray, Infinity));
+        }
+    }
+}
+
+TEST(BVHAggregate, Cache) {
+    RNG rng;
+    std::vector<Primitive> prims = RandomTrianglePrimitives(2000, rng);
+    std::vector<std::string> oldCacheFiles = MatchingFilenames("bvh-");
+    std::string savedCacheDirectory = Options->cacheDirectory;
+    Options->cacheDirectory = ".";
+
+    for (bool quantize : {false, true}) {
+        // The first BVH is built and written to the cache; the second is
+        // read from it.
+        BVHAggregate built(prims, 4, BVHAggregate::SplitMethod::SAH, 4, false, 0.3f,
+                           quantize);
+        BVHAggregate cached(prims, 4, BVHAggregate::SplitMethod::SAH, 4, false, 0.3f,
+                            quantize);
+        EXPECT_EQ(built.Bounds(), cached.Bounds());
+        for (int i = 0; i < 1000; ++i) {
+            Ray ray = RandomRay(rng);
+            pstd::optional<ShapeIntersection> si = built.Intersect(ray, Infinity);
+            pstd::optional<ShapeIntersection> cachedSi = cached.Intersect(ray, Infinity);
+            ASSERT_EQ(si.has_value(), cachedSi.has_value());
+            if (si) {
+                EXPECT_EQ(si->tHit, cachedSi->tHit);
+            }
+        }
+        // Refitting modifies the mapped nodes in memory only.
+        cached.Refit();
+        EXPECT_EQ(built.Bounds(), cached.Bounds());
+    }
+    Options->cacheDirectory = savedCacheDirectory;
+
+    std::vector<std::string> newCacheFiles;
+    for (const std::string &fn : MatchingFilenames("bvh-"))
+        if (std::find(oldCacheFiles.begin(), oldCacheFiles.end(), fn) ==
+            oldCacheFiles.end())
+            newCacheFiles.push_back(fn);
+    EXPECT_EQ(2, newCacheFiles.size());
+
+    // A corrupt cache file should be ignored.
+    if (!newCacheFiles.empty()) {
+        EXPECT_TRUE(WriteFileContents(newCacheFiles[0], "not a BVH"));
+        Options->cacheDirectory = ".";
+        BVHAggregate rebuilt(prims, 4, BVHAggregate::SplitMethod::SAH, 4);
+        Options->cacheDirectory = savedCacheDirectory;
+        EXPECT_EQ(rebuilt.Bounds(), BVHAggregate(prims, 4).Bounds());
+    }
+    for (const std::string &fn : newCacheFiles)
+        EXPECT_TRUE(RemoveFile(fn));
+}
@@ -0,0 +1,190 @@
+// pbrt is Copyright(c) 1998-2020 Matt Pharr, Wenzel Jakob, and Greg Humphreys.
+// The pbrt source code is licensed under the Apache License, Version 2.0.
+// SPDX: Apache-2.0
+
+#include <pbrt/cpu/denoiser.h>
+
+#include <pbrt/util/error.h>
+#include <pbrt/util/math.h>
+#include <pbrt/util/parallel.h>
+#include <pbrt/util/stats.h>
+#include <pbrt/util/vecmath.h>
+
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+namespace pbrt {
+
+STAT_COUNTER("Denoiser/Images denoised", nImagesDenoised);
+
+// Denoiser Function Definitions
+Image DenoiseImage(const Image &image, int samplesPerPixel) {
+    // Find the G-buffer channels used to guide the filter
+    ImageChannelDesc rgbDesc = image.GetChannelDesc({"R", "G", "B"});
+    ImageChannelDesc albedoDesc =
+        image.GetChannelDesc({"Albedo.R", "Albedo.G", "Albedo.B"});
+    ImageChannelDesc nDesc = image.GetChannelDesc({"Nsx", "Nsy", "Nsz"});
+    ImageChannelDesc zDesc = image.GetChannelDesc({"Pz"});
+    ImageChannelDesc varianceDesc =
+        image.GetChannelDesc({"Variance.R", "Variance.G", "Variance.B"});
+    if (!rgbDesc || !albedoDesc || !nDesc || !zDesc || !varianceDesc)
+        ErrorExit("Image doesn't have the channels written by the \"gbuffer\" film "
+                  "that are needed for denoising.");
+    ++nImagesDenoised;
+
+    // Copy the G-buffer into planar arrays with the albedo divided out
+    Point2i res = image.Resolution();
+    size_t nPixels = size_t(res.x) * size_t(res.y);
+    std::vector<Float> illum[3], albedo[3], n[3];
+    for (int c = 0; c < 3; ++c) {
+        illum[c].resize(nPixels);
+        albedo[c].resize(nPixels);
+        n[c].resize(nPixels);
+    }
+    std::vector<Float> z(nPixels), variance(nPixels);
+    std::vector<uint8_t> background(nPixels);
+    Float invSamples = 1.f / std::max(1, samplesPerPixel);
+    ParallelFor(0, res.y, [&](int64_t y) {
+        for (int x = 0; x < res.x; ++x) {
+            Point2i p(x, int(y));
+            size_t i = size_t(y) * res.x + x;
+            ImageChannelValues L = image.GetChannels(p, rgbDesc);
+            ImageChannelValues a = image.GetChannels(p, albedoDesc);
+            ImageChannelValues ns = image.GetChannels(p, nDesc);
+            ImageChannelValues var = image.GetChannels(p, varianceDesc);
+            Float v = 0;
+            for (int c = 0; c < 3; ++c) {
+                Float scale = a[c] > 0 ? 1 / a[c] : 1;
+                illum[c][i] = L[c] * scale;
+                albedo[c][i] = a[c];
+                n[c][i] = ns[c];
+                v += var[c] * Sqr(scale);
+            }
+            // Pixels that no camera ray hit a surface in are left as is
+            background[i] = ns[0] == 0 && ns[1] == 0 && ns[2] == 0;
+            z[i] = image.GetChannels(p, zDesc)[0];
+            // Store the variance of the pixel's average illumination estimate
+            variance[i] = v / 3 * invSamples;
+        }
+    });
+
+    // Estimate screen-space depth gradients from neighboring pixels, taking
+    // the smaller difference so that depth discontinuities aren't included
+    std::vector<Float> dzdx(nPixels), dzdy(nPixels);
+    ParallelFor(0, res.y, [&](int64_t y) {
+        for (int x = 0; x < res.x; ++x) {
+            size_t i = size_t(y) * res.x + x;
+            auto gradient = [&](bool prevValid, size_t prev, bool nextValid,
+                                size_t next) {
+                Float g = Infinity;
+                if (prevValid && !background[prev])
+                    g = std::abs(z[i] - z[prev]);
+                if (nextValid && !background[next])
+                    g = std::min(g, std::abs(z[next] - z[i]));
+                return IsInf(g) ? Float(0) : g;
+            };
+            dzdx[i] = gradient(x > 0, i - 1, x + 1 < res.x, i + 1);
+            dzdy[i] = gradient(y > 0, i - res.x, y + 1 < res.y, i + res.x);
+        }
+    });
+
+    // Apply a-trous wavelet filter levels to the illumination
+    static constexpr int nLevels = 5;
+    // Scale factors for the widths of the depth and illumination weights
+    static constexpr Float sigmaZ = 1, sigmaL = 4;
+    static constexpr Float h[5] = {1.f / 16, 1.f / 4, 3.f / 8, 1.f / 4, 1.f / 16};
+    std::vector<Float> filtered[3];
+    for (int c = 0; c < 3; ++c)
+        filtered[c].resize(nPixels);
+    std::vector<Float> filteredVariance(nPixels), blurredVariance(nPixels);
+    Bounds2i imageBounds(Point2i(0, 0), res);
+    for (int level = 0; level < nLevels; ++level) {
+        int step = 1 << level;
+        // Blur the variance estimates for the illumination weights
+        ParallelFor2D(imageBounds, [&](Bounds2i tile) {
+            for (int y = tile.pMin.y; y < tile.pMax.y; ++y)
+                for (int x = tile.pMin.x; x < tile.pMax.x; ++x) {
+                    Float sum = 0, wSum = 0;
+                    for (int dy = -1; dy <= 1; ++dy)
+                        for (int dx = -1; dx <= 1; ++dx) {
+                            int xq = x + dx, yq = y + dy;
+                            if (xq < 0 || xq >= res.x || yq < 0 || yq >= res.y)
+                                continue;
+                            Float w = Float(1 << (2 - std::abs(dx) - std::abs(dy)));
+                            sum += w * variance[size_t(yq) * res.x + xq];
+                            wSum += w;
+                        }
+                    blurredVariance[size_t(y) * res.x + x] = sum / wSum;
+                }
+        });
+
+        ParallelFor2D(imageBounds, [&](Bounds2i tile) {
+            for (int y = tile.pMin.y; y < tile.pMax.y; ++y)
+                for (int x = tile.pMin.x; x < tile.pMax.x; ++x) {
+                    size_t i = size_t(y) * res.x + x;
+                    if (background[i]) {
+                        for (int c = 0; c < 3; ++c)
+                            filtered[c][i] = illum[c][i];
+                        filteredVariance[i] = variance[i];
+                        continue;
+                    }
+                    Normal3f np(n[0][i], n[1][i], n[2][i]);
+                    Float lp = (illum[0][i] + illum[1][i] + illum[2][i]) / 3;
+                    Float lScale = sigmaL * SafeSqrt(blurredVariance[i]) + 1e-6f;
+                    Float sum[3] = {0, 0, 0}, wSum = 0, varianceSum = 0;
+                    for (int dy = -2; dy <= 2; ++dy) {
+                        int yq = y + dy * step;
+                        if (yq < 0 || yq >= res.y)
+                            continue;
+                        for (int dx = -2; dx <= 2; ++dx) {
+                            int xq = x + dx * step;
+                            if (xq < 0 || xq >= res.x)
+                                continue;
+                            size_t q = size_t(yq) * res.x + xq;
+                            if (background[q])
+                                continue;
+                            // Compute the edge-stopping weights for pixel _q_
+                            Normal3f nq(n[0][q], n[1][q], n[2][q]);
+                            Float wn = Pow<128>(std::max<Float>(0, Dot(np, nq)));
+                            Float zScale = sigmaZ * (std::abs(dx * step) * dzdx[i] +
+                                                     std::abs(dy * step) * dzdy[i]) +
+                                           1e-3f * std::abs(z[i]) + 1e-6f;
+                            Float wz = FastExp(-std::abs(z[i] - z[q]) / zScale);
+                            Float lq = (illum[0][q] + illum[1][q] + illum[2][q]) / 3;
+                            Float wl = FastExp(-std::abs(lp - lq) / lScale);
+                            Float w = h[dx + 2] * h[dy + 2] * wn * wz * wl;
+
+                            for (int c = 0; c < 3; ++c)
+                                sum[c] += w * illum[c][q];
+                            wSum += w;
+                            varianceSum += Sqr(w) * variance[q];
+                        }
+                    }
+                    // The pixel itself always has a nonzero weight
+                    for (int c = 0; c < 3; ++c)
+                        filtered[c][i] = sum[c] / wSum;
+                    filteredVariance[i] = varianceSum / Sqr(wSum);
+                }
+        });
+
+        for (int c = 0; c < 3; ++c)
+            std::swap(illum[c], filtered[c]);
+        std::swap(variance, filteredVariance);
+    }
+
+    // Multiply the filtered illumination by the albedo
+    Image result(PixelFormat::Float, res, {"R", "G", "B"});
+    ParallelFor(0, res.y, [&](int64_t y) {
+        for (int x = 0; x < res.x; ++x) {
+            size_t i = size_t(y) * res.x + x;
+            for (int c = 0; c < 3; ++c)
+                result.SetChannel({x, int(y)}, c,
+                                  albedo[c][i] > 0 ? illum[c][i] * albedo[c][i]
+                                                   : illum[c][i]);
+        }
+    });
+    return result;
+}
+
+}  // namespace pbrt
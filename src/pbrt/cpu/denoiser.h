@@ -0,0 +1,28 @@
+// pbrt is Copyright(c) 1998-2020 Matt Pharr, Wenzel Jakob, and Greg Humphreys.
+// The pbrt source code is licensed under the Apache License, Version 2.0.
+// SPDX: Apache-2.0
+
+#ifndef PBRT_CPU_DENOISER_H
+#define PBRT_CPU_DENOISER_H
+
+#include <pbrt/pbrt.h>
+
+#include <pbrt/util/image.h>
+
+namespace pbrt {
+
+// Denoiser Function Declarations
+// Denoises the "R", "G", and "B" channels of an image with the channels
+// written by the "gbuffer" film using an edge-avoiding a-trous wavelet
+// filter: a joint bilateral filter whose footprint doubles at each level,
+// with weights given by the differences in surface normal, depth, and
+// illumination relative to the pixels' estimated variance. Illumination is
+// filtered with the surface albedo divided out so that texture detail is
+// preserved. _samplesPerPixel_ is the number of samples that the image's
+// pixel variances were computed from. Returns an image with the denoised
+// "R", "G", and "B" channels.
+Image DenoiseImage(const Image &image, int samplesPerPixel);
+
+}  // namespace pbrt
+
+#endif  // PBRT_CPU_DENOISER_H
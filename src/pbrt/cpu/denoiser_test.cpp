@@ -0,0 +1,74 @@
+// pbrt is Copyright(c) 1998-2020 Matt Pharr, Wenzel Jakob, and Greg Humphreys.
+// The pbrt source code is licensed under the Apache License, Version 2.0.
+// SPDX: Apache-2.0
+
+#include <gtest/gtest.h>
+
+#include <pbrt/pbrt.h>
+#include <pbrt/cpu/denoiser.h>
+#include <pbrt/util/image.h>
+#include <pbrt/util/rng.h>
+
+#include <cmath>
+
+using namespace pbrt;
+
+TEST(Denoiser, EdgesAndAlbedo) {
+    // Two perpendicular surfaces meeting at x = 32 with different
+    // illumination; the left one has a checkerboard albedo texture. The
+    // bottom row is background.
+    Point2i res(64, 32);
+    Image image(PixelFormat::Float, res,
+                {"R", "G", "B", "Albedo.R", "Albedo.G", "Albedo.B", "Nsx", "Nsy", "Nsz",
+                 "Pz", "Variance.R", "Variance.G", "Variance.B"});
+    Image expected(PixelFormat::Float, res, {"R", "G", "B"});
+    int spp = 16;
+    Float sigma = 0.05f;
+    RNG rng;
+    for (int y = 0; y < res.y; ++y)
+        for (int x = 0; x < res.x; ++x) {
+            bool left = x < res.x / 2;
+            Float albedo = (left && ((x / 4 + y / 4) & 1)) ? 0.2f : 0.8f;
+            Float L = (left ? 1 : 3) * albedo;
+            Float n[3] = {left ? 0.f : 1.f, 0, left ? 1.f : 0.f};
+            if (y == res.y - 1) {
+                L = 0.5f;
+                albedo = 0;
+                n[0] = n[2] = 0;
+            }
+            for (int c = 0; c < 3; ++c) {
+                expected.SetChannel({x, y}, c, L);
+                // Uniform noise with standard deviation _sigma_
+                Float noise = y == res.y - 1
+                                  ? 0
+                                  : sigma * std::sqrt(3.f) *
+                                        (2 * rng.Uniform<Float>() - 1);
+                image.SetChannel({x, y}, c, L + noise);
+                image.SetChannel({x, y}, 3 + c, albedo);
+                image.SetChannel({x, y}, 6 + c, n[c]);
+                image.SetChannel({x, y}, 10 + c, Sqr(sigma) * spp);
+            }
+            image.SetChannel({x, y}, 9, 5);
+        }
+
+    Image denoised = DenoiseImage(image, spp);
+    ASSERT_EQ(res, denoised.Resolution());
+
+    double noisyError = 0, denoisedError = 0;
+    for (int y = 0; y < res.y; ++y)
+        for (int x = 0; x < res.x; ++x)
+            for (int c = 0; c < 3; ++c) {
+                Float e = expected.GetChannel({x, y}, c);
+                if (y == res.y - 1) {
+                    // Background pixels shouldn't be changed
+                    EXPECT_EQ(image.GetChannel({x, y}, c),
+                              denoised.GetChannel({x, y}, c));
+                    continue;
+                }
+                noisyError += Sqr(image.GetChannel({x, y}, c) - e);
+                denoisedError += Sqr(denoised.GetChannel({x, y}, c) - e);
+                // Neither the edge nor the albedo texture should be blurred
+                EXPECT_NEAR(e, denoised.GetChannel({x, y}, c), 0.1f * e) << x << ", " << y;
+            }
+    EXPECT_LT(denoisedError, 0.1 * noisyError);
+}
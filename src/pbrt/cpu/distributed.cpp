@@ -0,0 +1,483 @@
+// pbrt is Copyright(c) 1998-2020 Matt Pharr, Wenzel Jakob, and Greg Humphreys.
+// The pbrt source code is licensed under the Apache License, Version 2.0.
+// SPDX: Apache-2.0
+
+#include <pbrt/cpu/distributed.h>
+
+#include <pbrt/film.h>
+#include <pbrt/options.h>
+#include <pbrt/util/check.h>
+#include <pbrt/util/error.h>
+#include <pbrt/util/log.h>
+#include <pbrt/util/math.h>
+#include <pbrt/util/parallel.h>
+#include <pbrt/util/print.h>
+#include <pbrt/util/pstd.h>
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <deque>
+#include <mutex>
+#include <thread>
+
+#ifndef PBRT_IS_WINDOWS
+#include <errno.h>
+#include <fcntl.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <signal.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#endif  // !PBRT_IS_WINDOWS
+
+namespace pbrt {
+
+std::vector<DistributedWorkUnit> DistributedWorkUnits(const Bounds2i &pixelBounds,
+                                                      int spp, int nUnits) {
+    // Choose a tile size that gives about _nUnits_ tiles
+    nUnits = std::max(nUnits, 1);
+    int tileSize = std::max<int>(8, std::sqrt(double(pixelBounds.Area()) / nUnits));
+    std::vector<Bounds2i> tiles = HilbertCurveTiles(pixelBounds, tileSize);
+
+    // Split the samples into ranges if there are too few tiles
+    int nRanges = Clamp((nUnits + int(tiles.size()) - 1) / int(tiles.size()), 1, spp);
+    std::vector<DistributedWorkUnit> units;
+    units.reserve(nRanges * tiles.size());
+    for (int r = 0; r < nRanges; ++r) {
+        int sampleStart = int64_t(spp) * r / nRanges;
+        int sampleEnd = int64_t(spp) * (r + 1) / nRanges;
+        for (const Bounds2i &tile : tiles)
+            units.push_back(DistributedWorkUnit{tile, sampleStart, sampleEnd});
+    }
+    return units;
+}
+
+#ifdef PBRT_IS_WINDOWS
+
+std::string StartRenderCoordinator(const std::string &listenAddress, int nLocalWorkers,
+                                   const std::string &program,
+                                   const std::vector<std::string> &args) {
+    ErrorExit("Distributed rendering is not supported on Windows.");
+}
+
+bool RenderCoordinatorStarted() {
+    return false;
+}
+
+void StopRenderCoordinator() {}
+
+void CoordinateDistributedRender(
+    Film film, int spp, std::vector<DistributedWorkUnit> units,
+    std::function<void(const DistributedWorkUnit &)> unitFinished) {
+    ErrorExit("Distributed rendering is not supported on Windows.");
+}
+
+void RenderDistributedWorker(const std::string &coordinatorAddress, Film film, int spp,
+                             std::function<void(const DistributedWorkUnit &)> renderUnit) {
+    ErrorExit("Distributed rendering is not supported on Windows.");
+}
+
+#else
+
+using socket_t = int;
+static constexpr socket_t InvalidSocket = -1;
+
+// DistributedMessage Definition
+// Messages start with a _DistributedMessageHeader_ that gives their type
+// and the size of the payload that follows it.
+enum class DistributedMessage : uint32_t {
+    Hello,        // worker: DistributedHello
+    Accept,       // coordinator
+    Reject,       // coordinator
+    RequestWork,  // worker, after finishing the previous unit, if any
+    WorkUnit,     // coordinator: DistributedWorkUnit
+    Done,         // coordinator: no units remain
+    FilmPixels    // worker: Film::SerializePixels()
+};
+
+struct DistributedMessageHeader {
+    uint32_t type;
+    uint32_t pad = 0;
+    uint64_t size;
+};
+
+// DistributedHello Definition
+// Sent by workers so that the coordinator can make sure that they are
+// rendering the same image.
+struct DistributedHello {
+    static constexpr uint64_t Magic = 0x3174736474726270;  // "pbrtdst1"
+    uint64_t magic = Magic;
+    Bounds2i pixelBounds;
+    int32_t samplesPerPixel, seed;
+    uint64_t filmBytes;
+};
+
+// Distributed Rendering Utility Functions
+static void SplitAddress(const std::string &address, std::string *host,
+                         std::string *port) {
+    size_t split = address.find_last_of(':');
+    if (split == std::string::npos)
+        ErrorExit("Expected \"host:port\" for address. Given \"%s\".", address);
+    *host = address.substr(0, split);
+    *port = address.substr(split + 1);
+}
+
+static bool SendAll(socket_t socket, const void *data, size_t size) {
+    const char *ptr = (const char *)data;
+    while (size > 0) {
+        ssize_t n = send(socket, ptr, size, 0);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n <= 0)
+            return false;
+        ptr += n;
+        size -= n;
+    }
+    return true;
+}
+
+static bool RecvAll(socket_t socket, void *data, size_t size) {
+    char *ptr = (char *)data;
+    while (size > 0) {
+        ssize_t n = recv(socket, ptr, size, 0);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n <= 0)
+            return false;
+        ptr += n;
+        size -= n;
+    }
+    return true;
+}
+
+static bool SendMessage(socket_t socket, DistributedMessage type,
+                        const void *payload = nullptr, size_t size = 0) {
+    DistributedMessageHeader header;
+    header.type = uint32_t(type);
+    header.size = size;
+    return SendAll(socket, &header, sizeof(header)) && SendAll(socket, payload, size);
+}
+
+static bool RecvMessage(socket_t socket, DistributedMessage *type,
+                        std::string *payload) {
+    DistributedMessageHeader header;
+    if (!RecvAll(socket, &header, sizeof(header)) ||
+        header.type > uint32_t(DistributedMessage::FilmPixels) ||
+        header.size > (uint64_t(1) << 40))
+        return false;
+    *type = DistributedMessage(header.type);
+    payload->resize(header.size);
+    return RecvAll(socket, payload->data(), header.size);
+}
+
+// Coordinator State
+static socket_t coordinatorSocket = InvalidSocket;
+static int nLocalWorkersStarted, nLocalWorkersExited;
+static std::vector<pid_t> localWorkers;
+
+// Reaps local worker processes that have exited, waiting for them if
+// _wait_ is true.
+static void ReapLocalWorkers(bool wait) {
+    for (auto iter = localWorkers.begin(); iter != localWorkers.end();) {
+        int status;
+        if (waitpid(*iter, &status, wait ? 0 : WNOHANG) != *iter) {
+            ++iter;
+            continue;
+        }
+        if (!WIFEXITED(status) || WEXITSTATUS(status) != 0)
+            Warning("Worker process %d exited abnormally (status %d).", *iter, status);
+        ++nLocalWorkersExited;
+        iter = localWorkers.erase(iter);
+    }
+}
+
+std::string StartRenderCoordinator(const std::string &listenAddress, int nLocalWorkers,
+                                   const std::string &program,
+                                   const std::vector<std::string> &args) {
+    CHECK_EQ(coordinatorSocket, InvalidSocket);
+    // Lost connections are handled where they're detected
+    signal(SIGPIPE, SIG_IGN);
+
+    // Start listening for workers
+    std::string host, port;
+    SplitAddress(listenAddress, &host, &port);
+    struct addrinfo hints = {}, *addrinfo;
+    hints.ai_family = PF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    hints.ai_flags = AI_PASSIVE;
+    int err = getaddrinfo(host.empty() ? nullptr : host.c_str(), port.c_str(), &hints,
+                          &addrinfo);
+    if (err)
+        ErrorExit("%s: %s", listenAddress, gai_strerror(err));
+    for (struct addrinfo *ptr = addrinfo; ptr; ptr = ptr->ai_next) {
+        coordinatorSocket = socket(ptr->ai_family, ptr->ai_socktype, ptr->ai_protocol);
+        if (coordinatorSocket == InvalidSocket)
+            continue;
+        int reuse = 1;
+        setsockopt(coordinatorSocket, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+        if (bind(coordinatorSocket, ptr->ai_addr, ptr->ai_addrlen) == 0 &&
+            listen(coordinatorSocket, SOMAXCONN) == 0)
+            break;
+        close(coordinatorSocket);
+        coordinatorSocket = InvalidSocket;
+    }
+    freeaddrinfo(addrinfo);
+    if (coordinatorSocket == InvalidSocket)
+        ErrorExit("%s: unable to listen for workers: %s", listenAddress, ErrorString());
+    // Don't leak the socket into the worker processes
+    fcntl(coordinatorSocket, F_SETFD, FD_CLOEXEC);
+
+    struct sockaddr_storage addr;
+    socklen_t addrLen = sizeof(addr);
+    if (getsockname(coordinatorSocket, (struct sockaddr *)&addr, &addrLen) != 0)
+        ErrorExit("getsockname: %s", ErrorString());
+    int listenPort = ntohs(addr.ss_family == AF_INET6
+                               ? ((struct sockaddr_in6 *)&addr)->sin6_port
+                               : ((struct sockaddr_in *)&addr)->sin_port);
+    std::string workerAddress = StringPrintf("localhost:%d", listenPort);
+    LOG_VERBOSE("Listening for workers on port %d", listenPort);
+
+    // Launch local workers
+    std::vector<std::string> workerArgs = args;
+    workerArgs.insert(workerArgs.end(), {"--coordinator", workerAddress, "--quiet"});
+    std::vector<char *> argv;
+    argv.push_back(const_cast<char *>(program.c_str()));
+    for (std::string &arg : workerArgs)
+        argv.push_back(&arg[0]);
+    argv.push_back(nullptr);
+
+    fflush(stdout);
+    fflush(stderr);
+    nLocalWorkersStarted = nLocalWorkersExited = 0;
+    for (int i = 0; i < nLocalWorkers; ++i) {
+        pid_t pid = fork();
+        if (pid == 0) {
+            execvp(argv[0], argv.data());
+            _exit(127);
+        }
+        if (pid < 0)
+            ErrorExit("Unable to launch worker process: %s", ErrorString());
+        localWorkers.push_back(pid);
+        ++nLocalWorkersStarted;
+    }
+
+    return workerAddress;
+}
+
+bool RenderCoordinatorStarted() {
+    return coordinatorSocket != InvalidSocket;
+}
+
+void StopRenderCoordinator() {
+    if (coordinatorSocket == InvalidSocket)
+        return;
+    close(coordinatorSocket);
+    coordinatorSocket = InvalidSocket;
+    ReapLocalWorkers(true);
+}
+
+void CoordinateDistributedRender(
+    Film film, int spp, std::vector<DistributedWorkUnit> units,
+    std::function<void(const DistributedWorkUnit &)> unitFinished) {
+    CHECK(RenderCoordinatorStarted());
+    // Each connected worker has a queue of units; the first queue holds
+    // those that no worker has taken yet.
+    std::mutex mutex;
+    std::vector<std::deque<DistributedWorkUnit>> queues(
+        1, std::deque<DistributedWorkUnit>(units.begin(), units.end()));
+    size_t nUnitsFinished = 0;
+    int nConnected = 0, nActiveWorkers = 0;
+    uint64_t filmBytes = film.SerializePixels().size();
+
+    // Returns the next unit from the given queue, first taking the back
+    // half of the largest queue if it's empty. _mutex_ must be held.
+    auto takeUnit = [&](int queueIndex) -> pstd::optional<DistributedWorkUnit> {
+        std::deque<DistributedWorkUnit> &queue = queues[queueIndex];
+        if (queue.empty()) {
+            auto victim = std::max_element(
+                queues.begin(), queues.end(),
+                [](const auto &a, const auto &b) { return a.size() < b.size(); });
+            size_t nSteal = (victim->size() + 1) / 2;
+            queue.insert(queue.end(), victim->end() - nSteal, victim->end());
+            victim->erase(victim->end() - nSteal, victim->end());
+            if (queue.empty())
+                return {};
+        }
+        DistributedWorkUnit unit = queue.front();
+        queue.pop_front();
+        return unit;
+    };
+
+    auto serveWorker = [&](socket_t socket) {
+        // Make sure that the worker is rendering the same image
+        DistributedMessage type;
+        std::string payload;
+        DistributedHello hello;
+        bool match = RecvMessage(socket, &type, &payload) &&
+                     type == DistributedMessage::Hello && payload.size() == sizeof(hello);
+        if (match) {
+            std::memcpy(&hello, payload.data(), sizeof(hello));
+            match = hello.magic == DistributedHello::Magic &&
+                    hello.pixelBounds == film.PixelBounds() &&
+                    hello.samplesPerPixel == spp && hello.seed == Options->seed &&
+                    hello.filmBytes == filmBytes;
+        }
+        if (!match || !SendMessage(socket, DistributedMessage::Accept)) {
+            Warning("Ignoring worker that isn't rendering the same image.");
+            SendMessage(socket, DistributedMessage::Reject);
+            close(socket);
+            std::lock_guard<std::mutex> lock(mutex);
+            --nActiveWorkers;
+            return;
+        }
+
+        int queueIndex;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            queueIndex = queues.size();
+            queues.push_back({});
+        }
+
+        // Hand out work units until none remain
+        pstd::optional<DistributedWorkUnit> unit;
+        while (true) {
+            if (!RecvMessage(socket, &type, &payload) ||
+                type != DistributedMessage::RequestWork)
+                ErrorExit("Lost connection to worker.");
+            if (unit)
+                unitFinished(*unit);
+
+            std::lock_guard<std::mutex> lock(mutex);
+            if (unit)
+                ++nUnitsFinished;
+            unit = takeUnit(queueIndex);
+            if (!unit)
+                break;
+            if (!SendMessage(socket, DistributedMessage::WorkUnit, &*unit, sizeof(*unit)))
+                ErrorExit("Lost connection to worker.");
+        }
+
+        // Add the worker's film pixels to _film_
+        if (!SendMessage(socket, DistributedMessage::Done) ||
+            !RecvMessage(socket, &type, &payload) ||
+            type != DistributedMessage::FilmPixels)
+            ErrorExit("Lost connection to worker.");
+        close(socket);
+        std::lock_guard<std::mutex> lock(mutex);
+        if (!film.DeserializePixels(payload, true))
+            ErrorExit("Worker's film pixels don't match the image being rendered.");
+        --nActiveWorkers;
+    };
+
+    // Accept workers until all units have been rendered and the workers'
+    // films have been added up
+    std::vector<std::thread> threads;
+    while (true) {
+        ReapLocalWorkers(false);
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            bool localWorkersDone =
+                nConnected + nLocalWorkersExited >= nLocalWorkersStarted;
+            if (nUnitsFinished == units.size() && nActiveWorkers == 0 &&
+                localWorkersDone)
+                break;
+            if (nActiveWorkers == 0 && nLocalWorkersStarted > 0 &&
+                nLocalWorkersExited == nLocalWorkersStarted)
+                ErrorExit("Worker processes exited before rendering finished.");
+        }
+
+        struct pollfd pfd = {coordinatorSocket, POLLIN, 0};
+        if (poll(&pfd, 1, 100 /* ms */) <= 0)
+            continue;
+        socket_t socket = accept(coordinatorSocket, nullptr, nullptr);
+        if (socket == InvalidSocket) {
+            LOG_VERBOSE("accept() failed: %s", ErrorString());
+            continue;
+        }
+        std::lock_guard<std::mutex> lock(mutex);
+        ++nConnected;
+        ++nActiveWorkers;
+        threads.push_back(std::thread(serveWorker, socket));
+    }
+
+    for (std::thread &thread : threads)
+        thread.join();
+    LOG_VERBOSE("Distributed rendering finished with %d workers", nConnected);
+}
+
+void RenderDistributedWorker(const std::string &coordinatorAddress, Film film, int spp,
+                             std::function<void(const DistributedWorkUnit &)> renderUnit) {
+    signal(SIGPIPE, SIG_IGN);
+
+    // Connect to the coordinator
+    std::string host, port;
+    SplitAddress(coordinatorAddress, &host, &port);
+    struct addrinfo hints = {}, *addrinfo;
+    hints.ai_family = PF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    int err = getaddrinfo(host.c_str(), port.c_str(), &hints, &addrinfo);
+    if (err)
+        ErrorExit("%s: %s", coordinatorAddress, gai_strerror(err));
+    socket_t socket = InvalidSocket;
+    for (struct addrinfo *ptr = addrinfo; ptr; ptr = ptr->ai_next) {
+        socket = ::socket(ptr->ai_family, ptr->ai_socktype, ptr->ai_protocol);
+        if (socket == InvalidSocket)
+            continue;
+        if (connect(socket, ptr->ai_addr, ptr->ai_addrlen) == 0)
+            break;
+        close(socket);
+        socket = InvalidSocket;
+    }
+    freeaddrinfo(addrinfo);
+    if (socket == InvalidSocket)
+        ErrorExit("%s: unable to connect to coordinator: %s", coordinatorAddress,
+                  ErrorString());
+
+    DistributedHello hello;
+    hello.pixelBounds = film.PixelBounds();
+    hello.samplesPerPixel = spp;
+    hello.seed = Options->seed;
+    hello.filmBytes = film.SerializePixels().size();
+    DistributedMessage type;
+    std::string payload;
+    if (!SendMessage(socket, DistributedMessage::Hello, &hello, sizeof(hello)) ||
+        !RecvMessage(socket, &type, &payload)) {
+        // The coordinator stops listening once the image is finished
+        Warning("%s: coordinator closed the connection before handing out work.",
+                coordinatorAddress);
+        close(socket);
+        return;
+    }
+    if (type != DistributedMessage::Accept)
+        ErrorExit("%s: coordinator is rendering a different image.", coordinatorAddress);
+
+    // Render work units until the coordinator has no more
+    int nUnits = 0;
+    while (true) {
+        if (!SendMessage(socket, DistributedMessage::RequestWork) ||
+            !RecvMessage(socket, &type, &payload))
+            ErrorExit("%s: lost connection to coordinator.", coordinatorAddress);
+        if (type == DistributedMessage::Done)
+            break;
+        DistributedWorkUnit unit;
+        if (type != DistributedMessage::WorkUnit || payload.size() != sizeof(unit))
+            ErrorExit("%s: unexpected message from coordinator.", coordinatorAddress);
+        std::memcpy(&unit, payload.data(), sizeof(unit));
+        renderUnit(unit);
+        ++nUnits;
+    }
+
+    std::string pixels = film.SerializePixels();
+    if (!SendMessage(socket, DistributedMessage::FilmPixels, pixels.data(),
+                     pixels.size()))
+        ErrorExit("%s: lost connection to coordinator.", coordinatorAddress);
+    close(socket);
+    LOG_VERBOSE("Worker rendered %d work units", nUnits);
+}
+
+#endif  // PBRT_IS_WINDOWS
+
+}  // namespace pbrt
@@ -0,0 +1,67 @@
+// pbrt is Copyright(c) 1998-2020 Matt Pharr, Wenzel Jakob, and Greg Humphreys.
+// The pbrt source code is licensed under the Apache License, Version 2.0.
+// SPDX: Apache-2.0
+
+#ifndef PBRT_CPU_DISTRIBUTED_H
+#define PBRT_CPU_DISTRIBUTED_H
+
+#include <pbrt/pbrt.h>
+
+#include <pbrt/base/film.h>
+#include <pbrt/util/vecmath.h>
+
+#include <functional>
+#include <string>
+#include <vector>
+
+namespace pbrt {
+
+// DistributedWorkUnit Definition
+// A region of the image and a range of sample indices, [sampleStart,
+// sampleEnd), for a worker process to render.
+struct DistributedWorkUnit {
+    Bounds2i pixelBounds;
+    int sampleStart, sampleEnd;
+};
+
+// Distributed Rendering Function Declarations
+// In distributed rendering, a coordinator process hands out work units to
+// worker processes, which may run on other hosts, over TCP connections.
+// Workers that run out of work take half of the remaining units of the
+// worker that has the most, and they send the unnormalized sums in their
+// films' pixels to the coordinator once there is no work left so that it
+// can add them up and write the final image. All processes must render
+// the same scene on machines with the same byte order.
+
+// Starts listening for workers at _listenAddress_ ("host:port"; port 0
+// picks an unused port) and launches _nLocalWorkers_ worker processes
+// running _program_ with the given arguments. Returns the address that
+// local workers connect to.
+std::string StartRenderCoordinator(const std::string &listenAddress, int nLocalWorkers,
+                                   const std::string &program,
+                                   const std::vector<std::string> &args);
+bool RenderCoordinatorStarted();
+// Stops listening and waits for the local worker processes to exit.
+void StopRenderCoordinator();
+
+// Splits the given pixel bounds and samples into about _nUnits_ work
+// units, splitting the sample range as well if the image is too small for
+// that many tiles.
+std::vector<DistributedWorkUnit> DistributedWorkUnits(const Bounds2i &pixelBounds,
+                                                      int spp, int nUnits);
+
+// Hands out _units_ to workers until all of them have been rendered and
+// adds the pixels of the workers' films to _film_. _unitFinished_ is
+// called after each unit is rendered.
+void CoordinateDistributedRender(
+    Film film, int spp, std::vector<DistributedWorkUnit> units,
+    std::function<void(const DistributedWorkUnit &)> unitFinished);
+
+// Connects to the coordinator at _coordinatorAddress_, calls _renderUnit_
+// for each work unit it hands out, and then sends it _film_'s pixels.
+void RenderDistributedWorker(const std::string &coordinatorAddress, Film film, int spp,
+                             std::function<void(const DistributedWorkUnit &)> renderUnit);
+
+}  // namespace pbrt
+
+#endif  // PBRT_CPU_DISTRIBUTED_H
@@ -0,0 +1,107 @@
+// pbrt is Copyright(c) 1998-2020 Matt Pharr, Wenzel Jakob, and Greg Humphreys.
+// The pbrt source code is licensed under the Apache License, Version 2.0.
+// SPDX: Apache-2.0
+
+#include <gtest/gtest.h>
+
+#include <pbrt/pbrt.h>
+#include <pbrt/cpu/distributed.h>
+#include <pbrt/film.h>
+#include <pbrt/filters.h>
+#include <pbrt/util/colorspace.h>
+#include <pbrt/util/containers.h>
+#include <pbrt/util/spectrum.h>
+
+#include <atomic>
+#include <cstring>
+#include <thread>
+
+using namespace pbrt;
+
+TEST(Distributed, WorkUnits) {
+    Bounds2i pixelBounds({-3, 5}, {61, 40});
+    for (int spp : {1, 7, 64})
+        for (int nUnits : {1, 16, 1000}) {
+            // Every sample of every pixel should be in exactly one unit
+            Array2D<std::vector<int>> counts(pixelBounds, std::vector<int>(spp, 0));
+            for (const DistributedWorkUnit &unit :
+                 DistributedWorkUnits(pixelBounds, spp, nUnits)) {
+                EXPECT_TRUE(Inside(unit.pixelBounds, pixelBounds));
+                for (Point2i p : unit.pixelBounds)
+                    for (int i = unit.sampleStart; i < unit.sampleEnd; ++i)
+                        ++counts[p][i];
+            }
+            for (Point2i p : pixelBounds)
+                for (int i = 0; i < spp; ++i)
+                    EXPECT_EQ(1, counts[p][i]);
+        }
+}
+
+static Film MakeFilm(const Bounds2i &pixelBounds) {
+    Filter filter = new BoxFilter(Vector2f(0.5, 0.5));
+    FilmBaseParameters fp(Point2i(pixelBounds.pMax), pixelBounds, filter, 1.,
+                          PixelSensor::CreateDefault(), "distributed.exr");
+    return new RGBFilm(fp, RGBColorSpace::sRGB);
+}
+
+static void AddSamples(Film film, const DistributedWorkUnit &unit) {
+    SampledWavelengths lambda = SampledWavelengths::SampleUniform(0.5f);
+    for (Point2i p : unit.pixelBounds)
+        for (int i = unit.sampleStart; i < unit.sampleEnd; ++i)
+            film.AddSample(p, SampledSpectrum(1 + (p.x + 3 * p.y + i) % 5), lambda,
+                           nullptr, 1);
+    film.AddSplat(Point2f(10.5f, 20.5f),
+                  SampledSpectrum(unit.sampleEnd - unit.sampleStart), lambda);
+}
+
+TEST(Distributed, CoordinatorAndWorkers) {
+    Bounds2i pixelBounds({0, 0}, {40, 30});
+    int spp = 8;
+    std::vector<DistributedWorkUnit> units = DistributedWorkUnits(pixelBounds, spp, 64);
+    Film reference = MakeFilm(pixelBounds);
+    for (const DistributedWorkUnit &unit : units)
+        AddSamples(reference, unit);
+
+    // Run the workers in threads; each one waits for the others to have
+    // a unit before rendering its first one so that all of them take part.
+    std::string address = StartRenderCoordinator("localhost:0", 0, "", {});
+    int nWorkers = 3;
+    std::atomic<int> nWorkersStarted{0};
+    std::vector<std::thread> workers;
+    for (int i = 0; i < nWorkers; ++i)
+        workers.push_back(std::thread([&]() {
+            Film film = MakeFilm(pixelBounds);
+            bool first = true;
+            RenderDistributedWorker(address, film, spp,
+                                    [&](const DistributedWorkUnit &unit) {
+                                        if (first) {
+                                            ++nWorkersStarted;
+                                            while (nWorkersStarted < nWorkers)
+                                                std::this_thread::yield();
+                                            first = false;
+                                        }
+                                        AddSamples(film, unit);
+                                    });
+        }));
+
+    Film film = MakeFilm(pixelBounds);
+    std::atomic<int> nUnitsFinished{0};
+    CoordinateDistributedRender(film, spp, units,
+                                [&](const DistributedWorkUnit &) { ++nUnitsFinished; });
+    StopRenderCoordinator();
+    for (std::thread &worker : workers)
+        worker.join();
+    EXPECT_EQ(nWorkers, nWorkersStarted);
+    EXPECT_EQ(units.size(), nUnitsFinished);
+
+    // The workers' films should add up to the film with all of the samples
+    std::string expected = reference.SerializePixels();
+    std::string merged = film.SerializePixels();
+    ASSERT_EQ(expected.size(), merged.size());
+    for (size_t i = 0; i < expected.size(); i += sizeof(double)) {
+        double e, m;
+        std::memcpy(&e, expected.data() + i, sizeof(double));
+        std::memcpy(&m, merged.data() + i, sizeof(double));
+        EXPECT_NEAR(e, m, 1e-9 * std::abs(e));
+    }
+}
@@ -7,6 +7,8 @@
 #include <pbrt/bsdf.h>
 #include <pbrt/bssrdf.h>
 #include <pbrt/cameras.h>
+#include <pbrt/cpu/denoiser.h>
+#include <pbrt/cpu/distributed.h>
 #include <pbrt/film.h>
 #include <pbrt/filters.h>
 #include <pbrt/interaction.h>
@@ -43,6 +45,7 @@
 namespace pbrt {
 
 STAT_COUNTER("Integrator/Camera rays traced", nCameraRays);
+STAT_COUNTER("Integrator/Image tiles split for cost", nTilesSplit);
 
 // RandomWalkIntegrator Method Definitions
 std::unique_ptr<RandomWalkIntegrator> RandomWalkIntegrator::Create(
@@ -60,6 +63,147 @@ std::string RandomWalkIntegrator::ToString() const {
 // Integrator Method Definitions
 Integrator::~Integrator() {}
 
+// ImageTileScheduler Method Definitions
+ImageTileScheduler::ImageTileScheduler(const Bounds2i &pixelBounds)
+    : pixelBounds(pixelBounds), sampleSeconds(pixelBounds) {
+    // Use the same tile size as _ParallelFor2D()_
+    tileSize = Clamp(int(std::sqrt(pixelBounds.Area() / (8 * RunningThreads()))), 1, 32);
+}
+
+void ImageTileScheduler::Render(std::vector<std::pair<int, int>> w,
+                                std::function<void(Bounds2i, int, int)> func) {
+    if (w.empty() || pixelBounds.IsEmpty())
+        return;
+    waves = std::move(w);
+    startWave(0);
+
+    // Have each thread render tiles until all have been handed out
+    ParallelFor(0, RunningThreads(), [&](int64_t) {
+        Tile tile;
+        while (nextTile(&tile)) {
+            Timer timer;
+            func(tile.bounds, waves[tile.wave].first, waves[tile.wave].second);
+            finishTile(tile, timer.ElapsedSeconds());
+        }
+    });
+    CHECK(running.empty());
+}
+
+void ImageTileScheduler::startWave(int wave) {
+    currentWave = wave;
+    tiles.clear();
+    std::vector<Bounds2i> baseTiles = HilbertCurveTiles(pixelBounds, tileSize);
+    if (!haveTimings)
+        tiles = std::move(baseTiles);
+    else {
+        // Split tiles expected to take more than a quarter of a thread's
+        // average share of the wave's time (twice the cost of a tile if each
+        // thread took eight equal ones) into quadrants
+        double maxCost = 2 * cost(pixelBounds) / (8 * RunningThreads());
+        std::function<void(const Bounds2i &)> addTile = [&](const Bounds2i &b) {
+            Vector2i d = b.Diagonal();
+            if (d.x < 2 * MinTileSize || d.y < 2 * MinTileSize || cost(b) <= maxCost) {
+                tiles.push_back(b);
+                return;
+            }
+            // Add quadrants in the order of the Hilbert curve's first level
+            ++nTilesSplit;
+            Point2i pMid = b.pMin + d / 2;
+            addTile(Bounds2i(b.pMin, pMid));
+            addTile(Bounds2i(Point2i(b.pMin.x, pMid.y), Point2i(pMid.x, b.pMax.y)));
+            addTile(Bounds2i(pMid, b.pMax));
+            addTile(Bounds2i(Point2i(pMid.x, b.pMin.y), Point2i(b.pMax.x, pMid.y)));
+        };
+        for (const Bounds2i &b : baseTiles)
+            addTile(b);
+    }
+    tileStarted.assign(tiles.size(), false);
+    firstUnstarted = 0;
+}
+
+bool ImageTileScheduler::nextTile(Tile *tile) {
+    std::unique_lock<std::mutex> lock(mutex);
+    while (true) {
+        // Start the first remaining tile of the current wave that doesn't
+        // overlap a tile of the previous wave that is still being rendered,
+        // preferring tiles in the thread's band of the image in NUMA mode
+        for (int pass = NumaEnabled() ? 0 : 1; pass < 2; ++pass)
+            for (size_t i = firstUnstarted; i < tiles.size(); ++i) {
+                const Bounds2i &b = tiles[i];
+                if (tileStarted[i] ||
+                    (pass == 0 && NumaNodeForRow((b.pMin.y + b.pMax.y) / 2 -
+                                                     pixelBounds.pMin.y,
+                                                 pixelBounds.Diagonal().y) !=
+                                      ThreadNumaNode()) ||
+                    std::any_of(running.begin(), running.end(), [&](const Tile &r) {
+                        return r.wave != currentWave && !Intersect(r.bounds, b).IsEmpty();
+                    }))
+                    continue;
+
+                tileStarted[i] = true;
+                while (firstUnstarted < tiles.size() && tileStarted[firstUnstarted])
+                    ++firstUnstarted;
+                *tile = Tile{b, currentWave};
+                running.push_back(*tile);
+                return true;
+            }
+
+        if (firstUnstarted == tiles.size()) {
+            if (currentWave + 1 == int(waves.size()))
+                return false;
+            // Move on to the next wave once the previous wave has finished
+            // so that at most two are in flight
+            if (std::all_of(running.begin(), running.end(),
+                            [&](const Tile &r) { return r.wave == currentWave; })) {
+                startWave(currentWave + 1);
+                continue;
+            }
+        }
+
+        // Wait for a tile to finish before trying again
+        tileFinished.wait(lock);
+    }
+}
+
+void ImageTileScheduler::finishTile(const Tile &tile, double seconds) {
+    std::lock_guard<std::mutex> lock(mutex);
+    // Record the tile's time per sample for each of its pixels
+    int nSamples = waves[tile.wave].second - waves[tile.wave].first;
+    float pixelSeconds = seconds / (tile.bounds.Area() * std::max(1, nSamples));
+    for (Point2i p : tile.bounds)
+        sampleSeconds[p] = pixelSeconds;
+    haveTimings = true;
+
+    auto iter = std::find_if(running.begin(), running.end(), [&](const Tile &r) {
+        return r.wave == tile.wave && r.bounds == tile.bounds;
+    });
+    CHECK(iter != running.end());
+    running.erase(iter);
+    tileFinished.notify_all();
+}
+
+double ImageTileScheduler::cost(const Bounds2i &b) const {
+    double sum = 0;
+    for (Point2i p : b)
+        sum += sampleSeconds[p];
+    return sum;
+}
+
+// RenderCheckpointHeader Definition
+// A checkpoint written when --time-limit stops rendering starts with this
+// header, which is followed by the film's serialized pixels and, with
+// adaptive sampling, the per-pixel estimates and active flags.
+struct RenderCheckpointHeader {
+    static constexpr uint64_t Magic = 0x31706b6374726270;  // "pbrtckp1"
+    uint64_t magic = Magic;
+    uint64_t dataHash;
+    Bounds2i pixelBounds;
+    int32_t samplesPerPixel, seed, sampleStart, sampleEnd;
+    int32_t waveStart, waveEnd, nextWaveSize;
+    int32_t adaptive;
+    uint64_t filmBytes;
+};
+
 // ImageTileIntegrator Method Definitions
 void ImageTileIntegrator::Render() {
     // Handle debugStart, if set
@@ -100,10 +244,125 @@ void ImageTileIntegrator::Render() {
 
     Bounds2i pixelBounds = camera.GetFilm().PixelBounds();
     int spp = samplerPrototype.SamplesPerPixel();
-    ProgressReporter progress(int64_t(spp) * pixelBounds.Area(), "Rendering",
-                              Options->quiet);
+    // Take just the samples in the range given by --sample-range, if set
+    int sampleStart = 0, sampleEnd = spp;
+    if (Options->sampleEnd != -1) {
+        sampleStart = std::min(Options->sampleStart, spp);
+        sampleEnd = std::min(Options->sampleEnd, spp);
+        if (sampleStart == sampleEnd)
+            ErrorExit("--sample-range %d,%d doesn't include any of the %d pixel samples.",
+                      Options->sampleStart, Options->sampleEnd, spp);
+        if (sampleEnd != Options->sampleEnd)
+            Warning("--sample-range %d,%d extends past the %d pixel samples. Clamping.",
+                    Options->sampleStart, Options->sampleEnd, spp);
+    }
+    ProgressReporter progress(int64_t(sampleEnd - sampleStart) * pixelBounds.Area(),
+                              "Rendering", Options->quiet);
+
+    int waveStart = sampleStart, waveEnd = sampleStart + 1, nextWaveSize = 1;
+
+    // Initialize per-pixel state for adaptive sampling
+    int64_t maxSamples = int64_t(sampleEnd - sampleStart) * pixelBounds.Area();
+    if (adaptiveSampling) {
+        pixelEstimates = Array2D<VarianceEstimator<Float>>(pixelBounds);
+        activePixels = Array2D<uint8_t>(pixelBounds, 1);
+        maxSamples = adaptiveBudget * maxSamples;
+    }
+
+    // Restore film and wave state from the checkpoint if resuming; since
+    // samplers are seeded by pixel and sample index, the remaining waves
+    // take the same samples as an uninterrupted render would
+    std::string checkpointFilename = camera.GetFilm().GetFilename() + ".checkpoint";
+    bool resumed = false;
+    if (Options->resume) {
+        if (!FileExists(checkpointFilename))
+            Warning("%s: checkpoint not found. Rendering from the start.",
+                    checkpointFilename);
+        else if (!readCheckpoint(checkpointFilename, &waveStart, &waveEnd,
+                                 &nextWaveSize))
+            ErrorExit("%s: checkpoint doesn't match the scene being rendered.",
+                      checkpointFilename);
+        else {
+            resumed = true;
+            progress.Update(int64_t(waveStart - sampleStart) * pixelBounds.Area());
+            LOG_VERBOSE("Resuming rendering at sample %d", waveStart);
+        }
+    }
+
+    // Count the samples taken on each NUMA node to report its throughput
+    int nNumaNodes = NumaNodeCount();
+    std::unique_ptr<std::atomic<int64_t>[]> numaNodeSamples(
+        new std::atomic<int64_t>[nNumaNodes]);
+    for (int i = 0; i < nNumaNodes; ++i)
+        numaNodeSamples[i] = 0;
+
+    auto renderTile = [&](Bounds2i tileBounds, int tileWaveStart, int tileWaveEnd) {
+        // Render image tile given by _tileBounds_
+        ScratchBuffer &scratchBuffer = scratchBuffers.Get();
+        Sampler &sampler = samplers.Get();
+        PBRT_DBG("Starting image tile (%d,%d)-(%d,%d) waveStart %d, waveEnd %d\n",
+                 tileBounds.pMin.x, tileBounds.pMin.y, tileBounds.pMax.x,
+                 tileBounds.pMax.y, tileWaveStart, tileWaveEnd);
+        int64_t tileSamples = 0;
+        for (Point2i pPixel : tileBounds) {
+            // Skip pixels that adaptive sampling has finished with
+            if (adaptiveSampling && !activePixels[pPixel])
+                continue;
+
+            StatsReportPixelStart(pPixel);
+            threadPixel = pPixel;
+            // Render samples in pixel _pPixel_
+            for (int sampleIndex = tileWaveStart; sampleIndex < tileWaveEnd;
+                 ++sampleIndex) {
+                threadSampleIndex = sampleIndex;
+                sampler.StartPixelSample(pPixel, sampleIndex);
+                EvaluatePixelSample(pPixel, sampleIndex, sampler, scratchBuffer);
+                scratchBuffer.Reset();
+            }
+            tileSamples += tileWaveEnd - tileWaveStart;
 
-    int waveStart = 0, waveEnd = 1, nextWaveSize = 1;
+            StatsReportPixelEnd(pPixel);
+        }
+        PBRT_DBG("Finished image tile (%d,%d)-(%d,%d)\n", tileBounds.pMin.x,
+                 tileBounds.pMin.y, tileBounds.pMax.x, tileBounds.pMax.y);
+        progress.Update((tileWaveEnd - tileWaveStart) * tileBounds.Area());
+        numaNodeSamples[ThreadNumaNode()].fetch_add(tileSamples,
+                                                    std::memory_order_relaxed);
+    };
+
+    // Render in distributed mode if this is a worker or coordinator
+    if (!Options->coordinatorAddress.empty() || RenderCoordinatorStarted()) {
+        if (adaptiveSampling)
+            ErrorExit("Adaptive sampling is not supported with distributed rendering.");
+        Film film = camera.GetFilm();
+        if (!Options->coordinatorAddress.empty())
+            // Render the units the coordinator hands out with all of our threads
+            RenderDistributedWorker(
+                Options->coordinatorAddress, film, spp,
+                [&](const DistributedWorkUnit &unit) {
+                    ParallelFor2D(unit.pixelBounds, [&](Bounds2i tileBounds) {
+                        renderTile(tileBounds, unit.sampleStart, unit.sampleEnd);
+                    });
+                });
+        else {
+            // Hand out work to the workers and write the image they rendered
+            int nUnits = 64 * std::max(Options->workers, 4);
+            CoordinateDistributedRender(
+                film, spp, DistributedWorkUnits(pixelBounds, spp, nUnits),
+                [&](const DistributedWorkUnit &unit) {
+                    progress.Update(int64_t(unit.sampleEnd - unit.sampleStart) *
+                                    unit.pixelBounds.Area());
+                });
+            progress.Done();
+
+            ImageMetadata metadata;
+            metadata.renderTimeSeconds = progress.ElapsedSeconds();
+            metadata.samplesPerPixel = spp;
+            camera.InitMetadata(&metadata);
+            film.WriteImage(metadata, 1.0f / spp);
+        }
+        return;
+    }
 
     if (Options->recordPixelStatistics)
         StatsEnablePixelStats(pixelBounds,
@@ -140,15 +399,29 @@ void ImageTileIntegrator::Render() {
     }
 
     // Connect to display server if needed
+    // With --denoise, the display shows the denoised image from the last wave.
+    std::mutex denoisedImageMutex;
+    Image denoisedImage;
     if (!Options->displayServer.empty()) {
         Film film = camera.GetFilm();
         DisplayDynamic(film.GetFilename(), Point2i(pixelBounds.Diagonal()),
                        {"R", "G", "B"},
                        [&](Bounds2i b, pstd::span<pstd::span<Float>> displayValue) {
                            int index = 0;
+                           std::lock_guard<std::mutex> lock(denoisedImageMutex);
+                           if (denoisedImage) {
+                               for (Point2i p : b) {
+                                   for (int c = 0; c < 3; ++c)
+                                       displayValue[c][index] =
+                                           denoisedImage.GetChannel(p, c);
+                                   ++index;
+                               }
+                               return;
+                           }
                            for (Point2i p : b) {
                                RGB rgb = film.GetPixelRGB(pixelBounds.pMin + p,
-                                                          2.f / (waveStart + waveEnd));
+                                                          2.f / (waveStart + waveEnd -
+                                                                 2 * sampleStart));
                                for (int c = 0; c < 3; ++c)
                                    displayValue[c][index] = rgb[c];
                                ++index;
@@ -157,62 +430,120 @@ void ImageTileIntegrator::Render() {
     }
 
     // Render image in waves
-    while (waveStart < spp) {
-        // Render current wave's image tiles in parallel
-        ParallelFor2D(pixelBounds, [&](Bounds2i tileBounds) {
-            // Render image tile given by _tileBounds_
-            ScratchBuffer &scratchBuffer = scratchBuffers.Get();
-            Sampler &sampler = samplers.Get();
-            PBRT_DBG("Starting image tile (%d,%d)-(%d,%d) waveStart %d, waveEnd %d\n",
-                     tileBounds.pMin.x, tileBounds.pMin.y, tileBounds.pMax.x,
-                     tileBounds.pMax.y, waveStart, waveEnd);
-            for (Point2i pPixel : tileBounds) {
-                StatsReportPixelStart(pPixel);
-                threadPixel = pPixel;
-                // Render samples in pixel _pPixel_
-                for (int sampleIndex = waveStart; sampleIndex < waveEnd; ++sampleIndex) {
-                    threadSampleIndex = sampleIndex;
-                    sampler.StartPixelSample(pPixel, sampleIndex);
-                    EvaluatePixelSample(pPixel, sampleIndex, sampler, scratchBuffer);
-                    scratchBuffer.Reset();
-                }
+    // Unless the image is needed after each wave, the remaining waves are
+    // all given to the tile scheduler at once so that they can overlap.
+    bool overlapWaves = !Options->writePartialImages && !referenceImage &&
+                        Options->displayServer.empty() && !adaptiveSampling &&
+                        Options->timeLimit == 0;
+    ImageTileScheduler tileScheduler(pixelBounds);
+    bool outOfTime = false;
+    while (waveStart < sampleEnd) {
+        double waveStartSeconds = progress.ElapsedSeconds();
+        // Find the sample ranges of the waves to render before the next update
+        std::vector<std::pair<int, int>> waves(1, std::make_pair(waveStart, waveEnd));
+        for (int start = waveEnd, size = nextWaveSize; overlapWaves && start < sampleEnd;
+             size = std::min(2 * size, 64)) {
+            waves.push_back(std::make_pair(start, std::min(sampleEnd, start + size)));
+            start = waves.back().second;
+        }
 
-                StatsReportPixelEnd(pPixel);
-            }
-            PBRT_DBG("Finished image tile (%d,%d)-(%d,%d)\n", tileBounds.pMin.x,
-                     tileBounds.pMin.y, tileBounds.pMax.x, tileBounds.pMax.y);
-            progress.Update((waveEnd - waveStart) * tileBounds.Area());
-        });
+        // Render the waves' image tiles in parallel
+        tileScheduler.Render(waves, renderTile);
 
         // Update start and end wave
-        waveStart = waveEnd;
-        waveEnd = std::min(spp, waveEnd + nextWaveSize);
-        if (!referenceImage)
-            nextWaveSize = std::min(2 * nextWaveSize, 64);
-        if (waveStart == spp)
+        for (size_t i = 0; i < waves.size(); ++i) {
+            waveStart = waveEnd;
+            waveEnd = std::min(sampleEnd, waveEnd + nextWaveSize);
+            if (!referenceImage)
+                nextWaveSize = std::min(2 * nextWaveSize, 64);
+        }
+        int samplesTaken = waveStart - sampleStart;
+        if (waveStart == sampleEnd)
             progress.Done();
+        else if (adaptiveSampling)
+            updateActivePixels(samplesTaken, waveEnd - waveStart, maxSamples);
+
+        // Denoise the image for the display after each wave
+        if (Options->denoise && !Options->displayServer.empty()) {
+            ImageMetadata filmMetadata;
+            Image image = DenoiseImage(
+                camera.GetFilm().GetImage(&filmMetadata, 1.f / samplesTaken),
+                samplesTaken);
+            std::lock_guard<std::mutex> lock(denoisedImageMutex);
+            denoisedImage = std::move(image);
+        }
+
+        // Stop if the next wave isn't expected to finish within the time
+        // limit, estimating its time from the time per sample of the last one
+        if (Options->timeLimit > 0 && waveStart < sampleEnd) {
+            double elapsed = progress.ElapsedSeconds();
+            double lastWaveSamples = waveStart - waves.back().first;
+            double nextWaveSeconds = (elapsed - waveStartSeconds) / lastWaveSamples *
+                                     (waveEnd - waveStart);
+            if (elapsed + nextWaveSeconds > Options->timeLimit) {
+                outOfTime = true;
+                progress.Done();
+            }
+        }
 
         // Optionally write current image to disk
-        if (waveStart == spp || Options->writePartialImages || referenceImage) {
-            LOG_VERBOSE("Writing image with spp = %d", waveStart);
+        if (waveStart == sampleEnd || Options->writePartialImages || referenceImage ||
+            outOfTime) {
+            LOG_VERBOSE("Writing image with spp = %d", samplesTaken);
             ImageMetadata metadata;
             metadata.renderTimeSeconds = progress.ElapsedSeconds();
-            metadata.samplesPerPixel = waveStart;
+            metadata.samplesPerPixel = samplesTaken;
             if (referenceImage) {
                 ImageMetadata filmMetadata;
                 Image filmImage =
-                    camera.GetFilm().GetImage(&filmMetadata, 1.f / waveStart);
+                    camera.GetFilm().GetImage(&filmMetadata, 1.f / samplesTaken);
                 ImageChannelValues mse =
                     filmImage.MSE(filmImage.AllChannelsDesc(), *referenceImage);
-                fprintf(mseOutFile, "%d, %.9g\n", waveStart, mse.Average());
+                fprintf(mseOutFile, "%d, %.9g\n", samplesTaken, mse.Average());
                 metadata.MSE = mse.Average();
                 fflush(mseOutFile);
             }
-            if (waveStart == spp || Options->writePartialImages) {
+            if (waveStart == sampleEnd || Options->writePartialImages || outOfTime) {
                 camera.InitMetadata(&metadata);
-                camera.GetFilm().WriteImage(metadata, 1.0f / waveStart);
+                camera.GetFilm().WriteImage(metadata, 1.0f / samplesTaken);
+
+                if (adaptiveSampling) {
+                    // Write image with the number of samples taken at each pixel
+                    Image sampleCounts(PixelFormat::Float, Point2i(pixelBounds.Diagonal()),
+                                       {"Y"});
+                    for (Point2i p : pixelBounds)
+                        sampleCounts.SetChannel(Point2i(p - pixelBounds.pMin), 0,
+                                                pixelEstimates[p].Count());
+                    std::string filename =
+                        RemoveExtension(camera.GetFilm().GetFilename()) + "-spp.exr";
+                    sampleCounts.Write(filename, metadata);
+                }
             }
         }
+
+        if (outOfTime) {
+            writeCheckpoint(checkpointFilename, waveStart, waveEnd, nextWaveSize);
+            if (!Options->quiet)
+                Printf("Time limit reached after %d samples per pixel. Wrote "
+                       "checkpoint \"%s\"; render with --resume to continue.\n",
+                       samplesTaken, checkpointFilename);
+            break;
+        }
+    }
+
+    // Remove the checkpoint once the render it was written for is finished
+    if (resumed && waveStart == sampleEnd && remove(checkpointFilename.c_str()) != 0)
+        Warning("%s: %s", checkpointFilename, ErrorString());
+
+    if (NumaEnabled() && !Options->quiet) {
+        double seconds = progress.ElapsedSeconds();
+        int64_t totalSamples = 0;
+        for (int i = 0; i < nNumaNodes; ++i)
+            totalSamples += numaNodeSamples[i];
+        for (int i = 0; i < nNumaNodes; ++i)
+            Printf("NUMA node %d: %.3f M samples/s (%.1f%% of samples)\n", i,
+                   numaNodeSamples[i] / (1e6 * seconds),
+                   100. * numaNodeSamples[i] / totalSamples);
     }
 
     if (mseOutFile)
@@ -221,6 +552,128 @@ void ImageTileIntegrator::Render() {
     LOG_VERBOSE("Rendering finished");
 }
 
+void ImageTileIntegrator::writeCheckpoint(const std::string &filename, int waveStart,
+                                          int waveEnd, int nextWaveSize) const {
+    std::string film = camera.GetFilm().SerializePixels();
+    std::string data = film;
+    if (adaptiveSampling) {
+        Bounds2i pixelBounds = camera.GetFilm().PixelBounds();
+        for (Point2i p : pixelBounds)
+            data.append((const char *)&pixelEstimates[p], sizeof(pixelEstimates[p]));
+        for (Point2i p : pixelBounds)
+            data.push_back(activePixels[p]);
+    }
+
+    RenderCheckpointHeader header;
+    header.dataHash = HashBuffer(data.data(), data.size());
+    header.pixelBounds = camera.GetFilm().PixelBounds();
+    header.samplesPerPixel = samplerPrototype.SamplesPerPixel();
+    header.seed = Options->seed;
+    header.sampleStart = Options->sampleStart;
+    header.sampleEnd = Options->sampleEnd;
+    header.waveStart = waveStart;
+    header.waveEnd = waveEnd;
+    header.nextWaveSize = nextWaveSize;
+    header.adaptive = adaptiveSampling;
+    header.filmBytes = film.size();
+
+    std::string contents((const char *)&header, sizeof(header));
+    contents += data;
+    if (!WriteFileContentsAtomic(filename, contents))
+        Warning("%s: unable to write checkpoint.", filename);
+}
+
+bool ImageTileIntegrator::readCheckpoint(const std::string &filename, int *waveStart,
+                                         int *waveEnd, int *nextWaveSize) {
+    std::string contents = ReadFileContents(filename);
+    RenderCheckpointHeader header;
+    if (contents.size() < sizeof(header))
+        return false;
+    std::memcpy(&header, contents.data(), sizeof(header));
+    std::string data = contents.substr(sizeof(header));
+
+    // Make sure that the checkpoint is intact and was written for this render
+    Bounds2i pixelBounds = camera.GetFilm().PixelBounds();
+    size_t adaptiveBytes =
+        adaptiveSampling
+            ? pixelBounds.Area() * (sizeof(VarianceEstimator<Float>) + sizeof(uint8_t))
+            : 0;
+    if (header.magic != RenderCheckpointHeader::Magic ||
+        header.dataHash != HashBuffer(data.data(), data.size()) ||
+        header.pixelBounds != pixelBounds ||
+        header.samplesPerPixel != samplerPrototype.SamplesPerPixel() ||
+        header.seed != Options->seed || header.sampleStart != Options->sampleStart ||
+        header.sampleEnd != Options->sampleEnd || header.adaptive != int(adaptiveSampling) ||
+        header.filmBytes + adaptiveBytes != data.size())
+        return false;
+    if (!camera.GetFilm().DeserializePixels(data.substr(0, header.filmBytes)))
+        return false;
+
+    if (adaptiveSampling) {
+        const char *ptr = data.data() + header.filmBytes;
+        for (Point2i p : pixelBounds) {
+            std::memcpy(&pixelEstimates[p], ptr, sizeof(pixelEstimates[p]));
+            ptr += sizeof(pixelEstimates[p]);
+        }
+        for (Point2i p : pixelBounds)
+            activePixels[p] = *ptr++;
+    }
+
+    *waveStart = header.waveStart;
+    *waveEnd = header.waveEnd;
+    *nextWaveSize = header.nextWaveSize;
+    return true;
+}
+
+void ImageTileIntegrator::SetAdaptiveSampling(int minSPP, Float errorThreshold,
+                                              Float budget) {
+    CHECK_GT(minSPP, 1);
+    CHECK_GT(errorThreshold, 0);
+    CHECK(budget > 0 && budget <= 1);
+    adaptiveSampling = true;
+    adaptiveMinSPP = minSPP;
+    adaptiveErrorThreshold = errorThreshold;
+    adaptiveBudget = budget;
+}
+
+void ImageTileIntegrator::updateActivePixels(int samplesTaken, int nextWaveSamples,
+                                             int64_t maxSamples) {
+    // Every pixel is sampled until _adaptiveMinSPP_ samples have been taken
+    if (samplesTaken < adaptiveMinSPP)
+        return;
+
+    // Stop sampling pixels whose relative error is below the threshold
+    Bounds2i pixelBounds = camera.GetFilm().PixelBounds();
+    int64_t totalSamples = 0;
+    std::vector<std::pair<Float, Point2i>> pixelErrors;
+    for (Point2i p : pixelBounds) {
+        const VarianceEstimator<Float> &estimate = pixelEstimates[p];
+        totalSamples += estimate.Count();
+        if (!activePixels[p])
+            continue;
+        Float error = std::sqrt(estimate.Variance() / estimate.Count()) /
+                      std::max<Float>(std::abs(estimate.Mean()), 1e-3f);
+        if (error < adaptiveErrorThreshold)
+            activePixels[p] = 0;
+        else
+            pixelErrors.push_back(std::make_pair(error, p));
+    }
+
+    // Give the remaining samples to the pixels with the highest error if
+    // there aren't enough for all of them
+    size_t nPixels =
+        std::max<int64_t>(0, (maxSamples - totalSamples) / nextWaveSamples);
+    if (nPixels < pixelErrors.size()) {
+        std::nth_element(pixelErrors.begin(), pixelErrors.begin() + nPixels,
+                         pixelErrors.end(),
+                         [](const auto &a, const auto &b) { return a.first > b.first; });
+        for (size_t i = nPixels; i < pixelErrors.size(); ++i)
+            activePixels[pixelErrors[i].second] = 0;
+    }
+    LOG_VERBOSE("Adaptive sampling: %d samples taken, %d pixels active",
+                totalSamples, std::min(nPixels, pixelErrors.size()));
+}
+
 // RayIntegrator Method Definitions
 void RayIntegrator::EvaluatePixelSample(Point2i pPixel, int sampleIndex, Sampler sampler,
                                         ScratchBuffer &scratchBuffer) {
@@ -286,6 +739,7 @@ void RayIntegrator::EvaluatePixelSample(Point2i pPixel, int sampleIndex, Sampler
     // Add camera ray's contribution to image
     camera.GetFilm().AddSample(pPixel, L, lambda, &visibleSurface,
                                cameraSample.filterWeight);
+    RecordPixelSample(pPixel, L, lambda, cameraSample.filterWeight);
 }
 
 // Integrator Utility Functions
@@ -3543,6 +3997,29 @@ std::unique_ptr<Integrator> Integrator::Create(
     if (!integrator)
         ErrorExit(loc, "%s: unable to create integrator.", name);
 
+    // Set up adaptive sampling if requested
+    Float adaptiveThreshold = parameters.GetOneFloat("adaptivethreshold", 0.f);
+    int adaptiveMinSPP = parameters.GetOneInt("adaptiveminspp", 16);
+    Float adaptiveBudget = parameters.GetOneFloat("adaptivebudget", 1.f);
+    if (adaptiveThreshold > 0) {
+        // Adaptive sampling requires that all image contributions are made
+        // through _RayIntegrator::EvaluatePixelSample()_, which isn't the
+        // case for BDPT's light tracing strategies.
+        RayIntegrator *rayIntegrator = dynamic_cast<RayIntegrator *>(integrator.get());
+        if (!rayIntegrator || name == "bdpt")
+            Warning(loc, "%s: integrator doesn't support adaptive sampling.", name);
+        else {
+            if (adaptiveMinSPP < 2)
+                ErrorExit(loc, "%d: \"adaptiveminspp\" must be at least two.",
+                          adaptiveMinSPP);
+            if (adaptiveBudget <= 0 || adaptiveBudget > 1)
+                ErrorExit(loc, "%f: \"adaptivebudget\" must be in (0,1].",
+                          adaptiveBudget);
+            rayIntegrator->SetAdaptiveSampling(adaptiveMinSPP, adaptiveThreshold,
+                                               adaptiveBudget);
+        }
+    }
+
     parameters.ReportUnused();
     return integrator;
 }
@@ -16,14 +16,17 @@
 #include <pbrt/interaction.h>
 #include <pbrt/lights.h>
 #include <pbrt/lightsamplers.h>
+#include <pbrt/util/containers.h>
 #include <pbrt/util/lowdiscrepancy.h>
 #include <pbrt/util/print.h>
 #include <pbrt/util/pstd.h>
 #include <pbrt/util/rng.h>
 #include <pbrt/util/sampling.h>
 
+#include <condition_variable>
 #include <functional>
 #include <memory>
+#include <mutex>
 #include <ostream>
 #include <string>
 #include <vector>
@@ -76,6 +79,58 @@ class Integrator {
     }
 };
 
+// ImageTileScheduler Definition
+// Hands out image tiles for one or more waves of samples to the threads
+// rendering them. Tiles are ordered along a Hilbert curve, and tiles that
+// are expected to take much more than their share of a wave's time, going
+// by the time per sample measured in earlier waves, are split into
+// quadrants. Tiles of the next wave are handed out once all of the
+// current wave's tiles have started, as long as they don't overlap any of
+// its tiles that are still being rendered; thus, threads don't wait at the
+// end of each wave for the last few tiles to finish.
+class ImageTileScheduler {
+  public:
+    // ImageTileScheduler Public Methods
+    explicit ImageTileScheduler(const Bounds2i &pixelBounds);
+
+    // Calls _func_ in parallel for the tiles of each given wave, where a
+    // wave is a range of sample indices. Overlapping tiles are never
+    // rendered concurrently and each pixel's waves are rendered in order.
+    void Render(std::vector<std::pair<int, int>> waves,
+                std::function<void(Bounds2i, int, int)> func);
+
+  private:
+    // A tile of one of the waves
+    struct Tile {
+        Bounds2i bounds;
+        int wave;
+    };
+
+    // ImageTileScheduler Private Methods
+    void startWave(int wave);
+    bool nextTile(Tile *tile);
+    void finishTile(const Tile &tile, double seconds);
+    double cost(const Bounds2i &b) const;
+
+    // ImageTileScheduler Private Members
+    static constexpr int MinTileSize = 4;
+    Bounds2i pixelBounds;
+    int tileSize;
+    // Seconds taken per sample at each pixel in the last wave that
+    // rendered it
+    Array2D<float> sampleSeconds;
+    bool haveTimings = false;
+
+    std::mutex mutex;
+    std::condition_variable tileFinished;
+    std::vector<std::pair<int, int>> waves;
+    int currentWave;
+    std::vector<Bounds2i> tiles;
+    std::vector<bool> tileStarted;
+    size_t firstUnstarted;
+    std::vector<Tile> running;
+};
+
 // ImageTileIntegrator Definition
 class ImageTileIntegrator : public Integrator {
   public:
@@ -89,10 +144,42 @@ class ImageTileIntegrator : public Integrator {
     virtual void EvaluatePixelSample(Point2i pPixel, int sampleIndex, Sampler sampler,
                                      ScratchBuffer &scratchBuffer) = 0;
 
+    // Enables adaptive sampling: once pixels have at least _minSPP_
+    // samples, those whose estimated relative error is below
+    // _errorThreshold_ stop being sampled. If _budget_ is less than one,
+    // the total number of samples is limited to that fraction of the
+    // sampler's and, when the remaining samples don't suffice for a wave,
+    // they go to the pixels with the highest error.
+    void SetAdaptiveSampling(int minSPP, Float errorThreshold, Float budget);
+
   protected:
+    // ImageTileIntegrator Protected Methods
+    // Records the luminance of a sample at _pPixel_ for adaptive sampling's
+    // error estimates; it must be called once for each sample taken.
+    void RecordPixelSample(Point2i pPixel, const SampledSpectrum &L,
+                           const SampledWavelengths &lambda, Float weight) {
+        if (adaptiveSampling)
+            pixelEstimates[pPixel].Add(weight * L.y(lambda));
+    }
+
     // ImageTileIntegrator Protected Members
     Camera camera;
     Sampler samplerPrototype;
+
+  private:
+    // ImageTileIntegrator Private Methods
+    void updateActivePixels(int samplesTaken, int nextWaveSamples, int64_t maxSamples);
+    void writeCheckpoint(const std::string &filename, int waveStart, int waveEnd,
+                         int nextWaveSize) const;
+    bool readCheckpoint(const std::string &filename, int *waveStart, int *waveEnd,
+                        int *nextWaveSize);
+
+    // ImageTileIntegrator Private Members
+    bool adaptiveSampling = false;
+    int adaptiveMinSPP = 0;
+    Float adaptiveErrorThreshold = 0, adaptiveBudget = 1;
+    Array2D<VarianceEstimator<Float>> pixelEstimates;
+    Array2D<uint8_t> activePixels;
 };
 
 // RayIntegrator Definition
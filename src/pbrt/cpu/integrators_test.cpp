@@ -7,6 +7,7 @@
 #include <pbrt/cameras.h>
 #include <pbrt/cpu/aggregates.h>
 #include <pbrt/cpu/integrators.h>
+#include <pbrt/film.h>
 #include <pbrt/filters.h>
 #include <pbrt/lights.h>
 #include <pbrt/materials.h>
@@ -17,11 +18,17 @@
 #include <pbrt/textures.h>
 #include <pbrt/util/color.h>
 #include <pbrt/util/colorspace.h>
+#include <pbrt/util/containers.h>
+#include <pbrt/util/file.h>
 #include <pbrt/util/image.h>
 #include <pbrt/util/spectrum.h>
 #include <pbrt/util/vecmath.h>
 
+#include <algorithm>
+#include <chrono>
 #include <memory>
+#include <mutex>
+#include <thread>
 
 using namespace pbrt;
 
@@ -447,3 +454,197 @@ TEST_P(RenderTest, RadianceMatches) {
 
 INSTANTIATE_TEST_CASE_P(AnalyticTestScenes, RenderTest,
                         testing::ValuesIn(GetIntegrators()));
+
+TEST(Integrators, AdaptiveSampling) {
+    TestScene scene = GetScenes()[0];
+    Point2i resolution(10, 10);
+    static Transform id;
+    AnimatedTransform identity(id, 0, id, 1);
+    Filter filter = new BoxFilter(Vector2f(0.5, 0.5));
+    FilmBaseParameters fp(resolution, Bounds2i(Point2i(0, 0), resolution), filter, 1.,
+                          PixelSensor::CreateDefault(), inTestDir("test.exr"));
+    RGBFilm *film = new RGBFilm(fp, RGBColorSpace::sRGB);
+    CameraBaseParameters cbp(CameraTransform(identity), film, nullptr, {}, nullptr);
+    PerspectiveCamera *camera = new PerspectiveCamera(
+        cbp, 45, Bounds2f(Point2f(-1, -1), Point2f(1, 1)), 0., 10.);
+
+    int spp = 256, minSPP = 16;
+    PathIntegrator *integrator =
+        new PathIntegrator(8, camera, new IndependentSampler(spp), scene.aggregate,
+                           scene.lights);
+    integrator->SetAdaptiveSampling(minSPP, 0.05f, 0.5f);
+    integrator->Render();
+    CheckSceneAverage(inTestDir("test.exr"), scene.expected);
+    delete integrator;
+
+    // Pixels should have between the minimum and maximum numbers of
+    // samples, and no more than the budget should have been used.
+    pstd::optional<ImageAndMetadata> im = Image::Read(inTestDir("test-spp.exr"));
+    ASSERT_TRUE((bool)im);
+    ASSERT_EQ(1, im->image.NChannels());
+    double sum = 0;
+    for (int y = 0; y < resolution.y; ++y)
+        for (int x = 0; x < resolution.x; ++x) {
+            Float count = im->image.GetChannel({x, y}, 0);
+            EXPECT_GE(count, minSPP);
+            EXPECT_LE(count, spp);
+            sum += count;
+        }
+    EXPECT_LE(sum, 0.5 * spp * resolution.x * resolution.y);
+
+    EXPECT_EQ(0, remove(inTestDir("test.exr").c_str()));
+    EXPECT_EQ(0, remove(inTestDir("test-spp.exr").c_str()));
+}
+
+TEST(Integrators, TimeLimitAndResume) {
+    TestScene scene = GetScenes()[0];
+    Point2i resolution(10, 10);
+    static Transform id;
+    AnimatedTransform identity(id, 0, id, 1);
+    Filter filter = new BoxFilter(Vector2f(0.5, 0.5));
+    auto render = [&](const std::string &filename) {
+        FilmBaseParameters fp(resolution, Bounds2i(Point2i(0, 0), resolution), filter,
+                              1., PixelSensor::CreateDefault(), inTestDir(filename));
+        RGBFilm *film = new RGBFilm(fp, RGBColorSpace::sRGB);
+        CameraBaseParameters cbp(CameraTransform(identity), film, nullptr, {},
+                                 nullptr);
+        PerspectiveCamera *camera = new PerspectiveCamera(
+            cbp, 45, Bounds2f(Point2f(-1, -1), Point2f(1, 1)), 0., 10.);
+        PathIntegrator integrator(8, camera, new IndependentSampler(32),
+                                  scene.aggregate, scene.lights);
+        integrator.Render();
+    };
+
+    render("full.exr");
+
+    // A tiny time limit stops rendering after the first wave; resuming
+    // should then give the same image as the uninterrupted render.
+    Float savedTimeLimit = Options->timeLimit;
+    bool savedResume = Options->resume;
+    Options->timeLimit = 1e-9f;
+    render("test.exr");
+    EXPECT_TRUE(FileExists(inTestDir("test.exr.checkpoint")));
+    Options->timeLimit = 0;
+    Options->resume = true;
+    render("test.exr");
+    EXPECT_FALSE(FileExists(inTestDir("test.exr.checkpoint")));
+    Options->timeLimit = savedTimeLimit;
+    Options->resume = savedResume;
+
+    pstd::optional<ImageAndMetadata> full = Image::Read(inTestDir("full.exr"));
+    pstd::optional<ImageAndMetadata> resumed = Image::Read(inTestDir("test.exr"));
+    ASSERT_TRUE(full && resumed);
+    ASSERT_EQ(full->image.Resolution(), resumed->image.Resolution());
+    for (int y = 0; y < resolution.y; ++y)
+        for (int x = 0; x < resolution.x; ++x)
+            for (int c = 0; c < 3; ++c)
+                EXPECT_EQ(full->image.GetChannel({x, y}, c),
+                          resumed->image.GetChannel({x, y}, c));
+
+    EXPECT_EQ(0, remove(inTestDir("full.exr").c_str()));
+    EXPECT_EQ(0, remove(inTestDir("test.exr").c_str()));
+}
+
+TEST(Integrators, SampleRangesMerge) {
+    TestScene scene = GetScenes()[0];
+    Point2i resolution(10, 10);
+    static Transform id;
+    AnimatedTransform identity(id, 0, id, 1);
+    Filter filter = new BoxFilter(Vector2f(0.5, 0.5));
+    auto render = [&](const std::string &filename) {
+        FilmBaseParameters fp(resolution, Bounds2i(Point2i(0, 0), resolution), filter,
+                              1., PixelSensor::CreateDefault(), inTestDir(filename));
+        RGBFilm *film = new RGBFilm(fp, RGBColorSpace::sRGB);
+        CameraBaseParameters cbp(CameraTransform(identity), film, nullptr, {},
+                                 nullptr);
+        PerspectiveCamera *camera = new PerspectiveCamera(
+            cbp, 45, Bounds2f(Point2f(-1, -1), Point2f(1, 1)), 0., 10.);
+        PathIntegrator integrator(8, camera, new IndependentSampler(32),
+                                  scene.aggregate, scene.lights);
+        integrator.Render();
+    };
+
+    render("full.exr");
+
+    // Render two disjoint sample ranges to raw film images; adding them up
+    // should give the full render.
+    int savedStart = Options->sampleStart, savedEnd = Options->sampleEnd;
+    bool savedRaw = Options->writeRawFilm;
+    Options->writeRawFilm = true;
+    Options->sampleStart = 0;
+    Options->sampleEnd = 13;
+    render("a.exr");
+    Options->sampleStart = 13;
+    Options->sampleEnd = 32;
+    render("b.exr");
+    Options->sampleStart = savedStart;
+    Options->sampleEnd = savedEnd;
+    Options->writeRawFilm = savedRaw;
+
+    std::vector<ImageAndMetadata> raw;
+    raw.push_back(Image::Read(inTestDir("a.exr")));
+    raw.push_back(Image::Read(inTestDir("b.exr")));
+    for (const ImageAndMetadata &im : raw) {
+        EXPECT_TRUE(IsRawFilmImage(im.metadata));
+        ASSERT_EQ(resolution, im.image.Resolution());
+    }
+    ImageMetadata metadata;
+    Image merged = MergeRawFilmImages(raw, &metadata);
+    EXPECT_FALSE(IsRawFilmImage(metadata));
+    EXPECT_EQ(32, *metadata.samplesPerPixel);
+
+    // The full render is stored as half-precision floats.
+    ImageAndMetadata full = Image::Read(inTestDir("full.exr"));
+    ASSERT_EQ(full.image.Resolution(), merged.Resolution());
+    ImageChannelDesc rgbDesc = full.image.GetChannelDesc({"R", "G", "B"});
+    ASSERT_TRUE(rgbDesc);
+    for (int y = 0; y < resolution.y; ++y)
+        for (int x = 0; x < resolution.x; ++x) {
+            ImageChannelValues v = full.image.GetChannels({x, y}, rgbDesc);
+            for (int c = 0; c < 3; ++c)
+                EXPECT_NEAR(v[c], merged.GetChannel({x, y}, c),
+                            1e-3f * std::max<Float>(1, std::abs(v[c])));
+        }
+
+    for (const char *fn : {"full.exr", "a.exr", "b.exr"})
+        EXPECT_EQ(0, remove(inTestDir(fn).c_str()));
+}
+
+TEST(ImageTileScheduler, WavesAndOverlap) {
+    Bounds2i pixelBounds({-5, 3}, {77, 58});
+    std::vector<std::pair<int, int>> waves = {{0, 1}, {1, 3}, {3, 7}, {7, 15}};
+    Array2D<int> samplesDone(pixelBounds);
+    std::mutex mutex;
+    std::vector<Bounds2i> active;
+
+    ImageTileScheduler scheduler(pixelBounds);
+    for (int pass = 0; pass < 2; ++pass) {
+        // The second pass splits tiles using the first pass's timings; make
+        // some tiles much slower than others so that it does so.
+        int sampleOffset = pass * waves.back().second;
+        std::vector<std::pair<int, int>> passWaves;
+        for (auto w : waves)
+            passWaves.push_back({w.first + sampleOffset, w.second + sampleOffset});
+
+        scheduler.Render(passWaves, [&](Bounds2i b, int waveStart, int waveEnd) {
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                for (const Bounds2i &a : active)
+                    EXPECT_TRUE(Intersect(a, b).IsEmpty());
+                active.push_back(b);
+            }
+            for (Point2i p : b) {
+                // Waves should be rendered in order at each pixel
+                EXPECT_EQ(waveStart, samplesDone[p]);
+                samplesDone[p] = waveEnd;
+            }
+            if (b.pMin.x < 10 && b.pMin.y < 20)
+                std::this_thread::sleep_for(std::chrono::milliseconds(2));
+            std::lock_guard<std::mutex> lock(mutex);
+            active.erase(std::find(active.begin(), active.end(), b));
+        });
+
+        for (Point2i p : pixelBounds)
+            EXPECT_EQ(passWaves.back().second, samplesDone[p]);
+    }
+}
@@ -83,6 +83,18 @@ bool GeometricPrimitive::IntersectP(const Ray &r, Float tMax) const {
         return shape.IntersectP(r, tMax);
 }
 
+const Triangle *GeometricPrimitive::DeferrableTriangle() const {
+    // Alpha testing needs the full _SurfaceInteraction_ for every hit
+    return alpha ? nullptr : shape.CastOrNullptr<Triangle>();
+}
+
+ShapeIntersection GeometricPrimitive::InteractionFromTriangleHit(
+    const Ray &r, const TriangleIntersection &ti) const {
+    ShapeIntersection si = shape.Cast<Triangle>()->InteractionFromHit(r, ti);
+    si.intr.SetIntersectionProperties(material, areaLight, &mediumInterface, r.medium);
+    return si;
+}
+
 // SimplePrimitive Method Definitions
 SimplePrimitive::SimplePrimitive(Shape shape, Material material)
     : shape(shape), material(material) {
@@ -108,9 +120,22 @@ pstd::optional<ShapeIntersection> SimplePrimitive::Intersect(const Ray &r,
     return si;
 }
 
+const Triangle *SimplePrimitive::DeferrableTriangle() const {
+    return shape.CastOrNullptr<Triangle>();
+}
+
+ShapeIntersection SimplePrimitive::InteractionFromTriangleHit(
+    const Ray &r, const TriangleIntersection &ti) const {
+    ShapeIntersection si = shape.Cast<Triangle>()->InteractionFromHit(r, ti);
+    si.intr.SetIntersectionProperties(material, nullptr, nullptr, r.medium);
+    return si;
+}
+
 // TransformedPrimitive Method Definitions
 pstd::optional<ShapeIntersection> TransformedPrimitive::Intersect(const Ray &r,
                                                                   Float tMax) const {
+    if (!(visibility & VisibleToRays))
+        return {};
     // Transform ray to primitive-space and intersect with primitive
     Ray ray = renderFromPrimitive->ApplyInverse(r, &tMax);
     pstd::optional<ShapeIntersection> si = primitive.Intersect(ray, tMax);
@@ -125,20 +150,25 @@ pstd::optional<ShapeIntersection> TransformedPrimitive::Intersect(const Ray &r,
 }
 
 bool TransformedPrimitive::IntersectP(const Ray &r, Float tMax) const {
+    if (!(visibility & CastsShadows))
+        return false;
     Ray ray = renderFromPrimitive->ApplyInverse(r, &tMax);
     return primitive.IntersectP(ray, tMax);
 }
 
 // AnimatedPrimitive Method Definitions
 AnimatedPrimitive::AnimatedPrimitive(Primitive p,
-                                     const AnimatedTransform &renderFromPrimitive)
-    : primitive(p), renderFromPrimitive(renderFromPrimitive) {
+                                     const AnimatedTransform &renderFromPrimitive,
+                                     uint8_t visibility)
+    : primitive(p), renderFromPrimitive(renderFromPrimitive), visibility(visibility) {
     primitiveMemory += sizeof(*this);
     CHECK(renderFromPrimitive.IsAnimated());
 }
 
 pstd::optional<ShapeIntersection> AnimatedPrimitive::Intersect(const Ray &r,
                                                                Float tMax) const {
+    if (!(visibility & VisibleToRays))
+        return {};
     // Compute _ray_ after transformation by _renderFromPrimitive_
     Transform interpRenderFromPrimitive = renderFromPrimitive.Interpolate(r.time);
     Ray ray = interpRenderFromPrimitive.ApplyInverse(r, &tMax);
@@ -153,6 +183,8 @@ pstd::optional<ShapeIntersection> AnimatedPrimitive::Intersect(const Ray &r,
 }
 
 bool AnimatedPrimitive::IntersectP(const Ray &r, Float tMax) const {
+    if (!(visibility & CastsShadows))
+        return false;
     Ray ray = renderFromPrimitive.ApplyInverse(r, &tMax);
     return primitive.IntersectP(ray, tMax);
 }
@@ -28,6 +28,7 @@ class TransformedPrimitive;
 class AnimatedPrimitive;
 class BVHAggregate;
 class KdTreeAggregate;
+struct TriangleIntersection;
 
 // Primitive Definition
 class Primitive
@@ -55,6 +56,13 @@ class GeometricPrimitive {
     pstd::optional<ShapeIntersection> Intersect(const Ray &r, Float tMax) const;
     bool IntersectP(const Ray &r, Float tMax) const;
 
+    // Returns the primitive's triangle if its intersections can be found
+    // with _Triangle::IntersectHit()_ and completed later using
+    // _InteractionFromTriangleHit()_.
+    const Triangle *DeferrableTriangle() const;
+    ShapeIntersection InteractionFromTriangleHit(const Ray &r,
+                                                 const TriangleIntersection &ti) const;
+
   private:
     // GeometricPrimitive Private Members
     Shape shape;
@@ -73,18 +81,37 @@ class SimplePrimitive {
     bool IntersectP(const Ray &r, Float tMax) const;
     SimplePrimitive(Shape shape, Material material);
 
+    const Triangle *DeferrableTriangle() const;
+    ShapeIntersection InteractionFromTriangleHit(const Ray &r,
+                                                 const TriangleIntersection &ti) const;
+
   private:
     // SimplePrimitive Private Members
     Shape shape;
     Material material;
 };
 
+// InstanceVisibility Definition
+// Bits of the visibility mask of an instanced primitive. Instances without
+// _VisibleToRays_ are skipped by _Intersect()_, which is used for camera
+// and indirect rays, and instances without _CastsShadows_ are skipped by
+// _IntersectP()_, which is used for shadow rays.
+enum InstanceVisibility : uint8_t {
+    NotVisible = 0,
+    VisibleToRays = 1 << 0,
+    CastsShadows = 1 << 1,
+    FullyVisible = VisibleToRays | CastsShadows
+};
+
 // TransformedPrimitive Definition
 class TransformedPrimitive {
   public:
     // TransformedPrimitive Public Methods
-    TransformedPrimitive(Primitive primitive, const Transform *renderFromPrimitive)
-        : primitive(primitive), renderFromPrimitive(renderFromPrimitive) {
+    TransformedPrimitive(Primitive primitive, const Transform *renderFromPrimitive,
+                         uint8_t visibility = FullyVisible)
+        : primitive(primitive),
+          renderFromPrimitive(renderFromPrimitive),
+          visibility(visibility) {
         primitiveMemory += sizeof(*this);
     }
 
@@ -93,10 +120,19 @@ class TransformedPrimitive {
 
     Bounds3f Bounds() const { return (*renderFromPrimitive)(primitive.Bounds()); }
 
+    // Note: aggregates that hold this primitive must be refit or rebuilt
+    // after its transformation is changed.
+    void SetRenderFromPrimitive(const Transform *r) { renderFromPrimitive = r; }
+
+    Primitive GetPrimitive() const { return primitive; }
+    const Transform &RenderFromPrimitive() const { return *renderFromPrimitive; }
+    uint8_t Visibility() const { return visibility; }
+
   private:
     // TransformedPrimitive Private Members
     Primitive primitive;
     const Transform *renderFromPrimitive;
+    uint8_t visibility;
 };
 
 // AnimatedPrimitive Definition
@@ -107,14 +143,25 @@ class AnimatedPrimitive {
         return renderFromPrimitive.MotionBounds(primitive.Bounds());
     }
 
-    AnimatedPrimitive(Primitive primitive, const AnimatedTransform &renderFromPrimitive);
+    AnimatedPrimitive(Primitive primitive, const AnimatedTransform &renderFromPrimitive,
+                      uint8_t visibility = FullyVisible);
     pstd::optional<ShapeIntersection> Intersect(const Ray &r, Float tMax) const;
     bool IntersectP(const Ray &r, Float tMax) const;
 
+    // Note: as with _TransformedPrimitive_, aggregates that hold this
+    // primitive must be refit or rebuilt after its transformation changes.
+    void SetRenderFromPrimitive(const AnimatedTransform &r) {
+        CHECK(r.IsAnimated());
+        renderFromPrimitive = r;
+    }
+
+    uint8_t Visibility() const { return visibility; }
+
   private:
     // AnimatedPrimitive Private Members
     Primitive primitive;
     AnimatedTransform renderFromPrimitive;
+    uint8_t visibility;
 };
 
 }  // namespace pbrt
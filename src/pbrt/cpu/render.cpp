@@ -6,6 +6,7 @@
 
 #include <pbrt/cameras.h>
 #include <pbrt/cpu/aggregates.h>
+#include <pbrt/cpu/distributed.h>
 #include <pbrt/cpu/integrators.h>
 #include <pbrt/film.h>
 #include <pbrt/filters.h>
@@ -97,6 +98,17 @@ void RenderCPU(ParsedScene &parsedScene) {
         parsedScene.integrator.name, parsedScene.integrator.parameters, camera, sampler,
         accel, lights, integratorColorSpace, &parsedScene.integrator.loc));
 
+    // Work units of distributed renders are rendered by ImageTileIntegrators
+    if ((RenderCoordinatorStarted() || !Options->coordinatorAddress.empty()) &&
+        !dynamic_cast<ImageTileIntegrator *>(integrator.get()))
+        ErrorExit(&parsedScene.integrator.loc,
+                  "\"%s\" integrator doesn't support distributed rendering.",
+                  parsedScene.integrator.name);
+    if (Options->sampleEnd != -1 && !dynamic_cast<ImageTileIntegrator *>(integrator.get()))
+        ErrorExit(&parsedScene.integrator.loc,
+                  "\"%s\" integrator doesn't support --sample-range.",
+                  parsedScene.integrator.name);
+
     // Helpful warnings
     for (const auto &sh : parsedScene.shapes)
         if (!sh.insideMedium.empty() || !sh.outsideMedium.empty())
@@ -198,6 +210,8 @@ void RenderCPU(ParsedScene &parsedScene) {
     }
 
     // Render!
+    // Per-thread data allocated while rendering should be node-local.
+    SetNumaInterleavedAllocation(false);
     integrator->Render();
 
     LOG_VERBOSE("Memory used after rendering: %s", GetCurrentRSS());
@@ -10,6 +10,7 @@
 
 #include <pbrt/bsdf.h>
 #include <pbrt/cameras.h>
+#include <pbrt/cpu/denoiser.h>
 #include <pbrt/filters.h>
 #include <pbrt/options.h>
 #include <pbrt/paramdict.h>
@@ -36,6 +37,13 @@ void Film::AddSplat(Point2f p, SampledSpectrum v, const SampledWavelengths &lamb
 }
 
 void Film::WriteImage(ImageMetadata metadata, Float splatScale) {
+    if (Options->writeRawFilm) {
+        // Write the film's pixel sums for _MergeRawFilmImages()_ instead
+        Image image = GetRawImage(&metadata);
+        LOG_VERBOSE("Writing raw film image %s", GetFilename());
+        image.Write(GetFilename(), metadata);
+        return;
+    }
     auto write = [&](auto ptr) { return ptr->WriteImage(metadata, splatScale); };
     return DispatchCPU(write);
 }
@@ -45,6 +53,11 @@ Image Film::GetImage(ImageMetadata *metadata, Float splatScale) {
     return DispatchCPU(get);
 }
 
+Image Film::GetRawImage(ImageMetadata *metadata) {
+    auto get = [&](auto ptr) { return ptr->GetRawImage(metadata); };
+    return DispatchCPU(get);
+}
+
 std::string Film::ToString() const {
     if (!ptr())
         return "(nullptr)";
@@ -58,6 +71,53 @@ std::string Film::GetFilename() const {
     return DispatchCPU(get);
 }
 
+std::string Film::SerializePixels() const {
+    auto serialize = [&](auto ptr) { return ptr->SerializePixels(); };
+    return DispatchCPU(serialize);
+}
+
+bool Film::DeserializePixels(const std::string &data, bool accumulate) {
+    auto deserialize = [&](auto ptr) { return ptr->DeserializePixels(data, accumulate); };
+    return DispatchCPU(deserialize);
+}
+
+// Film Serialization Helper Functions
+template <typename T>
+static void AppendBytes(std::string *buf, const T &value) {
+    static_assert(std::is_trivially_copyable_v<T>);
+    buf->append((const char *)&value, sizeof(T));
+}
+
+template <typename T>
+static bool ReadBytes(const std::string &buf, size_t *offset, T *value,
+                      bool accumulate = false) {
+    static_assert(std::is_trivially_copyable_v<T>);
+    if (*offset + sizeof(T) > buf.size())
+        return false;
+    T v;
+    std::memcpy(&v, buf.data() + *offset, sizeof(T));
+    *offset += sizeof(T);
+    if constexpr (std::is_same_v<T, VarianceEstimator<Float>>) {
+        if (!accumulate)
+            *value = VarianceEstimator<Float>();
+        value->Merge(v);
+    } else
+        *value = accumulate ? *value + v : v;
+    return true;
+}
+
+static bool ReadBytes(const std::string &buf, size_t *offset, AtomicDouble *value,
+                      bool accumulate) {
+    double v;
+    if (!ReadBytes(buf, offset, &v))
+        return false;
+    if (accumulate)
+        value->Add(v);
+    else
+        *value = v;
+    return true;
+}
+
 // FilmBaseParameters Method Definitions
 FilmBaseParameters::FilmBaseParameters(const ParameterDictionary &parameters,
                                        Filter filter, const PixelSensor *sensor,
@@ -74,6 +134,9 @@ FilmBaseParameters::FilmBaseParameters(const ParameterDictionary &parameters,
         filename = Options->imageFile;
     } else if (filename.empty())
         filename = "pbrt.exr";
+    if (Options->writeRawFilm && !HasExtension(filename, "exr"))
+        ErrorExit(loc, "%s: raw film images must be written in OpenEXR format.",
+                  filename);
 
     fullResolution = Point2i(parameters.GetOneInt("xresolution", 1280),
                              parameters.GetOneInt("yresolution", 720));
@@ -480,6 +543,7 @@ RGBFilm::RGBFilm(FilmBaseParameters p, const RGBColorSpace *colorSpace,
     CHECK(!pixelBounds.IsEmpty());
     CHECK(colorSpace);
     filmPixelMemory += pixelBounds.Area() * sizeof(Pixel);
+    NumaPlaceImageRows(pixels.begin(), pixels.XSize() * sizeof(Pixel), pixels.YSize());
     // Compute _outputRGBFromSensorRGB_ matrix
     outputRGBFromSensorRGB = colorSpace->RGBFromXYZ * sensor->XYZFromSensorRGB;
 }
@@ -513,6 +577,189 @@ void RGBFilm::AddSplat(Point2f p, SampledSpectrum L, const SampledWavelengths &l
     }
 }
 
+std::string RGBFilm::SerializePixels() const {
+    std::string buf;
+    buf.reserve(pixelBounds.Area() * 7 * sizeof(double));
+    for (Point2i p : pixelBounds) {
+        const Pixel &pixel = pixels[p];
+        for (int c = 0; c < 3; ++c)
+            AppendBytes(&buf, pixel.rgbSum[c]);
+        AppendBytes(&buf, pixel.weightSum);
+        for (int c = 0; c < 3; ++c)
+            AppendBytes(&buf, double(pixel.rgbSplat[c]));
+    }
+    return buf;
+}
+
+bool RGBFilm::DeserializePixels(const std::string &data, bool accumulate) {
+    if (data.size() != pixelBounds.Area() * 7 * sizeof(double))
+        return false;
+    size_t offset = 0;
+    for (Point2i p : pixelBounds) {
+        Pixel &pixel = pixels[p];
+        for (int c = 0; c < 3; ++c)
+            ReadBytes(data, &offset, &pixel.rgbSum[c], accumulate);
+        ReadBytes(data, &offset, &pixel.weightSum, accumulate);
+        for (int c = 0; c < 3; ++c)
+            ReadBytes(data, &offset, &pixel.rgbSplat[c], accumulate);
+    }
+    return true;
+}
+
+// Raw Film Image Definitions
+// Raw film images store the sums of the films' _Pixel_ members. RGB sums
+// and splats are converted to the output color space, which is linear, and
+// splats are divided by the filter integral. _VarianceEstimator_s are
+// stored as their mean, variance, and count.
+static const char *RawFilmAttribute = "pbrtRawFilm";
+
+static const std::vector<std::string> RawRGBFilmChannels = {
+    "RGBSum.R", "RGBSum.G", "RGBSum.B", "WeightSum", "Splat.R", "Splat.G", "Splat.B"};
+
+static const std::vector<std::string> RawGBufferFilmChannels = {
+    "RGBSum.R",           "RGBSum.G",           "RGBSum.B",
+    "WeightSum",          "Splat.R",            "Splat.G",
+    "Splat.B",            "AlbedoSum.R",        "AlbedoSum.G",
+    "AlbedoSum.B",        "GBufferWeightSum",   "PSum.X",
+    "PSum.Y",             "PSum.Z",             "dzdxSum",
+    "dzdySum",            "NSum.X",             "NSum.Y",
+    "NSum.Z",             "NsSum.X",            "NsSum.Y",
+    "NsSum.Z",            "uSum",               "vSum",
+    "Variance.R.Mean",    "Variance.R.Var",     "Variance.R.Count",
+    "Variance.G.Mean",    "Variance.G.Var",     "Variance.G.Count",
+    "Variance.B.Mean",    "Variance.B.Var",     "Variance.B.Count"};
+
+bool IsRawFilmImage(const ImageMetadata &metadata) {
+    return metadata.stringVectors.find(RawFilmAttribute) != metadata.stringVectors.end();
+}
+
+Image MergeRawFilmImages(const std::vector<ImageAndMetadata> &images,
+                         ImageMetadata *metadata) {
+    CHECK(!images.empty());
+    const ImageAndMetadata &first = images[0];
+    CHECK(IsRawFilmImage(first.metadata));
+    bool gBuffer = first.metadata.stringVectors.at(RawFilmAttribute) ==
+                   std::vector<std::string>{"gbuffer"};
+    const std::vector<std::string> &channels =
+        gBuffer ? RawGBufferFilmChannels : RawRGBFilmChannels;
+    Point2i res = first.image.Resolution();
+    int nSumChannels = gBuffer ? 24 : int(channels.size());
+
+    // Add up the images' pixel sums in double precision and merge the
+    // variance estimates
+    *metadata = first.metadata;
+    metadata->stringVectors.erase(RawFilmAttribute);
+    metadata->samplesPerPixel = 0;
+    metadata->renderTimeSeconds = 0;
+    Array2D<double> sums(nSumChannels * res.x, res.y);
+    Array2D<VarianceEstimator<Float>> variances(3 * res.x, gBuffer ? res.y : 0);
+    for (const ImageAndMetadata &im : images) {
+        // Look up the channels by name since image files may reorder them
+        ImageChannelDesc desc = im.image.GetChannelDesc(channels);
+        CHECK(IsRawFilmImage(im.metadata) && im.image.Resolution() == res && desc);
+        *metadata->samplesPerPixel += im.metadata.samplesPerPixel.value_or(0);
+        *metadata->renderTimeSeconds += im.metadata.renderTimeSeconds.value_or(0);
+        ParallelFor(0, res.y, [&](int64_t y) {
+            for (int x = 0; x < res.x; ++x) {
+                ImageChannelValues v = im.image.GetChannels({x, int(y)}, desc);
+                for (int c = 0; c < nSumChannels; ++c)
+                    sums(nSumChannels * x + c, y) += v[c];
+                for (int c = 0; gBuffer && c < 3; ++c)
+                    variances(3 * x + c, y)
+                        .Merge(VarianceEstimator<Float>(v[nSumChannels + 3 * c],
+                                                        v[nSumChannels + 3 * c + 1],
+                                                        v[nSumChannels + 3 * c + 2]));
+            }
+        });
+    }
+
+    // Compute final pixel values as the film would
+    Float splatScale = 1.f / std::max(1, *metadata->samplesPerPixel);
+    std::vector<std::string> outputChannels = {"R", "G", "B"};
+    if (gBuffer)
+        outputChannels.insert(
+            outputChannels.end(),
+            {"Albedo.R", "Albedo.G", "Albedo.B", "Px", "Py", "Pz", "dzdx", "dzdy", "Nx",
+             "Ny", "Nz", "Nsx", "Nsy", "Nsz", "u", "v", "Variance.R", "Variance.G",
+             "Variance.B", "RelativeVariance.R", "RelativeVariance.G",
+             "RelativeVariance.B"});
+    Image image(PixelFormat::Float, res, outputChannels);
+    ParallelFor(0, res.y, [&](int64_t y) {
+        for (int x = 0; x < res.x; ++x) {
+            const double *s = &sums(nSumChannels * x, y);
+            double weightSum = s[3];
+            Float rgb[3];
+            for (int c = 0; c < 3; ++c)
+                rgb[c] = (weightSum != 0 ? s[c] / weightSum : s[c]) + splatScale * s[4 + c];
+            if (!gBuffer) {
+                image.SetChannels({x, int(y)}, {rgb[0], rgb[1], rgb[2]});
+                continue;
+            }
+
+            double gBufferWeightSum = s[10];
+            auto gBufferValue = [&](int c) {
+                return Float(gBufferWeightSum != 0 ? s[c] / gBufferWeightSum : s[c]);
+            };
+            Float albedo[3];
+            for (int c = 0; c < 3; ++c)
+                albedo[c] = weightSum != 0 ? s[7 + c] / weightSum : s[7 + c];
+            Normal3f n(s[16], s[17], s[18]), ns(s[19], s[20], s[21]);
+            n = LengthSquared(n) > 0 ? Normalize(n) : Normal3f(0, 0, 0);
+            ns = LengthSquared(ns) > 0 ? Normalize(ns) : Normal3f(0, 0, 0);
+            const VarianceEstimator<Float> *ve = &variances(3 * x, y);
+            Float values[] = {rgb[0],
+                              rgb[1],
+                              rgb[2],
+                              albedo[0],
+                              albedo[1],
+                              albedo[2],
+                              gBufferValue(11),
+                              gBufferValue(12),
+                              gBufferValue(13),
+                              std::abs(gBufferValue(14)),
+                              std::abs(gBufferValue(15)),
+                              n.x,
+                              n.y,
+                              n.z,
+                              ns.x,
+                              ns.y,
+                              ns.z,
+                              gBufferValue(22),
+                              gBufferValue(23),
+                              ve[0].Variance(),
+                              ve[1].Variance(),
+                              ve[2].Variance(),
+                              ve[0].RelativeVariance(),
+                              ve[1].RelativeVariance(),
+                              ve[2].RelativeVariance()};
+            image.SetChannels({x, int(y)}, pstd::span<const Float>(values));
+        }
+    });
+    return image;
+}
+
+Image RGBFilm::GetRawImage(ImageMetadata *metadata) {
+    Image image(PixelFormat::Float, Point2i(pixelBounds.Diagonal()), RawRGBFilmChannels);
+    ParallelFor2D(pixelBounds, [&](Point2i p) {
+        const Pixel &pixel = pixels[p];
+        RGB rgbSum = outputRGBFromSensorRGB *
+                     RGB(pixel.rgbSum[0], pixel.rgbSum[1], pixel.rgbSum[2]);
+        RGB splat = outputRGBFromSensorRGB * RGB(pixel.rgbSplat[0], pixel.rgbSplat[1],
+                                                 pixel.rgbSplat[2]) /
+                    filterIntegral;
+        Float values[] = {rgbSum.r, rgbSum.g, rgbSum.b, Float(pixel.weightSum),
+                          splat.r,  splat.g,  splat.b};
+        Point2i pOffset(p.x - pixelBounds.pMin.x, p.y - pixelBounds.pMin.y);
+        image.SetChannels(pOffset, pstd::span<const Float>(values));
+    });
+
+    metadata->pixelBounds = pixelBounds;
+    metadata->fullResolution = fullResolution;
+    metadata->colorSpace = colorSpace;
+    metadata->stringVectors[RawFilmAttribute] = {"rgb"};
+    return image;
+}
+
 void RGBFilm::WriteImage(ImageMetadata metadata, Float splatScale) {
     Image image = GetImage(&metadata, splatScale);
     LOG_VERBOSE("Writing image %s with bounds %s", filename, pixelBounds);
@@ -642,6 +889,7 @@ GBufferFilm::GBufferFilm(FilmBaseParameters p, const AnimatedTransform &outputFr
       filterIntegral(filter.Integral()) {
     CHECK(!pixelBounds.IsEmpty());
     filmPixelMemory += pixelBounds.Area() * sizeof(Pixel);
+    NumaPlaceImageRows(pixels.begin(), pixels.XSize() * sizeof(Pixel), pixels.YSize());
     outputRGBFromSensorRGB = colorSpace->RGBFromXYZ * sensor->XYZFromSensorRGB;
 }
 
@@ -668,8 +916,125 @@ void GBufferFilm::AddSplat(Point2f p, SampledSpectrum v,
     }
 }
 
+std::string GBufferFilm::SerializePixels() const {
+    std::string buf;
+    for (Point2i p : pixelBounds) {
+        const Pixel &pixel = pixels[p];
+        for (int c = 0; c < 3; ++c)
+            AppendBytes(&buf, pixel.rgbSum[c]);
+        AppendBytes(&buf, pixel.weightSum);
+        AppendBytes(&buf, pixel.gBufferWeightSum);
+        for (int c = 0; c < 3; ++c)
+            AppendBytes(&buf, double(pixel.rgbSplat[c]));
+        AppendBytes(&buf, pixel.pSum);
+        AppendBytes(&buf, pixel.dzdxSum);
+        AppendBytes(&buf, pixel.dzdySum);
+        AppendBytes(&buf, pixel.nSum);
+        AppendBytes(&buf, pixel.nsSum);
+        AppendBytes(&buf, pixel.uvSum);
+        for (int c = 0; c < 3; ++c)
+            AppendBytes(&buf, pixel.rgbAlbedoSum[c]);
+        for (int c = 0; c < 3; ++c)
+            AppendBytes(&buf, pixel.rgbVariance[c]);
+    }
+    return buf;
+}
+
+bool GBufferFilm::DeserializePixels(const std::string &data, bool accumulate) {
+    size_t offset = 0;
+    bool ok = true;
+    for (Point2i p : pixelBounds) {
+        Pixel &pixel = pixels[p];
+        for (int c = 0; c < 3; ++c)
+            ok &= ReadBytes(data, &offset, &pixel.rgbSum[c], accumulate);
+        ok &= ReadBytes(data, &offset, &pixel.weightSum, accumulate);
+        ok &= ReadBytes(data, &offset, &pixel.gBufferWeightSum, accumulate);
+        for (int c = 0; c < 3; ++c)
+            ok &= ReadBytes(data, &offset, &pixel.rgbSplat[c], accumulate);
+        ok &= ReadBytes(data, &offset, &pixel.pSum, accumulate);
+        ok &= ReadBytes(data, &offset, &pixel.dzdxSum, accumulate);
+        ok &= ReadBytes(data, &offset, &pixel.dzdySum, accumulate);
+        ok &= ReadBytes(data, &offset, &pixel.nSum, accumulate);
+        ok &= ReadBytes(data, &offset, &pixel.nsSum, accumulate);
+        ok &= ReadBytes(data, &offset, &pixel.uvSum, accumulate);
+        for (int c = 0; c < 3; ++c)
+            ok &= ReadBytes(data, &offset, &pixel.rgbAlbedoSum[c], accumulate);
+        for (int c = 0; c < 3; ++c)
+            ok &= ReadBytes(data, &offset, &pixel.rgbVariance[c], accumulate);
+        if (!ok)
+            return false;
+    }
+    return offset == data.size();
+}
+
+Image GBufferFilm::GetRawImage(ImageMetadata *metadata) {
+    Image image(PixelFormat::Float, Point2i(pixelBounds.Diagonal()),
+                RawGBufferFilmChannels);
+    ParallelFor2D(pixelBounds, [&](Point2i p) {
+        const Pixel &pixel = pixels[p];
+        RGB rgbSum = outputRGBFromSensorRGB *
+                     RGB(pixel.rgbSum[0], pixel.rgbSum[1], pixel.rgbSum[2]);
+        RGB splat = outputRGBFromSensorRGB * RGB(pixel.rgbSplat[0], pixel.rgbSplat[1],
+                                                 pixel.rgbSplat[2]) /
+                    filterIntegral;
+        const VarianceEstimator<Float> *ve = pixel.rgbVariance;
+        Float values[] = {rgbSum.r,
+                          rgbSum.g,
+                          rgbSum.b,
+                          Float(pixel.weightSum),
+                          splat.r,
+                          splat.g,
+                          splat.b,
+                          Float(pixel.rgbAlbedoSum[0]),
+                          Float(pixel.rgbAlbedoSum[1]),
+                          Float(pixel.rgbAlbedoSum[2]),
+                          Float(pixel.gBufferWeightSum),
+                          pixel.pSum.x,
+                          pixel.pSum.y,
+                          pixel.pSum.z,
+                          pixel.dzdxSum,
+                          pixel.dzdySum,
+                          pixel.nSum.x,
+                          pixel.nSum.y,
+                          pixel.nSum.z,
+                          pixel.nsSum.x,
+                          pixel.nsSum.y,
+                          pixel.nsSum.z,
+                          pixel.uvSum.x,
+                          pixel.uvSum.y,
+                          ve[0].Mean(),
+                          ve[0].Variance(),
+                          Float(ve[0].Count()),
+                          ve[1].Mean(),
+                          ve[1].Variance(),
+                          Float(ve[1].Count()),
+                          ve[2].Mean(),
+                          ve[2].Variance(),
+                          Float(ve[2].Count())};
+        Point2i pOffset(p.x - pixelBounds.pMin.x, p.y - pixelBounds.pMin.y);
+        image.SetChannels(pOffset, pstd::span<const Float>(values));
+    });
+
+    metadata->pixelBounds = pixelBounds;
+    metadata->fullResolution = fullResolution;
+    metadata->colorSpace = colorSpace;
+    metadata->stringVectors[RawFilmAttribute] = {"gbuffer"};
+    return image;
+}
+
 void GBufferFilm::WriteImage(ImageMetadata metadata, Float splatScale) {
     Image image = GetImage(&metadata, splatScale);
+    if (Options->denoise) {
+        // Replace the image's RGB values with denoised ones
+        LOG_VERBOSE("Denoising image %s", filename);
+        Image denoised = DenoiseImage(image, metadata.samplesPerPixel.value_or(1));
+        ImageChannelDesc rgbDesc = image.GetChannelDesc({"R", "G", "B"});
+        ParallelFor(0, denoised.Resolution().y, [&](int64_t y) {
+            for (int x = 0; x < denoised.Resolution().x; ++x)
+                image.SetChannels({x, int(y)}, rgbDesc,
+                                  denoised.GetChannels({x, int(y)}));
+        });
+    }
     LOG_VERBOSE("Writing image %s with bounds %s", filename, pixelBounds);
     image.Write(filename, metadata);
 }
@@ -846,6 +1211,8 @@ Film Film::Create(const std::string &name, const ParameterDictionary &parameters
                                    parameters.ColorSpace(), loc, alloc);
     else
         ErrorExit(loc, "%s: film type unknown.", name);
+    if (Options->denoise && name != "gbuffer")
+        ErrorExit(loc, "%s: --denoise requires the \"gbuffer\" film.", name);
 
     if (!film)
         ErrorExit(loc, "%s: unable to create film.", name);
@@ -287,6 +287,10 @@ class RGBFilm : public FilmBase {
 
     void WriteImage(ImageMetadata metadata, Float splatScale = 1);
     Image GetImage(ImageMetadata *metadata, Float splatScale = 1);
+    Image GetRawImage(ImageMetadata *metadata);
+
+    std::string SerializePixels() const;
+    bool DeserializePixels(const std::string &data, bool accumulate = false);
 
     std::string ToString() const;
 
@@ -365,6 +369,10 @@ class GBufferFilm : public FilmBase {
 
     void WriteImage(ImageMetadata metadata, Float splatScale = 1);
     Image GetImage(ImageMetadata *metadata, Float splatScale = 1);
+    Image GetRawImage(ImageMetadata *metadata);
+
+    std::string SerializePixels() const;
+    bool DeserializePixels(const std::string &data, bool accumulate = false);
 
     std::string ToString() const;
 
@@ -394,6 +402,17 @@ class GBufferFilm : public FilmBase {
     SquareMatrix<3> outputRGBFromSensorRGB;
 };
 
+// Raw Film Image Function Declarations
+// With --raw-film, films write images with their unnormalized pixel sums
+// rather than final pixel values so that the images from renders of
+// different ranges of the pixel samples can be added up exactly.
+// _MergeRawFilmImages()_ does so and returns the final image that the film
+// would have written had it taken all of the samples. The images must have
+// been written by the same kind of film with the same pixel bounds.
+bool IsRawFilmImage(const ImageMetadata &metadata);
+Image MergeRawFilmImages(const std::vector<ImageAndMetadata> &images,
+                         ImageMetadata *metadata);
+
 PBRT_CPU_GPU
 inline SampledWavelengths Film::SampleWavelengths(Float u) const {
     auto sample = [&](auto ptr) { return ptr->SampleWavelengths(u); };
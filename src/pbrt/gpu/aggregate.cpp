@@ -405,7 +405,9 @@ OptiXAggregate::BVH OptiXAggregate::buildBVHForTriangles(
 
                 mesh = alloc.new_object<TriangleMesh>(
                     *shape.renderFromObject, shape.reverseOrientation, plyMesh.triIndices,
-                    plyMesh.p, std::vector<Vector3f>(), plyMesh.n, plyMesh.uv,
+                    std::vector<Point3f>(plyMesh.p.begin(), plyMesh.p.end()),
+                    std::vector<Vector3f>(),
+                    std::vector<Normal3f>(plyMesh.n.begin(), plyMesh.n.end()), plyMesh.uv,
                     plyMesh.faceIndices, alloc);
             }
 
@@ -1460,6 +1462,9 @@ OptiXAggregate::OptiXAggregate(
     OptixInstance gasInstance = {};
     float identity[12] = {1, 0, 0, 0, 0, 1, 0, 0, 0, 0, 1, 0};
     memcpy(gasInstance.transform, identity, 12 * sizeof(float));
+    static_assert(int(OptiXIntersectRayMask) == int(VisibleToRays) &&
+                      int(OptiXShadowRayMask) == int(CastsShadows),
+                  "OptiX ray masks must match InstanceVisibility");
     gasInstance.visibilityMask = 255;
     gasInstance.flags =
         OPTIX_INSTANCE_FLAG_NONE;  // TODO: OPTIX_INSTANCE_FLAG_DISABLE_ANYHIT
@@ -1525,7 +1530,7 @@ OptiXAggregate::OptiXAggregate(
                 for (int j = 0; j < 3; ++j)
                     for (int k = 0; k < 4; ++k)
                         optixInstance.transform[4 * j + k] = renderFromInstance[j][k];
-                optixInstance.visibilityMask = 255;
+                optixInstance.visibilityMask = sceneInstance.visibility;
                 optixInstance.sbtOffset = in.sbtOffsets[i];
                 optixInstance.flags = OPTIX_INSTANCE_FLAG_NONE;  // TODO:
                 // OPTIX_INSTANCE_FLAG_DISABLE_ANYHIT
@@ -59,10 +59,11 @@ static __forceinline__ __device__ T *getPayload() {
 
 template <typename... Args>
 __device__ inline void Trace(OptixTraversableHandle traversable, Ray ray, Float tMin,
-                             Float tMax, OptixRayFlags flags, Args &&... payload) {
+                             Float tMax, OptiXRayMask mask, OptixRayFlags flags,
+                             Args &&... payload) {
     optixTrace(traversable, make_float3(ray.o.x, ray.o.y, ray.o.z),
                make_float3(ray.d.x, ray.d.y, ray.d.z), tMin, tMax, ray.time,
-               OptixVisibilityMask(255), flags, 0, /* ray type */
+               OptixVisibilityMask(mask), flags, 0, /* ray type */
                1,                                  /* number of ray types */
                0,                                  /* missSBTIndex */
                std::forward<Args>(payload)...);
@@ -110,8 +111,8 @@ extern "C" __global__ void __raygen__findClosest() {
         ray.d.y, ray.d.z, tMax);
 
     uint32_t missed = 0;
-    Trace(params.traversable, ray, 1e-5f /* tMin */, tMax, OPTIX_RAY_FLAG_NONE, p0, p1,
-          missed);
+    Trace(params.traversable, ray, 1e-5f /* tMin */, tMax, OptiXIntersectRayMask,
+          OPTIX_RAY_FLAG_NONE, p0, p1, missed);
 
     if (missed)
         EnqueueWorkAfterMiss(r, params.mediumSampleQueue, params.escapedRayQueue);
@@ -255,8 +256,8 @@ extern "C" __global__ void __raygen__shadow() {
              sr.ray.d.x, sr.ray.d.y, sr.ray.d.z);
 
     uint32_t missed = 0;
-    Trace(params.traversable, sr.ray, 1e-5f /* tMin */, sr.tMax, OPTIX_RAY_FLAG_NONE,
-          missed);
+    Trace(params.traversable, sr.ray, 1e-5f /* tMin */, sr.tMax, OptiXShadowRayMask,
+          OPTIX_RAY_FLAG_NONE, missed);
 
     RecordShadowRayIntersection(sr, &params.pixelSampleState, !missed);
 }
@@ -282,8 +283,9 @@ extern "C" __global__ void __raygen__shadow_Tr() {
 
                            uint32_t missed = 0;
 
-                           Trace(params.traversable, ray, 1e-5f /* tMin */, tMax, OPTIX_RAY_FLAG_NONE, p0,
-                                 p1, missed);
+                           Trace(params.traversable, ray, 1e-5f /* tMin */, tMax,
+                                 OptiXIntersectRayMask, OPTIX_RAY_FLAG_NONE, p0, p1,
+                                 missed);
 
                            return TransmittanceTraceResult{!missed, Point3f(ctx.piHit), ctx.material};
                        },
@@ -493,7 +495,7 @@ extern "C" __global__ void __raygen__randomHit() {
 
     while (true) {
         Trace(params.traversable, ray, 0.f /* tMin */, 1.f /* tMax */,
-              OPTIX_RAY_FLAG_NONE, ptr0, ptr1);
+              OptiXIntersectRayMask, OPTIX_RAY_FLAG_NONE, ptr0, ptr1);
 
         if (payload.intr) {
             ray = payload.intr->SpawnRayTo(s.p1);
@@ -23,6 +23,17 @@ namespace pbrt {
 class TriangleMesh;
 class BilinearPatchMesh;
 
+// OptiX visibility masks for the rays that pbrt traces. Instances use their
+// _InstanceVisibility_ mask, which has the same bits, and non-instanced
+// geometry is visible to all rays.
+enum OptiXRayMask : uint8_t {
+    // Closest-hit, transmittance, and random-hit rays, which correspond to
+    // _Intersect()_ calls on the CPU
+    OptiXIntersectRayMask = 1 << 0,
+    // Shadow rays, which correspond to _IntersectP()_ calls
+    OptiXShadowRayMask = 1 << 1
+};
+
 struct TriangleMeshRecord {
     const TriangleMesh *mesh;
     Material material;
@@ -29,17 +29,22 @@ std::string PBRTOptions::ToString() const {
     return StringPrintf(
         "[ PBRTOptions seed: %s quiet: %s disablePixelJitter: %s "
         "disableWavelengthJitter: %s forceDiffuse: %s useGPU: %s wavefront: %s "
-        "renderingSpace: %s nThreads: %s logLevel: %s logFile: %s logUtilization: %s "
+        "renderingSpace: %s nThreads: %s numa: %s logLevel: %s logFile: %s logUtilization: %s "
         "writePartialImages: %s recordPixelStatistics: %s printStatistics: %s "
         "pixelSamples: %s gpuDevice: %s quickRender: %s upgrade: %s imageFile: %s "
         "mseReferenceImage: %s mseReferenceOutput: %s debugStart: %s displayServer: %s "
-        "cropWindow: %s pixelBounds: %s pixelMaterial: %s displacementEdgeScale: %f ]",
+        "cropWindow: %s pixelBounds: %s pixelMaterial: %s displacementEdgeScale: %f "
+        "cacheDirectory: %s timeLimit: %f resume: %s workers: %d "
+        "listenAddress: %s coordinatorAddress: %s sampleStart: %d sampleEnd: %d "
+        "writeRawFilm: %s denoise: %s textureCacheMB: %d compressTextures: %s ]",
         seed, quiet, disablePixelJitter, disableWavelengthJitter, forceDiffuse, useGPU,
-        wavefront, renderingSpace, nThreads, logLevel, logFile, logUtilization,
+        wavefront, renderingSpace, nThreads, numa, logLevel, logFile, logUtilization,
         writePartialImages, recordPixelStatistics, printStatistics, pixelSamples,
         gpuDevice, quickRender, upgrade, imageFile, mseReferenceImage, mseReferenceOutput,
         debugStart, displayServer, cropWindow, pixelBounds, pixelMaterial,
-        displacementEdgeScale);
+        displacementEdgeScale, cacheDirectory, timeLimit, resume, workers, listenAddress,
+        coordinatorAddress, sampleStart, sampleEnd, writeRawFilm, denoise,
+        textureCacheMB, compressTextures);
 }
 
 }  // namespace pbrt
@@ -32,6 +32,7 @@ struct BasicPBRTOptions {
 // PBRTOptions Definition
 struct PBRTOptions : BasicPBRTOptions {
     int nThreads = 0;
+    bool numa = false;
     LogLevel logLevel = LogLevel::Error;
     std::string logFile;
     bool logUtilization = false;
@@ -50,6 +51,20 @@ struct PBRTOptions : BasicPBRTOptions {
     pstd::optional<Bounds2i> pixelBounds;
     pstd::optional<Point2i> pixelMaterial;
     Float displacementEdgeScale = 1;
+    std::string cacheDirectory;
+    Float timeLimit = 0;
+    bool resume = false;
+    int workers = 0;
+    // Range of pixel sample indices to render; _sampleEnd_ is -1 to render
+    // all of them.
+    int sampleStart = 0, sampleEnd = -1;
+    bool writeRawFilm = false;
+    bool denoise = false;
+    // Budget for texture tiles kept in memory; zero disables texture tiling.
+    int textureCacheMB = 0;
+    // Store image textures in block-compressed formats.
+    bool compressTextures = false;
+    std::string listenAddress, coordinatorAddress;
 
     std::string ToString() const;
 };
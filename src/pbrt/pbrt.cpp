@@ -20,6 +20,7 @@
 #include <pbrt/util/print.h>
 #include <pbrt/util/spectrum.h>
 #include <pbrt/util/stats.h>
+#include <pbrt/util/texcache.h>
 
 #include <ImfThreading.h>
 
@@ -56,8 +57,12 @@ void InitPBRT(const PBRTOptions &opt) {
 
     // General \pbrt Initialization
     int nThreads = Options->nThreads != 0 ? Options->nThreads : AvailableCores();
-    ParallelInit(nThreads);  // Threads must be launched before the
-                             // profiler is initialized.
+    if (Options->numa && Options->useGPU) {
+        Warning("--numa is not supported with the GPU renderer. Ignoring it.");
+        Options->numa = false;
+    }
+    ParallelInit(nThreads, Options->numa);  // Threads must be launched before
+                                            // the profiler is initialized.
 
     if (Options->useGPU) {
 #ifdef PBRT_BUILD_GPU_RENDERER
@@ -89,6 +94,8 @@ void InitPBRT(const PBRTOptions &opt) {
         RGBColorSpace::Init(Allocator{});
         Triangle::Init({});
         BilinearPatch::Init({});
+
+        TextureTileCache::Init(size_t(Options->textureCacheMB) << 20);
     }
 
     InitBufferCaches();
@@ -425,6 +425,15 @@ void SceneStateManager::ObjectInstance(const std::string &name, FileLoc loc) {
 
         instanceUses.push_back(InstanceSceneEntity(name, loc, renderFromInstance));
     }
+
+    // Set instance's visibility mask from the current shape attributes
+    ParameterDictionary dict({}, graphicsState.shapeAttributes, graphicsState.colorSpace);
+    uint8_t visibility = NotVisible;
+    if (dict.GetOneBool("visible", true))
+        visibility |= VisibleToRays;
+    if (dict.GetOneBool("castshadows", true))
+        visibility |= CastsShadows;
+    instanceUses.back().visibility = visibility;
 }
 
 void SceneStateManager::EndOfFiles() {
@@ -798,8 +807,8 @@ void ParsedScene::AddNamedMaterial(std::string name, SceneEntity material) {
 
 int ParsedScene::AddMaterial(SceneEntity material) {
     std::lock_guard<std::mutex> lock(materialMutex);
-    materials.push_back(std::move(material));
     startLoadingNormalMaps(material.parameters);
+    materials.push_back(std::move(material));
     return materials.size() - 1;
 }
 
@@ -873,13 +882,6 @@ void ParsedScene::AddFloatTexture(std::string name, TextureSceneEntity texture)
         return;
     }
 
-    if (loadingTextureFilenames.find(filename) != loadingTextureFilenames.end()) {
-        serialFloatTextures.push_back(
-            std::make_pair(std::move(name), std::move(texture)));
-        return;
-    }
-    loadingTextureFilenames.insert(filename);
-
     auto create = [=](TextureSceneEntity texture) {
         Allocator alloc = threadAllocators.Get();
 
@@ -916,13 +918,6 @@ void ParsedScene::AddSpectrumTexture(std::string name, TextureSceneEntity textur
         return;
     }
 
-    if (loadingTextureFilenames.find(filename) != loadingTextureFilenames.end()) {
-        serialSpectrumTextures.push_back(
-            std::make_pair(std::move(name), std::move(texture)));
-        return;
-    }
-    loadingTextureFilenames.insert(filename);
-
     asyncSpectrumTextures.push_back(std::make_pair(name, texture));
 
     auto create = [=](TextureSceneEntity texture) {
@@ -1128,24 +1123,30 @@ NamedTextures ParsedScene::CreateTextures() {
     LOG_VERBOSE("Finished consuming texture futures");
 
     LOG_VERBOSE("Starting to create remaining textures");
-    Allocator alloc = threadAllocators.Get();
-    // Create the other SpectrumTypes for the spectrum textures.
-    for (const auto &tex : asyncSpectrumTextures) {
+    // Create the other SpectrumTypes for the spectrum textures in parallel;
+    // their images have all been loaded and will be found in the image
+    // texture cache.
+    std::vector<SpectrumTexture> unboundedTextures(asyncSpectrumTextures.size());
+    std::vector<SpectrumTexture> illuminantTextures(asyncSpectrumTextures.size());
+    ParallelFor(0, asyncSpectrumTextures.size(), [&](int64_t i) {
+        const auto &tex = asyncSpectrumTextures[i];
+        Allocator alloc = threadAllocators.Get();
         pbrt::Transform renderFromTexture = tex.second.renderFromObject.startTransform;
         // These are all image textures, so nullptr is fine for the
         // textures, as earlier.
         TextureParameterDictionary texDict(&tex.second.parameters, nullptr);
 
-        // These should be fast since they should hit the texture cache
-        SpectrumTexture unboundedTex = SpectrumTexture::Create(
+        unboundedTextures[i] = SpectrumTexture::Create(
             tex.second.texName, renderFromTexture, texDict, SpectrumType::Unbounded,
             &tex.second.loc, alloc, Options->useGPU);
-        SpectrumTexture illumTex = SpectrumTexture::Create(
+        illuminantTextures[i] = SpectrumTexture::Create(
             tex.second.texName, renderFromTexture, texDict, SpectrumType::Illuminant,
             &tex.second.loc, alloc, Options->useGPU);
-
-        textures.unboundedSpectrumTextures[tex.first] = unboundedTex;
-        textures.illuminantSpectrumTextures[tex.first] = illumTex;
+    });
+    for (size_t i = 0; i < asyncSpectrumTextures.size(); ++i) {
+        const std::string &name = asyncSpectrumTextures[i].first;
+        textures.unboundedSpectrumTextures[name] = unboundedTextures[i];
+        textures.illuminantSpectrumTextures[name] = illuminantTextures[i];
     }
 
     // And do the rest serially
@@ -1321,7 +1322,8 @@ Primitive ParsedScene::CreateAggregate(
     const std::map<int, pstd::vector<Light> *> &shapeIndexToAreaLights,
     const std::map<std::string, Medium> &media,
     const std::map<std::string, pbrt::Material> &namedMaterials,
-    const std::vector<pbrt::Material> &materials) {
+    const std::vector<pbrt::Material> &materials,
+    std::vector<Primitive> *instanceUsePrimitives) {
     Allocator alloc;
     auto findMedium = [&media](const std::string &s, const FileLoc *loc) -> Medium {
         if (s.empty())
@@ -1534,13 +1536,15 @@ Primitive ParsedScene::CreateAggregate(
             continue;
 
         if (inst.renderFromInstance)
-            primitives.push_back(
-                new TransformedPrimitive(iter->second, inst.renderFromInstance));
+            primitives.push_back(new TransformedPrimitive(
+                iter->second, inst.renderFromInstance, inst.visibility));
         else {
-            primitives.push_back(
-                new AnimatedPrimitive(iter->second, *inst.renderFromInstanceAnim));
+            primitives.push_back(new AnimatedPrimitive(
+                iter->second, *inst.renderFromInstanceAnim, inst.visibility));
             delete inst.renderFromInstanceAnim;
         }
+        if (instanceUsePrimitives)
+            instanceUsePrimitives->push_back(primitives.back());
     }
 
     instances.clear();
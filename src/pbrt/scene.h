@@ -211,17 +211,20 @@ struct InstanceSceneEntity {
     std::string ToString() const {
         return StringPrintf(
             "[ InstanceSeneEntity name: %s loc: %s "
-            "renderFromInstanceAnim: %s renderFromInstance: %s ]",
+            "renderFromInstanceAnim: %s renderFromInstance: %s visibility: %d ]",
             name, loc,
             renderFromInstanceAnim ? renderFromInstanceAnim->ToString()
                                    : std::string("nullptr"),
-            renderFromInstance ? renderFromInstance->ToString() : std::string("nullptr"));
+            renderFromInstance ? renderFromInstance->ToString() : std::string("nullptr"),
+            visibility);
     }
 
     std::string name;
     FileLoc loc;
     AnimatedTransform *renderFromInstanceAnim = nullptr;
     const Transform *renderFromInstance = nullptr;
+    // _InstanceVisibility_ mask
+    uint8_t visibility = FullyVisible;
 };
 
 // TransformHash Definition
@@ -345,12 +348,19 @@ class ParsedScene : public SceneProcessor {
         const NamedTextures &textures,
         std::map<int, pstd::vector<Light> *> *shapeIndexToAreaLights);
 
+    // If _instanceUsePrimitives_ is non-null, it is filled with the
+    // _TransformedPrimitive_s and _AnimatedPrimitive_s created for object
+    // instance uses, in the order they appeared in the scene description.
+    // Their transformations can then be updated for later frames, followed
+    // by a call to _BVHAggregate::Update()_ on the returned aggregate, while
+    // the instances' own BVHs are reused.
     Primitive CreateAggregate(
         const NamedTextures &textures,
         const std::map<int, pstd::vector<Light> *> &shapeIndexToAreaLights,
         const std::map<std::string, Medium> &media,
         const std::map<std::string, Material> &namedMaterials,
-        const std::vector<Material> &materials);
+        const std::vector<Material> &materials,
+        std::vector<Primitive> *instanceUsePrimitives = nullptr);
 
     // Public for now...
   public:
@@ -389,7 +399,6 @@ class ParsedScene : public SceneProcessor {
     std::vector<std::pair<std::string, TextureSceneEntity>> serialFloatTextures;
     std::vector<std::pair<std::string, TextureSceneEntity>> serialSpectrumTextures;
     std::vector<std::pair<std::string, TextureSceneEntity>> asyncSpectrumTextures;
-    std::set<std::string> loadingTextureFilenames;
     std::map<std::string, Future<FloatTexture>> floatTextureFutures;
     std::map<std::string, Future<SpectrumTexture>> spectrumTextureFutures;
     int nMissingTextures = 0;
@@ -316,6 +316,14 @@ DirectionCone Triangle::NormalBounds() const {
 }
 
 pstd::optional<ShapeIntersection> Triangle::Intersect(const Ray &ray, Float tMax) const {
+    pstd::optional<TriangleIntersection> triIsect = IntersectHit(ray, tMax);
+    if (!triIsect)
+        return {};
+    return InteractionFromHit(ray, *triIsect);
+}
+
+pstd::optional<TriangleIntersection> Triangle::IntersectHit(const Ray &ray,
+                                                            Float tMax) const {
 #ifndef PBRT_IS_GPU_CODE
     ++nTriTests;
 #endif
@@ -326,14 +334,11 @@ pstd::optional<ShapeIntersection> Triangle::Intersect(const Ray &ray, Float tMax
 
     pstd::optional<TriangleIntersection> triIsect =
         IntersectTriangle(ray, tMax, p0, p1, p2);
-    if (!triIsect)
-        return {};
-    SurfaceInteraction intr =
-        InteractionFromIntersection(mesh, triIndex, *triIsect, ray.time, -ray.d);
 #ifndef PBRT_IS_GPU_CODE
-    ++nTriHits;
+    if (triIsect)
+        ++nTriHits;
 #endif
-    return ShapeIntersection{intr, triIsect->t};
+    return triIsect;
 }
 
 bool Triangle::IntersectP(const Ray &ray, Float tMax) const {
@@ -1454,19 +1459,25 @@ pstd::vector<Shape> Shape::Create(
             displacedTrisDelta += plyMesh.triIndices.size() / 3 - origTriCount;
         }
 
+        // Only the positions and normals are copied from _plyMesh_, since the
+        // meshes transform them to rendering space; its other arrays are used
+        // in place.
         if (!plyMesh.triIndices.empty()) {
             TriangleMesh *mesh = alloc.new_object<TriangleMesh>(
-                *renderFromObject, reverseOrientation, plyMesh.triIndices, plyMesh.p,
-                std::vector<Vector3f>(), plyMesh.n, plyMesh.uv, plyMesh.faceIndices,
-                alloc);
+                *renderFromObject, reverseOrientation, plyMesh.triIndices,
+                std::vector<Point3f>(plyMesh.p.begin(), plyMesh.p.end()),
+                std::vector<Vector3f>(),
+                std::vector<Normal3f>(plyMesh.n.begin(), plyMesh.n.end()), plyMesh.uv,
+                plyMesh.faceIndices, alloc);
             shapes = Triangle::CreateTriangles(mesh, alloc);
         }
 
         if (!plyMesh.quadIndices.empty()) {
             BilinearPatchMesh *mesh = alloc.new_object<BilinearPatchMesh>(
-                *renderFromObject, reverseOrientation, plyMesh.quadIndices, plyMesh.p,
-                plyMesh.n, plyMesh.uv, plyMesh.faceIndices, nullptr /* image dist */,
-                alloc);
+                *renderFromObject, reverseOrientation, plyMesh.quadIndices,
+                std::vector<Point3f>(plyMesh.p.begin(), plyMesh.p.end()),
+                std::vector<Normal3f>(plyMesh.n.begin(), plyMesh.n.end()), plyMesh.uv,
+                plyMesh.faceIndices, nullptr /* image dist */, alloc);
             pstd::vector<Shape> quadMesh = BilinearPatch::CreatePatches(mesh, alloc);
             shapes.insert(shapes.end(), quadMesh.begin(), quadMesh.end());
         }
@@ -847,6 +847,21 @@ class Triangle {
     PBRT_CPU_GPU
     bool IntersectP(const Ray &ray, Float tMax = Infinity) const;
 
+    // _IntersectHit()_ only finds the ray's parametric distance and
+    // barycentrics, leaving the more expensive computation of the
+    // _SurfaceInteraction_ to _InteractionFromHit()_, which callers can
+    // defer until they know the hit is the closest one.
+    PBRT_CPU_GPU
+    pstd::optional<TriangleIntersection> IntersectHit(const Ray &ray,
+                                                      Float tMax = Infinity) const;
+    PBRT_CPU_GPU
+    ShapeIntersection InteractionFromHit(const Ray &ray,
+                                         const TriangleIntersection &ti) const {
+        SurfaceInteraction intr =
+            InteractionFromIntersection(GetMesh(), triIndex, ti, ray.time, -ray.d);
+        return ShapeIntersection{intr, ti.t};
+    }
+
     PBRT_CPU_GPU
     Float Area() const {
         // Get triangle vertices in _p0_, _p1_, and _p2_
@@ -857,6 +872,13 @@ class Triangle {
         return 0.5f * Length(Cross(p1 - p0, p2 - p0));
     }
 
+    PBRT_CPU_GPU
+    pstd::array<Point3f, 3> Vertices() const {
+        const TriangleMesh *mesh = GetMesh();
+        const int *v = &mesh->vertexIndices[3 * triIndex];
+        return {mesh->p[v[0]], mesh->p[v[1]], mesh->p[v[2]]};
+    }
+
     PBRT_CPU_GPU
     DirectionCone NormalBounds() const;
 
@@ -145,7 +145,7 @@ Triangle *GetRandomTriangle(std::function<Float()> value) {
     static Transform identity;
     int indices[3] = {0, 1, 2};
     // Leaks...
-    TriangleMesh *mesh = new TriangleMesh(identity, false, {indices, indices + 3},
+    TriangleMesh *mesh = new TriangleMesh(identity, false, {indices, 3},
                                           {v, v + 3}, {}, {}, {}, {},
                                           Allocator());
     pstd::vector<Shape> triVec = Triangle::CreateTriangles(mesh, Allocator());
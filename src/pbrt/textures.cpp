@@ -14,10 +14,15 @@
 #include <pbrt/util/error.h>
 #include <pbrt/util/file.h>
 #include <pbrt/util/float.h>
+#include <pbrt/util/parallel.h>
 #include <pbrt/util/print.h>
 #include <pbrt/util/splines.h>
 #include <pbrt/util/stats.h>
+#include <pbrt/util/texcache.h>
 
+#include <chrono>
+#include <functional>
+#include <future>
 #include <mutex>
 
 #include <Ptexture.h>
@@ -393,8 +398,69 @@ std::string TexInfo::ToString() const {
         filterOptions, wrapMode, encoding);
 }
 
-std::mutex ImageTextureBase::textureCacheMutex;
-std::map<TexInfo, MIPMap *> ImageTextureBase::textureCache;
+// Image Texture Cache Definitions
+// The cache is split into shards with separate locks so that threads
+// creating textures for different files rarely contend. Each entry holds a
+// future for the _MIPMap_, so that the first thread to request a file loads
+// it while others that request it wait for the result.
+struct ImageTextureCacheShard {
+    std::mutex mutex;
+    std::map<TexInfo, std::shared_future<MIPMap *>> mipmaps;
+};
+static constexpr int ImageTextureCacheShards = 16;
+static ImageTextureCacheShard imageTextureCacheShards[ImageTextureCacheShards];
+
+STAT_COUNTER("Scene/Image texture files loaded", nImageTextureFilesLoaded);
+STAT_COUNTER("Scene/Image texture cache hits", nImageTextureCacheHits);
+
+static MIPMap *LoadImageTexture(const TexInfo &texInfo, Allocator alloc) {
+    ++nImageTextureFilesLoaded;
+    // Load the file in an isolated region so that the parallel loops used
+    // to build its _MIPMap_ don't lead this thread to run the creation of
+    // another texture, which may wait for a file whose loading in turn
+    // waits for this one.
+    MIPMap *mipmap = nullptr;
+    RunIsolated([&]() {
+        mipmap = MIPMap::CreateFromFile(texInfo.filename, texInfo.filterOptions,
+                                        texInfo.wrapMode, texInfo.encoding, alloc);
+    });
+    return mipmap;
+}
+
+MIPMap *ImageTextureBase::GetMIPMap(const TexInfo &texInfo, Allocator alloc) {
+    ImageTextureCacheShard &shard =
+        imageTextureCacheShards[std::hash<std::string>()(texInfo.filename) %
+                                ImageTextureCacheShards];
+    std::unique_lock<std::mutex> lock(shard.mutex);
+    if (auto iter = shard.mipmaps.find(texInfo); iter != shard.mipmaps.end()) {
+        std::shared_future<MIPMap *> mipmap = iter->second;
+        lock.unlock();
+        auto ready = [&]() {
+            return mipmap.wait_for(std::chrono::seconds(0)) == std::future_status::ready;
+        };
+        // Help with other work while the _MIPMap_ is loaded
+        ++nImageTextureCacheHits;
+        while (!ready() && DoParallelWork())
+            ;
+        return mipmap.get();
+    }
+
+    // Add the future for the _MIPMap_ before releasing the lock so that other
+    // threads wait for this one to load it
+    std::promise<MIPMap *> promise;
+    shard.mipmaps[texInfo] = promise.get_future().share();
+    lock.unlock();
+    MIPMap *mipmap = LoadImageTexture(texInfo, alloc);
+    promise.set_value(mipmap);
+    return mipmap;
+}
+
+void ImageTextureBase::ClearCache() {
+    for (ImageTextureCacheShard &shard : imageTextureCacheShards) {
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        shard.mipmaps.clear();
+    }
+}
 
 FloatImageTexture *FloatImageTexture::Create(const Transform &renderFromTexture,
                                              const TextureParameterDictionary &parameters,
@@ -589,7 +655,7 @@ struct : public PtexErrorHandler {
 PtexTextureBase::PtexTextureBase(const std::string &filename, ColorEncoding encoding,
                                  Float scale)
     : filename(filename), encoding(encoding), scale(scale) {
-    std::mutex mutex;
+    static std::mutex mutex;
     mutex.lock();
     if (!cache) {
         int maxFiles = 100;
@@ -1088,6 +1154,9 @@ GPUSpectrumImageTexture *GPUSpectrumImageTexture::Create(
     Float scale = parameters.GetOneFloat("scale", 1.f);
     bool invert = parameters.GetOneBool("invert", false);
     std::string filename = ResolveFilename(parameters.GetOneString("filename", ""));
+    if (TiledImagePyramid::IsTiledMIPFile(filename))
+        ErrorExit(loc, "%s: tiled MIP files are only supported by the CPU renderers.",
+                  filename);
 
     const char *defaultEncoding = HasExtension(filename, "png") ? "sRGB" : "linear";
     std::string encodingString = parameters.GetOneString("encoding", defaultEncoding);
@@ -1338,6 +1407,9 @@ GPUFloatImageTexture *GPUFloatImageTexture::Create(
     Float scale = parameters.GetOneFloat("scale", 1.f);
     bool invert = parameters.GetOneBool("invert", false);
     std::string filename = ResolveFilename(parameters.GetOneString("filename", ""));
+    if (TiledImagePyramid::IsTiledMIPFile(filename))
+        ErrorExit(loc, "%s: tiled MIP files are only supported by the CPU renderers.",
+                  filename);
 
     const char *defaultEncoding = HasExtension(filename, "png") ? "sRGB" : "linear";
     std::string encodingString = parameters.GetOneString("encoding", defaultEncoding);
@@ -535,27 +535,12 @@ class ImageTextureBase {
                      MIPMapFilterOptions filterOptions, WrapMode wrapMode, Float scale,
                      bool invert, ColorEncoding encoding, Allocator alloc)
         : mapping(mapping), filename(filename), scale(scale), invert(invert) {
-        // Get _MIPMap_ from texture cache if present
+        // Get _MIPMap_ from texture cache, loading it if necessary
         TexInfo texInfo(filename, filterOptions, wrapMode, encoding);
-        std::unique_lock<std::mutex> lock(textureCacheMutex);
-        if (auto iter = textureCache.find(texInfo); iter != textureCache.end()) {
-            mipmap = iter->second;
-            return;
-        }
-        lock.unlock();
-
-        // Create _MIPMap_ for _filename_ and add to texture cache
-        mipmap =
-            MIPMap::CreateFromFile(filename, filterOptions, wrapMode, encoding, alloc);
-        lock.lock();
-        // This is actually ok, but if it hits, it means we've wastefully
-        // loaded this texture. (Note that in that case, should just return
-        // the one that's already in there and not replace it.)
-        CHECK(textureCache.find(texInfo) == textureCache.end());
-        textureCache[texInfo] = mipmap;
+        mipmap = GetMIPMap(texInfo, alloc);
     }
 
-    static void ClearCache() { textureCache.clear(); }
+    static void ClearCache();
 
     void MultiplyScale(Float s) { scale *= s; }
 
@@ -568,9 +553,8 @@ class ImageTextureBase {
     MIPMap *mipmap;
 
   private:
-    // ImageTextureBase Private Members
-    static std::mutex textureCacheMutex;
-    static std::map<TexInfo, MIPMap *> textureCache;
+    // ImageTextureBase Private Methods
+    static MIPMap *GetMIPMap(const TexInfo &texInfo, Allocator alloc);
 };
 
 // FloatImageTexture Definition
@@ -0,0 +1,541 @@
+// pbrt is Copyright(c) 1998-2020 Matt Pharr, Wenzel Jakob, and Greg Humphreys.
+// The pbrt source code is licensed under the Apache License, Version 2.0.
+// SPDX: Apache-2.0
+
+#include <pbrt/util/bcn.h>
+
+#include <pbrt/util/check.h>
+#include <pbrt/util/math.h>
+#include <pbrt/util/parallel.h>
+#include <pbrt/util/print.h>
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <limits>
+
+namespace pbrt {
+
+std::string ToString(BCFormat format) {
+    switch (format) {
+    case BCFormat::BC1:
+        return "BC1";
+    case BCFormat::BC4:
+        return "BC4";
+    case BCFormat::BC5:
+        return "BC5";
+    case BCFormat::BC6H:
+        return "BC6H";
+    default:
+        LOG_FATAL("Unhandled BCFormat");
+        return "";
+    }
+}
+
+pstd::optional<BCFormat> ParseBCFormat(const std::string &str) {
+    if (str == "bc1" || str == "BC1")
+        return BCFormat::BC1;
+    else if (str == "bc4" || str == "BC4")
+        return BCFormat::BC4;
+    else if (str == "bc5" || str == "BC5")
+        return BCFormat::BC5;
+    else if (str == "bc6h" || str == "BC6H")
+        return BCFormat::BC6H;
+    return {};
+}
+
+///////////////////////////////////////////////////////////////////////////
+// Endpoint Fitting
+
+// Finds initial endpoints for the texels of a block by projecting them onto
+// the principal axis of their distribution.
+static void PrincipalAxisEndpoints(const Float pts[16][3], Float e0[3], Float e1[3]) {
+    Float mean[3] = {0, 0, 0};
+    for (int i = 0; i < 16; ++i)
+        for (int c = 0; c < 3; ++c)
+            mean[c] += pts[i][c] / 16;
+    Float cov[3][3] = {};
+    for (int i = 0; i < 16; ++i)
+        for (int a = 0; a < 3; ++a)
+            for (int b = 0; b < 3; ++b)
+                cov[a][b] += (pts[i][a] - mean[a]) * (pts[i][b] - mean[b]);
+
+    // Find the principal axis using power iteration
+    Float axis[3] = {1, 1, 1};
+    for (int iter = 0; iter < 8; ++iter) {
+        Float next[3];
+        for (int a = 0; a < 3; ++a)
+            next[a] = cov[a][0] * axis[0] + cov[a][1] * axis[1] + cov[a][2] * axis[2];
+        Float len = std::sqrt(Sqr(next[0]) + Sqr(next[1]) + Sqr(next[2]));
+        if (len == 0)
+            break;
+        for (int a = 0; a < 3; ++a)
+            axis[a] = next[a] / len;
+    }
+
+    Float tMin = Infinity, tMax = -Infinity;
+    for (int i = 0; i < 16; ++i) {
+        Float t = 0;
+        for (int c = 0; c < 3; ++c)
+            t += (pts[i][c] - mean[c]) * axis[c];
+        tMin = std::min(tMin, t);
+        tMax = std::max(tMax, t);
+    }
+    for (int c = 0; c < 3; ++c) {
+        e0[c] = mean[c] + tMin * axis[c];
+        e1[c] = mean[c] + tMax * axis[c];
+    }
+}
+
+// Computes the endpoints that minimize the squared error for the block's
+// texels given the interpolation weight of the second endpoint for each
+// one, returning false if they're not well-defined.
+static bool RefitEndpoints(const Float pts[16][3], const Float w[16], Float e0[3],
+                           Float e1[3]) {
+    Float a = 0, b = 0, c = 0, r0[3] = {0, 0, 0}, r1[3] = {0, 0, 0};
+    for (int i = 0; i < 16; ++i) {
+        a += Sqr(1 - w[i]);
+        b += (1 - w[i]) * w[i];
+        c += Sqr(w[i]);
+        for (int ch = 0; ch < 3; ++ch) {
+            r0[ch] += (1 - w[i]) * pts[i][ch];
+            r1[ch] += w[i] * pts[i][ch];
+        }
+    }
+    Float det = a * c - b * b;
+    if (std::abs(det) < 1e-6f)
+        return false;
+    for (int ch = 0; ch < 3; ++ch) {
+        e0[ch] = (c * r0[ch] - b * r1[ch]) / det;
+        e1[ch] = (a * r1[ch] - b * r0[ch]) / det;
+    }
+    return true;
+}
+
+///////////////////////////////////////////////////////////////////////////
+// BC1
+
+static uint16_t ToRGB565(const Float rgb[3]) {
+    auto quantize = [](Float v, int maxValue) {
+        return Clamp(int(std::round(v * maxValue / 255)), 0, maxValue);
+    };
+    return (quantize(rgb[0], 31) << 11) | (quantize(rgb[1], 63) << 5) |
+           quantize(rgb[2], 31);
+}
+
+// Computes the four colors that BC1 texel indices select between.
+static void BC1Palette(uint16_t c0, uint16_t c1, uint8_t palette[4][3]) {
+    auto expand = [](uint16_t c, uint8_t rgb[3]) {
+        int r = c >> 11, g = (c >> 5) & 0x3f, b = c & 0x1f;
+        rgb[0] = (r << 3) | (r >> 2);
+        rgb[1] = (g << 2) | (g >> 4);
+        rgb[2] = (b << 3) | (b >> 2);
+    };
+    expand(c0, palette[0]);
+    expand(c1, palette[1]);
+    for (int c = 0; c < 3; ++c) {
+        int a = palette[0][c], b = palette[1][c];
+        if (c0 > c1) {
+            palette[2][c] = (2 * a + b + 1) / 3;
+            palette[3][c] = (a + 2 * b + 1) / 3;
+        } else {
+            // The second color is black in the three-color mode
+            palette[2][c] = (a + b + 1) / 2;
+            palette[3][c] = 0;
+        }
+    }
+}
+
+void EncodeBC1Block(const uint8_t *rgb, uint8_t *block) {
+    Float pts[16][3];
+    for (int i = 0; i < 16; ++i)
+        for (int c = 0; c < 3; ++c)
+            pts[i][c] = rgb[3 * i + c];
+    Float e0[3], e1[3];
+    PrincipalAxisEndpoints(pts, e0, e1);
+
+    // Choose texel indices for the endpoints and refit the endpoints to them
+    uint16_t bestC0 = 0, bestC1 = 0;
+    uint32_t bestIndices = 0;
+    int bestError = std::numeric_limits<int>::max();
+    for (int iter = 0; iter < 3; ++iter) {
+        // Quantize the endpoints and order them for the four-color mode
+        uint16_t c0 = ToRGB565(e0), c1 = ToRGB565(e1);
+        if (c0 < c1)
+            pstd::swap(c0, c1);
+        uint8_t palette[4][3];
+        BC1Palette(c0, c1, palette);
+
+        uint32_t indices = 0;
+        int error = 0;
+        for (int i = 0; i < 16; ++i) {
+            int texelIndex = 0, texelError = std::numeric_limits<int>::max();
+            for (int j = 0; j < 4; ++j) {
+                int e = 0;
+                for (int c = 0; c < 3; ++c)
+                    e += Sqr(int(rgb[3 * i + c]) - int(palette[j][c]));
+                if (e < texelError) {
+                    texelIndex = j;
+                    texelError = e;
+                }
+            }
+            indices |= uint32_t(texelIndex) << (2 * i);
+            error += texelError;
+        }
+        if (error < bestError) {
+            bestC0 = c0;
+            bestC1 = c1;
+            bestIndices = indices;
+            bestError = error;
+        }
+        if (error == 0 || c0 == c1)
+            break;
+
+        Float w[16];
+        static constexpr Float indexWeights[4] = {0, 1, 1.f / 3, 2.f / 3};
+        for (int i = 0; i < 16; ++i)
+            w[i] = indexWeights[(indices >> (2 * i)) & 3];
+        if (!RefitEndpoints(pts, w, e0, e1))
+            break;
+    }
+
+    block[0] = bestC0 & 0xff;
+    block[1] = bestC0 >> 8;
+    block[2] = bestC1 & 0xff;
+    block[3] = bestC1 >> 8;
+    for (int i = 0; i < 4; ++i)
+        block[4 + i] = (bestIndices >> (8 * i)) & 0xff;
+}
+
+void DecodeBC1Row(const uint8_t *block, int y, uint8_t *rgb) {
+    uint16_t c0 = block[0] | (block[1] << 8), c1 = block[2] | (block[3] << 8);
+    uint8_t palette[4][3];
+    BC1Palette(c0, c1, palette);
+    // Each row's indices are stored in a single byte
+    uint8_t indices = block[4 + y];
+    for (int x = 0; x < 4; ++x)
+        for (int c = 0; c < 3; ++c)
+            rgb[3 * x + c] = palette[(indices >> (2 * x)) & 3][c];
+}
+
+///////////////////////////////////////////////////////////////////////////
+// BC4 and BC5
+
+// Computes the eight values that BC4 texel indices select between.
+static void BC4Palette(int v0, int v1, uint8_t palette[8]) {
+    palette[0] = v0;
+    palette[1] = v1;
+    if (v0 > v1) {
+        for (int i = 1; i < 7; ++i)
+            palette[i + 1] = ((7 - i) * v0 + i * v1 + 3) / 7;
+    } else {
+        for (int i = 1; i < 5; ++i)
+            palette[i + 1] = ((5 - i) * v0 + i * v1 + 2) / 5;
+        palette[6] = 0;
+        palette[7] = 255;
+    }
+}
+
+void EncodeBC4Block(const uint8_t *v, int stride, uint8_t *block) {
+    // Use the extreme values as endpoints with the eight-value mode
+    int vMin = 255, vMax = 0;
+    for (int i = 0; i < 16; ++i) {
+        vMin = std::min<int>(vMin, v[i * stride]);
+        vMax = std::max<int>(vMax, v[i * stride]);
+    }
+    uint8_t palette[8];
+    BC4Palette(vMax, vMin, palette);
+
+    uint64_t indices = 0;
+    for (int i = 0; i < 16; ++i) {
+        int texelIndex = 0, texelError = 256;
+        for (int j = 0; j < 8; ++j)
+            if (std::abs(int(v[i * stride]) - int(palette[j])) < texelError) {
+                texelIndex = j;
+                texelError = std::abs(int(v[i * stride]) - int(palette[j]));
+            }
+        indices |= uint64_t(texelIndex) << (3 * i);
+    }
+
+    block[0] = vMax;
+    block[1] = vMin;
+    for (int i = 0; i < 6; ++i)
+        block[2 + i] = (indices >> (8 * i)) & 0xff;
+}
+
+void DecodeBC4Row(const uint8_t *block, int y, uint8_t *v, int stride) {
+    uint8_t palette[8];
+    BC4Palette(block[0], block[1], palette);
+    // Find the 12 bits of the row's indices in the 48 bits that store them
+    uint64_t indices = 0;
+    for (int i = 0; i < 6; ++i)
+        indices |= uint64_t(block[2 + i]) << (8 * i);
+    indices >>= 12 * y;
+    for (int x = 0; x < 4; ++x)
+        v[x * stride] = palette[(indices >> (3 * x)) & 7];
+}
+
+void EncodeBC5Block(const uint8_t *rg, uint8_t *block) {
+    EncodeBC4Block(rg, 2, block);
+    EncodeBC4Block(rg + 1, 2, block + 8);
+}
+
+void DecodeBC5Row(const uint8_t *block, int y, uint8_t *rg) {
+    DecodeBC4Row(block, y, rg, 2);
+    DecodeBC4Row(block + 8, y, rg + 1, 2);
+}
+
+///////////////////////////////////////////////////////////////////////////
+// BC6H
+
+// BC6H interpolates between endpoints in a 16-bit domain that is mapped to
+// unsigned half-float values after interpolation.
+static constexpr int BC6HWeights[16] = {0,  4,  9,  13, 17, 21, 26, 30,
+                                        34, 38, 43, 47, 51, 55, 60, 64};
+// Bits in the block's header that give the single-region mode with 10-bit
+// endpoints (mode 11 in the D3D11 specification)
+static constexpr int BC6HMode = 0x03;
+
+static int BC6HUnquantize(int v) {
+    // Map a 10-bit endpoint to the interpolation domain
+    if (v == 0)
+        return 0;
+    if (v == 1023)
+        return 0xffff;
+    return ((v << 16) + 0x8000) >> 10;
+}
+
+static uint16_t BC6HInterpolate(int u0, int u1, int index) {
+    int w = BC6HWeights[index];
+    int u = ((64 - w) * u0 + w * u1 + 32) >> 6;
+    // Map the interpolated value to a half-float
+    return (u * 31) >> 6;
+}
+
+// Reads and writes bits of 128-bit BC6H blocks, which are stored in little
+// endian order.
+static uint64_t GetBlockBits(const uint8_t *block, int start, int count) {
+    uint64_t bits = 0;
+    for (int i = 0; i < count; ++i)
+        bits |= uint64_t((block[(start + i) >> 3] >> ((start + i) & 7)) & 1) << i;
+    return bits;
+}
+
+static void SetBlockBits(uint8_t *block, int start, int count, uint64_t bits) {
+    for (int i = 0; i < count; ++i)
+        block[(start + i) >> 3] |= ((bits >> i) & 1) << ((start + i) & 7);
+}
+
+// Returns the position of the index of texel _i_ of a BC6H block; the
+// first texel's index has one fewer bit than the others.
+static int BC6HIndexBit(int i) {
+    return i == 0 ? 65 : 68 + 4 * (i - 1);
+}
+
+void EncodeBC6HBlock(const Float *rgb, uint8_t *block) {
+    // Find the texels' values as unsigned half-floats and in the
+    // interpolation domain
+    int target[16][3];
+    Float pts[16][3];
+    for (int i = 0; i < 16; ++i)
+        for (int c = 0; c < 3; ++c) {
+            Float v = rgb[3 * i + c];
+            v = IsNaN(v) ? 0 : Clamp(v, 0, 65504);
+            target[i][c] = Half(v).Bits();
+            pts[i][c] = target[i][c] * 64.f / 31.f;
+        }
+    Float e0[3], e1[3];
+    PrincipalAxisEndpoints(pts, e0, e1);
+
+    // Choose texel indices for the endpoints and refit the endpoints to them
+    int bestEndpoints[2][3] = {};
+    int bestIndices[16] = {};
+    int64_t bestError = std::numeric_limits<int64_t>::max();
+    for (int iter = 0; iter < 3; ++iter) {
+        int endpoints[2][3], u[2][3];
+        for (int c = 0; c < 3; ++c) {
+            endpoints[0][c] = Clamp(int(std::round((e0[c] - 32) / 64)), 0, 1023);
+            endpoints[1][c] = Clamp(int(std::round((e1[c] - 32) / 64)), 0, 1023);
+            u[0][c] = BC6HUnquantize(endpoints[0][c]);
+            u[1][c] = BC6HUnquantize(endpoints[1][c]);
+        }
+        uint16_t palette[16][3];
+        for (int j = 0; j < 16; ++j)
+            for (int c = 0; c < 3; ++c)
+                palette[j][c] = BC6HInterpolate(u[0][c], u[1][c], j);
+
+        int indices[16];
+        int64_t error = 0;
+        for (int i = 0; i < 16; ++i) {
+            int64_t texelError = std::numeric_limits<int64_t>::max();
+            for (int j = 0; j < 16; ++j) {
+                int64_t e = 0;
+                for (int c = 0; c < 3; ++c)
+                    e += Sqr(int64_t(target[i][c]) - int64_t(palette[j][c]));
+                if (e < texelError) {
+                    indices[i] = j;
+                    texelError = e;
+                }
+            }
+            error += texelError;
+        }
+        if (error < bestError) {
+            std::memcpy(bestEndpoints, endpoints, sizeof(endpoints));
+            std::memcpy(bestIndices, indices, sizeof(indices));
+            bestError = error;
+        }
+        if (error == 0)
+            break;
+
+        Float w[16];
+        for (int i = 0; i < 16; ++i)
+            w[i] = BC6HWeights[indices[i]] / 64.f;
+        if (!RefitEndpoints(pts, w, e0, e1))
+            break;
+    }
+
+    // The first texel's index must have a zero high bit, which is ensured by
+    // swapping the endpoints if necessary.
+    if (bestIndices[0] >= 8) {
+        for (int c = 0; c < 3; ++c)
+            pstd::swap(bestEndpoints[0][c], bestEndpoints[1][c]);
+        for (int i = 0; i < 16; ++i)
+            bestIndices[i] = 15 - bestIndices[i];
+    }
+
+    std::memset(block, 0, 16);
+    SetBlockBits(block, 0, 5, BC6HMode);
+    for (int e = 0; e < 2; ++e)
+        for (int c = 0; c < 3; ++c)
+            SetBlockBits(block, 5 + 10 * (3 * e + c), 10, bestEndpoints[e][c]);
+    for (int i = 0; i < 16; ++i)
+        SetBlockBits(block, BC6HIndexBit(i), i == 0 ? 3 : 4, bestIndices[i]);
+}
+
+void DecodeBC6HRow(const uint8_t *block, int y, Half *rgb) {
+    CHECK_EQ(BC6HMode, GetBlockBits(block, 0, 5));
+    int u[2][3];
+    for (int e = 0; e < 2; ++e)
+        for (int c = 0; c < 3; ++c)
+            u[e][c] = BC6HUnquantize(GetBlockBits(block, 5 + 10 * (3 * e + c), 10));
+    for (int x = 0; x < 4; ++x) {
+        int i = 4 * y + x;
+        int index = GetBlockBits(block, BC6HIndexBit(i), i == 0 ? 3 : 4);
+        for (int c = 0; c < 3; ++c)
+            rgb[3 * x + c] = Half::FromBits(BC6HInterpolate(u[0][c], u[1][c], index));
+    }
+}
+
+///////////////////////////////////////////////////////////////////////////
+// BCImage Method Definitions
+
+BCImage BCImage::Compress(const Image &image, BCFormat format, Allocator alloc) {
+    int nc = BCChannels(format);
+    CHECK_GE(image.NChannels(), nc);
+    if (format != BCFormat::BC6H)
+        CHECK(image.Format() == PixelFormat::U256);
+
+    BCImage bc(alloc);
+    bc.format = format;
+    bc.resolution = image.Resolution();
+    bc.nBlocks = (bc.resolution + Vector2i(3, 3)) / 4;
+    std::vector<std::string> names = image.ChannelNames();
+    bc.channelNames = pstd::vector<std::string>(names.begin(), names.begin() + nc, alloc);
+    bc.encoding = image.Encoding();
+    bc.blocks.resize(BCBlockBytes(format) * size_t(bc.nBlocks.x) * bc.nBlocks.y);
+
+    ParallelFor(0, bc.nBlocks.y, [&](int64_t by) {
+        for (int bx = 0; bx < bc.nBlocks.x; ++bx) {
+            // Gather the block's texels, replicating the last row and column
+            // of the image if its resolution isn't a multiple of four
+            uint8_t texels8[16 * 3];
+            Float texels[16 * 3];
+            for (int i = 0; i < 16; ++i) {
+                Point2i p(std::min(4 * bx + i % 4, bc.resolution.x - 1),
+                          std::min(4 * int(by) + i / 4, bc.resolution.y - 1));
+                for (int c = 0; c < nc; ++c) {
+                    if (format == BCFormat::BC6H)
+                        texels[nc * i + c] = image.GetChannel(p, c);
+                    else
+                        texels8[nc * i + c] =
+                            ((const uint8_t *)image.RawPointer(p))[c];
+                }
+            }
+
+            uint8_t *block = &bc.blocks[BCBlockBytes(format) *
+                                        (size_t(by) * bc.nBlocks.x + bx)];
+            switch (format) {
+            case BCFormat::BC1:
+                EncodeBC1Block(texels8, block);
+                break;
+            case BCFormat::BC4:
+                EncodeBC4Block(texels8, 1, block);
+                break;
+            case BCFormat::BC5:
+                EncodeBC5Block(texels8, block);
+                break;
+            case BCFormat::BC6H:
+                EncodeBC6HBlock(texels, block);
+                break;
+            }
+        }
+    });
+    return bc;
+}
+
+pstd::optional<BCFormat> BCImage::TextureFormat(PixelFormat format, int nChannels) {
+    if (format == PixelFormat::U256 && nChannels == 1)
+        return BCFormat::BC4;
+    if (format == PixelFormat::U256 && nChannels == 3)
+        return BCFormat::BC1;
+    if (format != PixelFormat::U256 && nChannels == 3)
+        return BCFormat::BC6H;
+    return {};
+}
+
+Image BCImage::Decompress(Allocator alloc) const {
+    int nc = NChannels();
+    PixelFormat pixelFormat =
+        format == BCFormat::BC6H ? PixelFormat::Half : PixelFormat::U256;
+    Image image(pixelFormat, resolution, channelNames, encoding, alloc);
+    ParallelFor(0, resolution.y, [&](int64_t y) {
+        for (int bx = 0; bx < nBlocks.x; ++bx) {
+            // Decode the block's row and copy the texels that are inside the
+            // image
+            uint8_t texels8[4 * 3];
+            Half texels[4 * 3];
+            const uint8_t *block = Block({bx, int(y) / 4});
+            switch (format) {
+            case BCFormat::BC1:
+                DecodeBC1Row(block, y % 4, texels8);
+                break;
+            case BCFormat::BC4:
+                DecodeBC4Row(block, y % 4, texels8, 1);
+                break;
+            case BCFormat::BC5:
+                DecodeBC5Row(block, y % 4, texels8);
+                break;
+            case BCFormat::BC6H:
+                DecodeBC6HRow(block, y % 4, texels);
+                break;
+            }
+
+            int n = std::min(4, resolution.x - 4 * bx);
+            void *row = image.RawPointer({4 * bx, int(y)});
+            if (format == BCFormat::BC6H)
+                std::memcpy(row, texels, n * nc * sizeof(Half));
+            else
+                std::memcpy(row, texels8, n * nc);
+        }
+    });
+    return image;
+}
+
+std::string BCImage::ToString() const {
+    return StringPrintf("[ BCImage format: %s resolution: %s channelNames: %s "
+                        "encoding: %s ]",
+                        format, resolution, channelNames,
+                        encoding ? encoding.ToString().c_str() : "(nullptr)");
+}
+
+}  // namespace pbrt
@@ -0,0 +1,100 @@
+// pbrt is Copyright(c) 1998-2020 Matt Pharr, Wenzel Jakob, and Greg Humphreys.
+// The pbrt source code is licensed under the Apache License, Version 2.0.
+// SPDX: Apache-2.0
+
+#ifndef PBRT_UTIL_BCN_H
+#define PBRT_UTIL_BCN_H
+
+#include <pbrt/pbrt.h>
+
+#include <pbrt/util/color.h>
+#include <pbrt/util/float.h>
+#include <pbrt/util/image.h>
+#include <pbrt/util/pstd.h>
+#include <pbrt/util/vecmath.h>
+
+#include <cstdint>
+#include <string>
+
+namespace pbrt {
+
+// BCFormat Definition
+// Block-compressed texel formats, which encode each 4x4 block of texels
+// with a fixed number of bytes. BC1 stores RGB, BC4 a single channel, and
+// BC5 two channels, all as 8-bit values; BC6H stores unsigned half-float
+// RGB values.
+enum class BCFormat { BC1, BC4, BC5, BC6H };
+
+// BCFormat Inline Functions
+constexpr int BCBlockBytes(BCFormat format) {
+    return (format == BCFormat::BC1 || format == BCFormat::BC4) ? 8 : 16;
+}
+constexpr int BCChannels(BCFormat format) {
+    return format == BCFormat::BC4 ? 1 : (format == BCFormat::BC5 ? 2 : 3);
+}
+
+std::string ToString(BCFormat format);
+pstd::optional<BCFormat> ParseBCFormat(const std::string &str);
+
+// Block Compression Function Declarations
+// The encoding functions take the block's 16 texels in scanline order with
+// interleaved channels; the decoding functions return the four texels of
+// row _y_ of a block, also with interleaved channels.
+void EncodeBC1Block(const uint8_t *rgb, uint8_t *block);
+void DecodeBC1Row(const uint8_t *block, int y, uint8_t *rgb);
+
+void EncodeBC4Block(const uint8_t *v, int stride, uint8_t *block);
+void DecodeBC4Row(const uint8_t *block, int y, uint8_t *v, int stride);
+
+void EncodeBC5Block(const uint8_t *rg, uint8_t *block);
+void DecodeBC5Row(const uint8_t *block, int y, uint8_t *rg);
+
+// BC6H blocks are always encoded with its single-region mode that has
+// 10-bit endpoints, which is also the only mode that _DecodeBC6HRow()_
+// supports. Negative values are clamped to zero.
+void EncodeBC6HBlock(const Float *rgb, uint8_t *block);
+void DecodeBC6HRow(const uint8_t *block, int y, Half *rgb);
+
+// BCImage Definition
+// Stores the first one, two, or three channels of an image in a
+// block-compressed format. 8-bit values are stored using the image's color
+// encoding.
+class BCImage {
+  public:
+    // BCImage Public Methods
+    BCImage(Allocator alloc = {}) : channelNames(alloc), blocks(alloc) {}
+    // Compresses _image_, which must have 8-bit texels unless _format_ is
+    // BC6H.
+    static BCImage Compress(const Image &image, BCFormat format, Allocator alloc = {});
+    // Returns the format that image textures with the given texel format and
+    // number of channels are compressed with, if there is one.
+    static pstd::optional<BCFormat> TextureFormat(PixelFormat format, int nChannels);
+
+    Image Decompress(Allocator alloc = {}) const;
+
+    BCFormat Format() const { return format; }
+    Point2i Resolution() const { return resolution; }
+    int NChannels() const { return BCChannels(format); }
+    ColorEncoding Encoding() const { return encoding; }
+    size_t BytesUsed() const { return blocks.size(); }
+
+    // Returns the block with the given block coordinates
+    const uint8_t *Block(Point2i b) const {
+        DCHECK(InsideExclusive(b, Bounds2i({0, 0}, nBlocks)));
+        return &blocks[BCBlockBytes(format) * (size_t(b.y) * nBlocks.x + b.x)];
+    }
+
+    std::string ToString() const;
+
+  private:
+    // BCImage Private Members
+    BCFormat format = BCFormat::BC1;
+    Point2i resolution, nBlocks;
+    pstd::vector<std::string> channelNames;
+    ColorEncoding encoding = nullptr;
+    pstd::vector<uint8_t> blocks;
+};
+
+}  // namespace pbrt
+
+#endif  // PBRT_UTIL_BCN_H
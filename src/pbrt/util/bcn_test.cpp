@@ -0,0 +1,176 @@
+// pbrt is Copyright(c) 1998-2020 Matt Pharr, Wenzel Jakob, and Greg Humphreys.
+// The pbrt source code is licensed under the Apache License, Version 2.0.
+// SPDX: Apache-2.0
+
+#include <gtest/gtest.h>
+
+#include <pbrt/pbrt.h>
+#include <pbrt/util/bcn.h>
+#include <pbrt/util/colorspace.h>
+#include <pbrt/util/image.h>
+#include <pbrt/util/mipmap.h>
+#include <pbrt/util/rng.h>
+
+#include <cmath>
+
+using namespace pbrt;
+
+static std::vector<std::string> ChannelNames(int nChannels) {
+    if (nChannels == 1)
+        return {"Y"};
+    else if (nChannels == 2)
+        return {"R", "G"};
+    return {"R", "G", "B"};
+}
+
+// Returns an image with smooth gradients. One- and two-channel images get
+// independent gradients in each channel, while RGB images get a tinted
+// gradient, since the three-channel formats fit a single line of colors to
+// each block.
+static Image GradientImage(PixelFormat format, Point2i res, int nChannels) {
+    Image image(format, res, ChannelNames(nChannels), ColorEncoding::Linear);
+    const Float tint[3] = {1, 0.7f, 0.4f};
+    for (int y = 0; y < res.y; ++y)
+        for (int x = 0; x < res.x; ++x)
+            for (int c = 0; c < nChannels; ++c) {
+                Float u = (x + 0.5f) / res.x, v = (y + 0.5f) / res.y;
+                Float value =
+                    nChannels == 3 ? tint[c] * 0.5f * (u + v) : (c == 0 ? u : v);
+                if (format != PixelFormat::U256)
+                    value *= 8;
+                image.SetChannel({x, y}, c, value);
+            }
+    return image;
+}
+
+TEST(BCImage, ConstantBlocks) {
+    // Images with one value per 4x4 block should be reproduced exactly, up
+    // to the quantization of the blocks' endpoints.
+    for (BCFormat format : {BCFormat::BC1, BCFormat::BC4, BCFormat::BC5, BCFormat::BC6H}) {
+        int nc = BCChannels(format);
+        PixelFormat pixelFormat =
+            format == BCFormat::BC6H ? PixelFormat::Half : PixelFormat::U256;
+        // Use a resolution that isn't a multiple of the block size.
+        Point2i res(18, 11);
+        Image image(pixelFormat, res, ChannelNames(nc), ColorEncoding::Linear);
+        RNG rng;
+        std::vector<Float> blockValues(3 * 5 * 3);
+        for (Float &v : blockValues) {
+            v = rng.Uniform<Float>();
+            if (format == BCFormat::BC1)
+                // Values that are exactly representable with 5 bits
+                v = std::round(v * 31) / 31;
+        }
+        for (int y = 0; y < res.y; ++y)
+            for (int x = 0; x < res.x; ++x)
+                for (int c = 0; c < nc; ++c)
+                    image.SetChannel({x, y}, c, blockValues[3 * (y / 4 * 5 + x / 4) + c]);
+
+        BCImage compressed = BCImage::Compress(image, format);
+        EXPECT_EQ(res, compressed.Resolution());
+        EXPECT_EQ(5 * 3 * BCBlockBytes(format), compressed.BytesUsed());
+        Image decoded = compressed.Decompress();
+        ASSERT_EQ(res, decoded.Resolution());
+        ASSERT_EQ(nc, decoded.NChannels());
+
+        // BC6H endpoints are quantized to 10 bits of the half-float bit
+        // pattern, which leaves about 5 bits of mantissa.
+        // Values that are exact with 5 bits are rounded to 6 bits for BC1's
+        // green endpoints, which may leave them off by two 8-bit steps.
+        for (int y = 0; y < res.y; ++y)
+            for (int x = 0; x < res.x; ++x)
+                for (int c = 0; c < nc; ++c) {
+                    Float v = image.GetChannel({x, y}, c);
+                    Float tolerance = format == BCFormat::BC6H ? v / 32 : 2.f / 255;
+                    EXPECT_LE(std::abs(v - decoded.GetChannel({x, y}, c)), tolerance)
+                        << ToString(format) << " " << Point2i(x, y) << " " << c;
+                }
+    }
+}
+
+TEST(BCImage, Gradients) {
+    for (BCFormat format : {BCFormat::BC1, BCFormat::BC4, BCFormat::BC5, BCFormat::BC6H}) {
+        int nc = BCChannels(format);
+        PixelFormat pixelFormat =
+            format == BCFormat::BC6H ? PixelFormat::Half : PixelFormat::U256;
+        Image image = GradientImage(pixelFormat, {64, 64}, nc);
+        Image decoded = BCImage::Compress(image, format).Decompress();
+
+        Float maxError = 0, sumError = 0;
+        for (int y = 0; y < 64; ++y)
+            for (int x = 0; x < 64; ++x)
+                for (int c = 0; c < nc; ++c) {
+                    Float v = image.GetChannel({x, y}, c);
+                    Float error = std::abs(v - decoded.GetChannel({x, y}, c));
+                    if (format == BCFormat::BC6H)
+                        error /= v;
+                    maxError = std::max(maxError, error);
+                    sumError += error;
+                }
+        Float avgError = sumError / (64 * 64 * nc);
+        // BC1's 565 endpoints and 2-bit indices are the coarsest of the 8-bit
+        // formats; BC4 and BC5 have 8-bit endpoints and 3-bit indices. BC6H
+        // errors are relative, since its endpoints are quantized
+        // logarithmically.
+        Float maxTolerance = format == BCFormat::BC1    ? 0.04f
+                             : format == BCFormat::BC6H ? 0.08f
+                                                        : 0.01f;
+        EXPECT_LT(maxError, maxTolerance) << ToString(format);
+        EXPECT_LT(avgError, maxTolerance / 2) << ToString(format);
+    }
+}
+
+TEST(BCImage, TextureFormat) {
+    EXPECT_EQ(BCFormat::BC4, *BCImage::TextureFormat(PixelFormat::U256, 1));
+    EXPECT_EQ(BCFormat::BC1, *BCImage::TextureFormat(PixelFormat::U256, 3));
+    EXPECT_EQ(BCFormat::BC6H, *BCImage::TextureFormat(PixelFormat::Half, 3));
+    EXPECT_EQ(BCFormat::BC6H, *BCImage::TextureFormat(PixelFormat::Float, 3));
+    EXPECT_FALSE(BCImage::TextureFormat(PixelFormat::U256, 4));
+    EXPECT_FALSE(BCImage::TextureFormat(PixelFormat::Float, 1));
+
+    for (BCFormat format : {BCFormat::BC1, BCFormat::BC4, BCFormat::BC5, BCFormat::BC6H})
+        EXPECT_EQ(format, *ParseBCFormat(ToString(format)));
+    EXPECT_FALSE(ParseBCFormat("bc7"));
+}
+
+TEST(BCImage, MIPMapFilter) {
+    // Filtering a compressed MIPMap should give nearly the same results as
+    // filtering the uncompressed one.
+    for (PixelFormat format : {PixelFormat::U256, PixelFormat::Half})
+        for (int nChannels : {1, 3}) {
+            if (format == PixelFormat::Half && nChannels == 1)
+                continue;
+            Image image = GradientImage(format, {128, 64}, nChannels);
+            for (FilterFunction filter : {FilterFunction::Bilinear, FilterFunction::EWA})
+                for (WrapMode wrapMode : {WrapMode::Repeat, WrapMode::Clamp}) {
+                    MIPMapFilterOptions options;
+                    options.filter = filter;
+                    const RGBColorSpace *colorSpace = RGBColorSpace::sRGB;
+                    MIPMap mipmap(image, colorSpace, wrapMode, {}, options);
+                    MIPMap compressed(image, colorSpace, wrapMode, {}, options);
+                    ASSERT_TRUE(compressed.Compress());
+                    EXPECT_FALSE(compressed.Compress());
+                    ASSERT_EQ(mipmap.Levels(), compressed.Levels());
+                    for (int level = 0; level < mipmap.Levels(); ++level)
+                        EXPECT_EQ(mipmap.LevelResolution(level),
+                                  compressed.LevelResolution(level));
+
+                    RNG rng;
+                    for (int i = 0; i < 1000; ++i) {
+                        Point2f st(rng.Uniform<Float>(), rng.Uniform<Float>());
+                        // Keep to the finer levels; the gradient's slope in
+                        // texels doubles at each coarser level, which makes
+                        // BC1 increasingly inaccurate.
+                        Float scale = std::pow(2.f, -5.f - 3.f * rng.Uniform<Float>());
+                        Vector2f dst0(scale * rng.Uniform<Float>(), 0);
+                        Vector2f dst1(0, scale * rng.Uniform<Float>());
+                        RGB a = mipmap.Filter<RGB>(st, dst0, dst1);
+                        RGB b = compressed.Filter<RGB>(st, dst0, dst1);
+                        for (int c = 0; c < 3; ++c)
+                            EXPECT_LE(std::abs(a[c] - b[c]),
+                                      format == PixelFormat::U256 ? 0.04f : 0.08f * a[c])
+                                << a << " vs " << b;
+                    }
+                }
+        }
+}
@@ -10,6 +10,7 @@
 #include <pbrt/util/check.h>
 #include <pbrt/util/math.h>
 #include <pbrt/util/pstd.h>
+#include <pbrt/util/simd.h>
 #include <pbrt/util/taggedptr.h>
 #include <pbrt/util/vecmath.h>
 
@@ -344,6 +345,17 @@ class RGBSigmoidPolynomial {
             return v > 0 ? 1 : 0;
         return s(v);
     }
+    // Evaluates the function at _N_ wavelengths at once.
+    template <int N>
+    SIMDFloat<N> operator()(SIMDFloat<N> lambda) const {
+        using SIMD = SIMDFloat<N>;
+        SIMD v = FMA(lambda, FMA(lambda, SIMD(c0), SIMD(c1)), SIMD(c2));
+        // Clamp _v_ to a range where _s()_ can be evaluated without
+        // overflow; it gives exactly 0 and 1 at the ends of it, as the
+        // scalar version does for infinite values.
+        v = Min(SIMD(1e18f), Max(SIMD(-1e18f), v));
+        return SIMD(.5f) + v / (SIMD(2) * Sqrt(SIMD(1) + v * v));
+    }
 
     PBRT_CPU_GPU
     Float MaxValue() const {
@@ -465,6 +477,8 @@ class GammaColorEncoding {
 
     std::string ToString() const;
 
+    Float Gamma() const { return gamma; }
+
   private:
     Float gamma;
     pstd::array<Float, 256> applyLUT;
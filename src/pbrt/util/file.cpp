@@ -6,6 +6,7 @@
 
 #include <pbrt/util/check.h>
 #include <pbrt/util/error.h>
+#include <pbrt/util/hash.h>
 #include <pbrt/util/parallel.h>
 #include <pbrt/util/string.h>
 
@@ -14,16 +15,27 @@
 #include <filesystem/path.h>
 #include <algorithm>
 #include <cctype>
+#include <chrono>
 #include <climits>
 #include <cstdio>
 #include <cstdlib>
 #include <cstring>
 #include <fstream>
+#include <new>
+#include <thread>
 #ifndef PBRT_IS_WINDOWS
 #include <dirent.h>
 #include <sys/dir.h>
 #include <sys/types.h>
 #endif
+#ifdef PBRT_HAVE_MMAP
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#elif defined(PBRT_IS_WINDOWS)
+#include <windows.h>  // Windows file mapping API
+#endif
 
 namespace pbrt {
 
@@ -277,4 +289,74 @@ bool WriteFileContents(std::string filename, const std::string &contents) {
     return true;
 }
 
+bool WriteFileContentsAtomic(std::string filename, const std::string &contents) {
+    // Write to a uniquely-named temporary file and then rename it, so that
+    // concurrent readers never see a partially-written file.
+    uint64_t unique = Hash(std::this_thread::get_id(),
+                           std::chrono::steady_clock::now().time_since_epoch().count());
+    std::string tempFilename =
+        StringPrintf("%s.%016llx.tmp", filename, (unsigned long long)unique);
+    if (!WriteFileContents(tempFilename, contents))
+        return false;
+    if (std::rename(tempFilename.c_str(), filename.c_str()) != 0) {
+        RemoveFile(tempFilename);
+        return false;
+    }
+    return true;
+}
+
+std::unique_ptr<MappedFile> MappedFile::Open(std::string filename) {
+#ifdef PBRT_HAVE_MMAP
+    int fd = open(filename.c_str(), O_RDONLY);
+    if (fd == -1)
+        return nullptr;
+    struct stat stat;
+    if (fstat(fd, &stat) != 0 || stat.st_size == 0) {
+        close(fd);
+        return nullptr;
+    }
+    size_t len = stat.st_size;
+    void *ptr = mmap(nullptr, len, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (ptr == MAP_FAILED)
+        return nullptr;
+    return std::unique_ptr<MappedFile>(new MappedFile((uint8_t *)ptr, len, true));
+#elif defined(PBRT_IS_WINDOWS)
+    HANDLE fileHandle =
+        CreateFileW(WStringFromUTF8(filename).c_str(), GENERIC_READ, FILE_SHARE_READ, 0,
+                    OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, 0);
+    if (fileHandle == INVALID_HANDLE_VALUE)
+        return nullptr;
+    size_t len = GetFileSize(fileHandle, 0);
+    HANDLE mapping = CreateFileMapping(fileHandle, 0, PAGE_WRITECOPY, 0, 0, 0);
+    CloseHandle(fileHandle);
+    if (mapping == 0)
+        return nullptr;
+    LPVOID ptr = MapViewOfFile(mapping, FILE_MAP_COPY, 0, 0, 0);
+    CloseHandle(mapping);
+    if (!ptr)
+        return nullptr;
+    return std::unique_ptr<MappedFile>(new MappedFile((uint8_t *)ptr, len, true));
+#else
+    if (!FileExists(filename))
+        return nullptr;
+    std::string contents = ReadFileContents(filename);
+    uint8_t *ptr = new (std::align_val_t(64)) uint8_t[contents.size()];
+    std::memcpy(ptr, contents.data(), contents.size());
+    return std::unique_ptr<MappedFile>(new MappedFile(ptr, contents.size(), false));
+#endif
+}
+
+MappedFile::~MappedFile() {
+    if (!mapped)
+        ::operator delete[](ptr, std::align_val_t(64));
+    else {
+#ifdef PBRT_HAVE_MMAP
+        munmap(ptr, length);
+#elif defined(PBRT_IS_WINDOWS)
+        UnmapViewOfFile(ptr);
+#endif
+    }
+}
+
 }  // namespace pbrt
@@ -9,6 +9,7 @@
 
 #include <pbrt/util/pstd.h>
 
+#include <memory>
 #include <string>
 #include <vector>
 
@@ -18,6 +19,7 @@ namespace pbrt {
 std::string ReadFileContents(std::string filename);
 std::string ReadDecompressedFileContents(std::string filename);
 bool WriteFileContents(std::string filename, const std::string &contents);
+bool WriteFileContentsAtomic(std::string filename, const std::string &contents);
 
 std::vector<Float> ReadFloatFile(std::string filename);
 
@@ -35,6 +37,33 @@ std::vector<std::string> MatchingFilenames(std::string filename);
 FILE *FOpenRead(std::string filename);
 FILE *FOpenWrite(std::string filename);
 
+// MappedFile Definition
+// Provides the contents of a file via a private, copy-on-write memory
+// mapping where available, so that data can be read lazily and modified
+// in memory without changing the file. Elsewhere, the file is read into a
+// 64-byte aligned buffer.
+class MappedFile {
+  public:
+    // MappedFile Public Methods
+    static std::unique_ptr<MappedFile> Open(std::string filename);
+    ~MappedFile();
+
+    MappedFile(const MappedFile &) = delete;
+    MappedFile &operator=(const MappedFile &) = delete;
+
+    uint8_t *data() const { return ptr; }
+    size_t size() const { return length; }
+
+  private:
+    MappedFile(uint8_t *ptr, size_t length, bool mapped)
+        : ptr(ptr), length(length), mapped(mapped) {}
+
+    // MappedFile Private Members
+    uint8_t *ptr;
+    size_t length;
+    bool mapped;
+};
+
 }  // namespace pbrt
 
 #endif  // PBRT_UTIL_FILE_H
@@ -79,3 +79,20 @@ l5l
 
     remove(fn.c_str());
 }
+
+TEST(File, MappedFile) {
+    std::string fn = inTestDir("mapped.bin");
+    std::string str = "mapped file contents";
+    EXPECT_TRUE(WriteFileContentsAtomic(fn, str));
+    EXPECT_TRUE(MappedFile::Open(inTestDir("no-such-file.bin")) == nullptr);
+
+    std::unique_ptr<MappedFile> file = MappedFile::Open(fn);
+    ASSERT_TRUE(file != nullptr);
+    EXPECT_EQ(str, std::string((const char *)file->data(), file->size()));
+
+    // Changes to the mapped contents are not written back to the file.
+    file->data()[0] = 'M';
+    file.reset();
+    EXPECT_EQ(str, ReadFileContents(fn));
+    EXPECT_EQ(0, remove(fn.c_str()));
+}
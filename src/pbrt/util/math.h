@@ -143,6 +143,29 @@ inline void DecodeMorton2(uint64_t v, uint32_t *x, uint32_t *y) {
     *y = Compact1By1(v >> 1);
 }
 
+// Returns the point at distance _d_ along the Hilbert curve that covers a
+// grid of _resolution_ by _resolution_ cells, where _resolution_ is a power
+// of two. Consecutive points along the curve are always adjacent.
+PBRT_CPU_GPU
+inline void DecodeHilbert2(uint64_t d, uint32_t resolution, uint32_t *x, uint32_t *y) {
+    DCHECK_EQ(resolution & (resolution - 1), 0);
+    *x = *y = 0;
+    for (uint32_t s = 1; s < resolution; s *= 2) {
+        // Find the quadrant of the current level and orient the curve in it
+        uint32_t rx = 1 & (d / 2), ry = 1 & (d ^ rx);
+        if (ry == 0) {
+            if (rx == 1) {
+                *x = s - 1 - *x;
+                *y = s - 1 - *y;
+            }
+            pstd::swap(*x, *y);
+        }
+        *x += s * rx;
+        *y += s * ry;
+        d /= 4;
+    }
+}
+
 PBRT_CPU_GPU
 inline uint32_t Compact1By2(uint32_t x) {
     x &= 0x09249249;                   // x = ---- 9--8 --7- -6-- 5--4 --3- -2-- 1--0
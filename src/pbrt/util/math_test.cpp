@@ -91,6 +91,26 @@ TEST(Morton2, Basics) {
     }
 }
 
+TEST(Hilbert2, Basics) {
+    for (uint32_t res : {1, 2, 4, 16, 64}) {
+        std::vector<bool> visited(res * res, false);
+        uint32_t xPrev = 0, yPrev = 0;
+        for (uint64_t d = 0; d < res * res; ++d) {
+            uint32_t x, y;
+            DecodeHilbert2(d, res, &x, &y);
+            ASSERT_LT(x, res);
+            ASSERT_LT(y, res);
+            // Every cell is visited once and each step moves to a neighbor
+            EXPECT_FALSE(visited[y * res + x]);
+            visited[y * res + x] = true;
+            if (d > 0)
+                EXPECT_EQ(1, std::abs(int(x) - int(xPrev)) + std::abs(int(y) - int(yPrev)));
+            xPrev = x;
+            yPrev = y;
+        }
+    }
+}
+
 TEST(Math, Pow) {
     EXPECT_EQ(Pow<0>(2.f), 1 << 0);
     EXPECT_EQ(Pow<1>(2.f), 1 << 1);
@@ -4,9 +4,12 @@
 
 #include <pbrt/util/mesh.h>
 
+#include <pbrt/options.h>
 #include <pbrt/util/buffercache.h>
 #include <pbrt/util/check.h>
 #include <pbrt/util/error.h>
+#include <pbrt/util/file.h>
+#include <pbrt/util/hash.h>
 #include <pbrt/util/log.h>
 #include <pbrt/util/print.h>
 #include <pbrt/util/stats.h>
@@ -18,13 +21,14 @@ namespace pbrt {
 
 STAT_RATIO("Geometry/Triangles per mesh", nTris, nTriMeshes);
 STAT_MEMORY_COUNTER("Memory/Triangles", triangleBytes);
+STAT_COUNTER("Geometry/PLY meshes read from cache", plyCacheHits);
 
 // TriangleMesh Method Definitions
 TriangleMesh::TriangleMesh(const Transform &renderFromObject, bool reverseOrientation,
-                           std::vector<int> indices, std::vector<Point3f> p,
+                           pstd::span<const int> indices, std::vector<Point3f> p,
                            std::vector<Vector3f> s, std::vector<Normal3f> n,
-                           std::vector<Point2f> uv, std::vector<int> faceIndices,
-                           Allocator alloc)
+                           pstd::span<const Point2f> uv,
+                           pstd::span<const int> faceIndices, Allocator alloc)
     : nTriangles(indices.size() / 3), nVertices(p.size()) {
     CHECK_EQ((indices.size() % 3), 0);
     ++nTriMeshes;
@@ -182,9 +186,11 @@ STAT_RATIO("Geometry/Bilinear patches per mesh", nBlps, nBilinearMeshes);
 STAT_MEMORY_COUNTER("Memory/Bilinear patches", blpBytes);
 
 BilinearPatchMesh::BilinearPatchMesh(const Transform &renderFromObject,
-                                     bool reverseOrientation, std::vector<int> indices,
+                                     bool reverseOrientation,
+                                     pstd::span<const int> indices,
                                      std::vector<Point3f> P, std::vector<Normal3f> N,
-                                     std::vector<Point2f> UV, std::vector<int> fIndices,
+                                     pstd::span<const Point2f> UV,
+                                     pstd::span<const int> fIndices,
                                      PiecewiseConstant2D *imageDist, Allocator alloc)
     : reverseOrientation(reverseOrientation),
       transformSwapsHandedness(renderFromObject.SwapsHandedness()),
@@ -321,7 +327,7 @@ int rply_faceindex_callback(p_ply_argument argument) {
     return 1;
 }
 
-TriQuadMesh TriQuadMesh::ReadPLY(const std::string &filename) {
+TriQuadMesh TriQuadMesh::ReadPLYFile(const std::string &filename) {
     TriQuadMesh mesh;
 
     p_ply ply = ply_open(filename.c_str(), rply_message_callback, 0, nullptr);
@@ -349,47 +355,40 @@ TriQuadMesh TriQuadMesh::ReadPLY(const std::string &filename) {
     if (vertexCount == 0 || faceCount == 0)
         ErrorExit("%s: PLY file is invalid! No face/vertex elements found!", filename);
 
-    mesh.p.resize(vertexCount);
-    if (ply_set_read_cb(ply, "vertex", "x", rply_vertex_callback, mesh.p.data(), 0x30) ==
-            0 ||
-        ply_set_read_cb(ply, "vertex", "y", rply_vertex_callback, mesh.p.data(), 0x31) ==
-            0 ||
-        ply_set_read_cb(ply, "vertex", "z", rply_vertex_callback, mesh.p.data(), 0x32) ==
-            0) {
+    mesh.pStorage.resize(vertexCount);
+    Point3f *p = mesh.pStorage.data();
+    if (ply_set_read_cb(ply, "vertex", "x", rply_vertex_callback, p, 0x30) == 0 ||
+        ply_set_read_cb(ply, "vertex", "y", rply_vertex_callback, p, 0x31) == 0 ||
+        ply_set_read_cb(ply, "vertex", "z", rply_vertex_callback, p, 0x32) == 0) {
         ErrorExit("%s: Vertex coordinate property not found!", filename);
     }
 
-    mesh.n.resize(vertexCount);
-    if (ply_set_read_cb(ply, "vertex", "nx", rply_vertex_callback, mesh.n.data(), 0x30) ==
-            0 ||
-        ply_set_read_cb(ply, "vertex", "ny", rply_vertex_callback, mesh.n.data(), 0x31) ==
-            0 ||
-        ply_set_read_cb(ply, "vertex", "nz", rply_vertex_callback, mesh.n.data(), 0x32) ==
-            0)
-        mesh.n.resize(0);
+    mesh.nStorage.resize(vertexCount);
+    Normal3f *n = mesh.nStorage.data();
+    if (ply_set_read_cb(ply, "vertex", "nx", rply_vertex_callback, n, 0x30) == 0 ||
+        ply_set_read_cb(ply, "vertex", "ny", rply_vertex_callback, n, 0x31) == 0 ||
+        ply_set_read_cb(ply, "vertex", "nz", rply_vertex_callback, n, 0x32) == 0)
+        mesh.nStorage.resize(0);
 
     /* There seem to be lots of different conventions regarding UV coordinate
      * names */
-    mesh.uv.resize(vertexCount);
-    if (((ply_set_read_cb(ply, "vertex", "u", rply_vertex_callback, mesh.uv.data(),
-                          0x20) != 0) &&
-         (ply_set_read_cb(ply, "vertex", "v", rply_vertex_callback, mesh.uv.data(),
-                          0x21) != 0)) ||
-        ((ply_set_read_cb(ply, "vertex", "s", rply_vertex_callback, mesh.uv.data(),
-                          0x20) != 0) &&
-         (ply_set_read_cb(ply, "vertex", "t", rply_vertex_callback, mesh.uv.data(),
-                          0x21) != 0)) ||
-        ((ply_set_read_cb(ply, "vertex", "texture_u", rply_vertex_callback,
-                          mesh.uv.data(), 0x20) != 0) &&
-         (ply_set_read_cb(ply, "vertex", "texture_v", rply_vertex_callback,
-                          mesh.uv.data(), 0x21) != 0)) ||
-        ((ply_set_read_cb(ply, "vertex", "texture_s", rply_vertex_callback,
-                          mesh.uv.data(), 0x20) != 0) &&
-         (ply_set_read_cb(ply, "vertex", "texture_t", rply_vertex_callback,
-                          mesh.uv.data(), 0x21) != 0)))
+    mesh.uvStorage.resize(vertexCount);
+    Point2f *uv = mesh.uvStorage.data();
+    if (((ply_set_read_cb(ply, "vertex", "u", rply_vertex_callback, uv, 0x20) != 0) &&
+         (ply_set_read_cb(ply, "vertex", "v", rply_vertex_callback, uv, 0x21) != 0)) ||
+        ((ply_set_read_cb(ply, "vertex", "s", rply_vertex_callback, uv, 0x20) != 0) &&
+         (ply_set_read_cb(ply, "vertex", "t", rply_vertex_callback, uv, 0x21) != 0)) ||
+        ((ply_set_read_cb(ply, "vertex", "texture_u", rply_vertex_callback, uv, 0x20) !=
+          0) &&
+         (ply_set_read_cb(ply, "vertex", "texture_v", rply_vertex_callback, uv, 0x21) !=
+          0)) ||
+        ((ply_set_read_cb(ply, "vertex", "texture_s", rply_vertex_callback, uv, 0x20) !=
+          0) &&
+         (ply_set_read_cb(ply, "vertex", "texture_t", rply_vertex_callback, uv, 0x21) !=
+          0)))
         ;
     else
-        mesh.uv.resize(0);
+        mesh.uvStorage.resize(0);
 
     FaceCallbackContext context;
     context.triIndices.reserve(faceCount * 3);
@@ -399,16 +398,17 @@ TriQuadMesh TriQuadMesh::ReadPLY(const std::string &filename) {
         ErrorExit("%s: vertex indices not found in PLY file", filename);
 
     if (ply_set_read_cb(ply, "face", "face_indices", rply_faceindex_callback,
-                        &mesh.faceIndices, 0) != 0)
-        mesh.faceIndices.reserve(faceCount);
+                        &mesh.faceIndicesStorage, 0) != 0)
+        mesh.faceIndicesStorage.reserve(faceCount);
 
     if (ply_read(ply) == 0)
         ErrorExit("%s: unable to read the contents of PLY file", filename);
 
-    mesh.triIndices = std::move(context.triIndices);
-    mesh.quadIndices = std::move(context.quadIndices);
+    mesh.triIndicesStorage = std::move(context.triIndices);
+    mesh.quadIndicesStorage = std::move(context.quadIndices);
 
     ply_close(ply);
+    mesh.UpdateViews();
 
     for (int idx : mesh.triIndices)
         if (idx < 0 || idx >= mesh.p.size())
@@ -424,48 +424,194 @@ TriQuadMesh TriQuadMesh::ReadPLY(const std::string &filename) {
     return mesh;
 }
 
+// PLY Mesh Cache Definitions
+// Cached meshes store a header followed by each of the mesh's arrays, each
+// padded to a multiple of 16 bytes.
+struct PLYCacheHeader {
+    static constexpr uint64_t Magic = 0x3168736d74726270;  // "pbrtmsh1"
+    uint64_t magic = Magic;
+    uint64_t key;
+    uint32_t floatSize = sizeof(Float);
+    uint32_t pad = 0;
+    uint64_t counts[6];
+};
+
+static size_t CacheArraySize(uint64_t count, size_t elementSize) {
+    size_t size = count * elementSize;
+    return size + (16 - size % 16) % 16;
+}
+
+template <typename T>
+static void AppendCacheArray(std::string *buf, pstd::span<const T> v) {
+    size_t size = v.size() * sizeof(T);
+    buf->append((const char *)v.data(), size);
+    buf->append(CacheArraySize(v.size(), sizeof(T)) - size, '\0');
+}
+
+template <typename T>
+static const uint8_t *ReadCacheArray(const uint8_t *ptr, uint64_t count,
+                                     pstd::span<const T> *v) {
+    // The header and the padding of each array keep the arrays suitably
+    // aligned, so they can be used directly from the mapped file.
+    *v = pstd::span<const T>((const T *)ptr, count);
+    return ptr + CacheArraySize(count, sizeof(T));
+}
+
+TriQuadMesh TriQuadMesh::ReadPLY(const std::string &filename) {
+    if (!Options || Options->cacheDirectory.empty())
+        return ReadPLYFile(filename);
+
+    // Look for a cached copy of the mesh keyed by the PLY file's contents
+    std::unique_ptr<MappedFile> plyFile = MappedFile::Open(filename);
+    if (!plyFile)
+        return ReadPLYFile(filename);
+    uint64_t key = HashBuffer(plyFile->data(), plyFile->size());
+    plyFile.reset();
+    std::string cacheFilename = StringPrintf("%s/mesh-%016llx.bin", Options->cacheDirectory,
+                                             (unsigned long long)key);
+    if (std::unique_ptr<MappedFile> cache = MappedFile::Open(cacheFilename);
+        cache && cache->size() >= sizeof(PLYCacheHeader)) {
+        PLYCacheHeader header;
+        std::memcpy(&header, cache->data(), sizeof(header));
+        size_t expectedSize = sizeof(header) +
+                              CacheArraySize(header.counts[0], sizeof(Point3f)) +
+                              CacheArraySize(header.counts[1], sizeof(Normal3f)) +
+                              CacheArraySize(header.counts[2], sizeof(Point2f));
+        for (int i = 3; i < 6; ++i)
+            expectedSize += CacheArraySize(header.counts[i], sizeof(int));
+        if (header.magic == PLYCacheHeader::Magic && header.key == key &&
+            header.floatSize == sizeof(Float) && expectedSize == cache->size()) {
+            // Use the mesh's arrays in place; the mesh holds on to the
+            // mapping for as long as it is alive.
+            TriQuadMesh mesh;
+            const uint8_t *ptr = cache->data() + sizeof(header);
+            ptr = ReadCacheArray(ptr, header.counts[0], &mesh.p);
+            ptr = ReadCacheArray(ptr, header.counts[1], &mesh.n);
+            ptr = ReadCacheArray(ptr, header.counts[2], &mesh.uv);
+            ptr = ReadCacheArray(ptr, header.counts[3], &mesh.faceIndices);
+            ptr = ReadCacheArray(ptr, header.counts[4], &mesh.triIndices);
+            ReadCacheArray(ptr, header.counts[5], &mesh.quadIndices);
+            mesh.cacheFile = std::move(cache);
+            ++plyCacheHits;
+            return mesh;
+        }
+        Warning("%s: ignoring invalid mesh cache file", cacheFilename);
+    }
+
+    // Read the PLY file and write the mesh to the cache
+    TriQuadMesh mesh = ReadPLYFile(filename);
+    PLYCacheHeader header;
+    header.key = key;
+    uint64_t counts[6] = {mesh.p.size(),           mesh.n.size(),
+                          mesh.uv.size(),          mesh.faceIndices.size(),
+                          mesh.triIndices.size(),  mesh.quadIndices.size()};
+    std::copy(counts, counts + 6, header.counts);
+    std::string buf((const char *)&header, sizeof(header));
+    AppendCacheArray(&buf, mesh.p);
+    AppendCacheArray(&buf, mesh.n);
+    AppendCacheArray(&buf, mesh.uv);
+    AppendCacheArray(&buf, mesh.faceIndices);
+    AppendCacheArray(&buf, mesh.triIndices);
+    AppendCacheArray(&buf, mesh.quadIndices);
+    if (!WriteFileContentsAtomic(cacheFilename, buf))
+        Warning("%s: unable to write mesh cache file", cacheFilename);
+    return mesh;
+}
+
+TriQuadMesh &TriQuadMesh::operator=(const TriQuadMesh &mesh) {
+    cacheFile = mesh.cacheFile;
+    pStorage = mesh.pStorage;
+    nStorage = mesh.nStorage;
+    uvStorage = mesh.uvStorage;
+    faceIndicesStorage = mesh.faceIndicesStorage;
+    triIndicesStorage = mesh.triIndicesStorage;
+    quadIndicesStorage = mesh.quadIndicesStorage;
+    // Meshes that refer to a mapped cache file share it; otherwise, the
+    // views must refer to the copied arrays.
+    if (cacheFile) {
+        p = mesh.p;
+        n = mesh.n;
+        uv = mesh.uv;
+        faceIndices = mesh.faceIndices;
+        triIndices = mesh.triIndices;
+        quadIndices = mesh.quadIndices;
+    } else
+        UpdateViews();
+    return *this;
+}
+
+void TriQuadMesh::MakeMutable() {
+    if (!cacheFile)
+        return;
+    // The mapped cache file can't be modified, so copy its arrays before the
+    // mesh is changed.
+    pStorage.assign(p.begin(), p.end());
+    nStorage.assign(n.begin(), n.end());
+    uvStorage.assign(uv.begin(), uv.end());
+    faceIndicesStorage.assign(faceIndices.begin(), faceIndices.end());
+    triIndicesStorage.assign(triIndices.begin(), triIndices.end());
+    quadIndicesStorage.assign(quadIndices.begin(), quadIndices.end());
+    cacheFile.reset();
+    UpdateViews();
+}
+
+void TriQuadMesh::UpdateViews() {
+    p = pStorage;
+    n = nStorage;
+    uv = uvStorage;
+    faceIndices = faceIndicesStorage;
+    triIndices = triIndicesStorage;
+    quadIndices = quadIndicesStorage;
+}
+
 void TriQuadMesh::ConvertToOnlyTriangles() {
     if (quadIndices.empty())
         return;
 
-    triIndices.reserve(triIndices.size() + 3 * quadIndices.size() / 2);
+    MakeMutable();
+    triIndicesStorage.reserve(triIndicesStorage.size() +
+                              3 * quadIndicesStorage.size() / 2);
 
-    for (size_t i = 0; i < quadIndices.size(); i += 4) {
-        triIndices.push_back(quadIndices[i]);  // 0, 1, 2 of original
-        triIndices.push_back(quadIndices[i + 1]);
-        triIndices.push_back(quadIndices[i + 3]);
+    for (size_t i = 0; i < quadIndicesStorage.size(); i += 4) {
+        triIndicesStorage.push_back(quadIndicesStorage[i]);  // 0, 1, 2 of original
+        triIndicesStorage.push_back(quadIndicesStorage[i + 1]);
+        triIndicesStorage.push_back(quadIndicesStorage[i + 3]);
 
-        triIndices.push_back(quadIndices[i]);  // 0, 2, 3 of original
-        triIndices.push_back(quadIndices[i + 3]);
-        triIndices.push_back(quadIndices[i + 2]);
+        triIndicesStorage.push_back(quadIndicesStorage[i]);  // 0, 2, 3 of original
+        triIndicesStorage.push_back(quadIndicesStorage[i + 3]);
+        triIndicesStorage.push_back(quadIndicesStorage[i + 2]);
     }
 
-    quadIndices.clear();
+    quadIndicesStorage.clear();
+    UpdateViews();
 }
 
 void TriQuadMesh::ComputeNormals() {
-    n.resize(p.size());
-    for (size_t i = 0; i < n.size(); ++i)
-        n[i] = Normal3f(0, 0, 0);
+    MakeMutable();
+    nStorage.resize(pStorage.size());
+    for (size_t i = 0; i < nStorage.size(); ++i)
+        nStorage[i] = Normal3f(0, 0, 0);
 
-    for (size_t i = 0; i < triIndices.size(); i += 3) {
-        int v[3] = {triIndices[i], triIndices[i + 1], triIndices[i + 2]};
-        Vector3f v10 = p[v[1]] - p[v[0]];
-        Vector3f v21 = p[v[2]] - p[v[1]];
+    for (size_t i = 0; i < triIndicesStorage.size(); i += 3) {
+        int v[3] = {triIndicesStorage[i], triIndicesStorage[i + 1],
+                    triIndicesStorage[i + 2]};
+        Vector3f v10 = pStorage[v[1]] - pStorage[v[0]];
+        Vector3f v21 = pStorage[v[2]] - pStorage[v[1]];
 
         Normal3f vn(Cross(v10, v21));
         if (LengthSquared(vn) > 0) {
             vn = Normalize(vn);
-            n[v[0]] += vn;
-            n[v[1]] += vn;
-            n[v[2]] += vn;
+            nStorage[v[0]] += vn;
+            nStorage[v[1]] += vn;
+            nStorage[v[2]] += vn;
         }
     }
-    CHECK_EQ(0, quadIndices.size());  // TODO: handle this...
+    CHECK_EQ(0, quadIndicesStorage.size());  // TODO: handle this...
 
-    for (size_t i = 0; i < n.size(); ++i)
-        if (LengthSquared(n[i]) > 0)
-            n[i] = Normalize(n[i]);
+    for (size_t i = 0; i < nStorage.size(); ++i)
+        if (LengthSquared(nStorage[i]) > 0)
+            nStorage[i] = Normalize(nStorage[i]);
+    UpdateViews();
 }
 
 std::string TriQuadMesh::ToString() const {
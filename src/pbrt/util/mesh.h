@@ -15,19 +15,23 @@
 #include <pbrt/util/vecmath.h>
 
 #include <array>
+#include <memory>
 #include <string>
 #include <vector>
 
 namespace pbrt {
 
+class MappedFile;
+
 // TriangleMesh Definition
 class TriangleMesh {
   public:
     // TriangleMesh Public Methods
     TriangleMesh(const Transform &renderFromObject, bool reverseOrientation,
-                 std::vector<int> vertexIndices, std::vector<Point3f> p,
+                 pstd::span<const int> vertexIndices, std::vector<Point3f> p,
                  std::vector<Vector3f> S, std::vector<Normal3f> N,
-                 std::vector<Point2f> uv, std::vector<int> faceIndices, Allocator alloc);
+                 pstd::span<const Point2f> uv, pstd::span<const int> faceIndices,
+                 Allocator alloc);
 
     std::string ToString() const;
 
@@ -51,9 +55,9 @@ class BilinearPatchMesh {
   public:
     // BilinearPatchMesh Public Methods
     BilinearPatchMesh(const Transform &renderFromObject, bool reverseOrientation,
-                      std::vector<int> vertexIndices, std::vector<Point3f> p,
-                      std::vector<Normal3f> N, std::vector<Point2f> uv,
-                      std::vector<int> faceIndices, PiecewiseConstant2D *imageDist,
+                      pstd::span<const int> vertexIndices, std::vector<Point3f> p,
+                      std::vector<Normal3f> N, pstd::span<const Point2f> uv,
+                      pstd::span<const int> faceIndices, PiecewiseConstant2D *imageDist,
                       Allocator alloc);
 
     std::string ToString() const;
@@ -83,6 +87,12 @@ struct TriQuadMesh {
     // TriQuadMesh Public Methods
     static TriQuadMesh ReadPLY(const std::string &filename);
 
+    TriQuadMesh() = default;
+    TriQuadMesh(const TriQuadMesh &mesh) { *this = mesh; }
+    TriQuadMesh(TriQuadMesh &&) = default;
+    TriQuadMesh &operator=(const TriQuadMesh &mesh);
+    TriQuadMesh &operator=(TriQuadMesh &&) = default;
+
     void ConvertToOnlyTriangles();
     void ComputeNormals();
 
@@ -97,9 +107,10 @@ struct TriQuadMesh {
         // Prepare the output mesh
         TriQuadMesh outputMesh = *this;
         outputMesh.ConvertToOnlyTriangles();
-        if (outputMesh.n.empty())
+        outputMesh.MakeMutable();
+        if (outputMesh.nStorage.empty())
             outputMesh.ComputeNormals();
-        outputMesh.triIndices.clear();
+        outputMesh.triIndicesStorage.clear();
 
         // Refine
         HashMap<std::pair<int, int>, int, HashIntPair> edgeSplit({});
@@ -108,32 +119,40 @@ struct TriQuadMesh {
                               triIndices[3 * i + 2], edgeSplit);
 
         // Displace
-        displace(outputMesh.p.data(), outputMesh.n.data(), outputMesh.uv.data(),
-                 outputMesh.p.size());
+        displace(outputMesh.pStorage.data(), outputMesh.nStorage.data(),
+                 outputMesh.uvStorage.data(), outputMesh.pStorage.size());
 
         outputMesh.ComputeNormals();
 
         return outputMesh;
     }
 
-    std::vector<Point3f> p;
-    std::vector<Normal3f> n;
-    std::vector<Point2f> uv;
-    std::vector<int> faceIndices;
-    std::vector<int> triIndices, quadIndices;
+    // TriQuadMesh Public Members
+    // The mesh's arrays refer either to the vectors below or, for meshes read
+    // from the mesh cache, directly to the memory-mapped cache file.
+    pstd::span<const Point3f> p;
+    pstd::span<const Normal3f> n;
+    pstd::span<const Point2f> uv;
+    pstd::span<const int> faceIndices;
+    pstd::span<const int> triIndices, quadIndices;
 
   private:
     // TriQuadMesh Private Methods
+    static TriQuadMesh ReadPLYFile(const std::string &filename);
+
+    void MakeMutable();
+    void UpdateViews();
+
     template <typename Dist>
     void Refine(Dist &&distance, Float maxDist, int v0, int v1, int v2,
                 HashMap<std::pair<int, int>, int, HashIntPair> &edgeSplit) {
-        Point3f p0 = p[v0], p1 = p[v1], p2 = p[v2];
+        Point3f p0 = pStorage[v0], p1 = pStorage[v1], p2 = pStorage[v2];
         Float d01 = distance(p0, p1), d12 = distance(p1, p2), d20 = distance(p2, p0);
 
         if (d01 < maxDist && d12 < maxDist && d20 < maxDist) {
-            triIndices.push_back(v0);
-            triIndices.push_back(v1);
-            triIndices.push_back(v2);
+            triIndicesStorage.push_back(v0);
+            triIndicesStorage.push_back(v1);
+            triIndicesStorage.push_back(v2);
             return;
         }
 
@@ -160,22 +179,30 @@ struct TriQuadMesh {
         if (edgeSplit.HasKey(edge)) {
             vmid = edgeSplit[edge];
         } else {
-            vmid = p.size();
+            vmid = pStorage.size();
             edgeSplit.Insert(edge, vmid);
-            p.push_back((p[v[0]] + p[v[1]]) / 2);
-            if (!n.empty()) {
-                Normal3f nn = n[v[0]] + n[v[1]];
+            pStorage.push_back((pStorage[v[0]] + pStorage[v[1]]) / 2);
+            if (!nStorage.empty()) {
+                Normal3f nn = nStorage[v[0]] + nStorage[v[1]];
                 if (LengthSquared(nn) > 0)
                     nn = Normalize(nn);
-                n.push_back(nn);
+                nStorage.push_back(nn);
             }
-            if (!uv.empty())
-                uv.push_back((uv[v[0]] + uv[v[1]]) / 2);
+            if (!uvStorage.empty())
+                uvStorage.push_back((uvStorage[v[0]] + uvStorage[v[1]]) / 2);
         }
 
         Refine(distance, maxDist, v[0], vmid, v[2], edgeSplit);
         Refine(distance, maxDist, vmid, v[1], v[2], edgeSplit);
     }
+
+    // TriQuadMesh Private Members
+    std::shared_ptr<MappedFile> cacheFile;
+    std::vector<Point3f> pStorage;
+    std::vector<Normal3f> nStorage;
+    std::vector<Point2f> uvStorage;
+    std::vector<int> faceIndicesStorage;
+    std::vector<int> triIndicesStorage, quadIndicesStorage;
 };
 
 bool WritePLY(std::string filename, pstd::span<const int> triIndices,
@@ -0,0 +1,72 @@
+// pbrt is Copyright(c) 1998-2020 Matt Pharr, Wenzel Jakob, and Greg Humphreys.
+// The pbrt source code is licensed under the Apache License, Version 2.0.
+// SPDX: Apache-2.0
+
+#include <gtest/gtest.h>
+
+#include <pbrt/pbrt.h>
+#include <pbrt/options.h>
+#include <pbrt/util/file.h>
+#include <pbrt/util/hash.h>
+#include <pbrt/util/mesh.h>
+#include <pbrt/util/print.h>
+
+#include <vector>
+
+using namespace pbrt;
+
+template <typename T>
+static std::vector<T> ToVector(pstd::span<const T> s) {
+    return std::vector<T>(s.begin(), s.end());
+}
+
+static void ExpectSameMesh(const TriQuadMesh &a, const TriQuadMesh &b) {
+    EXPECT_EQ(ToVector(a.p), ToVector(b.p));
+    EXPECT_EQ(ToVector(a.n), ToVector(b.n));
+    EXPECT_EQ(ToVector(a.uv), ToVector(b.uv));
+    EXPECT_EQ(ToVector(a.faceIndices), ToVector(b.faceIndices));
+    EXPECT_EQ(ToVector(a.triIndices), ToVector(b.triIndices));
+    EXPECT_EQ(ToVector(a.quadIndices), ToVector(b.quadIndices));
+}
+
+TEST(TriQuadMesh, PLYCache) {
+    std::string filename = "mesh-cache-test.ply";
+    std::vector<int> triIndices = {0, 1, 2, 2, 1, 3};
+    std::vector<int> quadIndices = {1, 3, 4, 5};
+    std::vector<Point3f> p = {Point3f(0, 0, 0), Point3f(1, 0, 0), Point3f(0, 1, 0),
+                              Point3f(1, 1, 0), Point3f(2, 1, 0), Point3f(2, 0, 0)};
+    std::vector<Normal3f> n(p.size(), Normal3f(0, 0, 1));
+    std::vector<Point2f> uv;
+    for (Point3f pp : p)
+        uv.push_back(Point2f(pp.x / 2, pp.y));
+    ASSERT_TRUE(WritePLY(filename, triIndices, quadIndices, p, n, uv, {}));
+
+    std::string contents = ReadFileContents(filename);
+    std::string cacheFilename = StringPrintf(
+        "./mesh-%016llx.bin",
+        (unsigned long long)HashBuffer(contents.data(), contents.size()));
+    std::string savedCacheDirectory = Options->cacheDirectory;
+    Options->cacheDirectory = ".";
+
+    // The first read writes the mesh to the cache and the second one uses
+    // the cached arrays in place.
+    TriQuadMesh mesh = TriQuadMesh::ReadPLY(filename);
+    TriQuadMesh cached = TriQuadMesh::ReadPLY(filename);
+    Options->cacheDirectory = savedCacheDirectory;
+    EXPECT_FALSE(ReadFileContents(cacheFilename).empty());
+    EXPECT_EQ(6, mesh.triIndices.size());
+    EXPECT_EQ(4, mesh.quadIndices.size());
+    ExpectSameMesh(mesh, cached);
+
+    // Modifying a copy of a cached mesh leaves the original unchanged.
+    TriQuadMesh converted = cached;
+    converted.ConvertToOnlyTriangles();
+    EXPECT_EQ(12, converted.triIndices.size());
+    EXPECT_TRUE(converted.quadIndices.empty());
+    EXPECT_EQ(4, cached.quadIndices.size());
+    mesh.ConvertToOnlyTriangles();
+    ExpectSameMesh(mesh, converted);
+
+    EXPECT_TRUE(RemoveFile(filename));
+    EXPECT_TRUE(RemoveFile(cacheFilename));
+}
@@ -4,6 +4,7 @@
 
 #include <pbrt/util/mipmap.h>
 
+#include <pbrt/options.h>
 #include <pbrt/util/check.h>
 #include <pbrt/util/color.h>
 #include <pbrt/util/colorspace.h>
@@ -12,14 +13,17 @@
 #include <pbrt/util/log.h>
 #include <pbrt/util/math.h>
 #include <pbrt/util/print.h>
+#include <pbrt/util/simd.h>
 #include <pbrt/util/stats.h>
 
 #include <algorithm>
 #include <cmath>
+#include <type_traits>
 
 namespace pbrt {
 
 STAT_MEMORY_COUNTER("Memory/Image maps", imageMapBytes);
+STAT_COUNTER("Texture/Block-compressed image maps", nCompressedImageMaps);
 
 ///////////////////////////////////////////////////////////////////////////
 // MIPMap Helper Declarations
@@ -197,25 +201,377 @@ MIPMap::MIPMap(Image image, const RGBColorSpace *colorSpace, WrapMode wrapMode,
     pyramid = Image::GeneratePyramid(std::move(image), wrapMode, alloc);
     std::for_each(pyramid.begin(), pyramid.end(),
                   [](const Image &im) { imageMapBytes += im.BytesUsed(); });
+    InitU256ToLinear();
+}
+
+void MIPMap::InitU256ToLinear() {
+    if (Format() != PixelFormat::U256)
+        return;
+    // Decode all 8-bit values up front so that texel lookups don't need to
+    // go through the _ColorEncoding_
+    ColorEncoding encoding =
+        tiledPyramid ? tiledPyramid->Encoding() : pyramid[0].Encoding();
+    for (int i = 0; i < 256; ++i) {
+        uint8_t v = i;
+        Float r;
+        encoding.ToLinear({&v, 1}, {&r, 1});
+        u256ToLinear[i] = r;
+    }
+}
+
+const Image *MIPMap::TexelImage(int level, Point2i *st) const {
+    CHECK(level >= 0 && level < Levels());
+    if (!tiledPyramid) {
+        if (!RemapPixelCoords(st, pyramid[level].Resolution(), wrapMode))
+            return nullptr;
+        return &pyramid[level];
+    }
+    // Find the tile that holds the texel and the texel's offset in it
+    if (!RemapPixelCoords(st, tiledPyramid->LevelResolution(level), wrapMode))
+        return nullptr;
+    Point2i tile(st->x >> TextureTileLog2Size, st->y >> TextureTileLog2Size);
+    *st -= Vector2i(tile * TextureTileSize);
+    return tiledPyramid->GetTile(level, tile);
+}
+
+Float MIPMap::BilerpChannel(int level, Point2f st, int c) const {
+    if (!tiledPyramid)
+        return pyramid[level].BilerpChannel(st, c, wrapMode);
+    // Bilinearly interpolate texels from the tile cache as
+    // _Image::BilerpChannel()_ does
+    Point2i res = tiledPyramid->LevelResolution(level);
+    Float x = st[0] * res.x - 0.5f, y = st[1] * res.y - 0.5f;
+    int xi = pstd::floor(x), yi = pstd::floor(y);
+    Float dx = x - xi, dy = y - yi;
+    auto texel = [&](Point2i p) {
+        const Image *image = TexelImage(level, &p);
+        return image ? image->GetChannel(p, c) : Float(0);
+    };
+    pstd::array<Float, 4> v = {texel({xi, yi}), texel({xi + 1, yi}),
+                               texel({xi, yi + 1}), texel({xi + 1, yi + 1})};
+    return ((1 - dx) * (1 - dy) * v[0] + dx * (1 - dy) * v[1] + (1 - dx) * dy * v[2] +
+            dx * dy * v[3]);
+}
+
+MIPMap::MIPMap(std::unique_ptr<TiledImagePyramid> tiledPyramid,
+               const RGBColorSpace *colorSpace, WrapMode wrapMode,
+               const MIPMapFilterOptions &options)
+    : tiledPyramid(std::move(tiledPyramid)),
+      colorSpace(colorSpace),
+      wrapMode(wrapMode),
+      options(options) {
+    CHECK(colorSpace);
+    InitU256ToLinear();
+}
+
+// TexelStorage gives the type that texel channels of a _PixelFormat_ are
+// stored as.
+template <PixelFormat Format>
+struct TexelStorage;
+template <>
+struct TexelStorage<PixelFormat::U256> {
+    using type = uint8_t;
+};
+template <>
+struct TexelStorage<PixelFormat::Half> {
+    using type = Half;
+};
+template <>
+struct TexelStorage<PixelFormat::Float> {
+    using type = float;
+};
+
+// Remaps a texel coordinate along one dimension with _Wrap_, which must not
+// be _WrapMode::OctahedralSphere_, returning false if the texel is black.
+template <WrapMode Wrap>
+static bool RemapTexelCoord(int *s, int resolution) {
+    if (*s >= 0 && *s < resolution)
+        return true;
+    if constexpr (Wrap == WrapMode::Repeat)
+        *s = Mod(*s, resolution);
+    else if constexpr (Wrap == WrapMode::Clamp)
+        *s = Clamp(*s, 0, resolution - 1);
+    else
+        return false;
+    return true;
+}
+
+template <typename F>
+auto MIPMap::DispatchTexelAccess(F func) const {
+    // Call _func_ with _std::integral_constant_s for the texel format and wrap
+    // mode, so that it can use the texel accessors specialized for them
+    auto dispatchWrap = [&](auto format) {
+        switch (wrapMode) {
+        case WrapMode::Repeat:
+            return func(format, std::integral_constant<WrapMode, WrapMode::Repeat>());
+        case WrapMode::Clamp:
+            return func(format, std::integral_constant<WrapMode, WrapMode::Clamp>());
+        default:
+            CHECK(wrapMode == WrapMode::Black);
+            return func(format, std::integral_constant<WrapMode, WrapMode::Black>());
+        }
+    };
+    if (!bcPyramid.empty()) {
+        // Two-channel BC5 images are only written by imgtool;
+        // _BCImage::TextureFormat()_ never chooses it for textures.
+        switch (bcPyramid[0].Format()) {
+        case BCFormat::BC1:
+            return dispatchWrap(std::integral_constant<BCFormat, BCFormat::BC1>());
+        case BCFormat::BC4:
+            return dispatchWrap(std::integral_constant<BCFormat, BCFormat::BC4>());
+        default:
+            CHECK(bcPyramid[0].Format() == BCFormat::BC6H);
+            return dispatchWrap(std::integral_constant<BCFormat, BCFormat::BC6H>());
+        }
+    }
+    switch (Format()) {
+    case PixelFormat::U256:
+        return dispatchWrap(std::integral_constant<PixelFormat, PixelFormat::U256>());
+    case PixelFormat::Half:
+        return dispatchWrap(std::integral_constant<PixelFormat, PixelFormat::Half>());
+    default:
+        CHECK(Format() == PixelFormat::Float);
+        return dispatchWrap(std::integral_constant<PixelFormat, PixelFormat::Float>());
+    }
+}
+
+template <PixelFormat Format, WrapMode Wrap>
+void MIPMap::GetTexels(int level, Point2i p, int n, int firstChannel, int nChannels,
+                       float *values, int stride) const {
+    // Stores channels _firstChannel_ through _firstChannel+nChannels-1_ of
+    // the _n_ texels starting at _p_ along a row in _values_, one channel
+    // every _stride_ values.
+    using Texel = typename TexelStorage<Format>::type;
+    Point2i res = LevelResolution(level);
+    int nc = NChannels();
+    bool rowIsBlack = !RemapTexelCoord<Wrap>(&p.y, res.y);
+
+    // Texels are read from _row_, which holds those with $s$ coordinates
+    // between _rowStart_ and _rowEnd_
+    const Texel *row = nullptr;
+    int rowStart = 0, rowEnd = 0;
+    for (int i = 0; i < n; ++i) {
+        int s = p.x + i;
+        if (rowIsBlack || !RemapTexelCoord<Wrap>(&s, res.x)) {
+            for (int c = 0; c < nChannels; ++c)
+                values[c * stride + i] = 0;
+            continue;
+        }
+        if (s < rowStart || s >= rowEnd) {
+            // Find the row of the level or of its tile that holds the texel
+            if (!tiledPyramid) {
+                row = (const Texel *)pyramid[level].RawPointer({0, p.y});
+                rowStart = 0;
+                rowEnd = res.x;
+            } else {
+                Point2i tile(s >> TextureTileLog2Size, p.y >> TextureTileLog2Size);
+                const Image *image = tiledPyramid->GetTile(level, tile);
+                row = (const Texel *)image->RawPointer(
+                    {0, p.y - tile.y * TextureTileSize});
+                rowStart = tile.x * TextureTileSize;
+                rowEnd = rowStart + image->Resolution().x;
+            }
+        }
+
+        const Texel *texel = row + (s - rowStart) * nc + firstChannel;
+        for (int c = 0; c < nChannels; ++c) {
+            if constexpr (Format == PixelFormat::U256)
+                values[c * stride + i] = u256ToLinear[texel[c]];
+            else
+                values[c * stride + i] = float(texel[c]);
+        }
+    }
+}
+
+template <BCFormat Format, WrapMode Wrap>
+void MIPMap::GetTexels(int level, Point2i p, int n, int firstChannel, int nChannels,
+                       float *values, int stride) const {
+    // Stores texels as the version above does, decoding a row of four texels
+    // of a block at a time
+    const BCImage &image = bcPyramid[level];
+    Point2i res = image.Resolution();
+    constexpr int nc = BCChannels(Format);
+    bool rowIsBlack = !RemapTexelCoord<Wrap>(&p.y, res.y);
+
+    // _texels_ holds the decoded texels of the row of block _blockX_
+    std::conditional_t<Format == BCFormat::BC6H, Half, uint8_t> texels[4 * nc];
+    int blockX = -1;
+    for (int i = 0; i < n; ++i) {
+        int s = p.x + i;
+        if (rowIsBlack || !RemapTexelCoord<Wrap>(&s, res.x)) {
+            for (int c = 0; c < nChannels; ++c)
+                values[c * stride + i] = 0;
+            continue;
+        }
+        if (s / 4 != blockX) {
+            blockX = s / 4;
+            const uint8_t *block = image.Block({blockX, p.y / 4});
+            if constexpr (Format == BCFormat::BC1)
+                DecodeBC1Row(block, p.y % 4, texels);
+            else if constexpr (Format == BCFormat::BC4)
+                DecodeBC4Row(block, p.y % 4, texels, 1);
+            else
+                DecodeBC6HRow(block, p.y % 4, texels);
+        }
+
+        const auto *texel = &texels[(s % 4) * nc + firstChannel];
+        for (int c = 0; c < nChannels; ++c) {
+            if constexpr (Format == BCFormat::BC6H)
+                values[c * stride + i] = float(texel[c]);
+            else
+                values[c * stride + i] = u256ToLinear[texel[c]];
+        }
+    }
+}
+
+template <typename T, auto Format, WrapMode Wrap>
+T MIPMap::GetTexel(int level, Point2i st) const {
+    // Return the first channel for _Float_ lookups and the first three or
+    // the single channel for _RGB_ lookups
+    float values[3];
+    int nFiltered = (std::is_same_v<T, Float> || NChannels() == 1) ? 1 : 3;
+    GetTexels<Format, Wrap>(level, st, 1, 0, nFiltered, values, 1);
+    if constexpr (std::is_same_v<T, Float>)
+        return values[0];
+    else
+        return nFiltered == 3 ? RGB(values[0], values[1], values[2])
+                              : RGB(values[0], values[0], values[0]);
+}
+
+template <typename T, auto Format, WrapMode Wrap>
+T MIPMap::BilerpTexels(int level, Point2f st) const {
+    // Compute discrete texel coordinates and offsets for _st_
+    Point2i res = LevelResolution(level);
+    Float x = st[0] * res.x - 0.5f, y = st[1] * res.y - 0.5f;
+    int xi = pstd::floor(x), yi = pstd::floor(y);
+    Float dx = x - xi, dy = y - yi;
+
+    // Find the channels to interpolate, matching _Texel()_ and
+    // _BilerpChannel()_
+    int nc = NChannels(), firstChannel = 0, nFiltered = 1;
+    if constexpr (std::is_same_v<T, Float>) {
+        if (nc == 3)
+            nFiltered = 3;
+        else if (nc == 4)
+            // Return alpha
+            firstChannel = 3;
+    } else if (nc != 1)
+        nFiltered = 3;
+
+    // Read the four texels and bilinearly interpolate their channels
+    float values[3 * 4];
+    GetTexels<Format, Wrap>(level, {xi, yi}, 2, firstChannel, nFiltered, values, 4);
+    GetTexels<Format, Wrap>(level, {xi, yi + 1}, 2, firstChannel, nFiltered,
+                            values + 2, 4);
+    auto bilerp = [&](int c) {
+        const float *v = &values[4 * c];
+        return ((1 - dx) * (1 - dy) * v[0] + dx * (1 - dy) * v[1] +
+                (1 - dx) * dy * v[2] + dx * dy * v[3]);
+    };
+    if constexpr (std::is_same_v<T, Float>)
+        return nFiltered == 3 ? (bilerp(0) + bilerp(1) + bilerp(2)) / 3 : bilerp(0);
+    else {
+        if (nFiltered == 3)
+            return RGB(bilerp(0), bilerp(1), bilerp(2));
+        Float v = bilerp(0);
+        return RGB(v, v, v);
+    }
+}
+
+template <typename T, auto Format, WrapMode Wrap>
+T MIPMap::EWATexels(int level, Point2f st, Float A, Float B, Float C, int s0, int s1,
+                    int t0, int t1) const {
+    // Filter the first channel for _Float_ lookups and single-channel images
+    // and the first three otherwise, as _Texel()_ does
+    int nFiltered = (std::is_same_v<T, Float> || NChannels() == 1) ? 1 : 3;
+
+    // Accumulate weighted texels four at a time, reading footprint rows in
+    // chunks of up to _RowChunkSize_ texels
+    using SIMD = SIMDFloat<4>;
+    static constexpr int RowChunkSize = 64;
+    float values[3 * RowChunkSize];
+    SIMD sum[3] = {SIMD(0.f), SIMD(0.f), SIMD(0.f)}, sumWts(0.f);
+    static constexpr float laneOffsets[4] = {0, 1, 2, 3};
+    for (int it = t0; it <= t1; ++it) {
+        Float tt = it - st[1];
+        SIMD Btt(B * tt), Ctt2(C * tt * tt);
+        for (int sc = s0; sc <= s1; sc += RowChunkSize) {
+            int n = std::min(RowChunkSize, s1 - sc + 1);
+            GetTexels<Format, Wrap>(level, {sc, it}, n, 0, nFiltered, values,
+                                    RowChunkSize);
+            // Zero the values after the last texel in the last group of four
+            for (int c = 0; c < nFiltered; ++c)
+                for (int i = n; i & 3; ++i)
+                    values[c * RowChunkSize + i] = 0;
+
+            for (int i = 0; i < n; i += 4) {
+                // Compute squared radii of four texels and their filter weights
+                SIMD ss = SIMD(Float(sc + i) - st[0]) + SIMD::Load(laneOffsets);
+                SIMD r2 = (SIMD(A) * ss + Btt) * ss + Ctt2;
+                if (CompareLEMask(SIMD(1.f), r2) == 0xf)
+                    // All four texels are outside the ellipse
+                    continue;
+                float r2s[4], weights[4];
+                r2.Store(r2s);
+                for (int j = 0; j < 4; ++j) {
+                    if (i + j < n && r2s[j] < 1) {
+                        int index = std::min<int>(r2s[j] * MIPFilterLUTSize,
+                                                  MIPFilterLUTSize - 1);
+                        weights[j] = MIPFilterLUT[index];
+                    } else
+                        weights[j] = 0;
+                }
+
+                SIMD w = SIMD::Load(weights);
+                sumWts = sumWts + w;
+                for (int c = 0; c < nFiltered; ++c)
+                    sum[c] = FMA(w, SIMD::Load(&values[c * RowChunkSize + i]), sum[c]);
+            }
+        }
+    }
+
+    // Sum the lanes of the accumulated values and normalize
+    auto reduce = [](SIMD v) { return (v[0] + v[1]) + (v[2] + v[3]); };
+    Float invSumWts = 1 / reduce(sumWts);
+    if constexpr (std::is_same_v<T, Float>)
+        return reduce(sum[0]) * invSumWts;
+    else {
+        if (nFiltered == 3)
+            return RGB(reduce(sum[0]), reduce(sum[1]), reduce(sum[2])) * invSumWts;
+        Float v = reduce(sum[0]) * invSumWts;
+        return RGB(v, v, v);
+    }
 }
 
 template <>
 Float MIPMap::Texel(int level, Point2i st) const {
-    CHECK(level >= 0 && level < pyramid.size());
-    return pyramid[level].GetChannel(st, 0, wrapMode);
+    if (wrapMode != WrapMode::OctahedralSphere)
+        return DispatchTexelAccess([&](auto format, auto wrap) {
+            return GetTexel<Float, decltype(format)::value, decltype(wrap)::value>(level,
+                                                                                 st);
+        });
+    const Image *image = TexelImage(level, &st);
+    return image ? image->GetChannel(st, 0) : 0;
 }
 
 template <>
 RGB MIPMap::Texel(int level, Point2i st) const {
-    CHECK(level >= 0 && level < pyramid.size());
-    if (pyramid[level].NChannels() == 3 || pyramid[level].NChannels() == 4) {
+    if (wrapMode != WrapMode::OctahedralSphere)
+        return DispatchTexelAccess([&](auto format, auto wrap) {
+            return GetTexel<RGB, decltype(format)::value, decltype(wrap)::value>(level,
+                                                                               st);
+        });
+    const Image *image = TexelImage(level, &st);
+    if (!image)
+        return RGB(0, 0, 0);
+    if (image->NChannels() == 3 || image->NChannels() == 4) {
         RGB rgb;
         for (int c = 0; c < 3; ++c)
-            rgb[c] = pyramid[level].GetChannel(st, c, wrapMode);
+            rgb[c] = image->GetChannel(st, c);
         return rgb;
     } else {
-        CHECK_EQ(1, pyramid[level].NChannels());
-        Float v = pyramid[level].GetChannel(st, 0, wrapMode);
+        CHECK_EQ(1, image->NChannels());
+        Float v = image->GetChannel(st, 0);
         return RGB(v, v, v);
     }
 }
@@ -279,15 +635,20 @@ T MIPMap::Filter(Point2f st, Vector2f dst0, Vector2f dst1) const {
 
 template <>
 RGB MIPMap::Bilerp(int level, Point2f st) const {
-    CHECK(level >= 0 && level < pyramid.size());
-    if (pyramid[level].NChannels() == 3 || pyramid[level].NChannels() == 4) {
+    CHECK(level >= 0 && level < Levels());
+    if (wrapMode != WrapMode::OctahedralSphere)
+        return DispatchTexelAccess([&](auto format, auto wrap) {
+            return BilerpTexels<RGB, decltype(format)::value, decltype(wrap)::value>(
+                level, st);
+        });
+    if (NChannels() == 3 || NChannels() == 4) {
         RGB rgb;
         for (int c = 0; c < 3; ++c)
-            rgb[c] = pyramid[level].BilerpChannel(st, c, wrapMode);
+            rgb[c] = BilerpChannel(level, st, c);
         return rgb;
     } else {
-        CHECK_EQ(1, pyramid[level].NChannels());
-        Float v = pyramid[level].BilerpChannel(st, 0, wrapMode);
+        CHECK_EQ(1, NChannels());
+        Float v = BilerpChannel(level, st, 0);
         return RGB(v, v, v);
     }
 }
@@ -324,6 +685,11 @@ T MIPMap::EWA(int level, Point2f st, Vector2f dst0, Vector2f dst1) const {
     int t1 = pstd::floor(st[1] + 2 * invDet * vSqrt);
 
     // Scan over ellipse bound and evaluate quadratic equation to filter image
+    if (wrapMode != WrapMode::OctahedralSphere)
+        return DispatchTexelAccess([&](auto format, auto wrap) {
+            return EWATexels<T, decltype(format)::value, decltype(wrap)::value>(
+                level, st, A, B, C, s0, s1, t0, t1);
+        });
     T sum{};
     Float sumWts = 0;
     for (int it = t0; it <= t1; ++it) {
@@ -343,9 +709,10 @@ T MIPMap::EWA(int level, Point2f st, Vector2f dst0, Vector2f dst1) const {
     return sum / sumWts;
 }
 
-MIPMap *MIPMap::CreateFromFile(const std::string &filename,
-                               const MIPMapFilterOptions &options, WrapMode wrapMode,
-                               ColorEncoding encoding, Allocator alloc) {
+// Reads an image to be used as a texture, returning its RGB or RGBA
+// channels or its single channel.
+static Image ReadTextureImage(const std::string &filename, ColorEncoding encoding,
+                              Allocator alloc, const RGBColorSpace **colorSpace) {
     ImageAndMetadata imageAndMetadata = Image::Read(filename, alloc, encoding);
 
     Image &image = imageAndMetadata.image;
@@ -372,9 +739,73 @@ MIPMap *MIPMap::CreateFromFile(const std::string &filename,
         }
     }
 
-    const RGBColorSpace *colorSpace = imageAndMetadata.metadata.GetColorSpace();
-    return alloc.new_object<MIPMap>(std::move(image), colorSpace, wrapMode, alloc,
-                                    options);
+    *colorSpace = imageAndMetadata.metadata.GetColorSpace();
+    return std::move(image);
+}
+
+MIPMap *MIPMap::CreateFromFile(const std::string &filename,
+                               const MIPMapFilterOptions &options, WrapMode wrapMode,
+                               ColorEncoding encoding, Allocator alloc) {
+    const RGBColorSpace *colorSpace = nullptr;
+    if (TiledImagePyramid::IsTiledMIPFile(filename)) {
+        // Use the pre-filtered levels in the tiled MIP file; the color
+        // encoding given when it was created is used for 8-bit texels.
+        WrapMode tiledWrapMode;
+        std::unique_ptr<TiledImagePyramid> tiledPyramid =
+            TiledImagePyramid::Read(filename, &colorSpace, &tiledWrapMode);
+        if (tiledWrapMode != wrapMode)
+            Warning("%s: MIP levels were filtered with the \"%s\" wrap mode rather "
+                    "than \"%s\".",
+                    filename, pbrt::ToString(tiledWrapMode), pbrt::ToString(wrapMode));
+        return alloc.new_object<MIPMap>(std::move(tiledPyramid), colorSpace, wrapMode,
+                                        options);
+    }
+
+    Image image = ReadTextureImage(filename, encoding, alloc, &colorSpace);
+    MIPMap *mipmap = alloc.new_object<MIPMap>(std::move(image), colorSpace, wrapMode,
+                                              alloc, options);
+
+    if (TextureTileCache::Enabled()) {
+        // Move the pyramid's texels to a tile file and read them on demand
+        mipmap->tiledPyramid = TiledImagePyramid::Create(mipmap->pyramid);
+        for (const Image &im : mipmap->pyramid)
+            imageMapBytes -= im.BytesUsed();
+        mipmap->pyramid.clear();
+    } else if (Options->compressTextures && !mipmap->Compress())
+        LOG_VERBOSE("%s: no block-compressed format for %s texels with %d channels",
+                    filename, mipmap->Format(), mipmap->NChannels());
+    return mipmap;
+}
+
+bool MIPMap::Compress() {
+    if (tiledPyramid || !bcPyramid.empty() || wrapMode == WrapMode::OctahedralSphere)
+        return false;
+    pstd::optional<BCFormat> format =
+        BCImage::TextureFormat(pyramid[0].Format(), pyramid[0].NChannels());
+    if (!format)
+        return false;
+
+    // Replace the pyramid's levels with compressed versions of them
+    Allocator alloc = pyramid.get_allocator();
+    bcPyramid = pstd::vector<BCImage>(alloc);
+    bcPyramid.reserve(pyramid.size());
+    for (const Image &image : pyramid) {
+        bcPyramid.push_back(BCImage::Compress(image, *format, alloc));
+        imageMapBytes += bcPyramid.back().BytesUsed();
+        imageMapBytes -= image.BytesUsed();
+    }
+    pyramid.clear();
+    ++nCompressedImageMaps;
+    return true;
+}
+
+bool MIPMap::WriteTiledFile(const std::string &filename,
+                            const std::string &tiledFilename, WrapMode wrapMode,
+                            ColorEncoding encoding) {
+    const RGBColorSpace *colorSpace = nullptr;
+    Image image = ReadTextureImage(filename, encoding, {}, &colorSpace);
+    pstd::vector<Image> pyramid = Image::GeneratePyramid(std::move(image), wrapMode);
+    return TiledImagePyramid::Write(tiledFilename, pyramid, colorSpace, wrapMode);
 }
 
 template <typename T>
@@ -389,21 +820,36 @@ T MIPMap::Bilerp(int level, Point2f st) const {
 
 template <>
 Float MIPMap::Bilerp(int level, Point2f st) const {
-    CHECK(level >= 0 && level < pyramid.size());
-    switch (pyramid[level].NChannels()) {
+    CHECK(level >= 0 && level < Levels());
+    if (wrapMode != WrapMode::OctahedralSphere)
+        return DispatchTexelAccess([&](auto format, auto wrap) {
+            return BilerpTexels<Float, decltype(format)::value, decltype(wrap)::value>(
+                level, st);
+        });
+    switch (NChannels()) {
     case 1:
-        return pyramid[level].BilerpChannel(st, 0, wrapMode);
+        return BilerpChannel(level, st, 0);
     case 3:
-        return pyramid[level].Bilerp(st, wrapMode).Average();
+        return (BilerpChannel(level, st, 0) + BilerpChannel(level, st, 1) +
+                BilerpChannel(level, st, 2)) /
+               3;
     case 4:
         // Return alpha
-        return pyramid[level].BilerpChannel(st, 3, wrapMode);
+        return BilerpChannel(level, st, 3);
     default:
-        LOG_FATAL("Unexpected number of image channels: %d", pyramid[level].NChannels());
+        LOG_FATAL("Unexpected number of image channels: %d", NChannels());
     }
 }
 
 std::string MIPMap::ToString() const {
+    if (!bcPyramid.empty())
+        return StringPrintf("[ MIPMap bcPyramid: %s colorSpace: %s wrapMode: %s "
+                            "options: %s ]",
+                            bcPyramid, colorSpace->ToString(), wrapMode, options);
+    if (tiledPyramid)
+        return StringPrintf("[ MIPMap tiledPyramid: %s colorSpace: %s wrapMode: %s "
+                            "options: %s ]",
+                            *tiledPyramid, colorSpace->ToString(), wrapMode, options);
     return StringPrintf("[ MIPMap pyramid: %s colorSpace: %s wrapMode: %s "
                         "options: %s ]",
                         pyramid, colorSpace->ToString(), wrapMode, options);
@@ -7,8 +7,10 @@
 
 #include <pbrt/pbrt.h>
 
+#include <pbrt/util/bcn.h>
 #include <pbrt/util/image.h>
 #include <pbrt/util/pstd.h>
+#include <pbrt/util/texcache.h>
 #include <pbrt/util/vecmath.h>
 
 #include <memory>
@@ -51,9 +53,22 @@ class MIPMap {
     // MIPMap Public Methods
     MIPMap(Image image, const RGBColorSpace *colorSpace, WrapMode wrapMode,
            Allocator alloc, const MIPMapFilterOptions &options);
+    MIPMap(std::unique_ptr<TiledImagePyramid> tiledPyramid,
+           const RGBColorSpace *colorSpace, WrapMode wrapMode,
+           const MIPMapFilterOptions &options);
     static MIPMap *CreateFromFile(const std::string &filename,
                                   const MIPMapFilterOptions &options, WrapMode wrapMode,
                                   ColorEncoding encoding, Allocator alloc);
+    // Generates the pyramid for the image in _filename_ and writes it to a
+    // tiled MIP file, which _CreateFromFile()_ can then use without
+    // regenerating the pyramid.
+    static bool WriteTiledFile(const std::string &filename,
+                               const std::string &tiledFilename, WrapMode wrapMode,
+                               ColorEncoding encoding);
+
+    // Stores the pyramid's levels in a block-compressed format if there is
+    // one for its texels, returning whether it did so.
+    bool Compress();
 
     template <typename T>
     T Filter(Point2f st, Vector2f dstdx, Vector2f dstdy) const;
@@ -61,12 +76,25 @@ class MIPMap {
     std::string ToString() const;
 
     Point2i LevelResolution(int level) const {
-        CHECK(level >= 0 && level < pyramid.size());
+        CHECK(level >= 0 && level < Levels());
+        if (tiledPyramid)
+            return tiledPyramid->LevelResolution(level);
+        if (!bcPyramid.empty())
+            return bcPyramid[level].Resolution();
         return pyramid[level].Resolution();
     }
-    int Levels() const { return int(pyramid.size()); }
+    int Levels() const {
+        if (tiledPyramid)
+            return tiledPyramid->Levels();
+        if (!bcPyramid.empty())
+            return int(bcPyramid.size());
+        return int(pyramid.size());
+    }
     const RGBColorSpace *GetRGBColorSpace() const { return colorSpace; }
-    const Image &GetLevel(int level) const { return pyramid[level]; }
+    const Image &GetLevel(int level) const {
+        CHECK(!tiledPyramid && bcPyramid.empty());
+        return pyramid[level];
+    }
 
   private:
     // MIPMap Private Methods
@@ -76,12 +104,57 @@ class MIPMap {
     T Bilerp(int level, Point2f st) const;
     template <typename T>
     T EWA(int level, Point2f st, Vector2f dst0, Vector2f dst1) const;
+    int NChannels() const {
+        if (tiledPyramid)
+            return tiledPyramid->NChannels();
+        if (!bcPyramid.empty())
+            return bcPyramid[0].NChannels();
+        return pyramid[0].NChannels();
+    }
+    // Returns the format of the texels, after decoding for compressed levels
+    PixelFormat Format() const {
+        if (tiledPyramid)
+            return tiledPyramid->Format();
+        if (!bcPyramid.empty())
+            return bcPyramid[0].Format() == BCFormat::BC6H ? PixelFormat::Half
+                                                           : PixelFormat::U256;
+        return pyramid[0].Format();
+    }
+    const Image *TexelImage(int level, Point2i *st) const;
+    Float BilerpChannel(int level, Point2f st, int c) const;
+    void InitU256ToLinear();
+
+    // Specializations of texel lookups and filtering for the pyramid's pixel
+    // or block-compressed format and for wrap modes other than
+    // _WrapMode::OctahedralSphere_
+    template <typename F>
+    auto DispatchTexelAccess(F func) const;
+    template <PixelFormat Format, WrapMode Wrap>
+    void GetTexels(int level, Point2i p, int n, int firstChannel, int nChannels,
+                   float *values, int stride) const;
+    template <BCFormat Format, WrapMode Wrap>
+    void GetTexels(int level, Point2i p, int n, int firstChannel, int nChannels,
+                   float *values, int stride) const;
+    template <typename T, auto Format, WrapMode Wrap>
+    T GetTexel(int level, Point2i st) const;
+    template <typename T, auto Format, WrapMode Wrap>
+    T BilerpTexels(int level, Point2f st) const;
+    template <typename T, auto Format, WrapMode Wrap>
+    T EWATexels(int level, Point2f st, Float A, Float B, Float C, int s0, int s1, int t0,
+                int t1) const;
 
     // MIPMap Private Members
     pstd::vector<Image> pyramid;
+    // Holds the pyramid's texels instead of _pyramid_ when they are paged
+    // through the _TextureTileCache_
+    std::unique_ptr<TiledImagePyramid> tiledPyramid;
+    // Holds the pyramid's levels instead of _pyramid_ after _Compress()_
+    pstd::vector<BCImage> bcPyramid;
     const RGBColorSpace *colorSpace;
     WrapMode wrapMode;
     MIPMapFilterOptions options;
+    // Linear values of 8-bit texels, indexed by their encoded values
+    pstd::array<float, 256> u256ToLinear;
 };
 
 }  // namespace pbrt
@@ -0,0 +1,204 @@
+// pbrt is Copyright(c) 1998-2020 Matt Pharr, Wenzel Jakob, and Greg Humphreys.
+// The pbrt source code is licensed under the Apache License, Version 2.0.
+// SPDX: Apache-2.0
+
+#include <gtest/gtest.h>
+
+#include <pbrt/pbrt.h>
+#include <pbrt/util/colorspace.h>
+#include <pbrt/util/image.h>
+#include <pbrt/util/mipmap.h>
+#include <pbrt/util/math.h>
+#include <pbrt/util/rng.h>
+
+#include <cmath>
+
+using namespace pbrt;
+
+TEST(MIPMap, PixelFormats) {
+    // Filtering 8-bit and half-float textures should give the same results
+    // as filtering float textures that store the same values.
+    for (PixelFormat format : {PixelFormat::U256, PixelFormat::Half})
+        for (int nChannels : {1, 3}) {
+            std::vector<std::string> channels = {"R", "G", "B"};
+            if (nChannels == 1)
+                channels = {"Y"};
+            Point2i res(64, 32);
+            Image image(format, res, channels, ColorEncoding::sRGB);
+            Image floatImage(PixelFormat::Float, res, channels);
+            RNG rng;
+            for (int y = 0; y < res.y; ++y)
+                for (int x = 0; x < res.x; ++x)
+                    for (int c = 0; c < nChannels; ++c) {
+                        image.SetChannel({x, y}, c, rng.Uniform<Float>());
+                        floatImage.SetChannel({x, y}, c, image.GetChannel({x, y}, c));
+                    }
+
+            for (FilterFunction filter : {FilterFunction::Bilinear, FilterFunction::EWA})
+                for (WrapMode wrapMode :
+                     {WrapMode::Repeat, WrapMode::Clamp, WrapMode::Black}) {
+                    MIPMapFilterOptions options;
+                    options.filter = filter;
+                    const RGBColorSpace *colorSpace = RGBColorSpace::sRGB;
+                    MIPMap mipmap(image, colorSpace, wrapMode, {}, options);
+                    MIPMap floatMIPMap(floatImage, colorSpace, wrapMode, {}, options);
+
+                    for (int i = 0; i < 1000; ++i) {
+                        // Only compare lookups at the first level, since the
+                        // lower levels of the two pyramids are quantized
+                        // differently.
+                        Point2f st(-0.5f + 2 * rng.Uniform<Float>(),
+                                   -0.5f + 2 * rng.Uniform<Float>());
+                        Float scale = 0.5f / res.x;
+                        Vector2f dst0(scale * rng.Uniform<Float>(),
+                                      scale * rng.Uniform<Float>());
+                        Vector2f dst1(-scale * rng.Uniform<Float>(),
+                                      scale * rng.Uniform<Float>());
+                        EXPECT_EQ(floatMIPMap.Filter<RGB>(st, dst0, dst1),
+                                  mipmap.Filter<RGB>(st, dst0, dst1));
+                        EXPECT_EQ(floatMIPMap.Filter<Float>(st, dst0, dst1),
+                                  mipmap.Filter<Float>(st, dst0, dst1));
+                    }
+                }
+        }
+}
+
+static Image RandomImage(PixelFormat format, Point2i res, int nChannels) {
+    std::vector<std::string> channels = {"R", "G", "B"};
+    if (nChannels == 1)
+        channels = {"Y"};
+    Image image(format, res, channels, ColorEncoding::sRGB);
+    RNG rng(nChannels);
+    for (int y = 0; y < res.y; ++y)
+        for (int x = 0; x < res.x; ++x)
+            for (int c = 0; c < nChannels; ++c)
+                image.SetChannel({x, y}, c, rng.Uniform<Float>());
+    return image;
+}
+
+TEST(MIPMap, BilinearMatchesImage) {
+    // Bilinear lookups at the first level should exactly match
+    // _Image::BilerpChannel()_ on the source image, which is how they were
+    // computed before texel access was specialized.
+    for (PixelFormat format : {PixelFormat::U256, PixelFormat::Half, PixelFormat::Float})
+        for (int nChannels : {1, 3}) {
+            Point2i res(64, 32);
+            Image image = RandomImage(format, res, nChannels);
+            for (WrapMode wrapMode : {WrapMode::Repeat, WrapMode::Clamp, WrapMode::Black}) {
+                MIPMapFilterOptions options;
+                options.filter = FilterFunction::Bilinear;
+                MIPMap mipmap(image, RGBColorSpace::sRGB, wrapMode, {}, options);
+
+                RNG rng;
+                for (int i = 0; i < 1000; ++i) {
+                    Point2f st(-0.5f + 2 * rng.Uniform<Float>(),
+                               -0.5f + 2 * rng.Uniform<Float>());
+                    Float b[3];
+                    for (int c = 0; c < 3; ++c)
+                        b[c] = image.BilerpChannel(st, std::min(c, nChannels - 1),
+                                                   wrapMode);
+                    EXPECT_EQ(RGB(b[0], b[1], b[2]), mipmap.Filter<RGB>(st, {}, {}))
+                        << st << " " << ToString(wrapMode);
+                    Float f = nChannels == 1 ? b[0] : (b[0] + b[1] + b[2]) / 3;
+                    EXPECT_EQ(f, mipmap.Filter<Float>(st, {}, {}))
+                        << st << " " << ToString(wrapMode);
+                }
+            }
+        }
+}
+
+// Returns the EWA-filtered value of the first level of a MIPMap of _image_
+// using a per-texel loop over the ellipse's bounds, as _MIPMap::EWA()_ did
+// before it was vectorized.
+static RGB ReferenceEWA(const Image &image, WrapMode wrapMode, Point2f st, Vector2f dst0,
+                        Vector2f dst1) {
+    Point2i res = image.Resolution();
+    st[0] = st[0] * res[0] - 0.5f;
+    st[1] = st[1] * res[1] - 0.5f;
+    dst0[0] *= res[0];
+    dst0[1] *= res[1];
+    dst1[0] *= res[0];
+    dst1[1] *= res[1];
+
+    Float A = dst0[1] * dst0[1] + dst1[1] * dst1[1] + 1;
+    Float B = -2 * (dst0[0] * dst0[1] + dst1[0] * dst1[1]);
+    Float C = dst0[0] * dst0[0] + dst1[0] * dst1[0] + 1;
+    Float invF = 1 / (A * C - B * B * 0.25f);
+    A *= invF;
+    B *= invF;
+    C *= invF;
+
+    Float det = -B * B + 4 * A * C;
+    Float invDet = 1 / det;
+    Float uSqrt = SafeSqrt(det * C), vSqrt = SafeSqrt(A * det);
+    int s0 = std::ceil(st[0] - 2 * invDet * uSqrt);
+    int s1 = std::floor(st[0] + 2 * invDet * uSqrt);
+    int t0 = std::ceil(st[1] - 2 * invDet * vSqrt);
+    int t1 = std::floor(st[1] + 2 * invDet * vSqrt);
+
+    // Filter weights as given by the MIPMap's lookup table
+    constexpr int lutSize = 128;
+    RGB sum;
+    Float sumWts = 0;
+    for (int it = t0; it <= t1; ++it) {
+        Float tt = it - st[1];
+        for (int is = s0; is <= s1; ++is) {
+            Float ss = is - st[0];
+            Float r2 = A * ss * ss + B * ss * tt + C * tt * tt;
+            if (r2 < 1) {
+                int index = std::min<int>(r2 * lutSize, lutSize - 1);
+                Float weight = std::exp(-2.f * index / (lutSize - 1)) - std::exp(-2.f);
+                RGB texel;
+                for (int c = 0; c < 3; ++c)
+                    texel[c] = image.GetChannel(
+                        {is, it}, std::min(c, image.NChannels() - 1), wrapMode);
+                sum += weight * texel;
+                sumWts += weight;
+            }
+        }
+    }
+    return sum / sumWts;
+}
+
+TEST(MIPMap, EWAMatchesPerTexelLoop) {
+    // The vectorized EWA filter computes the ellipse's squared radii in a
+    // different order than the per-texel loop, which may change which
+    // lookup table entry a texel uses, so only nearly-equal results are
+    // expected.
+    for (PixelFormat format : {PixelFormat::U256, PixelFormat::Float})
+        for (int nChannels : {1, 3}) {
+            Point2i res(64, 32);
+            Image image = RandomImage(format, res, nChannels);
+            for (WrapMode wrapMode : {WrapMode::Repeat, WrapMode::Clamp, WrapMode::Black}) {
+                MIPMapFilterOptions options;
+                options.filter = FilterFunction::EWA;
+                MIPMap mipmap(image, RGBColorSpace::sRGB, wrapMode, {}, options);
+
+                RNG rng;
+                for (int i = 0; i < 1000; ++i) {
+                    Point2f st(-0.5f + 2 * rng.Uniform<Float>(),
+                               -0.5f + 2 * rng.Uniform<Float>());
+                    // Choose an ellipse with a minor axis short enough that
+                    // only the first level is used and with an eccentricity
+                    // that isn't clamped.
+                    Float minorLength = (0.25f + 0.7f * rng.Uniform<Float>()) / res.x;
+                    Float majorLength = minorLength * (1 + 6 * rng.Uniform<Float>());
+                    Float theta = 2 * Pi * rng.Uniform<Float>();
+                    Vector2f dst0(majorLength * std::cos(theta),
+                                  majorLength * std::sin(theta));
+                    Vector2f dst1(-minorLength * std::sin(theta),
+                                  minorLength * std::cos(theta));
+
+                    RGB ref = ReferenceEWA(image, wrapMode, st, dst0, dst1);
+                    RGB rgb = mipmap.Filter<RGB>(st, dst0, dst1);
+                    for (int c = 0; c < 3; ++c)
+                        EXPECT_LT(std::abs(ref[c] - rgb[c]), 2e-3f)
+                            << st << " " << ToString(wrapMode) << " " << ref << " vs "
+                            << rgb;
+                    // Float lookups filter the first channel.
+                    EXPECT_LT(std::abs(ref[0] - mipmap.Filter<Float>(st, dst0, dst1)),
+                              2e-3f);
+                }
+            }
+        }
+}
@@ -5,16 +5,27 @@
 #include <pbrt/util/parallel.h>
 
 #include <pbrt/util/check.h>
+#include <pbrt/util/error.h>
 #include <pbrt/util/print.h>
+#include <pbrt/util/rng.h>
+#include <pbrt/util/string.h>
 #ifdef PBRT_BUILD_GPU_RENDERER
 #include <pbrt/gpu/util.h>
 #endif  // PBRT_BUILD_GPU_RENDERER
 
+#include <deque>
+#include <fstream>
 #include <iterator>
-#include <list>
 #include <thread>
 #include <vector>
 
+#ifdef PBRT_IS_LINUX
+#include <pthread.h>
+#include <sched.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif  // PBRT_IS_LINUX
+
 namespace pbrt {
 
 std::string AtomicFloat::ToString() const {
@@ -41,6 +52,11 @@ bool Barrier::Block() {
 }
 
 // ThreadPool Definition
+// Each thread in the pool, including the one that called _ParallelInit()_,
+// has its own _WorkStealingDeque_. Threads push the jobs they create onto
+// their own deque and pop them in LIFO order; threads without work steal
+// the oldest jobs from randomly-chosen other deques. Threads outside the
+// pool add jobs to a shared queue instead.
 class ThreadPool {
   public:
     // ThreadPool Public Methods
@@ -50,11 +66,11 @@ class ThreadPool {
 
     size_t size() const { return threads.size(); }
 
-    std::unique_lock<std::mutex> AddToJobList(ParallelJob *job);
-    void RemoveFromJobList(ParallelJob *job);
-
-    void WorkOrWait(std::unique_lock<std::mutex> *lock);
-    bool WorkOrReturn();
+    void Enqueue(ParallelJob *job);
+    bool RunOneJob();
+    template <typename F>
+    void WorkUntil(F done);
+    void Signal();
 
     void ForEachThread(std::function<void(void)> func);
 
@@ -63,108 +79,176 @@ class ThreadPool {
   private:
     // ThreadPool Private Methods
     void workerFunc(int index);
+    static bool canRun(uint64_t isolation);
+    ParallelJob *stealJob();
+    bool haveWork() const;
+    void wake(bool all);
 
     // ThreadPool Private Members
+    std::vector<std::unique_ptr<WorkStealingDeque<ParallelJob *>>> deques;
     std::vector<std::thread> threads;
-    mutable std::mutex mutex;
-    bool shutdownThreads = false;
-    ParallelJob *jobList = nullptr;
-    std::condition_variable jobListCondition;
+    std::atomic<bool> shutdownThreads{false};
+    // Jobs enqueued by threads outside the pool
+    mutable std::mutex sharedQueueMutex;
+    std::deque<ParallelJob *> sharedQueue;
+    std::atomic<int> sharedQueueSize{0};
+    // Idle threads sleep until _epoch_ changes; it is incremented whenever
+    // jobs are enqueued or a loop finishes.
+    std::mutex sleepMutex;
+    std::condition_variable sleepCondition;
+    std::atomic<uint64_t> epoch{0};
+    std::atomic<int> nSleeping{0};
 };
 
 static std::unique_ptr<ThreadPool> threadPool;
+// Index of the current thread's deque in the thread pool, or -1 for threads
+// outside of it
+static thread_local int threadIndex = -1;
+// Isolation region that the current thread is running in; zero if it may run
+// any job.
+static thread_local uint64_t threadIsolation = 0;
 
 // ThreadPool Method Definitions
 ThreadPool::ThreadPool(int nThreads) {
+    for (int i = 0; i < nThreads; ++i)
+        deques.push_back(std::make_unique<WorkStealingDeque<ParallelJob *>>());
     for (int i = 0; i < nThreads - 1; ++i)
         threads.push_back(std::thread(&ThreadPool::workerFunc, this, i + 1));
 }
 
 void ThreadPool::workerFunc(int index) {
     LOG_VERBOSE("Started execution in worker thread %d", index);
+    threadIndex = index;
 
 #ifdef PBRT_BUILD_GPU_RENDERER
     GPUThreadInit();
 #endif  // PBRT_BUILD_GPU_RENDERER
 
-    std::unique_lock<std::mutex> lock(mutex);
-    while (!shutdownThreads)
-        WorkOrWait(&lock);
+    WorkUntil([this]() { return shutdownThreads.load(std::memory_order_acquire); });
 
     LOG_VERBOSE("Exiting worker thread %d", index);
 }
 
-std::unique_lock<std::mutex> ThreadPool::AddToJobList(ParallelJob *job) {
-    std::unique_lock<std::mutex> lock(mutex);
-    // Add _job_ to head of _jobList_
-    if (jobList)
-        jobList->prev = job;
-    job->next = jobList;
-    jobList = job;
-
-    jobListCondition.notify_all();
-    return lock;
-}
-
-void ThreadPool::WorkOrWait(std::unique_lock<std::mutex> *lock) {
-    DCHECK(lock->owns_lock());
-
-    ParallelJob *job = jobList;
-    while (job && !job->HaveWork())
-        job = job->next;
-    if (job) {
-        // Execute work for _job_
-        job->activeWorkers++;
-        job->RunStep(lock);
-        DCHECK(!lock->owns_lock());
-        lock->lock();
-        job->activeWorkers--;
-        if (job->Finished()) {
-            jobListCondition.notify_all();
-            job->Cleanup();
-        }
+void ThreadPool::Enqueue(ParallelJob *job) {
+    job->isolation = threadIsolation;
+    if (threadIndex >= 0)
+        deques[threadIndex]->Push(job, job->isolation);
+    else {
+        std::lock_guard<std::mutex> lock(sharedQueueMutex);
+        sharedQueue.push_back(job);
+        ++sharedQueueSize;
+    }
+    wake(false);
+}
 
-    } else
-        // Wait for new work to arrive or the job to finish
-        jobListCondition.wait(*lock);
+void ThreadPool::Signal() {
+    wake(true);
 }
 
-void ThreadPool::RemoveFromJobList(ParallelJob *job) {
-    DCHECK(!job->removed);
+void ThreadPool::wake(bool all) {
+    epoch.fetch_add(1);
+    // A thread that is about to sleep increments _nSleeping_ before
+    // checking _epoch_, so it either sees the new epoch or is notified.
+    if (nSleeping.load() > 0) {
+        std::lock_guard<std::mutex> lock(sleepMutex);
+        if (all)
+            sleepCondition.notify_all();
+        else
+            sleepCondition.notify_one();
+    }
+}
 
-    if (job->prev)
-        job->prev->next = job->next;
-    else {
-        DCHECK(jobList == job);
-        jobList = job->next;
+bool ThreadPool::RunOneJob() {
+    ParallelJob *job = nullptr;
+    if (threadIndex >= 0) {
+        job = deques[threadIndex]->Pop();
+        // Jobs from outside the current isolation region are below the
+        // region's jobs in the deque, so at most one needs to be put back.
+        if (job && !canRun(job->isolation)) {
+            deques[threadIndex]->Push(job, job->isolation);
+            job = nullptr;
+        }
     }
-    if (job->next)
-        job->next->prev = job->prev;
+    if (!job)
+        job = stealJob();
+    if (!job)
+        return false;
 
-    job->removed = true;
+    // Run the job in the isolation region it was enqueued in
+    uint64_t isolation = threadIsolation;
+    threadIsolation = job->isolation;
+    job->Run();
+    threadIsolation = isolation;
+    return true;
 }
 
-bool ThreadPool::WorkOrReturn() {
-    std::unique_lock<std::mutex> lock(mutex);
+bool ThreadPool::canRun(uint64_t isolation) {
+    return threadIsolation == 0 || isolation == threadIsolation;
+}
 
-    ParallelJob *job = jobList;
-    while (job && !job->HaveWork())
-        job = job->next;
-    if (!job)
-        return false;
+ParallelJob *ThreadPool::stealJob() {
+    // Take jobs from threads outside the pool first
+    if (sharedQueueSize.load(std::memory_order_relaxed) > 0) {
+        std::lock_guard<std::mutex> lock(sharedQueueMutex);
+        if (!sharedQueue.empty() && canRun(sharedQueue.front()->isolation)) {
+            ParallelJob *job = sharedQueue.front();
+            sharedQueue.pop_front();
+            --sharedQueueSize;
+            return job;
+        }
+    }
 
-    // Execute work for _job_
-    job->activeWorkers++;
-    job->RunStep(&lock);
-    DCHECK(!lock.owns_lock());
-    lock.lock();
-    job->activeWorkers--;
-    if (job->Finished()) {
-        jobListCondition.notify_all();
-        job->Cleanup();
+    // Try to steal from each of the other threads, starting at a random one
+    static thread_local RNG rng(std::hash<std::thread::id>()(std::this_thread::get_id()));
+    int n = deques.size();
+    int start = rng.Uniform<uint32_t>() % n;
+    for (int i = 0; i < n; ++i) {
+        int victim = (start + i) % n;
+        if (victim == threadIndex)
+            continue;
+        if (ParallelJob *job = deques[victim]->Steal(canRun))
+            return job;
     }
+    return nullptr;
+}
 
-    return true;
+bool ThreadPool::haveWork() const {
+    if (sharedQueueSize.load() > 0)
+        return true;
+    for (const auto &deque : deques)
+        if (!deque->Empty())
+            return true;
+    return false;
+}
+
+template <typename F>
+void ThreadPool::WorkUntil(F done) {
+    int nIdle = 0;
+    while (!done()) {
+        if (RunOneJob()) {
+            nIdle = 0;
+            continue;
+        }
+        // Spin briefly before sleeping, since more work often arrives soon
+        if (++nIdle < 64) {
+            std::this_thread::yield();
+            continue;
+        }
+
+        // Sleep until jobs are enqueued or a loop finishes. Changes made
+        // before _epoch_ is read are found by the checks that follow.
+        // Isolated threads don't check for other work, which they can't
+        // run; the jobs in their region are run by the threads that
+        // enqueued them if no others do, and finishing them wakes this one.
+        uint64_t currentEpoch = epoch.load();
+        if (done() || (threadIsolation == 0 && haveWork()))
+            continue;
+        std::unique_lock<std::mutex> lock(sleepMutex);
+        ++nSleeping;
+        sleepCondition.wait(lock, [&]() { return epoch.load() != currentEpoch; });
+        --nSleeping;
+        nIdle = 0;
+    }
 }
 
 void ThreadPool::ForEachThread(std::function<void(void)> func) {
@@ -181,11 +265,8 @@ ThreadPool::~ThreadPool() {
     if (threads.empty())
         return;
 
-    {
-        std::lock_guard<std::mutex> lock(mutex);
-        shutdownThreads = true;
-        jobListCondition.notify_all();
-    }
+    shutdownThreads = true;
+    Signal();
 
     for (std::thread &thread : threads)
         thread.join();
@@ -193,127 +274,101 @@ ThreadPool::~ThreadPool() {
 
 std::string ThreadPool::ToString() const {
     std::string s = StringPrintf("[ ThreadPool threads.size(): %d shutdownThreads: %s ",
-                                 threads.size(), shutdownThreads);
-    if (mutex.try_lock()) {
-        s += "jobList: [ ";
-        ParallelJob *job = jobList;
-        while (job) {
-            s += job->ToString() + " ";
-            job = job->next;
-        }
-        s += "] ";
-        mutex.unlock();
-    } else
-        s += "(job list mutex locked) ";
-    return s + "]";
+                                 threads.size(), shutdownThreads.load());
+    s += "deques empty: [ ";
+    for (const auto &deque : deques)
+        s += deque->Empty() ? "true " : "false ";
+    return s + StringPrintf("] sharedQueueSize: %d nSleeping: %d ]",
+                            sharedQueueSize.load(), nSleeping.load());
 }
 
-std::unique_lock<std::mutex> ParallelJob::AddToJobList() {
+void ParallelJob::Enqueue() {
     CHECK(threadPool && threadPool->size());
-    return threadPool->AddToJobList(this);
+    threadPool->Enqueue(this);
 }
 
-void ParallelJob::RemoveFromJobList() {
+bool DoParallelWork() {
     CHECK(threadPool && threadPool->size());
-    // lock should be held when this is called...
-    threadPool->RemoveFromJobList(this);
+    return threadPool->RunOneJob();
 }
 
-bool DoParallelWork() {
-    CHECK(threadPool && threadPool->size());
-    // lock should be held when this is called...
-    return threadPool->WorkOrReturn();
+void RunIsolated(std::function<void(void)> func) {
+    static std::atomic<uint64_t> nextIsolation{1};
+    uint64_t isolation = threadIsolation;
+    threadIsolation = nextIsolation++;
+    func();
+    threadIsolation = isolation;
 }
 
-// ParallelForLoop1D Definition
-class ParallelForLoop1D : public ParallelJob {
+// ParallelForLoop Definition
+// Parallel loop over _nChunks_ chunks of work. Ranges of chunks are split
+// in half recursively: the thread running a range enqueues its upper half
+// as a new job and continues with the lower half. Thus, idle threads steal
+// large ranges while each thread's own deque holds its remaining chunks in
+// order.
+class ParallelForLoop {
   public:
-    // ParallelForLoop1D Public Methods
-    ParallelForLoop1D(int64_t startIndex, int64_t endIndex, int chunkSize,
-                      std::function<void(int64_t, int64_t)> func)
-        : func(std::move(func)),
-          nextIndex(startIndex),
-          endIndex(endIndex),
-          chunkSize(chunkSize) {}
-
-    bool HaveWork() const { return nextIndex < endIndex; }
-
-    void RunStep(std::unique_lock<std::mutex> *lock);
-
-    std::string ToString() const {
-        return StringPrintf("[ ParallelForLoop1D nextIndex: %d endIndex: %d "
-                            "chunkSize: %d ]",
-                            nextIndex, endIndex, chunkSize);
+    // ParallelForLoop Public Methods
+    ParallelForLoop(int64_t nChunks, std::function<void(int64_t)> func)
+        : func(std::move(func)), rangeJobs(nChunks), chunksRemaining(nChunks) {
+        for (int64_t i = 0; i < nChunks; ++i) {
+            rangeJobs[i].loop = this;
+            rangeJobs[i].begin = i;
+        }
     }
 
-  private:
-    // ParallelForLoop1D Private Members
-    std::function<void(int64_t, int64_t)> func;
-    int64_t nextIndex, endIndex;
-    int chunkSize;
-};
+    void RunRange(int64_t begin, int64_t end);
 
-class ParallelForLoop2D : public ParallelJob {
-  public:
-    ParallelForLoop2D(const Bounds2i &extent, int chunkSize,
-                      std::function<void(Bounds2i)> func)
-        : func(std::move(func)),
-          extent(extent),
-          nextStart(extent.pMin),
-          chunkSize(chunkSize) {}
-
-    bool HaveWork() const { return nextStart.y < extent.pMax.y; }
-    void RunStep(std::unique_lock<std::mutex> *lock);
-
-    std::string ToString() const {
-        return StringPrintf("[ ParallelForLoop2D extent: %s nextStart: %s "
-                            "chunkSize: %d ]",
-                            extent, nextStart, chunkSize);
-    }
+    bool Finished() const { return chunksRemaining.load(std::memory_order_acquire) == 0; }
 
   private:
-    std::function<void(Bounds2i)> func;
-    const Bounds2i extent;
-    Point2i nextStart;
-    int chunkSize;
+    // ParallelForLoop Private Members
+    struct RangeJob : public ParallelJob {
+        void Run() { loop->RunRange(begin, end); }
+        std::string ToString() const {
+            return StringPrintf("[ RangeJob begin: %d end: %d ]", begin, end);
+        }
+
+        ParallelForLoop *loop;
+        int64_t begin, end;
+    };
+
+    std::function<void(int64_t)> func;
+    // The job for the range of chunks starting at _i_ is _rangeJobs[i]_;
+    // each chunk starts at most one range.
+    std::vector<RangeJob> rangeJobs;
+    std::atomic<int64_t> chunksRemaining;
 };
 
-// ParallelForLoop1D Method Definitions
-void ParallelForLoop1D::RunStep(std::unique_lock<std::mutex> *lock) {
-    // Determine the range of loop iterations to run in this step
-    int64_t indexStart = nextIndex;
-    int64_t indexEnd = std::min(indexStart + chunkSize, endIndex);
-    nextIndex = indexEnd;
-
-    // Remove job from list if all work has been started
-    if (!HaveWork())
-        threadPool->RemoveFromJobList(this);
-
-    // Release lock and execute loop iterations in _[indexStart, indexEnd)_
-    lock->unlock();
-    func(indexStart, indexEnd);
-}
-
-void ParallelForLoop2D::RunStep(std::unique_lock<std::mutex> *lock) {
-    // Compute extent for this step
-    Point2i end = nextStart + Vector2i(chunkSize, chunkSize);
-    Bounds2i b = Intersect(Bounds2i(nextStart, end), extent);
-    CHECK(!b.IsEmpty());
-
-    // Advance to be ready for the next extent.
-    nextStart.x += chunkSize;
-    if (nextStart.x >= extent.pMax.x) {
-        nextStart.x = extent.pMin.x;
-        nextStart.y += chunkSize;
+// ParallelForLoop Method Definitions
+void ParallelForLoop::RunRange(int64_t begin, int64_t end) {
+    // Enqueue upper halves of range until a single chunk remains
+    while (end - begin > 1) {
+        int64_t mid = (begin + end) / 2;
+        rangeJobs[mid].end = end;
+        threadPool->Enqueue(&rangeJobs[mid]);
+        end = mid;
     }
 
-    if (!HaveWork())
-        threadPool->RemoveFromJobList(this);
+    func(begin);
 
-    lock->unlock();
+    // Note: the loop may be destroyed as soon as the last chunk finishes
+    if (chunksRemaining.fetch_sub(1, std::memory_order_acq_rel) == 1)
+        threadPool->Signal();
+}
+
+// Runs _func_ for each chunk in _[0, nChunks)_ and returns once all have
+// finished, helping with work in the current thread.
+static void RunParallelLoop(int64_t nChunks, std::function<void(int64_t)> func) {
+    if (threadPool->size() == 0) {
+        for (int64_t i = 0; i < nChunks; ++i)
+            func(i);
+        return;
+    }
 
-    // Run the loop iteration
-    func(b);
+    ParallelForLoop loop(nChunks, std::move(func));
+    loop.RunRange(0, nChunks);
+    threadPool->WorkUntil([&loop]() { return loop.Finished(); });
 }
 
 // Parallel Function Definitions
@@ -326,13 +381,11 @@ void ParallelFor(int64_t start, int64_t end, std::function<void(int64_t, int64_t
         return;
     }
 
-    // Create and enqueue _ParallelForLoop1D_ for this loop
-    ParallelForLoop1D loop(start, end, chunkSize, std::move(func));
-    std::unique_lock<std::mutex> lock = threadPool->AddToJobList(&loop);
-
-    // Help out with parallel loop iterations in the current thread
-    while (!loop.Finished())
-        threadPool->WorkOrWait(&lock);
+    int64_t nChunks = (end - start + chunkSize - 1) / chunkSize;
+    RunParallelLoop(nChunks, [&](int64_t chunk) {
+        int64_t chunkStart = start + chunk * chunkSize;
+        func(chunkStart, std::min(chunkStart + chunkSize, end));
+    });
 }
 
 void ParallelFor2D(const Bounds2i &extent, std::function<void(Bounds2i)> func) {
@@ -352,12 +405,69 @@ void ParallelFor2D(const Bounds2i &extent, std::function<void(Bounds2i)> func) {
                                        (8 * RunningThreads()))),
                          1, 32);
 
-    ParallelForLoop2D loop(extent, tileSize, std::move(func));
-    std::unique_lock<std::mutex> lock = threadPool->AddToJobList(&loop);
+    // Run tiles in Hilbert curve order, so that the ranges of tiles that
+    // threads take from each other are spatially coherent
+    std::vector<Bounds2i> tiles = HilbertCurveTiles(extent, tileSize);
+    if (!NumaEnabled()) {
+        RunParallelLoop(tiles.size(), [&](int64_t tile) { func(tiles[tile]); });
+        return;
+    }
+
+    // Split tiles into one band of tile rows per NUMA node
+    int nNodes = NumaNodeCount();
+    std::vector<std::vector<Bounds2i>> bandTiles(nNodes);
+    for (const Bounds2i &tile : tiles) {
+        int yCenter = (tile.pMin.y + tile.pMax.y) / 2 - extent.pMin.y;
+        bandTiles[NumaNodeForRow(yCenter, extent.Diagonal().y)].push_back(tile);
+    }
+    std::unique_ptr<std::atomic<size_t>[]> nextTile(new std::atomic<size_t>[nNodes]);
+    for (int i = 0; i < nNodes; ++i)
+        nextTile[i] = 0;
+
+    // Have each thread take tiles from its own node's band first
+    RunParallelLoop(RunningThreads(), [&](int64_t) {
+        int homeNode = ThreadNumaNode();
+        for (int i = 0; i < nNodes; ++i) {
+            int band = (homeNode + i) % nNodes;
+            size_t tile;
+            while ((tile = nextTile[band].fetch_add(1, std::memory_order_relaxed)) <
+                   bandTiles[band].size())
+                func(bandTiles[band][tile]);
+        }
+    });
+}
 
-    // Help out with parallel loop iterations in the current thread
-    while (!loop.Finished())
-        threadPool->WorkOrWait(&lock);
+std::vector<Bounds2i> HilbertCurveTiles(const Bounds2i &extent, int tileSize) {
+    CHECK_GT(tileSize, 0);
+    Vector2i diag = extent.Diagonal();
+    int nxTiles = (diag.x + tileSize - 1) / tileSize;
+    int nyTiles = (diag.y + tileSize - 1) / tileSize;
+
+    // Cover the grid of tiles with a row of square power-of-two blocks along
+    // its longer axis. A Hilbert curve over a block starts and ends at the
+    // corners of one of its sides, so the curves of successive blocks join
+    // up when that side is oriented along the row.
+    std::vector<Bounds2i> tiles;
+    tiles.reserve(std::max(0, nxTiles * nyTiles));
+    bool alongX = nxTiles >= nyTiles;
+    int blockSize = RoundUpPow2(std::max(1, std::min(nxTiles, nyTiles)));
+    int nBlocks = (std::max(nxTiles, nyTiles) + blockSize - 1) / blockSize;
+    for (int block = 0; block < nBlocks; ++block)
+        for (uint64_t d = 0; d < uint64_t(blockSize) * blockSize; ++d) {
+            // Find the tile at _d_ along the block's curve, skipping cells
+            // outside the grid
+            uint32_t u, v;
+            DecodeHilbert2(d, blockSize, &u, &v);
+            Point2i tile = alongX ? Point2i(block * blockSize + u, v)
+                                  : Point2i(v, block * blockSize + u);
+            if (tile.x >= nxTiles || tile.y >= nyTiles)
+                continue;
+
+            Point2i pMin = extent.pMin + tileSize * Vector2i(tile);
+            tiles.push_back(
+                Intersect(Bounds2i(pMin, pMin + Vector2i(tileSize, tileSize)), extent));
+        }
+    return tiles;
 }
 
 ///////////////////////////////////////////////////////////////////////////
@@ -370,15 +480,216 @@ int RunningThreads() {
     return threadPool ? (1 + threadPool->size()) : 1;
 }
 
-void ParallelInit(int nThreads) {
+int ThreadPoolIndex() {
+    return threadIndex;
+}
+
+// NUMA State
+static bool numaEnabled = false;
+// System ids of the NUMA nodes that have threads pinned to them
+static std::vector<int> numaNodeIds;
+// NUMA node of each thread in the pool, indexed by _threadIndex_
+static std::vector<int> threadNumaNodes;
+
+#ifdef PBRT_IS_LINUX
+// Values from <linux/mempolicy.h>
+static constexpr int MemPolicyDefault = 0, MemPolicyPreferred = 1,
+                     MemPolicyInterleave = 3;
+static constexpr unsigned MemPolicyMoveFlag = 1 << 1;
+// Size of the node masks passed to the kernel
+static constexpr int MaxNumaNodes = 1024;
+
+// Parses lists of ranges like "0-15,32-47" as used in sysfs.
+static std::vector<int> ParseSysfsList(const std::string &str) {
+    std::vector<int> values;
+    for (const std::string &range : SplitString(str, ',')) {
+        std::vector<int> bounds = SplitStringToInts(range, '-');
+        if (bounds.size() == 1)
+            values.push_back(bounds[0]);
+        else if (bounds.size() == 2)
+            for (int i = bounds[0]; i <= bounds[1]; ++i)
+                values.push_back(i);
+    }
+    return values;
+}
+
+static std::string ReadSysfsFile(const std::string &filename) {
+    std::ifstream in(filename);
+    std::string line;
+    std::getline(in, line);
+    return line;
+}
+
+// Returns pairs of (node id, cores) for the online NUMA nodes that have
+// cores this process may run on.
+static std::vector<std::pair<int, std::vector<int>>> GetNumaTopology() {
+    cpu_set_t allowed;
+    CPU_ZERO(&allowed);
+    if (sched_getaffinity(0, sizeof(allowed), &allowed) != 0)
+        return {};
+
+    std::vector<std::pair<int, std::vector<int>>> nodes;
+    for (int node : ParseSysfsList(ReadSysfsFile("/sys/devices/system/node/online"))) {
+        if (node < 0 || node >= MaxNumaNodes)
+            continue;
+        std::vector<int> cpus;
+        for (int cpu : ParseSysfsList(ReadSysfsFile(
+                 StringPrintf("/sys/devices/system/node/node%d/cpulist", node))))
+            if (cpu >= 0 && cpu < CPU_SETSIZE && CPU_ISSET(cpu, &allowed))
+                cpus.push_back(cpu);
+        if (!cpus.empty())
+            nodes.push_back(std::make_pair(node, std::move(cpus)));
+    }
+    return nodes;
+}
+
+static std::vector<unsigned long> NumaNodeMask(const std::vector<int> &nodeIds) {
+    constexpr int bitsPerWord = 8 * sizeof(unsigned long);
+    std::vector<unsigned long> mask(MaxNumaNodes / bitsPerWord, 0);
+    for (int id : nodeIds)
+        mask[id / bitsPerWord] |= 1ul << (id % bitsPerWord);
+    return mask;
+}
+#endif  // PBRT_IS_LINUX
+
+static void NumaInit(int nThreads) {
+#ifdef PBRT_IS_LINUX
+    std::vector<std::pair<int, std::vector<int>>> nodes = GetNumaTopology();
+    if (nodes.empty()) {
+        Warning("Unable to determine the NUMA topology from "
+                "/sys/devices/system/node. Ignoring --numa.");
+        return;
+    }
+
+    // Assign threads to cores, spreading them evenly over the nodes' cores
+    std::vector<int> cpus, cpuNodes;
+    for (size_t i = 0; i < nodes.size(); ++i)
+        for (int cpu : nodes[i].second) {
+            cpus.push_back(cpu);
+            cpuNodes.push_back(i);
+        }
+    std::vector<int> threadCpus(nThreads);
+    threadNumaNodes.resize(nThreads);
+    for (int i = 0; i < nThreads; ++i) {
+        int64_t c = int64_t(i) * cpus.size() / nThreads;
+        threadCpus[i] = cpus[c];
+        threadNumaNodes[i] = cpuNodes[c];
+    }
+    for (const auto &node : nodes)
+        numaNodeIds.push_back(node.first);
+
+    // Pin each of the pool's threads to its core
+    std::atomic<int> nFailed{0};
+    ForEachThread([&]() {
+        cpu_set_t cpuSet;
+        CPU_ZERO(&cpuSet);
+        CPU_SET(threadCpus[ThreadPoolIndex()], &cpuSet);
+        if (pthread_setaffinity_np(pthread_self(), sizeof(cpuSet), &cpuSet) != 0)
+            ++nFailed;
+    });
+    if (nFailed > 0)
+        Warning("Unable to pin %d of %d threads to cores.", nFailed.load(), nThreads);
+
+    numaEnabled = true;
+    LOG_VERBOSE("NUMA mode: %d threads on %d nodes", nThreads, numaNodeIds.size());
+#else
+    Warning("NUMA mode is only supported on Linux. Ignoring --numa.");
+#endif  // PBRT_IS_LINUX
+}
+
+void ParallelInit(int nThreads, bool numa) {
     CHECK(!threadPool);
     if (nThreads <= 0)
         nThreads = AvailableCores();
     threadPool = std::make_unique<ThreadPool>(nThreads);
+    threadIndex = 0;
+    if (numa)
+        NumaInit(nThreads);
 }
 
 void ParallelCleanup() {
+    if (numaEnabled) {
+        // Unpin the calling thread, which outlives the pool
+        SetNumaInterleavedAllocation(false);
+#ifdef PBRT_IS_LINUX
+        cpu_set_t cpuSet;
+        CPU_ZERO(&cpuSet);
+        for (int i = 0; i < CPU_SETSIZE; ++i)
+            CPU_SET(i, &cpuSet);
+        pthread_setaffinity_np(pthread_self(), sizeof(cpuSet), &cpuSet);
+#endif  // PBRT_IS_LINUX
+        numaEnabled = false;
+        numaNodeIds.clear();
+        threadNumaNodes.clear();
+    }
     threadPool.reset();
+    threadIndex = -1;
+}
+
+// NUMA Function Definitions
+bool NumaEnabled() {
+    return numaEnabled;
+}
+
+int NumaNodeCount() {
+    return numaEnabled ? numaNodeIds.size() : 1;
+}
+
+int ThreadNumaNode() {
+    if (!numaEnabled || threadIndex < 0)
+        return 0;
+    return threadNumaNodes[threadIndex];
+}
+
+int NumaNodeForRow(int row, int nRows) {
+    DCHECK(row >= 0 && row < nRows);
+    return int(int64_t(row) * NumaNodeCount() / nRows);
+}
+
+void SetNumaInterleavedAllocation(bool interleave) {
+#ifdef PBRT_IS_LINUX
+    if (NumaNodeCount() < 2)
+        return;
+    std::vector<unsigned long> mask = NumaNodeMask(numaNodeIds);
+    std::atomic<int> nFailed{0};
+    ForEachThread([&]() {
+        long result = interleave
+                          ? syscall(SYS_set_mempolicy, MemPolicyInterleave, mask.data(),
+                                    MaxNumaNodes + 1)
+                          : syscall(SYS_set_mempolicy, MemPolicyDefault, nullptr, 0);
+        if (result != 0)
+            ++nFailed;
+    });
+    if (nFailed > 0)
+        Warning("Unable to set NUMA memory policy: %s", ErrorString());
+#endif  // PBRT_IS_LINUX
+}
+
+void NumaPlaceImageRows(void *ptr, size_t rowBytes, int nRows) {
+#ifdef PBRT_IS_LINUX
+    int nNodes = NumaNodeCount();
+    if (nNodes < 2 || nRows < nNodes)
+        return;
+    uintptr_t pageSize = sysconf(_SC_PAGESIZE);
+    for (int node = 0; node < nNodes; ++node) {
+        // Find the page-aligned part of the node's rows and move it to the node
+        int64_t rowStart = (int64_t(node) * nRows + nNodes - 1) / nNodes;
+        int64_t rowEnd = (int64_t(node + 1) * nRows + nNodes - 1) / nNodes;
+        uintptr_t start = uintptr_t(ptr) + rowStart * rowBytes;
+        uintptr_t end = uintptr_t(ptr) + rowEnd * rowBytes;
+        start = (start + pageSize - 1) & ~(pageSize - 1);
+        end &= ~(pageSize - 1);
+        if (start >= end)
+            continue;
+        std::vector<unsigned long> mask = NumaNodeMask({numaNodeIds[node]});
+        if (syscall(SYS_mbind, start, end - start, MemPolicyPreferred, mask.data(),
+                    MaxNumaNodes + 1, MemPolicyMoveFlag) != 0) {
+            Warning("Unable to move image rows to NUMA node %d: %s", numaNodeIds[node],
+                    ErrorString());
+            return;
+        }
+    }
+#endif  // PBRT_IS_LINUX
 }
 
 void ForEachThread(std::function<void(void)> func) {
@@ -17,8 +17,9 @@
 #include <functional>
 #include <future>
 #include <initializer_list>
+#include <map>
+#include <memory>
 #include <mutex>
-#include <shared_mutex>
 #include <string>
 #include <thread>
 #include <type_traits>
@@ -26,78 +27,6 @@
 
 namespace pbrt {
 
-// ThreadLocal Definition
-template <typename T, int maxThreads = 256>
-class ThreadLocal {
-  public:
-    ThreadLocal() : hashTable(maxThreads), create([]() { return T(); }) {}
-    ThreadLocal(std::function<T(void)> &&c) : hashTable(maxThreads), create(c) {}
-
-    T &Get() {
-        std::thread::id tid = std::this_thread::get_id();
-        uint32_t hash = std::hash<std::thread::id>()(tid);
-        hash %= hashTable.size();
-        int step = 1;
-
-        mutex.lock_shared();
-        while (true) {
-            if (hashTable[hash] && hashTable[hash]->tid == tid) {
-                // Found it
-                T &threadLocal = hashTable[hash]->value;
-                mutex.unlock_shared();
-                return threadLocal;
-            } else if (!hashTable[hash]) {
-                mutex.unlock_shared();
-                T newItem = create();
-                mutex.lock();
-
-                if (hashTable[hash]) {
-                    // someone else got there first--keep looking, but now
-                    // with a writer lock.
-                    while (true) {
-                        hash += step;
-                        ++step;
-                        if (hash >= hashTable.size())
-                            hash %= hashTable.size();
-
-                        if (!hashTable[hash])
-                            break;
-                    }
-                }
-
-                hashTable[hash] = Entry{tid, std::move(newItem)};
-                T &threadLocal = hashTable[hash]->value;
-                mutex.unlock();
-                return threadLocal;
-            }
-
-            hash += step;
-            ++step;
-            if (hash >= hashTable.size())
-                hash %= hashTable.size();
-        }
-    }
-
-    template <typename F>
-    void ForAll(F &&func) {
-        mutex.lock();
-        for (auto &entry : hashTable) {
-            if (entry)
-                func(entry->value);
-        }
-        mutex.unlock();
-    }
-
-  private:
-    struct Entry {
-        std::thread::id tid;
-        T value;
-    };
-    std::shared_mutex mutex;
-    std::vector<pstd::optional<Entry>> hashTable;
-    std::function<T(void)> create;
-};
-
 // AtomicFloat Definition
 class AtomicFloat {
   public:
@@ -239,6 +168,11 @@ class Barrier {
 void ParallelFor(int64_t start, int64_t end, std::function<void(int64_t, int64_t)> func);
 void ParallelFor2D(const Bounds2i &extent, std::function<void(Bounds2i)> func);
 
+// Returns the tiles of size _tileSize_ that cover _extent_, ordered along a
+// Hilbert curve so that nearby tiles are mostly close together in the
+// returned order. Tiles at the upper edges of _extent_ are clipped to it.
+std::vector<Bounds2i> HilbertCurveTiles(const Bounds2i &extent, int tileSize);
+
 // Parallel Inline Functions
 inline void ParallelFor(int64_t start, int64_t end, std::function<void(int64_t)> func) {
     ParallelFor(start, end, [&func](int64_t start, int64_t end) {
@@ -254,39 +188,167 @@ inline void ParallelFor2D(const Bounds2i &extent, std::function<void(Point2i)> f
     });
 }
 
+// WorkStealingDeque Definition
+// Lock-free work-stealing deque of pointers, following Chase and Lev's
+// "Dynamic Circular Work-Stealing Deque" with the C11 memory orderings
+// given by Le et al. A single owner thread pushes and pops at the bottom
+// and any thread may steal from the top. Arrays that are replaced when the
+// deque grows are kept until it is destroyed, since thieves may still be
+// reading from them. Each item has a tag that thieves can test before
+// taking it, since the item itself may already have been taken and freed
+// by another thread.
+template <typename T>
+class WorkStealingDeque {
+  public:
+    // WorkStealingDeque Public Methods
+    explicit WorkStealingDeque(int64_t capacity = 256) {
+        CHECK(IsPowerOf2(capacity));
+        arrays.push_back(std::make_unique<Array>(capacity));
+        array.store(arrays.back().get(), std::memory_order_relaxed);
+    }
+
+    WorkStealingDeque(const WorkStealingDeque &) = delete;
+    WorkStealingDeque &operator=(const WorkStealingDeque &) = delete;
+
+    // Owner-only methods
+    void Push(T item, uint64_t tag = 0) {
+        int64_t b = bottom.load(std::memory_order_relaxed);
+        int64_t t = top.load(std::memory_order_acquire);
+        Array *a = array.load(std::memory_order_relaxed);
+        if (b - t > a->capacity - 1) {
+            // Grow the array, copying the items currently in the deque
+            arrays.push_back(std::make_unique<Array>(2 * a->capacity));
+            Array *newArray = arrays.back().get();
+            for (int64_t i = t; i < b; ++i)
+                newArray->Put(i, a->Get(i), a->GetTag(i));
+            array.store(newArray, std::memory_order_release);
+            a = newArray;
+        }
+        a->Put(b, item, tag);
+        std::atomic_thread_fence(std::memory_order_release);
+        bottom.store(b + 1, std::memory_order_relaxed);
+    }
+
+    // Returns the most recently pushed item, or _nullptr_ if the deque is
+    // empty.
+    T Pop() {
+        int64_t b = bottom.load(std::memory_order_relaxed) - 1;
+        Array *a = array.load(std::memory_order_relaxed);
+        bottom.store(b, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        int64_t t = top.load(std::memory_order_relaxed);
+        if (t > b) {
+            // Deque was empty
+            bottom.store(b + 1, std::memory_order_relaxed);
+            return nullptr;
+        }
+        T item = a->Get(b);
+        if (t == b) {
+            // Race against thieves for the last item
+            if (!top.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst,
+                                             std::memory_order_relaxed))
+                item = nullptr;
+            bottom.store(b + 1, std::memory_order_relaxed);
+        }
+        return item;
+    }
+
+    // Returns the least recently pushed item, or _nullptr_ if the deque is
+    // empty or another thread took the item first. May be called from any
+    // thread.
+    T Steal() {
+        return Steal([](uint64_t) { return true; });
+    }
+
+    // Like _Steal()_, but leaves the least recently pushed item in the deque
+    // and returns _nullptr_ if _pred_ returns false for its tag.
+    template <typename P>
+    T Steal(P pred) {
+        int64_t t = top.load(std::memory_order_acquire);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        int64_t b = bottom.load(std::memory_order_acquire);
+        if (t >= b)
+            return nullptr;
+        Array *a = array.load(std::memory_order_acquire);
+        // Like the item, the tag read here is only used if the CAS below
+        // succeeds, in which case the slot wasn't reused in the meantime.
+        if (!pred(a->GetTag(t)))
+            return nullptr;
+        T item = a->Get(t);
+        if (!top.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst,
+                                         std::memory_order_relaxed))
+            return nullptr;
+        return item;
+    }
+
+    // Only a hint if called concurrently with other methods.
+    bool Empty() const {
+        return bottom.load(std::memory_order_relaxed) <=
+               top.load(std::memory_order_relaxed);
+    }
+
+  private:
+    // WorkStealingDeque Private Members
+    struct Array {
+        explicit Array(int64_t capacity)
+            : capacity(capacity),
+              items(new std::atomic<T>[capacity]),
+              tags(new std::atomic<uint64_t>[capacity]) {}
+        T Get(int64_t i) const {
+            return items[i & (capacity - 1)].load(std::memory_order_relaxed);
+        }
+        uint64_t GetTag(int64_t i) const {
+            return tags[i & (capacity - 1)].load(std::memory_order_relaxed);
+        }
+        void Put(int64_t i, T item, uint64_t tag) {
+            items[i & (capacity - 1)].store(item, std::memory_order_relaxed);
+            tags[i & (capacity - 1)].store(tag, std::memory_order_relaxed);
+        }
+
+        int64_t capacity;
+        std::unique_ptr<std::atomic<T>[]> items;
+        std::unique_ptr<std::atomic<uint64_t>[]> tags;
+    };
+
+    // Keep _top_ and _bottom_ on separate cache lines: thieves only update
+    // _top_ and the owner mostly updates _bottom_.
+    alignas(64) std::atomic<int64_t> top{0};
+    alignas(64) std::atomic<int64_t> bottom{0};
+    std::atomic<Array *> array;
+    std::vector<std::unique_ptr<Array>> arrays;
+};
+
 // ParallelJob Definition
+// Unit of work run by the thread pool. Jobs are pushed onto the deque of
+// the thread that enqueues them and may be stolen by idle threads.
 class ParallelJob {
   public:
     // ParallelJob Public Methods
-    virtual ~ParallelJob() { DCHECK(removed); }
+    virtual ~ParallelJob() = default;
 
-    virtual bool HaveWork() const = 0;
-    virtual void RunStep(std::unique_lock<std::mutex> *lock) = 0;
-
-    bool Finished() const { return !HaveWork() && activeWorkers == 0; }
+    // Note: the thread pool doesn't access the job after calling _Run()_,
+    // so it may delete itself.
+    virtual void Run() = 0;
 
     virtual std::string ToString() const = 0;
 
-    virtual void Cleanup() {}
-
-    void RemoveFromJobList();
-    std::unique_lock<std::mutex> AddToJobList();
-
-  protected:
-    std::string BaseToString() const {
-        return StringPrintf("activeWorkers: %d removed: %s", activeWorkers, removed);
-    }
+    void Enqueue();
 
   private:
-    // ParallelJob Private Members
     friend class ThreadPool;
-    int activeWorkers = 0;
-    ParallelJob *prev = nullptr, *next = nullptr;
-    bool removed = false;
+    // Isolation region that the job was enqueued in; see _RunIsolated()_.
+    uint64_t isolation = 0;
 };
 
 bool DoParallelWork();
 
+// Runs _func_ on the calling thread. While it runs, the thread only helps
+// with parallel work that _func_ creates rather than running unrelated jobs
+// when it waits in a nested parallel loop, which can otherwise lead to
+// deadlock if such a job waits for a result that _func_ computes. Threads
+// that run jobs that _func_ creates are restricted in the same way.
+void RunIsolated(std::function<void(void)> func);
+
 // Future Definition
 template <typename T>
 class Future {
@@ -321,39 +383,123 @@ class AsyncJob : public ParallelJob {
   public:
     AsyncJob(std::function<T(void)> w) : work(std::move(w)) {}
 
-    bool HaveWork() const { return !started; }
-
-    void RunStep(std::unique_lock<std::mutex> *lock) {
-        // No need to stick around in the job list
-        RemoveFromJobList();
-        started = true;
-        lock->unlock();
-        DoWork();
+    void Run() {
+        work();
+        delete this;
     }
 
-    void DoWork() { work(); }
-
-    void Cleanup() { delete this; }
-
-    std::string ToString() const {
-        return StringPrintf("[ AsyncJob started: %s ]", started);
-    }
+    std::string ToString() const { return "[ AsyncJob ]"; }
 
     Future<T> GetFuture() { return work.get_future(); }
 
   private:
-    bool started = false;
     std::packaged_task<T(void)> work;
 };
 
 void ForEachThread(std::function<void(void)> func);
 
 // ParallelFunction Declarations
-void ParallelInit(int nThreads = -1);
+void ParallelInit(int nThreads = -1, bool numa = false);
 void ParallelCleanup();
 
 int AvailableCores();
 int RunningThreads();
+// Returns the calling thread's index in the thread pool, in
+// [0, RunningThreads()), or -1 if it isn't one of the pool's threads.
+int ThreadPoolIndex();
+
+// NUMA Function Declarations
+// When _ParallelInit()_ is called with _numa_ set, the pool's threads are
+// pinned to cores, spread evenly over the system's NUMA nodes, and
+// _ParallelFor2D()_ splits its extent into one horizontal band per node,
+// giving each thread tiles from its own node's band before it helps with
+// the others. These functions report the default single-node topology
+// otherwise.
+bool NumaEnabled();
+int NumaNodeCount();
+// Returns the NUMA node, in [0, NumaNodeCount()), of the core that the
+// calling thread is pinned to, or 0 for threads outside the pool.
+int ThreadNumaNode();
+// Returns the NUMA node whose _ParallelFor2D()_ band holds the given row
+// of an extent with _nRows_ rows.
+int NumaNodeForRow(int row, int nRows);
+// Sets whether memory allocated by the pool's threads is interleaved
+// across all NUMA nodes, which avoids having all of the read-mostly scene
+// data on the node of the thread that created it.
+void SetNumaInterleavedAllocation(bool interleave);
+// Moves the pages of an image with _nRows_ rows of _rowBytes_ each to the
+// nodes whose threads render the corresponding rows.
+void NumaPlaceImageRows(void *ptr, size_t rowBytes, int nRows);
+
+// ThreadLocal Definition
+// Per-thread values of type _T_, created by each thread on its first call to
+// _Get()_. Threads in the thread pool find their values in an array indexed
+// by _ThreadPoolIndex()_ without locking; other threads' values are stored
+// in a map protected by a mutex.
+template <typename T>
+class ThreadLocal {
+  public:
+    // ThreadLocal Public Methods
+    ThreadLocal() : ThreadLocal([]() { return T(); }) {}
+    ThreadLocal(std::function<T(void)> &&c)
+        : nSlots(RunningThreads()),
+          slots(new std::atomic<Entry *>[nSlots]),
+          create(std::move(c)) {
+        for (int i = 0; i < nSlots; ++i)
+            slots[i].store(nullptr, std::memory_order_relaxed);
+    }
+    ~ThreadLocal() {
+        for (int i = 0; i < nSlots; ++i)
+            delete slots[i].load(std::memory_order_relaxed);
+    }
+
+    ThreadLocal(const ThreadLocal &) = delete;
+    ThreadLocal &operator=(const ThreadLocal &) = delete;
+
+    T &Get() {
+        int index = ThreadPoolIndex();
+        if (index >= 0 && index < nSlots) {
+            // Only this thread sets its slot; the release store makes the
+            // new value visible to _ForAll()_.
+            Entry *entry = slots[index].load(std::memory_order_relaxed);
+            if (!entry) {
+                entry = new Entry{create()};
+                slots[index].store(entry, std::memory_order_release);
+            }
+            return entry->value;
+        }
+
+        // Find value for thread outside the thread pool
+        std::lock_guard<std::mutex> lock(mutex);
+        std::unique_ptr<Entry> &entry = otherThreads[std::this_thread::get_id()];
+        if (!entry)
+            entry.reset(new Entry{create()});
+        return entry->value;
+    }
+
+    template <typename F>
+    void ForAll(F &&func) {
+        for (int i = 0; i < nSlots; ++i)
+            if (Entry *entry = slots[i].load(std::memory_order_acquire))
+                func(entry->value);
+        std::lock_guard<std::mutex> lock(mutex);
+        for (auto &entry : otherThreads)
+            func(entry.second->value);
+    }
+
+  private:
+    // Align entries to cache lines so that threads' values don't share them
+    struct alignas(64) Entry {
+        T value;
+    };
+
+    // ThreadLocal Private Members
+    int nSlots;
+    std::unique_ptr<std::atomic<Entry *>[]> slots;
+    std::mutex mutex;
+    std::map<std::thread::id, std::unique_ptr<Entry>> otherThreads;
+    std::function<T(void)> create;
+};
 
 // Asynchronous Task Launch Function Definitions
 template <typename F, typename... Args>
@@ -362,13 +508,14 @@ inline auto RunAsync(F func, Args &&...args) {
     using R = typename std::invoke_result_t<F, Args...>;
 
     AsyncJob<R> *job = new AsyncJob<R>(std::move(fvoid));
-    std::unique_lock<std::mutex> lock;
+    // Get the future first; the job deletes itself after it runs.
+    Future<R> future = job->GetFuture();
     if (RunningThreads() == 1)
-        job->DoWork();
+        job->Run();
     else
-        lock = job->AddToJobList();
+        job->Enqueue();
 
-    return job->GetFuture();
+    return future;
 }
 
 }  // namespace pbrt
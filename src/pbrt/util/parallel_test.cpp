@@ -6,6 +6,8 @@
 #include <pbrt/pbrt.h>
 #include <pbrt/util/parallel.h>
 #include <atomic>
+#include <thread>
+#include <vector>
 
 using namespace pbrt;
 
@@ -44,3 +46,257 @@ TEST(Parallel, ForEachThread) {
     ForEachThread([&count] { --count; });
     EXPECT_EQ(0, count);
 }
+
+TEST(Parallel, ParallelFor2DCoverage) {
+    // Every pixel should be visited exactly once, including with extents
+    // that aren't a multiple of the tile size.
+    Bounds2i extent({-3, 5}, {97, 66});
+    std::vector<std::atomic<int>> visits(extent.Area());
+    ParallelFor2D(extent, [&](Bounds2i b) {
+        for (Point2i p : b) {
+            ASSERT_TRUE(Inside(p, extent));
+            Vector2i d = p - extent.pMin;
+            ++visits[d.y * extent.Diagonal().x + d.x];
+        }
+    });
+    for (const std::atomic<int> &v : visits)
+        EXPECT_EQ(1, v);
+}
+
+TEST(Parallel, HilbertCurveTiles) {
+    for (Bounds2i extent : {Bounds2i({0, 0}, {64, 64}), Bounds2i({-3, 5}, {97, 66}),
+                            Bounds2i({0, 0}, {1000, 3}), Bounds2i({2, 0}, {9, 700})})
+        for (int tileSize : {1, 4, 16}) {
+            // Tiles should cover the extent exactly once
+            std::vector<Bounds2i> tiles = HilbertCurveTiles(extent, tileSize);
+            std::vector<int> visits(extent.Area(), 0);
+            for (const Bounds2i &b : tiles) {
+                EXPECT_FALSE(b.IsEmpty());
+                for (Point2i p : b) {
+                    ASSERT_TRUE(Inside(p, extent));
+                    Vector2i d = p - extent.pMin;
+                    ++visits[d.y * extent.Diagonal().x + d.x];
+                }
+            }
+            for (int v : visits)
+                EXPECT_EQ(1, v);
+
+            if (extent == Bounds2i({0, 0}, {64, 64}))
+                // Successive tiles share an edge if none are skipped
+                for (size_t i = 1; i < tiles.size(); ++i) {
+                    Vector2i d = tiles[i].pMin - tiles[i - 1].pMin;
+                    EXPECT_EQ(tileSize, std::abs(d.x) + std::abs(d.y));
+                }
+        }
+}
+
+TEST(Parallel, NumaMode) {
+    // Restart the thread pool in NUMA mode; NUMA may not be available on
+    // the system running the test, in which case the pool runs as usual.
+    int nThreads = RunningThreads();
+    ParallelCleanup();
+    ParallelInit(nThreads, true);
+
+    int nNodes = NumaNodeCount();
+    EXPECT_GE(nNodes, 1);
+    std::vector<std::atomic<int>> nodeThreads(nNodes);
+    ForEachThread([&]() {
+        int node = ThreadNumaNode();
+        ASSERT_TRUE(node >= 0 && node < nNodes);
+        ++nodeThreads[node];
+    });
+    int total = 0;
+    for (const std::atomic<int> &n : nodeThreads)
+        total += n;
+    EXPECT_EQ(nThreads, total);
+
+    // Rows should be assigned to nodes in contiguous bands
+    for (int nRows : {1, 7, 1000})
+        for (int row = 1; row < nRows; ++row) {
+            int prev = NumaNodeForRow(row - 1, nRows), cur = NumaNodeForRow(row, nRows);
+            EXPECT_TRUE(cur == prev || cur == prev + 1);
+            EXPECT_LT(cur, nNodes);
+        }
+
+    Bounds2i extent({-3, 5}, {97, 66});
+    std::vector<std::atomic<int>> visits(extent.Area());
+    ParallelFor2D(extent, [&](Bounds2i b) {
+        for (Point2i p : b) {
+            ASSERT_TRUE(Inside(p, extent));
+            Vector2i d = p - extent.pMin;
+            ++visits[d.y * extent.Diagonal().x + d.x];
+        }
+    });
+    for (const std::atomic<int> &v : visits)
+        EXPECT_EQ(1, v);
+
+    ParallelCleanup();
+    EXPECT_FALSE(NumaEnabled());
+    ParallelInit(nThreads);
+}
+
+TEST(Parallel, Nested) {
+    std::atomic<int64_t> sum{0};
+    ParallelFor(0, 100, [&](int64_t i) {
+        ParallelFor(0, 100, [&](int64_t j) { sum += i * 100 + j; });
+    });
+    EXPECT_EQ(10000 * 9999 / 2, sum);
+}
+
+TEST(Parallel, RunAsync) {
+    std::vector<Future<int>> futures;
+    for (int i = 0; i < 100; ++i)
+        futures.push_back(RunAsync([](int v) { return v * v; }, i));
+    for (int i = 0; i < 100; ++i)
+        EXPECT_EQ(i * i, futures[i].Get());
+
+    // Asynchronous jobs that run parallel loops
+    Future<int64_t> f = RunAsync([]() {
+        std::atomic<int64_t> count{0};
+        ParallelFor(0, 1000, [&](int64_t) { ++count; });
+        return count.load();
+    });
+    EXPECT_EQ(1000, f.Get());
+}
+
+TEST(Parallel, RunIsolated) {
+    // Iterations of the outer loop must not be run by a thread while it is
+    // in an isolated region started by another iteration.
+    static thread_local bool inIsolatedRegion = false;
+    std::atomic<int> nOuter{0}, nInner{0};
+    ParallelFor(0, 64, [&](int64_t) {
+        EXPECT_FALSE(inIsolatedRegion);
+        ++nOuter;
+        RunIsolated([&]() {
+            inIsolatedRegion = true;
+            ParallelFor(0, 1000, [&](int64_t) { ++nInner; });
+            inIsolatedRegion = false;
+        });
+    });
+    EXPECT_EQ(64, nOuter);
+    EXPECT_EQ(64 * 1000, nInner);
+}
+
+TEST(Parallel, RunIsolatedStress) {
+    // Nest isolated regions and asynchronous jobs under load, so that
+    // threads frequently try to steal jobs that they can't run.
+    std::atomic<int64_t> sum{0}, expected{0};
+    for (int rep = 0; rep < 10; ++rep)
+        ParallelFor(0, 256, [&](int64_t i) {
+            Future<int64_t> f = RunAsync([i]() { return i; });
+            expected += i;
+            RunIsolated([&]() {
+                std::vector<Future<int64_t>> futures;
+                for (int j = 0; j < 4; ++j)
+                    futures.push_back(RunAsync([&sum, j]() {
+                        ParallelFor(0, 64, [&](int64_t k) { sum += k; });
+                        return int64_t(j);
+                    }));
+                ParallelFor(0, 16, [&](int64_t) {
+                    RunIsolated([&]() { ParallelFor(0, 8, [&](int64_t) { ++sum; }); });
+                });
+                for (int j = 0; j < 4; ++j)
+                    sum += futures[j].Get();
+                expected += 4 * 64 * 63 / 2 + 16 * 8 + 6;
+            });
+            sum += f.Get();
+        });
+    EXPECT_EQ(expected, sum);
+}
+
+TEST(WorkStealingDeque, Owner) {
+    WorkStealingDeque<int *> deque(4);
+    EXPECT_TRUE(deque.Empty());
+    EXPECT_EQ(nullptr, deque.Pop());
+    EXPECT_EQ(nullptr, deque.Steal());
+
+    // Push enough items to grow the deque; the owner pops them in LIFO
+    // order and thieves steal them in FIFO order.
+    std::vector<int> values(100);
+    for (int &v : values)
+        deque.Push(&v);
+    EXPECT_FALSE(deque.Empty());
+    EXPECT_EQ(&values[0], deque.Steal());
+    EXPECT_EQ(&values[99], deque.Pop());
+    EXPECT_EQ(&values[1], deque.Steal());
+    for (int i = 98; i >= 2; --i)
+        EXPECT_EQ(&values[i], deque.Pop());
+    EXPECT_TRUE(deque.Empty());
+    EXPECT_EQ(nullptr, deque.Pop());
+}
+
+TEST(WorkStealingDeque, Tags) {
+    // Items are only stolen if the predicate accepts their tags.
+    WorkStealingDeque<int *> deque(4);
+    int a, b;
+    deque.Push(&a, 1);
+    deque.Push(&b, 2);
+    EXPECT_EQ(nullptr, deque.Steal([](uint64_t tag) { return tag == 2; }));
+    EXPECT_EQ(&a, deque.Steal([](uint64_t tag) { return tag == 1; }));
+    EXPECT_EQ(&b, deque.Steal([](uint64_t tag) { return tag == 2; }));
+    EXPECT_TRUE(deque.Empty());
+}
+
+TEST(WorkStealingDeque, Concurrent) {
+    // The owner pushes and pops items while other threads steal them; each
+    // item should be taken exactly once.
+    constexpr int nItems = 200000, nThieves = 3;
+    std::vector<int> items(nItems);
+    std::vector<std::atomic<int>> taken(nItems);
+    WorkStealingDeque<int *> deque(16);
+    std::atomic<bool> done{false};
+
+    auto take = [&](int *item) { ++taken[item - items.data()]; };
+    std::vector<std::thread> thieves;
+    for (int i = 0; i < nThieves; ++i)
+        thieves.push_back(std::thread([&]() {
+            while (!done)
+                if (int *item = deque.Steal())
+                    take(item);
+        }));
+
+    for (int i = 0; i < nItems; ++i) {
+        deque.Push(&items[i]);
+        if (i % 3 == 0)
+            if (int *item = deque.Pop())
+                take(item);
+    }
+    while (int *item = deque.Pop())
+        take(item);
+    done = true;
+    for (std::thread &thread : thieves)
+        thread.join();
+
+    for (const std::atomic<int> &t : taken)
+        EXPECT_EQ(1, t);
+}
+
+TEST(ThreadLocal, Basics) {
+    std::atomic<int> nCreated{0};
+    ThreadLocal<int64_t> sums([&]() {
+        ++nCreated;
+        return int64_t(0);
+    });
+    ParallelFor(0, 10000, [&](int64_t i) { sums.Get() += i; });
+
+    // Threads outside the thread pool get their own values, too
+    std::vector<std::thread> threads;
+    for (int i = 0; i < 4; ++i)
+        threads.push_back(std::thread([&]() {
+            int64_t &sum = sums.Get();
+            EXPECT_EQ(&sum, &sums.Get());
+            sum += 1000;
+        }));
+    for (std::thread &thread : threads)
+        thread.join();
+
+    int64_t total = 0;
+    int nValues = 0;
+    sums.ForAll([&](int64_t v) {
+        total += v;
+        ++nValues;
+    });
+    EXPECT_EQ(10000 * 9999 / 2 + 4 * 1000, total);
+    EXPECT_EQ(nCreated, nValues);
+    EXPECT_LE(nValues, RunningThreads() + 4);
+}
@@ -478,6 +478,13 @@ template <typename Float = Float>
 class VarianceEstimator {
   public:
     // VarianceEstimator Public Methods
+    VarianceEstimator() = default;
+    // Initializes the estimator with the statistics of _n_ values, as
+    // returned by _Mean()_, _Variance()_, and _Count()_.
+    PBRT_CPU_GPU
+    VarianceEstimator(Float mean, Float variance, int64_t n)
+        : mean(mean), S(n > 1 ? variance * (n - 1) : 0), n(n) {}
+
     PBRT_CPU_GPU
     void Add(Float x) {
         ++n;
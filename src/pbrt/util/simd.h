@@ -0,0 +1,415 @@
+// pbrt is Copyright(c) 1998-2020 Matt Pharr, Wenzel Jakob, and Greg Humphreys.
+// The pbrt source code is licensed under the Apache License, Version 2.0.
+// SPDX: Apache-2.0
+
+#ifndef PBRT_UTIL_SIMD_H
+#define PBRT_UTIL_SIMD_H
+
+#include <pbrt/pbrt.h>
+
+#include <pbrt/util/pstd.h>
+
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+
+// Only use SIMD intrinsics in host code; device code always takes the
+// portable path below.
+#if !defined(PBRT_IS_GPU_CODE)
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define PBRT_HAS_SSE
+#include <immintrin.h>
+#endif
+#if defined(PBRT_HAS_SSE) && defined(__AVX__)
+#define PBRT_HAS_AVX
+#endif
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+#define PBRT_HAS_NEON
+#include <arm_neon.h>
+#endif
+#endif  // !PBRT_IS_GPU_CODE
+
+namespace pbrt {
+
+// SIMDFloat Definition
+// N-wide vector of 32-bit floats. The generic version is a plain loop
+// over an array that the compiler is free to vectorize; the 4- and 8-wide
+// specializations below map directly to SSE/NEON and AVX registers when
+// they are available.
+template <int N>
+class SIMDFloat {
+  public:
+    // SIMDFloat Public Methods
+    SIMDFloat() = default;
+    PBRT_CPU_GPU
+    explicit SIMDFloat(float f) {
+        for (int i = 0; i < N; ++i)
+            v[i] = f;
+    }
+
+    PBRT_CPU_GPU
+    static SIMDFloat Load(const float *p) {
+        SIMDFloat r;
+        for (int i = 0; i < N; ++i)
+            r.v[i] = p[i];
+        return r;
+    }
+    // Converts _N_ unsigned bytes to floats.
+    PBRT_CPU_GPU
+    static SIMDFloat LoadBytes(const uint8_t *p) {
+        SIMDFloat r;
+        for (int i = 0; i < N; ++i)
+            r.v[i] = p[i];
+        return r;
+    }
+    PBRT_CPU_GPU
+    void Store(float *p) const {
+        for (int i = 0; i < N; ++i)
+            p[i] = v[i];
+    }
+
+    PBRT_CPU_GPU
+    float operator[](int i) const { return v[i]; }
+
+    PBRT_CPU_GPU
+    SIMDFloat operator+(SIMDFloat b) const {
+        SIMDFloat r;
+        for (int i = 0; i < N; ++i)
+            r.v[i] = v[i] + b.v[i];
+        return r;
+    }
+    PBRT_CPU_GPU
+    SIMDFloat operator-(SIMDFloat b) const {
+        SIMDFloat r;
+        for (int i = 0; i < N; ++i)
+            r.v[i] = v[i] - b.v[i];
+        return r;
+    }
+    PBRT_CPU_GPU
+    SIMDFloat operator*(SIMDFloat b) const {
+        SIMDFloat r;
+        for (int i = 0; i < N; ++i)
+            r.v[i] = v[i] * b.v[i];
+        return r;
+    }
+    PBRT_CPU_GPU
+    SIMDFloat operator/(SIMDFloat b) const {
+        SIMDFloat r;
+        for (int i = 0; i < N; ++i)
+            r.v[i] = v[i] / b.v[i];
+        return r;
+    }
+    PBRT_CPU_GPU
+    SIMDFloat operator-() const {
+        SIMDFloat r;
+        for (int i = 0; i < N; ++i)
+            r.v[i] = -v[i];
+        return r;
+    }
+
+    // Returns a * b + c, with a single rounding where the hardware
+    // supports fused multiply-add.
+    PBRT_CPU_GPU
+    friend SIMDFloat FMA(SIMDFloat a, SIMDFloat b, SIMDFloat c) {
+        SIMDFloat r;
+        for (int i = 0; i < N; ++i)
+            r.v[i] = std::fma(a.v[i], b.v[i], c.v[i]);
+        return r;
+    }
+    PBRT_CPU_GPU
+    friend SIMDFloat Sqrt(SIMDFloat a) {
+        SIMDFloat r;
+        for (int i = 0; i < N; ++i)
+            r.v[i] = std::sqrt(a.v[i]);
+        return r;
+    }
+    // Returns a / b, or zero where b is zero.
+    PBRT_CPU_GPU
+    friend SIMDFloat SafeDiv(SIMDFloat a, SIMDFloat b) {
+        SIMDFloat r;
+        for (int i = 0; i < N; ++i)
+            r.v[i] = (b.v[i] != 0) ? a.v[i] / b.v[i] : 0.f;
+        return r;
+    }
+
+    // Note: as with the SSE instructions, _Min()_ and _Max()_ return the
+    // second operand if either is NaN.
+    PBRT_CPU_GPU
+    friend SIMDFloat Min(SIMDFloat a, SIMDFloat b) {
+        SIMDFloat r;
+        for (int i = 0; i < N; ++i)
+            r.v[i] = (a.v[i] < b.v[i]) ? a.v[i] : b.v[i];
+        return r;
+    }
+    PBRT_CPU_GPU
+    friend SIMDFloat Max(SIMDFloat a, SIMDFloat b) {
+        SIMDFloat r;
+        for (int i = 0; i < N; ++i)
+            r.v[i] = (a.v[i] > b.v[i]) ? a.v[i] : b.v[i];
+        return r;
+    }
+
+    PBRT_CPU_GPU
+    friend SIMDFloat Abs(SIMDFloat a) {
+        SIMDFloat r;
+        for (int i = 0; i < N; ++i)
+            r.v[i] = (a.v[i] < 0) ? -a.v[i] : a.v[i];
+        return r;
+    }
+
+    // Returns a bitmask with the _i_th bit set if a[i] <= b[i].
+    PBRT_CPU_GPU
+    friend uint32_t CompareLEMask(SIMDFloat a, SIMDFloat b) {
+        uint32_t mask = 0;
+        for (int i = 0; i < N; ++i)
+            mask |= uint32_t(a.v[i] <= b.v[i]) << i;
+        return mask;
+    }
+    // Returns a bitmask with the _i_th bit set if a[i] != b[i], which
+    // includes the case of either being NaN.
+    PBRT_CPU_GPU
+    friend uint32_t CompareNEMask(SIMDFloat a, SIMDFloat b) {
+        uint32_t mask = 0;
+        for (int i = 0; i < N; ++i)
+            mask |= uint32_t(a.v[i] != b.v[i]) << i;
+        return mask;
+    }
+
+  private:
+    pstd::array<float, N> v;
+};
+
+#if defined(PBRT_HAS_SSE)
+template <>
+class SIMDFloat<4> {
+  public:
+    SIMDFloat() = default;
+    explicit SIMDFloat(float f) : v(_mm_set1_ps(f)) {}
+    explicit SIMDFloat(__m128 v) : v(v) {}
+
+    static SIMDFloat Load(const float *p) { return SIMDFloat(_mm_loadu_ps(p)); }
+    static SIMDFloat LoadBytes(const uint8_t *p) {
+        int32_t bytes;
+        std::memcpy(&bytes, p, sizeof(bytes));
+        // Zero-extend bytes to 32-bit integers before conversion
+        __m128i zero = _mm_setzero_si128();
+        __m128i i = _mm_unpacklo_epi8(_mm_cvtsi32_si128(bytes), zero);
+        return SIMDFloat(_mm_cvtepi32_ps(_mm_unpacklo_epi16(i, zero)));
+    }
+    void Store(float *p) const { _mm_storeu_ps(p, v); }
+
+    float operator[](int i) const {
+        alignas(16) float f[4];
+        _mm_store_ps(f, v);
+        return f[i];
+    }
+
+    SIMDFloat operator+(SIMDFloat b) const { return SIMDFloat(_mm_add_ps(v, b.v)); }
+    SIMDFloat operator-(SIMDFloat b) const { return SIMDFloat(_mm_sub_ps(v, b.v)); }
+    SIMDFloat operator*(SIMDFloat b) const { return SIMDFloat(_mm_mul_ps(v, b.v)); }
+    SIMDFloat operator/(SIMDFloat b) const { return SIMDFloat(_mm_div_ps(v, b.v)); }
+    SIMDFloat operator-() const { return SIMDFloat(_mm_xor_ps(v, _mm_set1_ps(-0.f))); }
+
+    friend SIMDFloat FMA(SIMDFloat a, SIMDFloat b, SIMDFloat c) {
+#if defined(__FMA__)
+        return SIMDFloat(_mm_fmadd_ps(a.v, b.v, c.v));
+#else
+        return SIMDFloat(_mm_add_ps(_mm_mul_ps(a.v, b.v), c.v));
+#endif
+    }
+    friend SIMDFloat Sqrt(SIMDFloat a) { return SIMDFloat(_mm_sqrt_ps(a.v)); }
+    friend SIMDFloat SafeDiv(SIMDFloat a, SIMDFloat b) {
+        __m128 nonzero = _mm_cmpneq_ps(b.v, _mm_setzero_ps());
+        return SIMDFloat(_mm_and_ps(_mm_div_ps(a.v, b.v), nonzero));
+    }
+
+    friend SIMDFloat Min(SIMDFloat a, SIMDFloat b) {
+        return SIMDFloat(_mm_min_ps(a.v, b.v));
+    }
+    friend SIMDFloat Max(SIMDFloat a, SIMDFloat b) {
+        return SIMDFloat(_mm_max_ps(a.v, b.v));
+    }
+    friend SIMDFloat Abs(SIMDFloat a) {
+        return SIMDFloat(_mm_andnot_ps(_mm_set1_ps(-0.f), a.v));
+    }
+    friend uint32_t CompareLEMask(SIMDFloat a, SIMDFloat b) {
+        return _mm_movemask_ps(_mm_cmple_ps(a.v, b.v));
+    }
+    friend uint32_t CompareNEMask(SIMDFloat a, SIMDFloat b) {
+        return _mm_movemask_ps(_mm_cmpneq_ps(a.v, b.v));
+    }
+
+  private:
+    __m128 v;
+};
+#elif defined(PBRT_HAS_NEON)
+template <>
+class SIMDFloat<4> {
+  public:
+    SIMDFloat() = default;
+    explicit SIMDFloat(float f) : v(vdupq_n_f32(f)) {}
+    explicit SIMDFloat(float32x4_t v) : v(v) {}
+
+    static SIMDFloat Load(const float *p) { return SIMDFloat(vld1q_f32(p)); }
+    static SIMDFloat LoadBytes(const uint8_t *p) {
+        uint32_t bytes;
+        std::memcpy(&bytes, p, sizeof(bytes));
+        uint16x4_t i = vget_low_u16(vmovl_u8(vreinterpret_u8_u32(vdup_n_u32(bytes))));
+        return SIMDFloat(vcvtq_f32_u32(vmovl_u16(i)));
+    }
+    void Store(float *p) const { vst1q_f32(p, v); }
+
+    float operator[](int i) const {
+        float f[4];
+        vst1q_f32(f, v);
+        return f[i];
+    }
+
+    SIMDFloat operator+(SIMDFloat b) const { return SIMDFloat(vaddq_f32(v, b.v)); }
+    SIMDFloat operator-(SIMDFloat b) const { return SIMDFloat(vsubq_f32(v, b.v)); }
+    SIMDFloat operator*(SIMDFloat b) const { return SIMDFloat(vmulq_f32(v, b.v)); }
+    SIMDFloat operator/(SIMDFloat b) const {
+#if defined(__aarch64__)
+        return SIMDFloat(vdivq_f32(v, b.v));
+#else
+        float fa[4], fb[4];
+        vst1q_f32(fa, v);
+        vst1q_f32(fb, b.v);
+        for (int i = 0; i < 4; ++i)
+            fa[i] /= fb[i];
+        return SIMDFloat(vld1q_f32(fa));
+#endif
+    }
+    SIMDFloat operator-() const { return SIMDFloat(vnegq_f32(v)); }
+
+    friend SIMDFloat FMA(SIMDFloat a, SIMDFloat b, SIMDFloat c) {
+#if defined(__aarch64__)
+        return SIMDFloat(vfmaq_f32(c.v, a.v, b.v));
+#else
+        return SIMDFloat(vmlaq_f32(c.v, a.v, b.v));
+#endif
+    }
+    friend SIMDFloat Sqrt(SIMDFloat a) {
+#if defined(__aarch64__)
+        return SIMDFloat(vsqrtq_f32(a.v));
+#else
+        float f[4];
+        vst1q_f32(f, a.v);
+        for (int i = 0; i < 4; ++i)
+            f[i] = std::sqrt(f[i]);
+        return SIMDFloat(vld1q_f32(f));
+#endif
+    }
+    friend SIMDFloat SafeDiv(SIMDFloat a, SIMDFloat b) {
+        uint32x4_t zero = vceqq_f32(b.v, vdupq_n_f32(0));
+        uint32x4_t q = vreinterpretq_u32_f32((a / b).v);
+        return SIMDFloat(vreinterpretq_f32_u32(vbicq_u32(q, zero)));
+    }
+
+    // Match the SSE NaN semantics: return _b_ unless the comparison holds.
+    friend SIMDFloat Min(SIMDFloat a, SIMDFloat b) {
+        return SIMDFloat(vbslq_f32(vcltq_f32(a.v, b.v), a.v, b.v));
+    }
+    friend SIMDFloat Max(SIMDFloat a, SIMDFloat b) {
+        return SIMDFloat(vbslq_f32(vcgtq_f32(a.v, b.v), a.v, b.v));
+    }
+    friend SIMDFloat Abs(SIMDFloat a) { return SIMDFloat(vabsq_f32(a.v)); }
+    friend uint32_t CompareLEMask(SIMDFloat a, SIMDFloat b) {
+        const uint32x4_t bits = {1, 2, 4, 8};
+        uint32x4_t m = vandq_u32(vcleq_f32(a.v, b.v), bits);
+#if defined(__aarch64__)
+        return vaddvq_u32(m);
+#else
+        uint32x2_t s = vadd_u32(vget_low_u32(m), vget_high_u32(m));
+        return vget_lane_u32(vpadd_u32(s, s), 0);
+#endif
+    }
+    friend uint32_t CompareNEMask(SIMDFloat a, SIMDFloat b) {
+        const uint32x4_t bits = {1, 2, 4, 8};
+        uint32x4_t m = vandq_u32(vmvnq_u32(vceqq_f32(a.v, b.v)), bits);
+#if defined(__aarch64__)
+        return vaddvq_u32(m);
+#else
+        uint32x2_t s = vadd_u32(vget_low_u32(m), vget_high_u32(m));
+        return vget_lane_u32(vpadd_u32(s, s), 0);
+#endif
+    }
+
+  private:
+    float32x4_t v;
+};
+#endif
+
+#if defined(PBRT_HAS_AVX)
+template <>
+class SIMDFloat<8> {
+  public:
+    SIMDFloat() = default;
+    explicit SIMDFloat(float f) : v(_mm256_set1_ps(f)) {}
+    explicit SIMDFloat(__m256 v) : v(v) {}
+
+    static SIMDFloat Load(const float *p) { return SIMDFloat(_mm256_loadu_ps(p)); }
+    static SIMDFloat LoadBytes(const uint8_t *p) {
+        int64_t bytes;
+        std::memcpy(&bytes, p, sizeof(bytes));
+        // Zero-extend bytes to 32-bit integers in two halves; AVX doesn't
+        // provide 256-bit integer unpacking.
+        __m128i zero = _mm_setzero_si128();
+        __m128i i = _mm_unpacklo_epi8(_mm_cvtsi64_si128(bytes), zero);
+        __m128 lo = _mm_cvtepi32_ps(_mm_unpacklo_epi16(i, zero));
+        __m128 hi = _mm_cvtepi32_ps(_mm_unpackhi_epi16(i, zero));
+        return SIMDFloat(_mm256_insertf128_ps(_mm256_castps128_ps256(lo), hi, 1));
+    }
+    void Store(float *p) const { _mm256_storeu_ps(p, v); }
+
+    float operator[](int i) const {
+        alignas(32) float f[8];
+        _mm256_store_ps(f, v);
+        return f[i];
+    }
+
+    SIMDFloat operator+(SIMDFloat b) const { return SIMDFloat(_mm256_add_ps(v, b.v)); }
+    SIMDFloat operator-(SIMDFloat b) const { return SIMDFloat(_mm256_sub_ps(v, b.v)); }
+    SIMDFloat operator*(SIMDFloat b) const { return SIMDFloat(_mm256_mul_ps(v, b.v)); }
+    SIMDFloat operator/(SIMDFloat b) const { return SIMDFloat(_mm256_div_ps(v, b.v)); }
+    SIMDFloat operator-() const {
+        return SIMDFloat(_mm256_xor_ps(v, _mm256_set1_ps(-0.f)));
+    }
+
+    friend SIMDFloat FMA(SIMDFloat a, SIMDFloat b, SIMDFloat c) {
+#if defined(__FMA__)
+        return SIMDFloat(_mm256_fmadd_ps(a.v, b.v, c.v));
+#else
+        return SIMDFloat(_mm256_add_ps(_mm256_mul_ps(a.v, b.v), c.v));
+#endif
+    }
+    friend SIMDFloat Sqrt(SIMDFloat a) { return SIMDFloat(_mm256_sqrt_ps(a.v)); }
+    friend SIMDFloat SafeDiv(SIMDFloat a, SIMDFloat b) {
+        __m256 nonzero = _mm256_cmp_ps(b.v, _mm256_setzero_ps(), _CMP_NEQ_UQ);
+        return SIMDFloat(_mm256_and_ps(_mm256_div_ps(a.v, b.v), nonzero));
+    }
+
+    friend SIMDFloat Min(SIMDFloat a, SIMDFloat b) {
+        return SIMDFloat(_mm256_min_ps(a.v, b.v));
+    }
+    friend SIMDFloat Max(SIMDFloat a, SIMDFloat b) {
+        return SIMDFloat(_mm256_max_ps(a.v, b.v));
+    }
+    friend SIMDFloat Abs(SIMDFloat a) {
+        return SIMDFloat(_mm256_andnot_ps(_mm256_set1_ps(-0.f), a.v));
+    }
+    friend uint32_t CompareLEMask(SIMDFloat a, SIMDFloat b) {
+        return _mm256_movemask_ps(_mm256_cmp_ps(a.v, b.v, _CMP_LE_OQ));
+    }
+    friend uint32_t CompareNEMask(SIMDFloat a, SIMDFloat b) {
+        return _mm256_movemask_ps(_mm256_cmp_ps(a.v, b.v, _CMP_NEQ_UQ));
+    }
+
+  private:
+    __m256 v;
+};
+#endif
+
+}  // namespace pbrt
+
+#endif  // PBRT_UTIL_SIMD_H
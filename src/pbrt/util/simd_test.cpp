@@ -0,0 +1,137 @@
+// pbrt is Copyright(c) 1998-2020 Matt Pharr, Wenzel Jakob, and Greg Humphreys.
+// The pbrt source code is licensed under the Apache License, Version 2.0.
+// SPDX: Apache-2.0
+
+#include <gtest/gtest.h>
+
+#include <pbrt/pbrt.h>
+#include <pbrt/util/rng.h>
+#include <pbrt/util/simd.h>
+
+#include <cmath>
+#include <limits>
+
+using namespace pbrt;
+
+template <int N>
+static void TestArithmetic() {
+    RNG rng;
+    for (int iter = 0; iter < 100; ++iter) {
+        float a[N], b[N];
+        for (int i = 0; i < N; ++i) {
+            a[i] = rng.Uniform<float>() * 20 - 10;
+            b[i] = rng.Uniform<float>() * 20 - 10;
+        }
+        // Make sure that equal values are also compared
+        b[0] = a[0];
+
+        SIMDFloat<N> va = SIMDFloat<N>::Load(a), vb = SIMDFloat<N>::Load(b);
+        SIMDFloat<N> sum = va + vb, diff = va - vb, prod = va * vb, quot = va / vb;
+        SIMDFloat<N> vmin = Min(va, vb), vmax = Max(va, vb), vabs = Abs(va);
+        uint32_t leMask = CompareLEMask(va, vb);
+        float stored[N];
+        sum.Store(stored);
+        for (int i = 0; i < N; ++i) {
+            EXPECT_EQ(a[i] + b[i], sum[i]);
+            EXPECT_EQ(a[i] + b[i], stored[i]);
+            EXPECT_EQ(a[i] - b[i], diff[i]);
+            EXPECT_EQ(a[i] * b[i], prod[i]);
+            EXPECT_EQ(a[i] / b[i], quot[i]);
+            EXPECT_EQ(std::min(a[i], b[i]), vmin[i]);
+            EXPECT_EQ(std::max(a[i], b[i]), vmax[i]);
+            EXPECT_EQ(std::abs(a[i]), vabs[i]);
+            EXPECT_EQ(a[i] <= b[i], (leMask & (1u << i)) != 0);
+        }
+        EXPECT_EQ(0u, leMask >> N);
+    }
+}
+
+TEST(SIMDFloat, Arithmetic4) {
+    TestArithmetic<4>();
+}
+
+TEST(SIMDFloat, Arithmetic8) {
+    TestArithmetic<8>();
+}
+
+TEST(SIMDFloat, Arithmetic3) {
+    // Widths without a specialization use the portable implementation.
+    TestArithmetic<3>();
+}
+
+template <int N>
+static void TestFunctions() {
+    RNG rng;
+    for (int iter = 0; iter < 100; ++iter) {
+        float a[N], b[N], c[N];
+        for (int i = 0; i < N; ++i) {
+            a[i] = rng.Uniform<float>() * 20 - 10;
+            b[i] = (i & 1) ? 0.f : rng.Uniform<float>() * 20 - 10;
+            c[i] = rng.Uniform<float>() * 20 - 10;
+        }
+        a[0] = 0;
+
+        SIMDFloat<N> va = SIMDFloat<N>::Load(a), vb = SIMDFloat<N>::Load(b),
+                     vc = SIMDFloat<N>::Load(c);
+        SIMDFloat<N> neg = -va, fma = FMA(va, vb, vc), sqrt = Sqrt(Abs(vc));
+        SIMDFloat<N> safeDiv = SafeDiv(va, vb);
+        uint32_t neMask = CompareNEMask(va, vb);
+        for (int i = 0; i < N; ++i) {
+            EXPECT_EQ(-a[i], neg[i]);
+            EXPECT_EQ(std::signbit(-a[i]), std::signbit(neg[i]));
+            // FMA may or may not be fused, depending on the hardware
+            EXPECT_NEAR(std::fma(a[i], b[i], c[i]), fma[i], 1e-5f);
+            EXPECT_EQ(std::sqrt(std::abs(c[i])), sqrt[i]);
+            EXPECT_EQ(b[i] != 0 ? a[i] / b[i] : 0.f, safeDiv[i]);
+            EXPECT_EQ(a[i] != b[i], (neMask & (1u << i)) != 0);
+        }
+        EXPECT_EQ(0u, neMask >> N);
+    }
+
+    // NaN compares unequal to everything, including itself
+    SIMDFloat<N> vnan(std::numeric_limits<float>::quiet_NaN());
+    EXPECT_EQ((1u << N) - 1, CompareNEMask(vnan, vnan));
+    EXPECT_EQ(0u, CompareNEMask(SIMDFloat<N>(1.f), SIMDFloat<N>(1.f)));
+}
+
+TEST(SIMDFloat, Functions) {
+    TestFunctions<3>();
+    TestFunctions<4>();
+    TestFunctions<8>();
+}
+
+template <int N>
+static void TestNaN() {
+    float nan = std::numeric_limits<float>::quiet_NaN();
+    SIMDFloat<N> vnan(nan), one(1.f);
+    // Min() and Max() return the second operand if either is NaN.
+    for (int i = 0; i < N; ++i) {
+        EXPECT_EQ(1.f, Min(vnan, one)[i]);
+        EXPECT_EQ(1.f, Max(vnan, one)[i]);
+        EXPECT_TRUE(std::isnan(Min(one, vnan)[i]));
+    }
+    EXPECT_EQ(0u, CompareLEMask(vnan, one));
+    EXPECT_EQ(0u, CompareLEMask(one, vnan));
+}
+
+TEST(SIMDFloat, NaN) {
+    TestNaN<3>();
+    TestNaN<4>();
+    TestNaN<8>();
+}
+
+template <int N>
+static void TestLoadBytes() {
+    uint8_t bytes[N];
+    for (int i = 0; i < N; ++i)
+        bytes[i] = (i * 97 + 255) & 0xff;
+    SIMDFloat<N> v = SIMDFloat<N>::LoadBytes(bytes);
+    for (int i = 0; i < N; ++i)
+        EXPECT_EQ(float(bytes[i]), v[i]);
+}
+
+TEST(SIMDFloat, LoadBytes) {
+    TestLoadBytes<2>();
+    TestLoadBytes<4>();
+    TestLoadBytes<8>();
+}
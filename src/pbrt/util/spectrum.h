@@ -17,6 +17,7 @@
 #include <pbrt/util/math.h>
 #include <pbrt/util/pstd.h>
 #include <pbrt/util/sampling.h>
+#include <pbrt/util/simd.h>
 #include <pbrt/util/taggedptr.h>
 
 #include <cmath>
@@ -85,6 +86,17 @@ Float SpectrumToPhotometric(Spectrum s);
 Float SpectrumToPhotometric(Spectrum s);
 XYZ SpectrumToXYZ(Spectrum s);
 
+// In host code with 32-bit _Float_s, _SampledSpectrum_ arithmetic is done
+// using _SIMDFloat_, which maps the four spectral samples to SSE or NEON
+// registers. Arithmetic results are the same as with the scalar loops used
+// otherwise. RGB spectra are sampled using _SIMDFloat_ _FMA()_, though,
+// which is only fused like the scalar _std::fma()_ when the target has
+// fused multiply-add instructions (e.g., x86 with -mfma or -march=native);
+// otherwise, sampled values may differ in the last bits.
+#if !defined(PBRT_FLOAT_AS_DOUBLE) && !defined(PBRT_IS_GPU_CODE)
+#define PBRT_SIMD_SAMPLED_SPECTRUM
+#endif
+
 // SampledSpectrum Definition
 class SampledSpectrum {
   public:
@@ -97,8 +109,12 @@ class SampledSpectrum {
 
     PBRT_CPU_GPU
     SampledSpectrum &operator-=(const SampledSpectrum &s) {
+#ifdef PBRT_SIMD_SAMPLED_SPECTRUM
+        (SIMD() - s.SIMD()).Store(values.data());
+#else
         for (int i = 0; i < NSpectrumSamples; ++i)
             values[i] -= s.values[i];
+#endif
         return *this;
     }
     PBRT_CPU_GPU
@@ -109,16 +125,24 @@ class SampledSpectrum {
     PBRT_CPU_GPU
     friend SampledSpectrum operator-(Float a, const SampledSpectrum &s) {
         DCHECK(!IsNaN(a));
+#ifdef PBRT_SIMD_SAMPLED_SPECTRUM
+        return SampledSpectrum(SIMDFloat<NSpectrumSamples>(a) - s.SIMD());
+#else
         SampledSpectrum ret;
         for (int i = 0; i < NSpectrumSamples; ++i)
             ret.values[i] = a - s.values[i];
         return ret;
+#endif
     }
 
     PBRT_CPU_GPU
     SampledSpectrum &operator*=(const SampledSpectrum &s) {
+#ifdef PBRT_SIMD_SAMPLED_SPECTRUM
+        (SIMD() * s.SIMD()).Store(values.data());
+#else
         for (int i = 0; i < NSpectrumSamples; ++i)
             values[i] *= s.values[i];
+#endif
         return *this;
     }
     PBRT_CPU_GPU
@@ -128,17 +152,18 @@ class SampledSpectrum {
     }
     PBRT_CPU_GPU
     SampledSpectrum operator*(Float a) const {
-        DCHECK(!IsNaN(a));
         SampledSpectrum ret = *this;
-        for (int i = 0; i < NSpectrumSamples; ++i)
-            ret.values[i] *= a;
-        return ret;
+        return ret *= a;
     }
     PBRT_CPU_GPU
     SampledSpectrum &operator*=(Float a) {
         DCHECK(!IsNaN(a));
+#ifdef PBRT_SIMD_SAMPLED_SPECTRUM
+        (SIMD() * SIMDFloat<NSpectrumSamples>(a)).Store(values.data());
+#else
         for (int i = 0; i < NSpectrumSamples; ++i)
             values[i] *= a;
+#endif
         return *this;
     }
     PBRT_CPU_GPU
@@ -146,10 +171,14 @@ class SampledSpectrum {
 
     PBRT_CPU_GPU
     SampledSpectrum &operator/=(const SampledSpectrum &s) {
-        for (int i = 0; i < NSpectrumSamples; ++i) {
+        for (int i = 0; i < NSpectrumSamples; ++i)
             DCHECK_NE(0, s.values[i]);
+#ifdef PBRT_SIMD_SAMPLED_SPECTRUM
+        (SIMD() / s.SIMD()).Store(values.data());
+#else
+        for (int i = 0; i < NSpectrumSamples; ++i)
             values[i] /= s.values[i];
-        }
+#endif
         return *this;
     }
     PBRT_CPU_GPU
@@ -161,8 +190,12 @@ class SampledSpectrum {
     SampledSpectrum &operator/=(Float a) {
         DCHECK_NE(a, 0);
         DCHECK(!IsNaN(a));
+#ifdef PBRT_SIMD_SAMPLED_SPECTRUM
+        (SIMD() / SIMDFloat<NSpectrumSamples>(a)).Store(values.data());
+#else
         for (int i = 0; i < NSpectrumSamples; ++i)
             values[i] /= a;
+#endif
         return *this;
     }
     PBRT_CPU_GPU
@@ -173,10 +206,14 @@ class SampledSpectrum {
 
     PBRT_CPU_GPU
     SampledSpectrum operator-() const {
+#ifdef PBRT_SIMD_SAMPLED_SPECTRUM
+        return SampledSpectrum(-SIMD());
+#else
         SampledSpectrum ret;
         for (int i = 0; i < NSpectrumSamples; ++i)
             ret.values[i] = -values[i];
         return ret;
+#endif
     }
     PBRT_CPU_GPU
     bool operator==(const SampledSpectrum &s) const { return values == s.values; }
@@ -187,10 +224,15 @@ class SampledSpectrum {
 
     PBRT_CPU_GPU
     bool HasNaNs() const {
+#ifdef PBRT_SIMD_SAMPLED_SPECTRUM
+        // Only NaN values compare unequal to themselves
+        return CompareNEMask(SIMD(), SIMD()) != 0;
+#else
         for (int i = 0; i < NSpectrumSamples; ++i)
             if (IsNaN(values[i]))
                 return true;
         return false;
+#endif
     }
 
     PBRT_CPU_GPU
@@ -209,6 +251,12 @@ class SampledSpectrum {
         for (int i = 0; i < NSpectrumSamples; ++i)
             values[i] = v[i];
     }
+#ifdef PBRT_SIMD_SAMPLED_SPECTRUM
+    explicit SampledSpectrum(SIMDFloat<NSpectrumSamples> v) { v.Store(values.data()); }
+    SIMDFloat<NSpectrumSamples> SIMD() const {
+        return SIMDFloat<NSpectrumSamples>::Load(values.data());
+    }
+#endif
 
     PBRT_CPU_GPU
     Float operator[](int i) const {
@@ -223,16 +271,24 @@ class SampledSpectrum {
 
     PBRT_CPU_GPU
     explicit operator bool() const {
+#ifdef PBRT_SIMD_SAMPLED_SPECTRUM
+        return CompareNEMask(SIMD(), SIMDFloat<NSpectrumSamples>(0.f)) != 0;
+#else
         for (int i = 0; i < NSpectrumSamples; ++i)
             if (values[i] != 0)
                 return true;
         return false;
+#endif
     }
 
     PBRT_CPU_GPU
     SampledSpectrum &operator+=(const SampledSpectrum &s) {
+#ifdef PBRT_SIMD_SAMPLED_SPECTRUM
+        (SIMD() + s.SIMD()).Store(values.data());
+#else
         for (int i = 0; i < NSpectrumSamples; ++i)
             values[i] += s.values[i];
+#endif
         return *this;
     }
 
@@ -306,6 +362,11 @@ class SampledWavelengths {
     Float &operator[](int i) { return lambda[i]; }
     PBRT_CPU_GPU
     SampledSpectrum PDF() const { return SampledSpectrum(pdf); }
+#ifdef PBRT_SIMD_SAMPLED_SPECTRUM
+    SIMDFloat<NSpectrumSamples> SIMD() const {
+        return SIMDFloat<NSpectrumSamples>::Load(lambda.data());
+    }
+#endif
 
     PBRT_CPU_GPU
     void TerminateSecondary() {
@@ -523,10 +584,14 @@ class RGBAlbedoSpectrum {
 
     PBRT_CPU_GPU
     SampledSpectrum Sample(const SampledWavelengths &lambda) const {
+#ifdef PBRT_SIMD_SAMPLED_SPECTRUM
+        return SampledSpectrum(rsp(lambda.SIMD()));
+#else
         SampledSpectrum s;
         for (int i = 0; i < NSpectrumSamples; ++i)
             s[i] = rsp(lambda[i]);
         return s;
+#endif
     }
 
     std::string ToString() const;
@@ -552,10 +617,14 @@ class RGBUnboundedSpectrum {
 
     PBRT_CPU_GPU
     SampledSpectrum Sample(const SampledWavelengths &lambda) const {
+#ifdef PBRT_SIMD_SAMPLED_SPECTRUM
+        return SampledSpectrum(SIMDFloat<NSpectrumSamples>(scale) * rsp(lambda.SIMD()));
+#else
         SampledSpectrum s;
         for (int i = 0; i < NSpectrumSamples; ++i)
             s[i] = scale * rsp(lambda[i]);
         return s;
+#endif
     }
 
     std::string ToString() const;
@@ -585,9 +654,13 @@ class RGBIlluminantSpectrum {
 
     PBRT_CPU_GPU
     SampledSpectrum Sample(const SampledWavelengths &lambda) const {
+#ifdef PBRT_SIMD_SAMPLED_SPECTRUM
+        SampledSpectrum s(SIMDFloat<NSpectrumSamples>(scale) * rsp(lambda.SIMD()));
+#else
         SampledSpectrum s;
         for (int i = 0; i < NSpectrumSamples; ++i)
             s[i] = scale * rsp(lambda[i]);
+#endif
         return s * illuminant->Sample(lambda);
     }
 
@@ -602,44 +675,67 @@ class RGBIlluminantSpectrum {
 
 // SampledSpectrum Inline Functions
 PBRT_CPU_GPU inline SampledSpectrum SafeDiv(SampledSpectrum a, SampledSpectrum b) {
+#ifdef PBRT_SIMD_SAMPLED_SPECTRUM
+    return SampledSpectrum(SafeDiv(a.SIMD(), b.SIMD()));
+#else
     SampledSpectrum r;
     for (int i = 0; i < NSpectrumSamples; ++i)
         r[i] = (b[i] != 0) ? a[i] / b[i] : 0.;
     return r;
+#endif
 }
 
 template <typename U, typename V>
 PBRT_CPU_GPU inline SampledSpectrum Clamp(const SampledSpectrum &s, U low, V high) {
+#ifdef PBRT_SIMD_SAMPLED_SPECTRUM
+    // _Max()_ and _Min()_ return their second operand if either is NaN, so
+    // NaN values are passed through as they are by _pbrt::Clamp()_
+    using SIMD = SIMDFloat<NSpectrumSamples>;
+    SampledSpectrum ret(Min(SIMD(Float(high)), Max(SIMD(Float(low)), s.SIMD())));
+#else
     SampledSpectrum ret;
     for (int i = 0; i < NSpectrumSamples; ++i)
         ret[i] = pbrt::Clamp(s[i], low, high);
+#endif
     DCHECK(!ret.HasNaNs());
     return ret;
 }
 
 PBRT_CPU_GPU
 inline SampledSpectrum ClampZero(const SampledSpectrum &s) {
+#ifdef PBRT_SIMD_SAMPLED_SPECTRUM
+    SampledSpectrum ret(Max(s.SIMD(), SIMDFloat<NSpectrumSamples>(0.f)));
+#else
     SampledSpectrum ret;
     for (int i = 0; i < NSpectrumSamples; ++i)
         ret[i] = std::max<Float>(0, s[i]);
+#endif
     DCHECK(!ret.HasNaNs());
     return ret;
 }
 
 PBRT_CPU_GPU
 inline SampledSpectrum Sqrt(const SampledSpectrum &s) {
+#ifdef PBRT_SIMD_SAMPLED_SPECTRUM
+    SampledSpectrum ret(Sqrt(s.SIMD()));
+#else
     SampledSpectrum ret;
     for (int i = 0; i < NSpectrumSamples; ++i)
         ret[i] = std::sqrt(s[i]);
+#endif
     DCHECK(!ret.HasNaNs());
     return ret;
 }
 
 PBRT_CPU_GPU
 inline SampledSpectrum SafeSqrt(const SampledSpectrum &s) {
+#ifdef PBRT_SIMD_SAMPLED_SPECTRUM
+    SampledSpectrum ret(Sqrt(Max(s.SIMD(), SIMDFloat<NSpectrumSamples>(0.f))));
+#else
     SampledSpectrum ret;
     for (int i = 0; i < NSpectrumSamples; ++i)
         ret[i] = SafeSqrt(s[i]);
+#endif
     DCHECK(!ret.HasNaNs());
     return ret;
 }
@@ -13,6 +13,8 @@
 #include <pbrt/util/spectrum.h>
 
 #include <array>
+#include <cmath>
+#include <limits>
 
 using namespace pbrt;
 
@@ -162,3 +164,71 @@ TEST(Spectrum, SamplingPdfXYZ) {
     EXPECT_LT(std::abs((impInt - unifInt) / unifInt), 1e-3)
         << impInt << " vs. " << unifInt;
 }
+
+TEST(SampledSpectrum, Arithmetic) {
+    // Check the results of SampledSpectrum operations against evaluating
+    // them one sample at a time.
+    RNG rng;
+    for (int iter = 0; iter < 100; ++iter) {
+        SampledSpectrum a, b;
+        for (int i = 0; i < NSpectrumSamples; ++i) {
+            a[i] = rng.Uniform<Float>() * 4 - 2;
+            b[i] = (iter & 1) && i == 1 ? 0 : rng.Uniform<Float>() * 4 - 2;
+        }
+        Float f = rng.Uniform<Float>() + .5f;
+
+        SampledSpectrum sum = a + b, diff = a - b, prod = a * b, neg = -a;
+        SampledSpectrum scaled = a * f, divided = a / f, fMinus = f - a;
+        SampledSpectrum safeDiv = SafeDiv(a, b), clamped = Clamp(a, -1, 1);
+        SampledSpectrum clampZero = ClampZero(a), safeSqrt = SafeSqrt(a);
+        for (int i = 0; i < NSpectrumSamples; ++i) {
+            EXPECT_EQ(a[i] + b[i], sum[i]);
+            EXPECT_EQ(a[i] - b[i], diff[i]);
+            EXPECT_EQ(a[i] * b[i], prod[i]);
+            EXPECT_EQ(-a[i], neg[i]);
+            EXPECT_EQ(a[i] * f, scaled[i]);
+            EXPECT_EQ(a[i] / f, divided[i]);
+            EXPECT_EQ(f - a[i], fMinus[i]);
+            EXPECT_EQ(b[i] != 0 ? a[i] / b[i] : 0, safeDiv[i]);
+            EXPECT_EQ(pbrt::Clamp(a[i], -1, 1), clamped[i]);
+            EXPECT_EQ(std::max<Float>(0, a[i]), clampZero[i]);
+            EXPECT_EQ(std::sqrt(std::max<Float>(0, a[i])), safeSqrt[i]);
+        }
+    }
+
+    EXPECT_FALSE(bool(SampledSpectrum(0.f)));
+    SampledSpectrum s(0.f);
+    s[NSpectrumSamples - 1] = 1e-20f;
+    EXPECT_TRUE(bool(s));
+    EXPECT_FALSE(s.HasNaNs());
+    s[1] = std::numeric_limits<Float>::quiet_NaN();
+    EXPECT_TRUE(s.HasNaNs());
+}
+
+TEST(Spectrum, RGBSampleAllWavelengths) {
+    // Sampling the RGB spectra at all wavelengths at once should give the
+    // same values as evaluating them at one wavelength at a time.
+    RNG rng;
+    for (int i = 0; i < 100; ++i) {
+        RGB rgb(rng.Uniform<Float>(), rng.Uniform<Float>(), rng.Uniform<Float>());
+        if (i == 0)
+            rgb = RGB(0, 0, 0);
+        else if (i == 1)
+            rgb = RGB(1, 1, 1);
+        else if (i == 2)
+            rgb = RGB(1, 0, .5);
+        SampledWavelengths lambda = SampledWavelengths::SampleUniform(rng.Uniform<Float>());
+
+        RGBAlbedoSpectrum sa(*RGBColorSpace::sRGB, rgb);
+        RGBUnboundedSpectrum su(*RGBColorSpace::sRGB, 5 * rgb);
+        RGBIlluminantSpectrum si(*RGBColorSpace::sRGB, rgb);
+        SampledSpectrum a = sa.Sample(lambda), u = su.Sample(lambda),
+                        il = si.Sample(lambda);
+        for (int j = 0; j < NSpectrumSamples; ++j) {
+            EXPECT_NEAR(sa(lambda[j]), a[j], 1e-6f) << rgb << " " << lambda[j];
+            EXPECT_NEAR(su(lambda[j]), u[j], 1e-5f) << rgb << " " << lambda[j];
+            EXPECT_NEAR(si(lambda[j]), il[j], 1e-5f * std::max<Float>(1, il[j]))
+                << rgb << " " << lambda[j];
+        }
+    }
+}
@@ -136,19 +136,27 @@ struct StatIntDistribution {
         var.max = int64_t(std::numeric_limits<int64_t>::lowest());                \
     });
 
-#define STAT_FLOAT_DISTRIBUTION(title, var)                                             \
-    static thread_local StatCounter<double> var##sum;                                   \
-    static thread_local int64_t var##count;                                             \
-    static thread_local StatCounter<double> var##min(                                   \
-        std::numeric_limits<double>::max());                                            \
-    static thread_local StatCounter<double> var##max(                                   \
-        std::numeric_limits<double>::lowest());                                         \
-    static StatRegisterer STATS_REG##var([](StatsAccumulator &accum) {                  \
-        accum.ReportFloatDistribution(title, var##sum, var##count, var##min, var##max); \
-        var##sum = 0;                                                                   \
-        var##count = 0;                                                                 \
-        var##min = StatCounter<double>(std::numeric_limits<double>::max());             \
-        var##max = StatCounter<double>(std::numeric_limits<double>::lowest());          \
+struct StatFloatDistribution {
+    double sum = 0;
+    int64_t count = 0;
+    double min = std::numeric_limits<double>::max();
+    double max = std::numeric_limits<double>::lowest();
+    void operator<<(double value) {
+        sum += value;
+        count += 1;
+        min = (value < min) ? value : min;
+        max = (value > max) ? value : max;
+    }
+};
+
+#define STAT_FLOAT_DISTRIBUTION(title, var)                                         \
+    static thread_local StatFloatDistribution var;                                  \
+    static StatRegisterer STATS_REG##var([](StatsAccumulator &accum) {              \
+        accum.ReportFloatDistribution(title, var.sum, var.count, var.min, var.max); \
+        var.sum = 0;                                                                \
+        var.count = 0;                                                              \
+        var.min = std::numeric_limits<double>::max();                               \
+        var.max = std::numeric_limits<double>::lowest();                            \
     });
 
 #define STAT_PERCENT(title, numVar, denomVar)                             \
@@ -0,0 +1,498 @@
+// pbrt is Copyright(c) 1998-2020 Matt Pharr, Wenzel Jakob, and Greg Humphreys.
+// The pbrt source code is licensed under the Apache License, Version 2.0.
+// SPDX: Apache-2.0
+
+#include <pbrt/util/texcache.h>
+
+#include <pbrt/util/check.h>
+#include <pbrt/util/colorspace.h>
+#include <pbrt/util/error.h>
+#include <pbrt/util/float.h>
+#include <pbrt/util/hash.h>
+#include <pbrt/util/print.h>
+#include <pbrt/util/stats.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+#include <list>
+#include <mutex>
+#include <unordered_map>
+#include <utility>
+#ifdef PBRT_HAVE_MMAP
+#include <unistd.h>
+#endif
+
+namespace pbrt {
+
+STAT_PERCENT("Texture cache/Tile lookups that missed", nTileMisses, nTileLookups);
+STAT_COUNTER("Texture cache/Thread-local tile cache hits", nLocalTileHits);
+STAT_COUNTER("Texture cache/Shared tile cache hits", nSharedTileHits);
+STAT_COUNTER("Texture cache/Tiles evicted", nTilesEvicted);
+STAT_MEMORY_COUNTER("Texture cache/Tile data read", tileBytesRead);
+STAT_MEMORY_COUNTER("Texture cache/Tile files written", tileFileBytes);
+
+// Tile keys pack the pyramid id, the level, and the tile coordinates into
+// 64 bits.
+static constexpr int TileKeyIdBits = 24, TileKeyLevelBits = 5, TileKeyTileBits = 17;
+
+static uint64_t TileKey(uint32_t id, int level, Point2i tile) {
+    return (uint64_t(id) << (TileKeyLevelBits + 2 * TileKeyTileBits)) |
+           (uint64_t(level) << (2 * TileKeyTileBits)) |
+           (uint64_t(tile.y) << TileKeyTileBits) | uint64_t(tile.x);
+}
+
+// Tiled MIP File Definitions
+// Tiled MIP files start with a header that gives the pyramid's format,
+// channels, and level resolutions, followed by the tiles of each level as
+// they are stored in temporary tile files. Header values are little-endian
+// 32-bit integers and floats, regardless of the host and of pbrt's _Float_
+// type; tile texels are stored in host order.
+static constexpr char TiledMIPFileMagic[8] = {'p', 'b', 'r', 't', 'M', 'I', 'P', '\0'};
+static constexpr uint32_t TiledMIPFileVersion = 1;
+// Tile data starts at a multiple of this many bytes
+static constexpr int64_t TiledMIPFileAlignment = 4096;
+
+static int64_t TiledMIPFileDataOffset(int64_t headerBytes) {
+    return (headerBytes + TiledMIPFileAlignment - 1) / TiledMIPFileAlignment *
+           TiledMIPFileAlignment;
+}
+
+// Tile Spill File Definition
+// The tiles of all pyramids that aren't read from tiled MIP files are
+// appended to a single anonymous temporary file, so that scenes with many
+// textures don't need a file descriptor for each one. Space in the file
+// isn't reused when pyramids are freed; the file is removed at exit.
+struct TileSpillFile {
+    // Protects _file_'s position and _size_
+    std::mutex mutex;
+    FILE *file = nullptr;
+    int64_t size = 0;
+};
+static TileSpillFile tileSpillFile;
+
+static bool SeekFile(FILE *f, int64_t offset) {
+#ifdef PBRT_IS_WINDOWS
+    return _fseeki64(f, offset, SEEK_SET) == 0;
+#else
+    return fseeko(f, off_t(offset), SEEK_SET) == 0;
+#endif
+}
+
+static std::string EncodingName(ColorEncoding encoding) {
+    if (!encoding || encoding.Is<LinearColorEncoding>())
+        return "linear";
+    if (encoding.Is<sRGBColorEncoding>())
+        return "sRGB";
+    return StringPrintf("gamma %f", encoding.Cast<GammaColorEncoding>()->Gamma());
+}
+
+// TiledImagePyramid Method Definitions
+TiledImagePyramid::TiledImagePyramid() {
+    static std::atomic<uint32_t> nextId{0};
+    id = nextId++;
+    if (id >= (1u << TileKeyIdBits))
+        ErrorExit("Too many tiled textures (%d maximum).", 1 << TileKeyIdBits);
+}
+
+void TiledImagePyramid::InitLevels(pstd::span<const Point2i> resolutions,
+                                   int64_t offset) {
+    if (resolutions.size() > (1u << TileKeyLevelBits))
+        ErrorExit("Too many MIP levels (%d) to tile image.", resolutions.size());
+    int64_t texelBytes = NChannels() * TexelBytes(format);
+    for (Point2i res : resolutions) {
+        Level level;
+        level.resolution = res;
+        level.nTiles = Point2i((res.x + TextureTileSize - 1) / TextureTileSize,
+                               (res.y + TextureTileSize - 1) / TextureTileSize);
+        CHECK_LE(level.nTiles.x, 1 << TileKeyTileBits);
+        CHECK_LE(level.nTiles.y, 1 << TileKeyTileBits);
+        level.offset = offset;
+        levels.push_back(level);
+        offset += texelBytes * res.x * res.y;
+    }
+}
+
+bool TiledImagePyramid::WriteTiles(FILE *f, pstd::span<const Image> pyramid) {
+    // Write the tiles of each level in scanline order
+    for (const Image &image : pyramid) {
+        Point2i res = image.Resolution();
+        int texelBytes = image.NChannels() * TexelBytes(image.Format());
+        for (int y0 = 0; y0 < res.y; y0 += TextureTileSize)
+            for (int x0 = 0; x0 < res.x; x0 += TextureTileSize) {
+                Bounds2i bounds(Point2i(x0, y0),
+                                Min(Point2i(x0, y0) + Vector2i(TextureTileSize,
+                                                               TextureTileSize),
+                                    res));
+                // Copy the tile's rows, which are contiguous in the tile but
+                // not in the image
+                size_t rowBytes = size_t(bounds.pMax.x - bounds.pMin.x) * texelBytes;
+                for (int y = bounds.pMin.y; y < bounds.pMax.y; ++y)
+                    if (fwrite(image.RawPointer({bounds.pMin.x, y}), 1, rowBytes, f) !=
+                        rowBytes)
+                        return false;
+            }
+    }
+    return true;
+}
+
+std::unique_ptr<TiledImagePyramid> TiledImagePyramid::Create(
+    pstd::span<const Image> pyramid) {
+    CHECK(!pyramid.empty());
+    std::unique_ptr<TiledImagePyramid> tiled(new TiledImagePyramid);
+    tiled->format = pyramid[0].Format();
+    tiled->channelNames = pyramid[0].ChannelNames();
+    tiled->encoding = pyramid[0].Encoding();
+    std::vector<Point2i> resolutions;
+    for (const Image &image : pyramid)
+        resolutions.push_back(image.Resolution());
+
+    // Append the tiles to the spill file
+    std::lock_guard<std::mutex> lock(tileSpillFile.mutex);
+    if (!tileSpillFile.file) {
+        tileSpillFile.file = std::tmpfile();
+        if (!tileSpillFile.file)
+            ErrorExit("Unable to create temporary file for texture tiles: %s",
+                      ErrorString());
+    }
+    int64_t offset = tileSpillFile.size;
+    tiled->InitLevels(resolutions, offset);
+    if (!SeekFile(tileSpillFile.file, offset) || !WriteTiles(tileSpillFile.file, pyramid) ||
+        fflush(tileSpillFile.file) != 0)
+        ErrorExit("Error writing texture tiles: %s", ErrorString());
+    const Level &last = tiled->levels.back();
+    tileSpillFile.size = last.offset + int64_t(tiled->NChannels()) *
+                                           TexelBytes(tiled->format) *
+                                           last.resolution.x * last.resolution.y;
+    tileFileBytes += tileSpillFile.size - offset;
+
+    return tiled;
+}
+
+bool TiledImagePyramid::Write(const std::string &filename,
+                              pstd::span<const Image> pyramid,
+                              const RGBColorSpace *colorSpace, WrapMode wrapMode) {
+    CHECK(!pyramid.empty());
+    CHECK(colorSpace);
+    // Assemble the header
+    std::string header(TiledMIPFileMagic, sizeof(TiledMIPFileMagic));
+    auto append = [&header](uint32_t value) {
+        for (int i = 0; i < 4; ++i)
+            header.push_back(char((value >> (8 * i)) & 0xff));
+    };
+    auto appendFloat = [&](float value) { append(FloatToBits(value)); };
+    auto appendString = [&](const std::string &str) {
+        append(uint32_t(str.size()));
+        header += str;
+    };
+    append(TiledMIPFileVersion);
+    append(uint32_t(pyramid[0].Format()));
+    append(uint32_t(wrapMode));
+    for (Point2f p : {colorSpace->r, colorSpace->g, colorSpace->b, colorSpace->w}) {
+        appendFloat(p.x);
+        appendFloat(p.y);
+    }
+    appendString(EncodingName(pyramid[0].Encoding()));
+    append(uint32_t(pyramid[0].NChannels()));
+    for (const std::string &name : pyramid[0].ChannelNames())
+        appendString(name);
+    append(uint32_t(pyramid.size()));
+    for (const Image &image : pyramid) {
+        append(uint32_t(image.Resolution().x));
+        append(uint32_t(image.Resolution().y));
+    }
+    header.resize(TiledMIPFileDataOffset(header.size()), '\0');
+
+    // Write the header and tiles to a temporary file that is then renamed,
+    // so that a partially-written file is never seen
+    std::string tempFilename = filename + ".tmp";
+    FILE *f = FOpenWrite(tempFilename);
+    if (!f) {
+        Error("%s: %s", tempFilename, ErrorString());
+        return false;
+    }
+    bool success = fwrite(header.data(), 1, header.size(), f) == header.size() &&
+                   WriteTiles(f, pyramid);
+    success = (fclose(f) == 0) && success;
+    if (!success || std::rename(tempFilename.c_str(), filename.c_str()) != 0) {
+        Error("%s: %s", filename, ErrorString());
+        RemoveFile(tempFilename);
+        return false;
+    }
+    return true;
+}
+
+bool TiledImagePyramid::IsTiledMIPFile(const std::string &filename) {
+    FILE *f = FOpenRead(filename);
+    if (!f)
+        return false;
+    char magic[sizeof(TiledMIPFileMagic)];
+    bool isTiled = fread(magic, 1, sizeof(magic), f) == sizeof(magic) &&
+                   memcmp(magic, TiledMIPFileMagic, sizeof(magic)) == 0;
+    fclose(f);
+    return isTiled;
+}
+
+std::unique_ptr<TiledImagePyramid> TiledImagePyramid::Read(
+    const std::string &filename, const RGBColorSpace **colorSpace, WrapMode *wrapMode) {
+    std::unique_ptr<MappedFile> mapped = MappedFile::Open(filename);
+    if (!mapped)
+        ErrorExit("%s: %s", filename, ErrorString());
+
+    // Parse the header
+    const uint8_t *ptr = mapped->data(), *end = ptr + mapped->size();
+    auto readBytes = [&](size_t size) {
+        if (end - ptr < int64_t(size))
+            ErrorExit("%s: premature end of tiled MIP file.", filename);
+        const uint8_t *bytes = ptr;
+        ptr += size;
+        return bytes;
+    };
+    auto read = [&]() {
+        const uint8_t *bytes = readBytes(4);
+        return uint32_t(bytes[0]) | (uint32_t(bytes[1]) << 8) |
+               (uint32_t(bytes[2]) << 16) | (uint32_t(bytes[3]) << 24);
+    };
+    auto readString = [&]() {
+        uint32_t size = read();
+        return std::string((const char *)readBytes(size), size);
+    };
+    if (memcmp(readBytes(sizeof(TiledMIPFileMagic)), TiledMIPFileMagic,
+               sizeof(TiledMIPFileMagic)) != 0)
+        ErrorExit("%s: not a tiled MIP file.", filename);
+    uint32_t version = read();
+    if (version != TiledMIPFileVersion)
+        ErrorExit("%s: unsupported tiled MIP file version %d.", filename, version);
+    uint32_t format = read(), wrap = read();
+    if (format > uint32_t(PixelFormat::Float) || wrap > uint32_t(WrapMode::OctahedralSphere))
+        ErrorExit("%s: corrupt tiled MIP file.", filename);
+    Point2f primaries[4];
+    for (Point2f &p : primaries) {
+        p.x = BitsToFloat(read());
+        p.y = BitsToFloat(read());
+    }
+    *colorSpace =
+        RGBColorSpace::Lookup(primaries[0], primaries[1], primaries[2], primaries[3]);
+    if (!*colorSpace)
+        ErrorExit("%s: unknown color space in tiled MIP file.", filename);
+    *wrapMode = WrapMode(wrap);
+
+    std::unique_ptr<TiledImagePyramid> tiled(new TiledImagePyramid);
+    tiled->format = PixelFormat(format);
+    tiled->encoding = ColorEncoding::Get(readString(), {});
+    if (!Is8Bit(tiled->format))
+        tiled->encoding = nullptr;
+    uint32_t nChannels = read();
+    for (uint32_t i = 0; i < nChannels; ++i)
+        tiled->channelNames.push_back(readString());
+    uint32_t nLevels = read();
+    if (nChannels == 0 || nLevels == 0 || nLevels > (1u << TileKeyLevelBits))
+        ErrorExit("%s: corrupt tiled MIP file.", filename);
+    std::vector<Point2i> resolutions(nLevels);
+    for (Point2i &res : resolutions) {
+        res.x = int32_t(read());
+        res.y = int32_t(read());
+    }
+
+    // Validate the level resolutions before tile offsets are computed from
+    // them: the first level must have a positive resolution that can be
+    // tiled, and each subsequent one must be half of the one before it.
+    constexpr int maxResolution = 1 << (TileKeyTileBits + TextureTileLog2Size);
+    if (resolutions[0].x <= 0 || resolutions[0].y <= 0 ||
+        resolutions[0].x > maxResolution || resolutions[0].y > maxResolution)
+        ErrorExit("%s: invalid resolution %s in tiled MIP file.", filename,
+                  resolutions[0]);
+    for (uint32_t i = 1; i < nLevels; ++i) {
+        Point2i prev = resolutions[i - 1];
+        if (prev == Point2i(1, 1) ||
+            resolutions[i] != Point2i(std::max(1, prev.x / 2), std::max(1, prev.y / 2)))
+            ErrorExit("%s: inconsistent resolution %s for level %d in tiled MIP file.",
+                      filename, resolutions[i], i);
+    }
+
+    int64_t offset = TiledMIPFileDataOffset(ptr - mapped->data());
+    tiled->InitLevels(resolutions, offset);
+    const Level &last = tiled->levels.back();
+    int64_t texelBytes = tiled->NChannels() * TexelBytes(tiled->format);
+    if (last.offset + texelBytes * last.resolution.x * last.resolution.y >
+        int64_t(mapped->size()))
+        ErrorExit("%s: premature end of tiled MIP file.", filename);
+
+    tiled->mappedFile = std::move(mapped);
+    return tiled;
+}
+
+TiledImagePyramid::~TiledImagePyramid() = default;
+
+Point2i TiledImagePyramid::TileResolution(int level, Point2i tile) const {
+    Point2i res = levels[level].resolution;
+    return Point2i(std::min(TextureTileSize, res.x - tile.x * TextureTileSize),
+                   std::min(TextureTileSize, res.y - tile.y * TextureTileSize));
+}
+
+int64_t TiledImagePyramid::TileOffset(int level, Point2i tile) const {
+    // All tiles in a row other than the last one are full width and all rows
+    // other than the last are full height.
+    const Level &l = levels[level];
+    int64_t texelBytes = NChannels() * TexelBytes(format);
+    int64_t rowOfTilesTexels = int64_t(TextureTileSize) * l.resolution.x;
+    int64_t tileTexels =
+        int64_t(TextureTileSize) * TileResolution(level, Point2i(0, tile.y)).y;
+    return l.offset + texelBytes * (tile.y * rowOfTilesTexels + tile.x * tileTexels);
+}
+
+Image TiledImagePyramid::ReadTile(int level, Point2i tile) const {
+    CHECK(level >= 0 && level < Levels());
+    CHECK(tile.x >= 0 && tile.x < levels[level].nTiles.x && tile.y >= 0 &&
+          tile.y < levels[level].nTiles.y);
+    Image image(format, TileResolution(level, tile), channelNames, encoding);
+    size_t nBytes = image.BytesUsed();
+    int64_t offset = TileOffset(level, tile);
+    void *dst = image.RawPointer({0, 0});
+    if (mappedFile)
+        memcpy(dst, mappedFile->data() + offset, nBytes);
+    else {
+        // The spill file isn't written to after the pyramid's tiles are, so
+        // positioned reads don't need the lock.
+#ifdef PBRT_HAVE_MMAP
+        if (pread(fileno(tileSpillFile.file), dst, nBytes, offset) != ssize_t(nBytes))
+            ErrorExit("Error reading texture tile: %s", ErrorString());
+#else
+        std::lock_guard<std::mutex> lock(tileSpillFile.mutex);
+        if (!SeekFile(tileSpillFile.file, offset) ||
+            fread(dst, 1, nBytes, tileSpillFile.file) != nBytes)
+            ErrorExit("Error reading texture tile: %s", ErrorString());
+#endif
+    }
+    tileBytesRead += nBytes;
+    return image;
+}
+
+const Image *TiledImagePyramid::GetTile(int level, Point2i tile) const {
+    return TextureTileCache::GetTile(this, TileKey(id, level, tile), level, tile);
+}
+
+std::string TiledImagePyramid::ToString() const {
+    std::string s = StringPrintf("[ TiledImagePyramid id: %d format: %s channels: [",
+                                 id, format);
+    for (const std::string &name : channelNames)
+        s += " " + name;
+    s += " ] levels: [";
+    for (const Level &level : levels)
+        s += StringPrintf(" %s", level.resolution);
+    return s + " ] ]";
+}
+
+// TextureTileCache Shard Definition
+struct TextureTileCacheShard {
+    struct Entry {
+        uint64_t key;
+        std::shared_ptr<const Image> tile;
+    };
+
+    std::mutex mutex;
+    // Most recently used tiles are at the front
+    std::list<Entry> lru;
+    std::unordered_map<uint64_t, std::list<Entry>::iterator> entries;
+    size_t bytes = 0;
+};
+
+static constexpr int TextureTileCacheShards = 64;
+static TextureTileCacheShard textureTileCacheShards[TextureTileCacheShards];
+
+// Thread-local Tile Cache Definition
+// Holding references to tiles here keeps them alive after they are evicted
+// from the shared cache, so the memory used may exceed the budget by up to
+// _LocalTileCacheSize_ tiles per thread.
+static constexpr int LocalTileCacheSize = 16;
+struct LocalTileCache {
+    struct Entry {
+        uint64_t key = ~uint64_t(0);
+        std::shared_ptr<const Image> tile;
+    };
+    Entry entries[LocalTileCacheSize];
+};
+static thread_local LocalTileCache localTileCache;
+
+// TextureTileCache Method Definitions
+size_t TextureTileCache::maxBytes = 0;
+
+void TextureTileCache::Init(size_t bytes) {
+    maxBytes = bytes;
+    Clear();
+}
+
+void TextureTileCache::Clear() {
+    for (TextureTileCacheShard &shard : textureTileCacheShards) {
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        shard.lru.clear();
+        shard.entries.clear();
+        shard.bytes = 0;
+    }
+    // Other threads' local caches are left as is; their tiles are still
+    // valid and are released as those entries are replaced.
+    for (LocalTileCache::Entry &entry : localTileCache.entries)
+        entry = LocalTileCache::Entry();
+}
+
+const Image *TextureTileCache::GetTile(const TiledImagePyramid *pyramid, uint64_t key,
+                                       int level, Point2i tile) {
+    ++nTileLookups;
+    uint64_t hash = MixBits(key);
+    // Check this thread's recently used tiles
+    LocalTileCache::Entry &local = localTileCache.entries[hash % LocalTileCacheSize];
+    if (local.key == key) {
+        ++nLocalTileHits;
+        return local.tile.get();
+    }
+
+    // Look for the tile in the shared cache
+    TextureTileCacheShard &shard =
+        textureTileCacheShards[(hash >> 32) % TextureTileCacheShards];
+    std::shared_ptr<const Image> result;
+    {
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        auto iter = shard.entries.find(key);
+        if (iter != shard.entries.end()) {
+            ++nSharedTileHits;
+            shard.lru.splice(shard.lru.begin(), shard.lru, iter->second);
+            result = iter->second->tile;
+        }
+    }
+
+    if (!result) {
+        // Read the tile without holding the lock and add it to the cache. If
+        // another thread reads the same tile in the meantime, the first one
+        // added is used.
+        ++nTileMisses;
+        result = std::make_shared<const Image>(pyramid->ReadTile(level, tile));
+
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        auto iter = shard.entries.find(key);
+        if (iter != shard.entries.end()) {
+            shard.lru.splice(shard.lru.begin(), shard.lru, iter->second);
+            result = iter->second->tile;
+        } else {
+            shard.lru.push_front(TextureTileCacheShard::Entry{key, result});
+            shard.entries[key] = shard.lru.begin();
+            shard.bytes += result->BytesUsed();
+            // Evict least recently used tiles to stay within the shard's
+            // share of the budget, always keeping the new tile
+            size_t shardMaxBytes = maxBytes / TextureTileCacheShards;
+            while (maxBytes > 0 && shard.bytes > shardMaxBytes &&
+                   shard.lru.size() > 1) {
+                TextureTileCacheShard::Entry &victim = shard.lru.back();
+                shard.bytes -= victim.tile->BytesUsed();
+                shard.entries.erase(victim.key);
+                shard.lru.pop_back();
+                ++nTilesEvicted;
+            }
+        }
+    }
+
+    local.key = key;
+    local.tile = std::move(result);
+    return local.tile.get();
+}
+
+}  // namespace pbrt
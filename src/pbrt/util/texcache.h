@@ -0,0 +1,125 @@
+// pbrt is Copyright(c) 1998-2020 Matt Pharr, Wenzel Jakob, and Greg Humphreys.
+// The pbrt source code is licensed under the Apache License, Version 2.0.
+// SPDX: Apache-2.0
+
+#ifndef PBRT_UTIL_TEXCACHE_H
+#define PBRT_UTIL_TEXCACHE_H
+
+#include <pbrt/pbrt.h>
+
+#include <pbrt/util/file.h>
+#include <pbrt/util/image.h>
+#include <pbrt/util/pstd.h>
+#include <pbrt/util/vecmath.h>
+
+#include <cstdint>
+#include <cstdio>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace pbrt {
+
+// Tiled images are split into square tiles of _TextureTileSize_ texels;
+// tiles at the right and bottom edges of an image may be smaller.
+static constexpr int TextureTileLog2Size = 6;
+static constexpr int TextureTileSize = 1 << TextureTileLog2Size;
+
+// TiledImagePyramid Definition
+// Stores the levels of an image pyramid as tiles in a file so that they can
+// be read on demand through the _TextureTileCache_ rather than being kept
+// in memory. The file is either a temporary one or a tiled MIP file, which
+// is pbrt's format for storing pre-filtered pyramids on disk.
+class TiledImagePyramid {
+  public:
+    // TiledImagePyramid Public Methods
+    // Writes the tiles of the given pyramid levels to an anonymous temporary
+    // file that is shared by all such pyramids.
+    static std::unique_ptr<TiledImagePyramid> Create(pstd::span<const Image> pyramid);
+
+    // Writes a tiled MIP file that stores the given pyramid levels, which
+    // were generated using _wrapMode_ and are in the color space
+    // _colorSpace_.
+    static bool Write(const std::string &filename, pstd::span<const Image> pyramid,
+                      const RGBColorSpace *colorSpace, WrapMode wrapMode);
+    static bool IsTiledMIPFile(const std::string &filename);
+    // Memory-maps a tiled MIP file; tiles are only read from it when they
+    // are first used.
+    static std::unique_ptr<TiledImagePyramid> Read(const std::string &filename,
+                                                   const RGBColorSpace **colorSpace,
+                                                   WrapMode *wrapMode);
+    ~TiledImagePyramid();
+
+    TiledImagePyramid(const TiledImagePyramid &) = delete;
+    TiledImagePyramid &operator=(const TiledImagePyramid &) = delete;
+
+    int Levels() const { return int(levels.size()); }
+    Point2i LevelResolution(int level) const { return levels[level].resolution; }
+    PixelFormat Format() const { return format; }
+    int NChannels() const { return int(channelNames.size()); }
+    ColorEncoding Encoding() const { return encoding; }
+
+    // Returns the tile of _level_ with the given tile coordinates, reading it
+    // if it isn't in the _TextureTileCache_. The returned pointer remains
+    // valid until the calling thread's next call to _GetTile()_.
+    const Image *GetTile(int level, Point2i tile) const;
+
+    // Reads a tile from the file, bypassing the cache.
+    Image ReadTile(int level, Point2i tile) const;
+
+    std::string ToString() const;
+
+  private:
+    // TiledImagePyramid Private Members
+    struct Level {
+        Point2i resolution, nTiles;
+        // File offset of the first tile; tiles are stored in scanline order
+        // and take the same number of bytes per texel.
+        int64_t offset;
+    };
+
+    TiledImagePyramid();
+    void InitLevels(pstd::span<const Point2i> resolutions, int64_t offset);
+    static bool WriteTiles(FILE *f, pstd::span<const Image> pyramid);
+    Point2i TileResolution(int level, Point2i tile) const;
+    int64_t TileOffset(int level, Point2i tile) const;
+
+    uint32_t id;
+    PixelFormat format;
+    std::vector<std::string> channelNames;
+    ColorEncoding encoding = nullptr;
+    std::vector<Level> levels;
+    // Tiles are read from the mapping of a tiled MIP file if there is one
+    // and from the shared temporary tile file otherwise.
+    std::unique_ptr<MappedFile> mappedFile;
+};
+
+// TextureTileCache Definition
+// Holds recently used tiles of _TiledImagePyramid_s in memory, up to a
+// global byte budget. Each thread first checks a small direct-mapped cache
+// of the tiles it has used most recently; tiles are otherwise found in one
+// of a number of independently-locked LRU caches that together hold the
+// budgeted amount of tile data.
+class TextureTileCache {
+  public:
+    // TextureTileCache Public Methods
+    // Sets the cache's budget. A value of zero disables the tiling of image
+    // textures; tiles of tiled MIP files are then never evicted.
+    static void Init(size_t maxBytes);
+    static bool Enabled() { return maxBytes > 0; }
+    static size_t MaxBytes() { return maxBytes; }
+
+    // Discards all cached tiles
+    static void Clear();
+
+  private:
+    friend class TiledImagePyramid;
+    static const Image *GetTile(const TiledImagePyramid *pyramid, uint64_t key, int level,
+                                Point2i tile);
+
+    static size_t maxBytes;
+};
+
+}  // namespace pbrt
+
+#endif  // PBRT_UTIL_TEXCACHE_H
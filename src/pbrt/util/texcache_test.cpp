@@ -0,0 +1,209 @@
+// pbrt is Copyright(c) 1998-2020 Matt Pharr, Wenzel Jakob, and Greg Humphreys.
+// The pbrt source code is licensed under the Apache License, Version 2.0.
+// SPDX: Apache-2.0
+
+#include <gtest/gtest.h>
+
+#include <pbrt/pbrt.h>
+#include <pbrt/util/colorspace.h>
+#include <pbrt/util/file.h>
+#include <pbrt/util/float.h>
+#include <pbrt/util/image.h>
+#include <pbrt/util/mipmap.h>
+#include <pbrt/util/parallel.h>
+#include <pbrt/util/rng.h>
+#include <pbrt/util/texcache.h>
+
+#include <atomic>
+
+using namespace pbrt;
+
+static Image RandomImage(PixelFormat format, Point2i res, int nChannels) {
+    std::vector<std::string> channels = {"R", "G", "B"};
+    if (nChannels == 1)
+        channels = {"Y"};
+    Image image(format, res, channels, ColorEncoding::sRGB);
+    RNG rng(res.x * res.y);
+    for (int y = 0; y < res.y; ++y)
+        for (int x = 0; x < res.x; ++x)
+            for (int c = 0; c < nChannels; ++c)
+                image.SetChannel({x, y}, c, rng.Uniform<Float>());
+    return image;
+}
+
+TEST(TextureTileCache, Tiles) {
+    TextureTileCache::Init(256 * 1024);
+    for (PixelFormat format : {PixelFormat::U256, PixelFormat::Half, PixelFormat::Float})
+        for (int nChannels : {1, 3}) {
+            pstd::vector<Image> pyramid = Image::GeneratePyramid(
+                RandomImage(format, {150, 77}, nChannels), WrapMode::Clamp);
+            std::unique_ptr<TiledImagePyramid> tiled = TiledImagePyramid::Create(pyramid);
+            ASSERT_EQ(pyramid.size(), tiled->Levels());
+
+            // Look up every texel twice, so that both cache misses and hits
+            // are exercised
+            for (int pass = 0; pass < 2; ++pass)
+                for (int level = 0; level < tiled->Levels(); ++level) {
+                    Point2i res = pyramid[level].Resolution();
+                    EXPECT_EQ(res, tiled->LevelResolution(level));
+                    for (int y = 0; y < res.y; ++y)
+                        for (int x = 0; x < res.x; ++x) {
+                            Point2i tile(x / TextureTileSize, y / TextureTileSize);
+                            const Image *image = tiled->GetTile(level, tile);
+                            Point2i p(x % TextureTileSize, y % TextureTileSize);
+                            for (int c = 0; c < nChannels; ++c)
+                                EXPECT_EQ(pyramid[level].GetChannel({x, y}, c),
+                                          image->GetChannel(p, c));
+                        }
+                }
+        }
+    TextureTileCache::Init(0);
+}
+
+TEST(TextureTileCache, ManyPyramids) {
+    // Keep more tiled pyramids alive than there are file descriptors
+    // available by default.
+    TextureTileCache::Init(256 * 1024);
+    std::vector<Image> images;
+    std::vector<std::unique_ptr<TiledImagePyramid>> tiled;
+    for (int i = 0; i < 2000; ++i) {
+        images.push_back(RandomImage(PixelFormat::U256, {4 + i % 7, 3}, 1));
+        tiled.push_back(TiledImagePyramid::Create({&images.back(), 1}));
+    }
+    for (int i = 0; i < 2000; ++i) {
+        Point2i res = images[i].Resolution();
+        const Image *tile = tiled[i]->GetTile(0, {0, 0});
+        for (int y = 0; y < res.y; ++y)
+            for (int x = 0; x < res.x; ++x)
+                EXPECT_EQ(images[i].GetChannel({x, y}, 0), tile->GetChannel({x, y}, 0));
+    }
+    TextureTileCache::Init(0);
+}
+
+TEST(TextureTileCache, MIPMapFilter) {
+    std::string filename = "texcache.pfm";
+    ASSERT_TRUE(RandomImage(PixelFormat::Float, {256, 128}, 3).Write(filename));
+
+    for (FilterFunction filter : {FilterFunction::Point, FilterFunction::Bilinear,
+                                  FilterFunction::Trilinear, FilterFunction::EWA})
+        for (WrapMode wrapMode : {WrapMode::Repeat, WrapMode::Clamp, WrapMode::Black}) {
+            MIPMapFilterOptions options;
+            options.filter = filter;
+            Allocator alloc;
+            MIPMap *mipmap =
+                MIPMap::CreateFromFile(filename, options, wrapMode, nullptr, alloc);
+            // Use a budget that's smaller than a tile per cache shard, so
+            // that tiles are evicted as soon as others are read
+            TextureTileCache::Init(64 * 1024);
+            MIPMap *tiled =
+                MIPMap::CreateFromFile(filename, options, wrapMode, nullptr, alloc);
+            ASSERT_EQ(mipmap->Levels(), tiled->Levels());
+
+            std::atomic<int> nMismatches{0};
+            ParallelFor(0, 1000, [&](int64_t i) {
+                RNG rng(i);
+                Point2f st(-0.5f + 2 * rng.Uniform<Float>(),
+                           -0.5f + 2 * rng.Uniform<Float>());
+                Float scale = std::pow(2.f, -8.f * rng.Uniform<Float>());
+                Vector2f dst0(scale * rng.Uniform<Float>(), scale * rng.Uniform<Float>());
+                Vector2f dst1(-scale * rng.Uniform<Float>(),
+                              scale * rng.Uniform<Float>());
+                if (mipmap->Filter<RGB>(st, dst0, dst1) !=
+                        tiled->Filter<RGB>(st, dst0, dst1) ||
+                    mipmap->Filter<Float>(st, dst0, dst1) !=
+                        tiled->Filter<Float>(st, dst0, dst1))
+                    ++nMismatches;
+            });
+            EXPECT_EQ(0, nMismatches) << options.ToString() << " " << ToString(wrapMode);
+
+            TextureTileCache::Init(0);
+            alloc.delete_object(mipmap);
+            alloc.delete_object(tiled);
+        }
+
+    EXPECT_TRUE(RemoveFile(filename));
+}
+
+TEST(TextureTileCache, TiledMIPFile) {
+    for (std::string filename : {"texcache.png", "texcache.pfm"}) {
+        PixelFormat format =
+            HasExtension(filename, "png") ? PixelFormat::U256 : PixelFormat::Float;
+        ASSERT_TRUE(RandomImage(format, {256, 64}, 3).Write(filename));
+        std::string tiledFilename = RemoveExtension(filename) + ".tmip";
+        ASSERT_TRUE(MIPMap::WriteTiledFile(filename, tiledFilename, WrapMode::Repeat,
+                                           ColorEncoding::sRGB));
+        EXPECT_FALSE(TiledImagePyramid::IsTiledMIPFile(filename));
+        EXPECT_TRUE(TiledImagePyramid::IsTiledMIPFile(tiledFilename));
+
+        for (FilterFunction filter : {FilterFunction::Bilinear, FilterFunction::EWA}) {
+            MIPMapFilterOptions options;
+            options.filter = filter;
+            Allocator alloc;
+            MIPMap *mipmap = MIPMap::CreateFromFile(filename, options, WrapMode::Repeat,
+                                                    ColorEncoding::sRGB, alloc);
+            MIPMap *tiled = MIPMap::CreateFromFile(tiledFilename, options,
+                                                   WrapMode::Repeat, nullptr, alloc);
+            ASSERT_EQ(mipmap->Levels(), tiled->Levels());
+            for (int level = 0; level < mipmap->Levels(); ++level)
+                EXPECT_EQ(mipmap->LevelResolution(level), tiled->LevelResolution(level));
+            EXPECT_EQ(mipmap->GetRGBColorSpace(), tiled->GetRGBColorSpace());
+
+            RNG rng;
+            for (int i = 0; i < 1000; ++i) {
+                Point2f st(rng.Uniform<Float>(), rng.Uniform<Float>());
+                Float scale = std::pow(2.f, -8.f * rng.Uniform<Float>());
+                Vector2f dst0(scale * rng.Uniform<Float>(), 0);
+                Vector2f dst1(0, scale * rng.Uniform<Float>());
+                EXPECT_EQ(mipmap->Filter<RGB>(st, dst0, dst1),
+                          tiled->Filter<RGB>(st, dst0, dst1));
+            }
+
+            alloc.delete_object(mipmap);
+            alloc.delete_object(tiled);
+        }
+
+        EXPECT_TRUE(RemoveFile(filename));
+        EXPECT_TRUE(RemoveFile(tiledFilename));
+    }
+}
+
+TEST(TextureTileCache, TiledMIPFileHeader) {
+    std::string filename = "texcache-header.png";
+    ASSERT_TRUE(RandomImage(PixelFormat::U256, {64, 32}, 3).Write(filename));
+    std::string tiledFilename = "texcache-header.tmip";
+    ASSERT_TRUE(MIPMap::WriteTiledFile(filename, tiledFilename, WrapMode::Clamp,
+                                       ColorEncoding::sRGB));
+    std::string contents = ReadFileContents(tiledFilename);
+    auto read32 = [&](size_t offset) {
+        uint32_t v = 0;
+        for (int i = 0; i < 4; ++i)
+            v |= uint32_t(uint8_t(contents[offset + i])) << (8 * i);
+        return v;
+    };
+
+    // The color space's primaries follow the magic number, version, pixel
+    // format, and wrap mode as 32-bit floats, independent of _Float_.
+    const RGBColorSpace *cs = RGBColorSpace::sRGB;
+    EXPECT_EQ(FloatToBits(float(cs->r.x)), read32(20));
+    EXPECT_EQ(FloatToBits(float(cs->w.y)), read32(48));
+    // The encoding name, three one-character channel names, and the number
+    // of levels precede the level resolutions.
+    size_t resOffset = 52 + 4 + 4 + 4 + 3 * 5 + 4;
+    ASSERT_EQ(7, read32(resOffset - 4));
+    EXPECT_EQ(64, read32(resOffset));
+    EXPECT_EQ(32, read32(resOffset + 4));
+    EXPECT_EQ(32, read32(resOffset + 8));
+
+    // Files with level resolutions that don't halve are rejected
+    contents[resOffset + 8] = 31;
+    std::string corruptFilename = "texcache-corrupt.tmip";
+    ASSERT_TRUE(WriteFileContents(corruptFilename, contents));
+    const RGBColorSpace *colorSpace;
+    WrapMode wrapMode;
+    EXPECT_DEATH(TiledImagePyramid::Read(corruptFilename, &colorSpace, &wrapMode),
+                 "inconsistent resolution");
+
+    EXPECT_TRUE(RemoveFile(filename));
+    EXPECT_TRUE(RemoveFile(tiledFilename));
+    EXPECT_TRUE(RemoveFile(corruptFilename));
+}
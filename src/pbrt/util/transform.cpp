@@ -272,11 +272,11 @@ Point3fi Transform::ApplyInverse(const Point3fi &p) const {
     Vector3f pOutError;
     if (p.IsExact()) {
         pOutError.x = gamma(3) * (std::abs(mInv[0][0] * x) + std::abs(mInv[0][1] * y) +
-                                  std::abs(mInv[0][2] * z));
+                                  std::abs(mInv[0][2] * z) + std::abs(mInv[0][3]));
         pOutError.y = gamma(3) * (std::abs(mInv[1][0] * x) + std::abs(mInv[1][1] * y) +
-                                  std::abs(mInv[1][2] * z));
+                                  std::abs(mInv[1][2] * z) + std::abs(mInv[1][3]));
         pOutError.z = gamma(3) * (std::abs(mInv[2][0] * x) + std::abs(mInv[2][1] * y) +
-                                  std::abs(mInv[2][2] * z));
+                                  std::abs(mInv[2][2] * z) + std::abs(mInv[2][3]));
     } else {
         Vector3f pInError = p.Error();
         pOutError.x = (gamma(3) + 1) * (std::abs(mInv[0][0]) * pInError.x +
@@ -107,3 +107,22 @@ TEST(RotateFromTo, Randoms) {
         EXPECT_GT(Dot(to, toNew), .999f);
     }
 }
+
+TEST(Transform, ApplyInversePointError) {
+    // Applying the inverse should bound the rounding error the same way as
+    // applying the inverse transformation, including its translation.
+    RNG rng;
+    for (int i = 0; i < 100; ++i) {
+        Transform t = RandomTransform(rng) * Translate(Vector3f(1e5f, -2e5f, 3e5f));
+        Point3f p(-10 + 20 * rng.Uniform<Float>(), -10 + 20 * rng.Uniform<Float>(),
+                  -10 + 20 * rng.Uniform<Float>());
+        Point3fi pi = t.ApplyInverse(Point3fi(p));
+        Point3fi piRef = Inverse(t)(Point3fi(p));
+        EXPECT_EQ(Point3f(piRef), Point3f(pi));
+        EXPECT_EQ(piRef.Error(), pi.Error());
+    }
+
+    Point3fi pi = Translate(Vector3f(1e5f, -2e5f, 3e5f)).ApplyInverse(Point3fi());
+    EXPECT_GE(pi.Error().x, gamma(3) * 1e5f);
+    EXPECT_GE(pi.Error().z, gamma(3) * 3e5f);
+}
@@ -20,6 +20,10 @@
 
 namespace pbrt {
 
+// Number of queued rays that are gathered and passed to
+// _BVHAggregate::IntersectN()_ at once.
+static constexpr int CPUAggregateBatchSize = 64;
+
 CPUAggregate::CPUAggregate(
     ParsedScene &scene, NamedTextures &textures,
     const std::map<int, pstd::vector<Light> *> &shapeIndexToAreaLights,
@@ -39,27 +43,70 @@ void CPUAggregate::IntersectClosest(int maxRays, const RayQueue *rayQueue,
                                     MediumSampleQueue *mediumSampleQueue,
                                     RayQueue *nextRayQueue) const {
     // _CPUAggregate::IntersectClosest()_ method implementation
-    ParallelFor(0, rayQueue->Size(), [=](int index) {
-        const RayWorkItem r = (*rayQueue)[index];
-        // Intersect _r_'s ray with the scene and enqueue resulting work
-        pstd::optional<ShapeIntersection> si = aggregate.Intersect(r.ray);
-        if (!si)
-            EnqueueWorkAfterMiss(r, mediumSampleQueue, escapedRayQueue);
-        else
-            // FIXME? Second arg r.ray.medium doesn't match OptiX path
-            EnqueueWorkAfterIntersection(
-                r, r.ray.medium, si->tHit, si->intr, mediumSampleQueue, nextRayQueue,
-                hitAreaLightQueue, basicEvalMaterialQueue, universalEvalMaterialQueue);
+    const BVHAggregate *bvh = aggregate.CastOrNullptr<BVHAggregate>();
+    ParallelFor(0, rayQueue->Size(), [=](int64_t start, int64_t end) {
+        // Trace consecutive rays from the queue together when possible
+        for (int64_t batchStart = start; batchStart < end;
+             batchStart += CPUAggregateBatchSize) {
+            int n = std::min<int64_t>(CPUAggregateBatchSize, end - batchStart);
+            RayWorkItem r[CPUAggregateBatchSize];
+            Ray rays[CPUAggregateBatchSize];
+            Float tMax[CPUAggregateBatchSize];
+            pstd::optional<ShapeIntersection> si[CPUAggregateBatchSize];
+            for (int i = 0; i < n; ++i) {
+                r[i] = (*rayQueue)[batchStart + i];
+                rays[i] = r[i].ray;
+                tMax[i] = Infinity;
+            }
+            if (bvh)
+                bvh->IntersectN(pstd::MakeSpan(rays, n), pstd::MakeSpan(tMax, n),
+                                pstd::MakeSpan(si, n));
+            else
+                for (int i = 0; i < n; ++i)
+                    si[i] = aggregate.Intersect(rays[i]);
+
+            // Enqueue work for each ray's intersection result
+            for (int i = 0; i < n; ++i) {
+                if (!si[i])
+                    EnqueueWorkAfterMiss(r[i], mediumSampleQueue, escapedRayQueue);
+                else
+                    // FIXME? Second arg r.ray.medium doesn't match OptiX path
+                    EnqueueWorkAfterIntersection(
+                        r[i], r[i].ray.medium, si[i]->tHit, si[i]->intr,
+                        mediumSampleQueue, nextRayQueue, hitAreaLightQueue,
+                        basicEvalMaterialQueue, universalEvalMaterialQueue);
+            }
+        }
     });
 }
 
 void CPUAggregate::IntersectShadow(int maxRays, ShadowRayQueue *shadowRayQueue,
                                    SOA<PixelSampleState> *pixelSampleState) const {
     // Intersect shadow rays from _shadowRayQueue_ in parallel
-    ParallelFor(0, shadowRayQueue->Size(), [=](int index) {
-        const ShadowRayWorkItem w = (*shadowRayQueue)[index];
-        bool hit = aggregate.IntersectP(w.ray, w.tMax);
-        RecordShadowRayIntersection(w, pixelSampleState, hit);
+    const BVHAggregate *bvh = aggregate.CastOrNullptr<BVHAggregate>();
+    ParallelFor(0, shadowRayQueue->Size(), [=](int64_t start, int64_t end) {
+        for (int64_t batchStart = start; batchStart < end;
+             batchStart += CPUAggregateBatchSize) {
+            int n = std::min<int64_t>(CPUAggregateBatchSize, end - batchStart);
+            ShadowRayWorkItem w[CPUAggregateBatchSize];
+            Ray rays[CPUAggregateBatchSize];
+            Float tMax[CPUAggregateBatchSize];
+            bool hit[CPUAggregateBatchSize];
+            for (int i = 0; i < n; ++i) {
+                w[i] = (*shadowRayQueue)[batchStart + i];
+                rays[i] = w[i].ray;
+                tMax[i] = w[i].tMax;
+            }
+            if (bvh)
+                bvh->IntersectPN(pstd::MakeSpan(rays, n), pstd::MakeSpan(tMax, n),
+                                 pstd::MakeSpan(hit, n));
+            else
+                for (int i = 0; i < n; ++i)
+                    hit[i] = aggregate.IntersectP(rays[i], tMax[i]);
+
+            for (int i = 0; i < n; ++i)
+                RecordShadowRayIntersection(w[i], pixelSampleState, hit[i]);
+        }
     });
 }
 